@@ -184,12 +184,16 @@ void ARM::Reset()
 
     ExceptionBase = Num ? 0x00000000 : 0xFFFF0000;
 
+    ResetIdleLoop();
+
     CodeMem.Mem = NULL;
 
 #ifdef JIT_ENABLED
     FastBlockLookup = NULL;
     FastBlockLookupStart = 0;
     FastBlockLookupSize = 0;
+
+    ResetDecodedPage();
 #endif
 
 #ifdef GDBSTUB_ENABLED
@@ -239,6 +243,8 @@ void ARM::DoSavestate(Savestate* file)
     }
 #endif
     file->VarArray(NextInstr, 2*sizeof(u32));
+    if (!file->Saving)
+        NextHandler[0] = NextHandler[1] = nullptr;
 
     file->Var32(&ExceptionBase);
 
@@ -266,6 +272,8 @@ void ARM::DoSavestate(Savestate* file)
             CodeRegion = R[15] >> 24;
             CodeCycles = R[15] >> 15; // cheato
         }
+
+        ResetIdleLoop();
     }
 }
 
@@ -291,6 +299,48 @@ void ARM::SetupCodeMem(u32 addr)
     }
 }
 
+#ifdef JIT_ENABLED
+DecodedInstr* ARM::DecodeInstr(u32 addr, bool thumb)
+{
+    // what's read from the ARM7 BIOS depends on where it's read from,
+    // which is only a different place than addr right after a jump
+    if (Num == 1 && addr < 0x10000
+        && ((addr < NDS.ARM7BIOSProt) != (R[15] < NDS.ARM7BIOSProt)
+            || (addr < 0x4000) != (R[15] < 0x4000)
+            || R[15] >= 0x10000))
+        return nullptr;
+
+    if ((addr & ~0x1FF) != CurDecodedAddr)
+    {
+        CurDecodedAddr = addr & ~0x1FF;
+        CurDecodedPage = NDS.JIT.GetDecodedPage(Num, addr);
+    }
+    if (!CurDecodedPage)
+        return nullptr;
+
+    DecodedInstr* instr;
+    if (thumb)
+    {
+        instr = &CurDecodedPage->THUMBInstrs[(addr & 0x1FF) >> 1];
+        instr->Instr = Num == 0
+            ? ((ARMv5*)this)->CodeFetch32(addr & ~0x2) >> ((addr & 0x2) * 8)
+            : ((ARMv4*)this)->CodeRead16(addr);
+        instr->Handler = ARMInterpreter::THUMBInstrTable[(instr->Instr >> 6) & 0x3FF];
+    }
+    else
+    {
+        instr = &CurDecodedPage->ARMInstrs[(addr & 0x1FF) >> 2];
+        instr->Instr = Num == 0
+            ? ((ARMv5*)this)->CodeFetch32(addr)
+            : ((ARMv4*)this)->CodeRead32(addr);
+        instr->Handler = ARMInterpreter::ARMInstrTable[((instr->Instr >> 4) & 0xF) | ((instr->Instr >> 16) & 0xFF0)];
+    }
+
+    NDS.JIT.AddDecodedInstr(CurDecodedPage, addr);
+    return instr;
+}
+#endif
+
 void ARMv5::JumpTo(u32 addr, bool restorecpsr)
 {
     if (restorecpsr)
@@ -321,15 +371,19 @@ void ARMv5::JumpTo(u32 addr, bool restorecpsr)
         // doesn't matter if we put garbage in the MSbs there
         if (addr & 0x2)
         {
-            NextInstr[0] = CodeRead32(addr-2, true) >> 16;
+            UpdateCodeCycles(addr-2, true);
+            NextInstr[0] = CodeReadDecoded16(addr, NextHandler[0]);
             Cycles += CodeCycles;
-            NextInstr[1] = CodeRead32(addr+2, false);
+            UpdateCodeCycles(addr+2, false);
+            NextInstr[1] = CodeReadDecoded16(addr+2, NextHandler[1]);
             Cycles += CodeCycles;
         }
         else
         {
-            NextInstr[0] = CodeRead32(addr, true);
+            UpdateCodeCycles(addr, true);
+            NextInstr[0] = CodeReadDecoded16(addr, NextHandler[0]);
             NextInstr[1] = NextInstr[0] >> 16;
+            NextHandler[1] = nullptr;
             Cycles += CodeCycles;
         }
 
@@ -342,9 +396,9 @@ void ARMv5::JumpTo(u32 addr, bool restorecpsr)
 
         if (newregion != oldregion) SetupCodeMem(addr);
 
-        NextInstr[0] = CodeRead32(addr, true);
+        NextInstr[0] = CodeReadDecoded32(addr, true, NextHandler[0]);
         Cycles += CodeCycles;
-        NextInstr[1] = CodeRead32(addr+4, false);
+        NextInstr[1] = CodeReadDecoded32(addr+4, false, NextHandler[1]);
         Cycles += CodeCycles;
 
         CPSR &= ~0x20;
@@ -382,8 +436,8 @@ void ARMv4::JumpTo(u32 addr, bool restorecpsr)
 
         //if (newregion != oldregion) SetupCodeMem(addr);
 
-        NextInstr[0] = CodeRead16(addr);
-        NextInstr[1] = CodeRead16(addr+2);
+        NextInstr[0] = CodeReadDecoded16(addr, NextHandler[0]);
+        NextInstr[1] = CodeReadDecoded16(addr+2, NextHandler[1]);
         Cycles += NDS.ARM7MemTimings[CodeCycles][0] + NDS.ARM7MemTimings[CodeCycles][1];
 
         CPSR |= 0x20;
@@ -395,8 +449,8 @@ void ARMv4::JumpTo(u32 addr, bool restorecpsr)
 
         //if (newregion != oldregion) SetupCodeMem(addr);
 
-        NextInstr[0] = CodeRead32(addr);
-        NextInstr[1] = CodeRead32(addr+4);
+        NextInstr[0] = CodeReadDecoded32(addr, NextHandler[0]);
+        NextInstr[1] = CodeReadDecoded32(addr+4, NextHandler[1]);
         Cycles += NDS.ARM7MemTimings[CodeCycles][2] + NDS.ARM7MemTimings[CodeCycles][3];
 
         CPSR &= ~0x20;
@@ -449,6 +503,9 @@ void ARM::UpdateMode(u32 oldmode, u32 newmode, bool phony)
 {
     if ((oldmode & 0x1F) == (newmode & 0x1F)) return;
 
+    // the banked registers aren't compared, IRQs also end up here
+    IdleLoopDirty = true;
+
     switch (oldmode & 0x1F)
     {
     case 0x11:
@@ -589,6 +646,92 @@ void ARM::CheckGdbIncoming()
     GdbCheckA();
 }
 
+void ARM::ResetIdleLoop() noexcept
+{
+    IdleLoopTarget = 0xFFFFFFFF;
+    IdleLoopMisses = 0;
+    IdleLoopStack = 0;
+    IdleLoopTime = 0;
+    IdleLoopDirty = true;
+}
+
+bool ARM::CheckIdleLoop(u32 pc) noexcept
+{
+    // similar to what the JIT does with IsIdleLoop, but looking at the
+    // state of the CPU instead of the instructions. That way loops which
+    // span several blocks or call functions are found as well.
+    u64 now = (Num ? NDS.ARM7Timestamp : NDS.ARM9Timestamp) + Cycles;
+    u64 target = Num ? NDS.ARM7Target : NDS.ARM9Target;
+    bool thumb = CPSR & 0x20;
+
+    if (R[15] != IdleLoopTarget)
+    {
+        if (IdleLoopTarget != 0xFFFFFFFF && ++IdleLoopMisses < IdleLoopMaxMisses)
+            return false;
+        IdleLoopTarget = R[15];
+    }
+    else if (!IdleLoopDirty)
+    {
+        u32 changed = 0;
+        for (int i = 0; i < 15; i++)
+        {
+            if (R[i] != IdleLoopRegs[i])
+                changed |= 1 << i;
+        }
+
+        if (!changed && CPSR == IdleLoopRegs[15])
+            return true;
+
+        // countdown loops (like SWI WaitByLoop) are run through in one go:
+        //   SUBS Rn, Rn, #1
+        //   BNE/BGT <the SUBS>
+        u32 size = thumb ? 2 : 4;
+        if (R[15] == pc - size && ((CPSR ^ IdleLoopRegs[15]) & 0x0FFFFFFF) == 0)
+        {
+            u32 cond = thumb ? ((CurInstr >> 8) & 0xF) : (CurInstr >> 28);
+            bool branch = thumb ? ((CurInstr & 0xF000) == 0xD000) : ((CurInstr & 0x0E000000) == 0x0A000000);
+
+            int reg = -1;
+            if (thumb)
+            {
+                u32 instr = NextInstr[0] & 0xFFFF;
+                if ((instr & 0xF8FF) == 0x3801) // SUB Rd, #1
+                    reg = (instr >> 8) & 0x7;
+                else if ((instr & 0xFFC0) == 0x1E40 && (instr & 0x7) == ((instr >> 3) & 0x7)) // SUB Rd, Rd, #1
+                    reg = instr & 0x7;
+            }
+            else
+            {
+                u32 instr = NextInstr[0];
+                if ((instr & 0xFFF00FFF) == 0xE2500001 && ((instr >> 12) & 0xF) == ((instr >> 16) & 0xF))
+                    reg = (instr >> 16) & 0xF;
+            }
+
+            if (branch && (cond == 0x1 || cond == 0xC) && reg != -1 && reg != 15
+                && changed == (1u << reg) && R[reg] == IdleLoopRegs[reg] - 1 && R[reg] > 1)
+            {
+                u64 iterCycles = now - IdleLoopTime;
+                u64 iterations = iterCycles ? std::min<u64>(R[reg] - 1, (target - std::min(target, now)) / iterCycles) : 0;
+
+                // stop one iteration before the loop ends, so that it's left as usual
+                R[reg] -= iterations;
+                Cycles += iterations * iterCycles;
+                now += iterations * iterCycles;
+                u32 lastValue = R[reg] + 1;
+                SetNZCV(R[reg] >> 31, false, true, lastValue == 0x80000000);
+            }
+        }
+    }
+
+    IdleLoopMisses = 0;
+    memcpy(IdleLoopRegs, R, 15 * sizeof(u32));
+    IdleLoopRegs[15] = CPSR;
+    IdleLoopStack = R[13] - IdleLoopStackSize;
+    IdleLoopTime = now;
+    IdleLoopDirty = false;
+    return false;
+}
+
 template <CPUExecuteMode mode>
 void ARMv5::Execute()
 {
@@ -657,6 +800,8 @@ void ARMv5::Execute()
         else
 #endif
         {
+            u32 pc = R[15];
+
             if (CPSR & 0x20) // THUMB
             {
                 if constexpr (mode == CPUExecuteMode::InterpreterGDB)
@@ -665,13 +810,23 @@ void ARMv5::Execute()
                 // prefetch
                 R[15] += 2;
                 CurInstr = NextInstr[0];
+                auto handler = NextHandler[0];
                 NextInstr[0] = NextInstr[1];
-                if (R[15] & 0x2) { NextInstr[1] >>= 16; CodeCycles = 0; }
-                else             NextInstr[1] = CodeRead32(R[15], false);
+                NextHandler[0] = NextHandler[1];
+                if (R[15] & 0x2) { NextInstr[1] >>= 16; NextHandler[1] = nullptr; CodeCycles = 0; }
+                else
+                {
+                    UpdateCodeCycles(R[15], false);
+                    NextInstr[1] = CodeReadDecoded16(R[15], NextHandler[1]);
+                }
 
                 // actually execute
-                u32 icode = (CurInstr >> 6) & 0x3FF;
-                ARMInterpreter::THUMBInstrTable[icode](this);
+                if (!handler)
+                {
+                    u32 icode = (CurInstr >> 6) & 0x3FF;
+                    handler = ARMInterpreter::THUMBInstrTable[icode];
+                }
+                handler(this);
             }
             else
             {
@@ -681,14 +836,20 @@ void ARMv5::Execute()
                 // prefetch
                 R[15] += 4;
                 CurInstr = NextInstr[0];
+                auto handler = NextHandler[0];
                 NextInstr[0] = NextInstr[1];
-                NextInstr[1] = CodeRead32(R[15], false);
+                NextHandler[0] = NextHandler[1];
+                NextInstr[1] = CodeReadDecoded32(R[15], false, NextHandler[1]);
 
                 // actually execute
                 if (CheckCondition(CurInstr >> 28))
                 {
-                    u32 icode = ((CurInstr >> 4) & 0xF) | ((CurInstr >> 16) & 0xFF0);
-                    ARMInterpreter::ARMInstrTable[icode](this);
+                    if (!handler)
+                    {
+                        u32 icode = ((CurInstr >> 4) & 0xF) | ((CurInstr >> 16) & 0xFF0);
+                        handler = ARMInterpreter::ARMInstrTable[icode];
+                    }
+                    handler(this);
                 }
                 else if ((CurInstr & 0xFE000000) == 0xFA000000)
                 {
@@ -698,6 +859,17 @@ void ARMv5::Execute()
                     AddCycles_C();
             }
 
+            if constexpr (mode == CPUExecuteMode::Interpreter)
+            {
+                // a branch backwards, this might be a loop waiting for an IRQ or the other CPU
+                if (R[15] <= pc && NDS.IsIdleLoopSkipEnabled() && (!IRQ || (CPSR & 0x80)) && CheckIdleLoop(pc))
+                {
+                    Cycles = 0;
+                    NDS.ARM9Timestamp = NDS.ARM9Target;
+                    break;
+                }
+            }
+
             // TODO optimize this shit!!!
             if (Halted)
             {
@@ -796,6 +968,8 @@ void ARMv4::Execute()
         else
 #endif
         {
+            u32 pc = R[15];
+
             if (CPSR & 0x20) // THUMB
             {
                 if constexpr (mode == CPUExecuteMode::InterpreterGDB)
@@ -804,12 +978,18 @@ void ARMv4::Execute()
                 // prefetch
                 R[15] += 2;
                 CurInstr = NextInstr[0];
+                auto handler = NextHandler[0];
                 NextInstr[0] = NextInstr[1];
-                NextInstr[1] = CodeRead16(R[15]);
+                NextHandler[0] = NextHandler[1];
+                NextInstr[1] = CodeReadDecoded16(R[15], NextHandler[1]);
 
                 // actually execute
-                u32 icode = (CurInstr >> 6);
-                ARMInterpreter::THUMBInstrTable[icode](this);
+                if (!handler)
+                {
+                    u32 icode = (CurInstr >> 6);
+                    handler = ARMInterpreter::THUMBInstrTable[icode];
+                }
+                handler(this);
             }
             else
             {
@@ -819,19 +999,36 @@ void ARMv4::Execute()
                 // prefetch
                 R[15] += 4;
                 CurInstr = NextInstr[0];
+                auto handler = NextHandler[0];
                 NextInstr[0] = NextInstr[1];
-                NextInstr[1] = CodeRead32(R[15]);
+                NextHandler[0] = NextHandler[1];
+                NextInstr[1] = CodeReadDecoded32(R[15], NextHandler[1]);
 
                 // actually execute
                 if (CheckCondition(CurInstr >> 28))
                 {
-                    u32 icode = ((CurInstr >> 4) & 0xF) | ((CurInstr >> 16) & 0xFF0);
-                    ARMInterpreter::ARMInstrTable[icode](this);
+                    if (!handler)
+                    {
+                        u32 icode = ((CurInstr >> 4) & 0xF) | ((CurInstr >> 16) & 0xFF0);
+                        handler = ARMInterpreter::ARMInstrTable[icode];
+                    }
+                    handler(this);
                 }
                 else
                     AddCycles_C();
             }
 
+            if constexpr (mode == CPUExecuteMode::Interpreter)
+            {
+                // a branch backwards, this might be a loop waiting for an IRQ or the other CPU
+                if (R[15] <= pc && NDS.IsIdleLoopSkipEnabled() && (!IRQ || (CPSR & 0x80)) && CheckIdleLoop(pc))
+                {
+                    Cycles = 0;
+                    NDS.ARM7Timestamp = NDS.ARM7Target;
+                    break;
+                }
+            }
+
             // TODO optimize this shit!!!
             if (Halted)
             {
@@ -874,6 +1071,7 @@ template void ARMv4::Execute<CPUExecuteMode::JIT>();
 void ARMv5::FillPipeline()
 {
     SetupCodeMem(R[15]);
+    NextHandler[0] = NextHandler[1] = nullptr;
 
     if (CPSR & 0x20)
     {
@@ -898,6 +1096,7 @@ void ARMv5::FillPipeline()
 void ARMv4::FillPipeline()
 {
     SetupCodeMem(R[15]);
+    NextHandler[0] = NextHandler[1] = nullptr;
 
     if (CPSR & 0x20)
     {
@@ -1154,6 +1353,8 @@ void ARMv4::DataRead32S(u32 addr, u32* val)
 
 void ARMv4::DataWrite8(u32 addr, u8 val)
 {
+    IdleLoopWrite(addr);
+
     BusWrite8(addr, val);
     DataRegion = addr;
     DataCycles = NDS.ARM7MemTimings[addr >> 15][0];
@@ -1161,6 +1362,8 @@ void ARMv4::DataWrite8(u32 addr, u8 val)
 
 void ARMv4::DataWrite16(u32 addr, u16 val)
 {
+    IdleLoopWrite(addr);
+
     addr &= ~1;
 
     BusWrite16(addr, val);
@@ -1170,6 +1373,8 @@ void ARMv4::DataWrite16(u32 addr, u16 val)
 
 void ARMv4::DataWrite32(u32 addr, u32 val)
 {
+    IdleLoopWrite(addr);
+
     addr &= ~3;
 
     BusWrite32(addr, val);
@@ -1179,6 +1384,8 @@ void ARMv4::DataWrite32(u32 addr, u32 val)
 
 void ARMv4::DataWrite32S(u32 addr, u32 val)
 {
+    IdleLoopWrite(addr);
+
     addr &= ~3;
 
     BusWrite32(addr, val);
@@ -1250,61 +1457,103 @@ void ARMv4::AddCycles_CD()
 
 u8 ARMv5::BusRead8(u32 addr)
 {
+    if (u8* page = NDS.GetMemPage(0, false, addr))
+        return *(u8*)&page[addr & (NDS::MemPageSize - sizeof(u8))];
     return NDS.ARM9Read8(addr);
 }
 
 u16 ARMv5::BusRead16(u32 addr)
 {
+    if (u8* page = NDS.GetMemPage(0, false, addr))
+        return *(u16*)&page[addr & (NDS::MemPageSize - sizeof(u16))];
     return NDS.ARM9Read16(addr);
 }
 
 u32 ARMv5::BusRead32(u32 addr)
 {
+    if (u8* page = NDS.GetMemPage(0, false, addr))
+        return *(u32*)&page[addr & (NDS::MemPageSize - sizeof(u32))];
     return NDS.ARM9Read32(addr);
 }
 
 void ARMv5::BusWrite8(u32 addr, u8 val)
 {
+    if (u8* page = NDS.GetMemPage(0, true, addr))
+    {
+        *(u8*)&page[addr & (NDS::MemPageSize - sizeof(u8))] = val;
+        return;
+    }
     NDS.ARM9Write8(addr, val);
 }
 
 void ARMv5::BusWrite16(u32 addr, u16 val)
 {
+    if (u8* page = NDS.GetMemPage(0, true, addr))
+    {
+        *(u16*)&page[addr & (NDS::MemPageSize - sizeof(u16))] = val;
+        return;
+    }
     NDS.ARM9Write16(addr, val);
 }
 
 void ARMv5::BusWrite32(u32 addr, u32 val)
 {
+    if (u8* page = NDS.GetMemPage(0, true, addr))
+    {
+        *(u32*)&page[addr & (NDS::MemPageSize - sizeof(u32))] = val;
+        return;
+    }
     NDS.ARM9Write32(addr, val);
 }
 
 u8 ARMv4::BusRead8(u32 addr)
 {
+    if (u8* page = NDS.GetMemPage(1, false, addr))
+        return *(u8*)&page[addr & (NDS::MemPageSize - sizeof(u8))];
     return NDS.ARM7Read8(addr);
 }
 
 u16 ARMv4::BusRead16(u32 addr)
 {
+    if (u8* page = NDS.GetMemPage(1, false, addr))
+        return *(u16*)&page[addr & (NDS::MemPageSize - sizeof(u16))];
     return NDS.ARM7Read16(addr);
 }
 
 u32 ARMv4::BusRead32(u32 addr)
 {
+    if (u8* page = NDS.GetMemPage(1, false, addr))
+        return *(u32*)&page[addr & (NDS::MemPageSize - sizeof(u32))];
     return NDS.ARM7Read32(addr);
 }
 
 void ARMv4::BusWrite8(u32 addr, u8 val)
 {
+    if (u8* page = NDS.GetMemPage(1, true, addr))
+    {
+        *(u8*)&page[addr & (NDS::MemPageSize - sizeof(u8))] = val;
+        return;
+    }
     NDS.ARM7Write8(addr, val);
 }
 
 void ARMv4::BusWrite16(u32 addr, u16 val)
 {
+    if (u8* page = NDS.GetMemPage(1, true, addr))
+    {
+        *(u16*)&page[addr & (NDS::MemPageSize - sizeof(u16))] = val;
+        return;
+    }
     NDS.ARM7Write16(addr, val);
 }
 
 void ARMv4::BusWrite32(u32 addr, u32 val)
 {
+    if (u8* page = NDS.GetMemPage(1, true, addr))
+    {
+        *(u32*)&page[addr & (NDS::MemPageSize - sizeof(u32))] = val;
+        return;
+    }
     NDS.ARM7Write32(addr, val);
 }
 }
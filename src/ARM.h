@@ -58,6 +58,32 @@ class GPU;
 class ARMJIT_Memory;
 class NDS;
 class Savestate;
+class ARM;
+
+#ifdef JIT_ENABLED
+/// An instruction the interpreter fetched before,
+/// with the handler it has in the interpreter's tables.
+struct DecodedInstr
+{
+    void (*Handler)(ARM* cpu); // NULL if it wasn't decoded yet
+    u32 Instr;
+};
+
+/// The instructions the interpreter decoded from 512 bytes of code memory,
+/// so that they don't have to be fetched and decoded again.
+/// Kept by ARMJIT, which drops them again when the memory is written to,
+/// using the same code index as for its blocks.
+struct DecodedPage
+{
+    u32 LocalAddr;
+    // the 16 byte chunks with decoded instructions, like AddressRange::Code
+    u32 Code;
+    DecodedInstr ARMInstrs[512 / 4];
+    // the ARM9 fetches THUMB code a word at a time, for it the ones
+    // at word addresses have the following halfword in the top bits
+    DecodedInstr THUMBInstrs[512 / 2];
+};
+#endif
 
 class ARM
 #ifdef GDBSTUB_ENABLED
@@ -134,6 +160,33 @@ public:
 
     void SetupCodeMem(u32 addr);
 
+#ifdef JIT_ENABLED
+    /// The interpreter's pre-decoded entry for the instruction at addr,
+    /// decodes it first if it's not there yet. NULL if addr isn't in code
+    /// memory the JIT keeps track of, then it has to be fetched as usual.
+    DecodedInstr* LookUpDecoded(u32 addr, bool thumb)
+    {
+        if (addr - CurDecodedAddr < 512 && CurDecodedPage)
+        {
+            DecodedInstr* instr = thumb
+                ? &CurDecodedPage->THUMBInstrs[(addr & 0x1FF) >> 1]
+                : &CurDecodedPage->ARMInstrs[(addr & 0x1FF) >> 2];
+            if (instr->Handler)
+                return instr;
+        }
+        return DecodeInstr(addr, thumb);
+    }
+    DecodedInstr* DecodeInstr(u32 addr, bool thumb);
+
+    /// Has to be called when the page of decoded instructions
+    /// the CPU is at might have been freed or mapped elsewhere.
+    void ResetDecodedPage()
+    {
+        CurDecodedPage = nullptr;
+        CurDecodedAddr = 1;
+    }
+#endif
+
 
     virtual void DataRead8(u32 addr, u32* val) = 0;
     virtual void DataRead16(u32 addr, u32* val) = 0;
@@ -151,6 +204,23 @@ public:
 
     void CheckGdbIncoming();
 
+    /// Called by the interpreter after a branch backwards (or onto itself).
+    /// Compares the state of the CPU to the one the last time this point of
+    /// the loop was reached, if nothing changed and nothing was written
+    /// in between the CPU is waiting for something only an event can bring.
+    /// @param pc R15 before the branch was executed
+    /// @return true if the CPU can skip ahead to the next event.
+    bool CheckIdleLoop(u32 pc) noexcept;
+    void ResetIdleLoop() noexcept;
+
+    /// Writes to the memory below the stack pointer the loop started with
+    /// don't count, so that loops can call functions which push registers.
+    void IdleLoopWrite(u32 addr) noexcept
+    {
+        if (addr - IdleLoopStack >= IdleLoopStackSize)
+            IdleLoopDirty = true;
+    }
+
     u32 Num;
 
     s32 Cycles;
@@ -180,14 +250,35 @@ public:
     u32 R_UND[3];
     u32 CurInstr;
     u32 NextInstr[2];
+    // the interpreter's handlers for the instructions in NextInstr,
+    // NULL where they have to be looked up in the instruction tables
+    void (*NextHandler[2])(ARM* cpu);
 
     u32 ExceptionBase;
 
+    // interpreter idle loop detection, see CheckIdleLoop
+    static constexpr u32 IdleLoopStackSize = 0x100;
+    // other loops which may run inside of the one being watched
+    static constexpr u32 IdleLoopMaxMisses = 16;
+    u32 IdleLoopTarget;
+    u32 IdleLoopMisses;
+    u32 IdleLoopStack;
+    u64 IdleLoopTime;
+    u32 IdleLoopRegs[16]; // R0-R14 and CPSR
+    // set by anything which the loop can't be skipped over,
+    // writes, mode changes and reads of registers which change with every cycle
+    bool IdleLoopDirty;
+
     MemRegion CodeMem;
 
 #ifdef JIT_ENABLED
     u32 FastBlockLookupStart, FastBlockLookupSize;
     u64* FastBlockLookup;
+
+    // the page of decoded instructions for the 512 bytes
+    // at CurDecodedAddr, which the interpreter last fetched from
+    DecodedPage* CurDecodedPage;
+    u32 CurDecodedAddr;
 #endif
 
     static const u32 ConditionTable[16];
@@ -254,6 +345,43 @@ public:
     // all code accesses are forced nonseq 32bit
     u32 CodeRead32(u32 addr, bool branch);
 
+    /// CodeRead32 without the timing.
+    u32 CodeFetch32(u32 addr);
+
+    /// Sets CodeCycles for a code fetch, like CodeRead32 does.
+    void UpdateCodeCycles(u32 addr, bool branch);
+
+    /// CodeRead32 for the interpreter, which also gets the handler
+    /// for the instruction, if it was decoded before.
+    u32 CodeReadDecoded32(u32 addr, bool branch, void (*&handler)(ARM* cpu))
+    {
+        UpdateCodeCycles(addr, branch);
+#ifdef JIT_ENABLED
+        if (DecodedInstr* instr = LookUpDecoded(addr, false))
+        {
+            handler = instr->Handler;
+            return instr->Instr;
+        }
+#endif
+        handler = nullptr;
+        return CodeFetch32(addr);
+    }
+
+    /// The same for the THUMB instruction at addr, without the timing.
+    /// Like the fetches, this returns the whole word for word addresses.
+    u32 CodeReadDecoded16(u32 addr, void (*&handler)(ARM* cpu))
+    {
+#ifdef JIT_ENABLED
+        if (DecodedInstr* instr = LookUpDecoded(addr, true))
+        {
+            handler = instr->Handler;
+            return instr->Instr;
+        }
+#endif
+        handler = nullptr;
+        return CodeFetch32(addr & ~0x2) >> ((addr & 0x2) * 8);
+    }
+
     void DataRead8(u32 addr, u32* val) override;
     void DataRead16(u32 addr, u32* val) override;
     void DataRead32(u32 addr, u32* val) override;
@@ -339,7 +467,8 @@ public:
     u8* DTCM;
 
     u8 ICache[0x2000];
-    u32 ICacheTags[64*4];
+    // the 4 ways of each set are next to each other, so they can be compared at once
+    alignas(16) u32 ICacheTags[64*4];
     u8 ICacheCount[64];
 
     u32 PU_CodeCacheable;
@@ -363,6 +492,8 @@ public:
     u8 MemTimings[0x100000][4];
 
     u8* CurICacheLine;
+    // address of the line CurICacheLine holds, 1 if there's none
+    u32 CurICacheAddr;
 
     bool (*GetMemRegion)(u32 addr, bool write, MemRegion* region);
 
@@ -402,6 +533,35 @@ public:
         return BusRead32(addr);
     }
 
+    /// CodeRead16 for the interpreter, which also gets the handler
+    /// for the instruction, if it was decoded before.
+    u16 CodeReadDecoded16(u32 addr, void (*&handler)(ARM* cpu))
+    {
+#ifdef JIT_ENABLED
+        if (DecodedInstr* instr = LookUpDecoded(addr, true))
+        {
+            handler = instr->Handler;
+            return instr->Instr;
+        }
+#endif
+        handler = nullptr;
+        return CodeRead16(addr);
+    }
+
+    /// The same for CodeRead32.
+    u32 CodeReadDecoded32(u32 addr, void (*&handler)(ARM* cpu))
+    {
+#ifdef JIT_ENABLED
+        if (DecodedInstr* instr = LookUpDecoded(addr, false))
+        {
+            handler = instr->Handler;
+            return instr->Instr;
+        }
+#endif
+        handler = nullptr;
+        return CodeRead32(addr);
+    }
+
     void DataRead8(u32 addr, u32* val) override;
     void DataRead16(u32 addr, u32* val) override;
     void DataRead32(u32 addr, u32* val) override;
@@ -22,6 +22,7 @@
 #include "ARMInterpreter_ALU.h"
 #include "ARMInterpreter_Branch.h"
 #include "ARMInterpreter_LoadStore.h"
+#include "BIOSHLE.h"
 #include "Platform.h"
 
 #ifdef GDBSTUB_ENABLED
@@ -266,6 +267,9 @@ void A_MRC(ARM* cpu)
 
 void A_SVC(ARM* cpu)
 {
+    if (cpu->NDS.IsBIOSHLEEnabled() && BIOSHLE::HandleSWI(cpu, (cpu->CurInstr >> 16) & 0xFF))
+        return;
+
     u32 oldcpsr = cpu->CPSR;
     cpu->CPSR &= ~0xBF;
     cpu->CPSR |= 0x93;
@@ -278,6 +282,9 @@ void A_SVC(ARM* cpu)
 
 void T_SVC(ARM* cpu)
 {
+    if (cpu->NDS.IsBIOSHLEEnabled() && BIOSHLE::HandleSWI(cpu, cpu->CurInstr & 0xFF))
+        return;
+
     u32 oldcpsr = cpu->CPSR;
     cpu->CPSR &= ~0xBF;
     cpu->CPSR |= 0x93;
@@ -20,7 +20,6 @@
 #include "ARMJIT_Memory.h"
 #include <string.h>
 #include <assert.h>
-#include <unordered_map>
 
 #define XXH_STATIC_LINKING_ONLY
 #include "xxhash/xxhash.h"
@@ -103,12 +102,14 @@ T SlowRead9(u32 addr, ARMv5* cpu)
         val = *(T*)&cpu->ITCM[addr & 0x7FFF];
     else if ((addr & cpu->DTCMMask) == cpu->DTCMBase)
         val = *(T*)&cpu->DTCM[addr & 0x3FFF];
+    else if (u8* page = cpu->NDS.GetMemPage(0, false, addr))
+        val = *(T*)&page[addr & (NDS::MemPageSize - 1)];
     else if (std::is_same<T, u32>::value)
-        val = NDS::Current->ARM9Read32(addr);
+        val = cpu->NDS.ARM9Read32(addr);
     else if (std::is_same<T, u16>::value)
-        val = NDS::Current->ARM9Read16(addr);
+        val = cpu->NDS.ARM9Read16(addr);
     else
-        val = NDS::Current->ARM9Read8(addr);
+        val = cpu->NDS.ARM9Read8(addr);
 
     if (std::is_same<T, u32>::value)
         return ROR(val, offset << 3);
@@ -117,18 +118,20 @@ T SlowRead9(u32 addr, ARMv5* cpu)
 }
 
 template <typename T, int ConsoleType>
-T SlowRead7(u32 addr)
+T SlowRead7(u32 addr, ARMv4* cpu)
 {
     u32 offset = addr & 0x3;
     addr &= ~(sizeof(T) - 1);
 
     T val;
-    if (std::is_same<T, u32>::value)
-        val = NDS::Current->ARM7Read32(addr);
+    if (u8* page = cpu->NDS.GetMemPage(1, false, addr))
+        val = *(T*)&page[addr & (NDS::MemPageSize - 1)];
+    else if (std::is_same<T, u32>::value)
+        val = cpu->NDS.ARM7Read32(addr);
     else if (std::is_same<T, u16>::value)
-        val = NDS::Current->ARM7Read16(addr);
+        val = cpu->NDS.ARM7Read16(addr);
     else
-        val = NDS::Current->ARM7Read8(addr);
+        val = cpu->NDS.ARM7Read8(addr);
 
     if (std::is_same<T, u32>::value)
         return ROR(val, offset << 3);
@@ -152,29 +155,29 @@ void SlowWrite9(u32 addr, ARMv5* cpu, u32 val)
     }
     else if (std::is_same<T, u32>::value)
     {
-        NDS::Current->ARM9Write32(addr, val);
+        cpu->NDS.ARM9Write32(addr, val);
     }
     else if (std::is_same<T, u16>::value)
     {
-        NDS::Current->ARM9Write16(addr, val);
+        cpu->NDS.ARM9Write16(addr, val);
     }
     else
     {
-        NDS::Current->ARM9Write8(addr, val);
+        cpu->NDS.ARM9Write8(addr, val);
     }
 }
 
 template <typename T, int ConsoleType>
-void SlowWrite7(u32 addr, u32 val)
+void SlowWrite7(u32 addr, ARMv4* cpu, u32 val)
 {
     addr &= ~(sizeof(T) - 1);
 
     if (std::is_same<T, u32>::value)
-        NDS::Current->ARM7Write32(addr, val);
+        cpu->NDS.ARM7Write32(addr, val);
     else if (std::is_same<T, u16>::value)
-        NDS::Current->ARM7Write16(addr, val);
+        cpu->NDS.ARM7Write16(addr, val);
     else
-        NDS::Current->ARM7Write8(addr, val);
+        cpu->NDS.ARM7Write8(addr, val);
 }
 
 template <bool Write, int ConsoleType>
@@ -192,15 +195,15 @@ void SlowBlockTransfer9(u32 addr, u64* data, u32 num, ARMv5* cpu)
 }
 
 template <bool Write, int ConsoleType>
-void SlowBlockTransfer7(u32 addr, u64* data, u32 num)
+void SlowBlockTransfer7(u32 addr, u64* data, u32 num, ARMv4* cpu)
 {
     addr &= ~0x3;
     for (u32 i = 0; i < num; i++)
     {
         if (Write)
-            SlowWrite7<u32, ConsoleType>(addr, data[i]);
+            SlowWrite7<u32, ConsoleType>(addr, cpu, data[i]);
         else
-            data[i] = SlowRead7<u32, ConsoleType>(addr);
+            data[i] = SlowRead7<u32, ConsoleType>(addr, cpu);
         addr += 4;
     }
 }
@@ -214,18 +217,18 @@ void SlowBlockTransfer7(u32 addr, u64* data, u32 num)
     template u16 SlowRead9<u16, consoleType>(u32, ARMv5*); \
     template u8 SlowRead9<u8, consoleType>(u32, ARMv5*); \
     \
-    template void SlowWrite7<u32, consoleType>(u32, u32); \
-    template void SlowWrite7<u16, consoleType>(u32, u32); \
-    template void SlowWrite7<u8, consoleType>(u32, u32); \
+    template void SlowWrite7<u32, consoleType>(u32, ARMv4*, u32); \
+    template void SlowWrite7<u16, consoleType>(u32, ARMv4*, u32); \
+    template void SlowWrite7<u8, consoleType>(u32, ARMv4*, u32); \
     \
-    template u32 SlowRead7<u32, consoleType>(u32); \
-    template u16 SlowRead7<u16, consoleType>(u32); \
-    template u8 SlowRead7<u8, consoleType>(u32); \
+    template u32 SlowRead7<u32, consoleType>(u32, ARMv4*); \
+    template u16 SlowRead7<u16, consoleType>(u32, ARMv4*); \
+    template u8 SlowRead7<u8, consoleType>(u32, ARMv4*); \
     \
     template void SlowBlockTransfer9<false, consoleType>(u32, u64*, u32, ARMv5*); \
     template void SlowBlockTransfer9<true, consoleType>(u32, u64*, u32, ARMv5*); \
-    template void SlowBlockTransfer7<false, consoleType>(u32 addr, u64* data, u32 num); \
-    template void SlowBlockTransfer7<true, consoleType>(u32 addr, u64* data, u32 num); \
+    template void SlowBlockTransfer7<false, consoleType>(u32, u64*, u32, ARMv4*); \
+    template void SlowBlockTransfer7<true, consoleType>(u32, u64*, u32, ARMv4*); \
 
 INSTANTIATE_SLOWMEM(0)
 INSTANTIATE_SLOWMEM(1)
@@ -234,16 +237,73 @@ ARMJIT::~ARMJIT() noexcept
 {
     JitEnableWrite();
     ResetBlockCache();
+
+    // the CPUs are already gone
+    for (auto& map : DecodedPages)
+        map.ForEach([](u32, DecodedPage* page) { delete page; });
 }
 
 void ARMJIT::Reset() noexcept
 {
     JitEnableWrite();
     ResetBlockCache();
+    ResetDecodedPages();
 
     Memory.Reset();
 }
 
+DecodedPage* ARMJIT::GetDecodedPage(u32 num, u32 addr) noexcept
+{
+    if (NDS.IsJITEnabled())
+        return nullptr;
+
+    int region = num == 0
+        ? Memory.ClassifyAddress9(addr)
+        : Memory.ClassifyAddress7(addr);
+    // VRAM isn't kept track of by bank, so it can change under the same local address
+    if (!CodeMemRegions[region] || region == ARMJIT_Memory::memregion_VRAM || region == ARMJIT_Memory::memregion_VWRAM)
+        return nullptr;
+
+    u32 localAddr = Memory.LocaliseAddress(region, num, addr) & ~0x1FF;
+    DecodedPage* page = DecodedPages[num].Find(localAddr);
+    if (!page)
+    {
+        page = new DecodedPage();
+        page->LocalAddr = localAddr;
+        DecodedPages[num].Insert(localAddr, page);
+
+        // writes have to go through the usual path to invalidate it
+        NDS.UnmapMemPageWrites(num, addr);
+    }
+    return page;
+}
+
+void ARMJIT::AddDecodedInstr(DecodedPage* page, u32 addr) noexcept
+{
+    u32 localAddr = page->LocalAddr;
+    u32 mask = 1 << ((addr & 0x1FF) / 16);
+
+    page->Code |= mask;
+    CodeMemRegions[localAddr >> 27][(localAddr & 0x7FFFFFF) / 512].Code |= mask;
+}
+
+void ARMJIT::ResetDecodedPages() noexcept
+{
+    for (auto& map : DecodedPages)
+    {
+        map.ForEach([this](u32, DecodedPage* page)
+        {
+            u32 localAddr = page->LocalAddr;
+            CodeMemRegions[localAddr >> 27][(localAddr & 0x7FFFFFF) / 512].Code &= ~page->Code;
+            delete page;
+        });
+        map.Clear();
+    }
+
+    NDS.ARM9.ResetDecodedPage();
+    NDS.ARM7.ResetDecodedPage();
+}
+
 void FloodFillSetFlags(FetchedInstr instrs[], int start, u8 flags)
 {
     for (int j = start; j >= 0; j--)
@@ -366,7 +426,9 @@ bool IsIdleLoop(bool thumb, FetchedInstr* instrs, int instrsCount)
             return false;
         if (!thumb && instrs[i].Info.Kind >= ARMInstrInfo::ak_MSR_IMM && instrs[i].Info.Kind <= ARMInstrInfo::ak_MRC)
             return false;
-        if (i < instrsCount - 1 && instrs[i].Info.Branches())
+        // branches in the middle were followed, if they're taken
+        // the other way the loop is left, which is fine
+        if (i < instrsCount - 1 && instrs[i].Info.Branches() && !(instrs[i].BranchFlags & branch_StaticTarget))
             return false;
 
         u16 srcRegs = instrs[i].Info.SrcRegs & ~(1 << 15);
@@ -475,21 +537,19 @@ ARMJIT::ARMJIT(melonDS::NDS& nds, std::optional<JITArgs> jit) noexcept :
         MaxBlockSize(jit.has_value() ? std::clamp(jit->MaxBlockSize, 1u, 32u) : 32),
         LiteralOptimizations(jit.has_value() ? jit->LiteralOptimizations : false),
         BranchOptimizations(jit.has_value() ? jit->BranchOptimizations : false),
-        FastMemory((jit.has_value() ? jit->FastMemory : false) && ARMJIT_Memory::IsFastMemSupported())
-{}
+        FastMemory((jit.has_value() ? jit->FastMemory : false) && ARMJIT_Memory::IsFastMemSupported()),
+        CodeCaching(jit.has_value() ? jit->CodeCache : false),
+        PerfMap(jit.has_value() ? jit->PerfMap : JITPerfMap::None),
+        Superblocks(jit.has_value() ? jit->Superblocks : false),
+        AsyncCompilation(jit.has_value() ? jit->AsyncCompile : false)
+{
+    UpdateAsyncCompiler();
+}
 
 void ARMJIT::RetireJitBlock(JitBlock* block) noexcept
 {
-    auto it = RestoreCandidates.find(block->InstrHash);
-    if (it != RestoreCandidates.end())
-    {
-        delete it->second;
-        it->second = block;
-    }
-    else
-    {
-        RestoreCandidates[block->InstrHash] = block;
-    }
+    TraceMapOp(JitMapOp::RestoreCandidates, JitMapOp::Insert, block->InstrHash);
+    delete RestoreCandidates.Insert(block->InstrHash, block);
 }
 
 void ARMJIT::SetJITArgs(JITArgs args) noexcept
@@ -500,37 +560,66 @@ void ARMJIT::SetJITArgs(JITArgs args) noexcept
     if (MaxBlockSize != args.MaxBlockSize
         || LiteralOptimizations != args.LiteralOptimizations
         || BranchOptimizations != args.BranchOptimizations
-        || FastMemory != args.FastMemory)
+        || FastMemory != args.FastMemory
+        || PerfMap != args.PerfMap // so that every block gets named
+        || Superblocks != args.Superblocks
+        || AsyncCompilation != args.AsyncCompile) // drops the blocks being compiled
         ResetBlockCache();
 
     MaxBlockSize = args.MaxBlockSize;
     LiteralOptimizations = args.LiteralOptimizations;
     BranchOptimizations = args.BranchOptimizations;
     FastMemory = args.FastMemory;
+    CodeCaching = args.CodeCache;
+    PerfMap = args.PerfMap;
+    Superblocks = args.Superblocks;
+    AsyncCompilation = args.AsyncCompile;
+    UpdateAsyncCompiler();
+}
+
+void ARMJIT::UpdateAsyncCompiler() noexcept
+{
+    if (!AsyncCompilation || !JITCompiler.CanCacheCode())
+    {
+        Async = nullptr;
+        return;
+    }
+    if (Async)
+        return;
+
+    // the blocks are moved over to the code memory the same way cached blocks are
+    Async = std::make_unique<AsyncCompiler>(NDS);
+    if (Async->GetCodeFingerprint() != JITCompiler.GetCodeFingerprint())
+    {
+        Log(LogLevel::Warn, "JIT: can't compile in the background, the code memory for it is too far away\n");
+        Async = nullptr;
+    }
 }
 
 void ARMJIT::SetMaxBlockSize(int size) noexcept
 {
-    SetJITArgs(JITArgs{static_cast<unsigned>(size), LiteralOptimizations, LiteralOptimizations, FastMemory});
+    SetJITArgs(JITArgs{static_cast<unsigned>(size), LiteralOptimizations, LiteralOptimizations, FastMemory, CodeCaching, PerfMap, Superblocks, AsyncCompilation});
 }
 
 void ARMJIT::SetLiteralOptimizations(bool enabled) noexcept
 {
-    SetJITArgs(JITArgs{static_cast<unsigned>(MaxBlockSize), enabled, BranchOptimizations, FastMemory});
+    SetJITArgs(JITArgs{static_cast<unsigned>(MaxBlockSize), enabled, BranchOptimizations, FastMemory, CodeCaching, PerfMap, Superblocks, AsyncCompilation});
 }
 
 void ARMJIT::SetBranchOptimizations(bool enabled) noexcept
 {
-    SetJITArgs(JITArgs{static_cast<unsigned>(MaxBlockSize), LiteralOptimizations, enabled, FastMemory});
+    SetJITArgs(JITArgs{static_cast<unsigned>(MaxBlockSize), LiteralOptimizations, enabled, FastMemory, CodeCaching, PerfMap, Superblocks, AsyncCompilation});
 }
 
 void ARMJIT::SetFastMemory(bool enabled) noexcept
 {
-    SetJITArgs(JITArgs{static_cast<unsigned>(MaxBlockSize), LiteralOptimizations, BranchOptimizations, enabled});
+    SetJITArgs(JITArgs{static_cast<unsigned>(MaxBlockSize), LiteralOptimizations, BranchOptimizations, enabled, CodeCaching, PerfMap, Superblocks, AsyncCompilation});
 }
 
 void ARMJIT::CompileBlock(ARM* cpu) noexcept
 {
+    PROFILE_SCOPE(NDS.Profiler, Prof_JITCompile);
+
     bool thumb = cpu->CPSR & 0x20;
 
     u32 blockAddr = cpu->R[15] - (thumb ? 2 : 4);
@@ -541,48 +630,64 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
         Log(LogLevel::Warn, "trying to compile non executable code? %x\n", blockAddr);
     }
 
+    // LookUpBlock found the block to be hot, compile it again as a superblock
+    bool superblock = false;
+
     auto& map = cpu->Num == 0 ? JitBlocks9 : JitBlocks7;
-    auto existingBlockIt = map.find(blockAddr);
-    if (existingBlockIt != map.end())
+    TraceMapOp(cpu->Num, JitMapOp::Find, blockAddr);
+    if (JitBlock* existingBlock = map.Find(blockAddr))
     {
+        superblock = existingBlock == HotBlock;
+        HotBlock = nullptr;
+
         // there's already a block, though it's not inside the fast map
         // could be that there are two blocks at the same physical addr
         // but different mirrors
-        u32 otherLocalAddr = existingBlockIt->second->StartAddrLocal;
+        u32 otherLocalAddr = existingBlock->StartAddrLocal;
 
-        if (localAddr == otherLocalAddr)
+        if (localAddr == otherLocalAddr && !superblock)
         {
-            JIT_DEBUGPRINT("switching out block %x %x %x\n", localAddr, blockAddr, existingBlockIt->second->StartAddr);
+            JIT_DEBUGPRINT("switching out block %x %x %x\n", localAddr, blockAddr, existingBlock->StartAddr);
 
             u64* entry = &FastBlockLookupRegions[localAddr >> 27][(localAddr & 0x7FFFFFF) / 2];
             *entry = ((u64)blockAddr | cpu->Num) << 32;
-            *entry |= JITCompiler.SubEntryOffset(existingBlockIt->second->EntryPoint);
+            *entry |= JITCompiler.SubEntryOffset(existingBlock->EntryPoint);
             return;
         }
 
         // some memory has been remapped
-        RetireJitBlock(existingBlockIt->second);
-        map.erase(existingBlockIt);
+        // or the block is replaced by a superblock
+        TraceMapOp(cpu->Num, JitMapOp::Erase, blockAddr);
+        map.Erase(blockAddr);
+        if (superblock)
+            RemoveFromCodeIndex(existingBlock);
+        RetireJitBlock(existingBlock);
     }
 
-    FetchedInstr instrs[MaxBlockSize];
+    int maxBlockSize = superblock ? MaxBlockSize * SuperblockScale : MaxBlockSize;
+    // whether the block could have been longer
+    bool truncated = false;
+    // whether it ends on a static branch back into itself, i.e. a short loop
+    bool branchesBack = false;
+
+    FetchedInstr instrs[maxBlockSize];
     int i = 0;
     u32 r15 = cpu->R[15];
 
-    u32 addressRanges[MaxBlockSize];
-    u32 addressMasks[MaxBlockSize];
-    memset(addressMasks, 0, MaxBlockSize * sizeof(u32));
+    u32 addressRanges[maxBlockSize];
+    u32 addressMasks[maxBlockSize];
+    memset(addressMasks, 0, maxBlockSize * sizeof(u32));
     u32 numAddressRanges = 0;
 
     u32 numLiterals = 0;
-    u32 literalLoadAddrs[MaxBlockSize];
+    u32 literalLoadAddrs[maxBlockSize];
     // they are going to be hashed
-    u32 literalValues[MaxBlockSize];
-    u32 instrValues[MaxBlockSize];
+    u32 literalValues[maxBlockSize];
+    u32 instrValues[maxBlockSize];
     // due to instruction merging i might not reflect the amount of actual instructions
     u32 numInstrs = 0;
 
-    u32 writeAddrs[MaxBlockSize];
+    u32 writeAddrs[maxBlockSize];
     u32 numWriteAddrs = 0, writeAddrsTranslated = 0;
 
     cpu->FillPipeline();
@@ -656,6 +761,7 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
             else
                 nextInstr[1] = cpuv4->CodeRead32(r15);
             instrs[i].CodeCycles = cpu->CodeCycles;
+            memcpy(instrs[i].CodeTimings, NDS.ARM7MemTimings[instrs[i].CodeCycles], 4);
         }
         instrs[i].Info = ARMInstrInfo::Decode(thumb, cpu->Num, instrs[i].Instr, LiteralOptimizations);
 
@@ -767,17 +873,44 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
                     }
                 }
 
-                if (cond < 0xE && target < instrs[i].Addr && target >= lastSegmentStart)
+                int loopStart = -1;
+                if (cond < 0xE)
+                {
+                    for (int j = 0; j <= i; j++)
+                    {
+                        if (instrs[j].Addr == target)
+                        {
+                            loopStart = j;
+                            break;
+                        }
+                    }
+                }
+
+                bool idleLoop = false;
+                if (loopStart != -1)
                 {
-                    // we might have an idle loop
-                    u32 backwardsOffset = (instrs[i].Addr - target) / (thumb ? 2 : 4);
-                    if (IsIdleLoop(thumb, &instrs[i - backwardsOffset], backwardsOffset + 1))
+                    // we might have an idle loop. Since the branches inside of the block
+                    // were followed it can also span several of them, e.g. calls to small functions
+                    if (IsIdleLoop(thumb, &instrs[loopStart], i - loopStart + 1))
                     {
                         instrs[i].BranchFlags |= branch_IdleBranch;
+                        idleLoop = true;
                         JIT_DEBUGPRINT("found %s idle loop %d in block %08x\n", thumb ? "thumb" : "arm", cpu->Num, blockAddr);
                     }
                 }
-                else if (hasBranched && !isBackJump && i + 1 < MaxBlockSize)
+
+                // superblocks also go around loops, predicting that
+                // the branch back is taken like it was this time
+                bool loopsBack = isBackJump || loopStart != -1;
+                if (hasBranched && !idleLoop && loopsBack && !superblock)
+                {
+                    branchesBack = true;
+                }
+                else if (hasBranched && !idleLoop && i + 1 >= maxBlockSize)
+                {
+                    truncated = true;
+                }
+                else if (hasBranched && !idleLoop)
                 {
                     if (link)
                     {
@@ -805,7 +938,11 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
                 }
             }
 
-            if (!hasBranched && cond < 0xE && i + 1 < MaxBlockSize)
+            if (!hasBranched && cond < 0xE && i + 1 >= maxBlockSize)
+            {
+                truncated = true;
+            }
+            else if (!hasBranched && cond < 0xE)
             {
                 JIT_DEBUGPRINT("block lengthened by untaken branch\n");
                 instrs[i].Info.EndBlock = false;
@@ -819,7 +956,10 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
         bool secondaryFlagReadCond = !canCompile || (instrs[i - 1].BranchFlags & (branch_FollowCondTaken | branch_FollowCondNotTaken));
         if (instrs[i - 1].Info.ReadFlags != 0 || secondaryFlagReadCond)
             FloodFillSetFlags(instrs, i - 2, !secondaryFlagReadCond ? instrs[i - 1].Info.ReadFlags : 0xF);
-    } while(!instrs[i - 1].Info.EndBlock && i < MaxBlockSize && !cpu->Halted && (!cpu->IRQ || (cpu->CPSR & 0x80)));
+    } while(!instrs[i - 1].Info.EndBlock && i < maxBlockSize && !cpu->Halted && (!cpu->IRQ || (cpu->CPSR & 0x80)));
+
+    if (!instrs[i - 1].Info.EndBlock && i == maxBlockSize)
+        truncated = true;
 
     if (numLiterals)
     {
@@ -841,16 +981,21 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
         }
     }
 
+    u64 blockKey = ((u64)cpu->Num << 32) | blockAddr;
+    if (QueuedBlocks.count(blockKey))
+    {
+        // it's still being compiled, for now it was interpreted above
+        return;
+    }
+
     u32 literalHash = (u32)XXH3_64bits(literalValues, numLiterals * 4);
     u32 instrHash = (u32)XXH3_64bits(instrValues, numInstrs * 4);
 
-    auto prevBlockIt = RestoreCandidates.find(instrHash);
-    JitBlock* prevBlock = NULL;
+    TraceMapOp(JitMapOp::RestoreCandidates, JitMapOp::Erase, instrHash);
+    JitBlock* prevBlock = RestoreCandidates.Erase(instrHash);
     bool mayRestore = true;
-    if (prevBlockIt != RestoreCandidates.end())
+    if (prevBlock)
     {
-        prevBlock = prevBlockIt->second;
-        RestoreCandidates.erase(prevBlockIt);
 
         mayRestore = prevBlock->StartAddr == blockAddr && prevBlock->LiteralHash == literalHash;
 
@@ -892,19 +1037,46 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
 
         block->StartAddr = blockAddr;
         block->StartAddrLocal = localAddr;
+        block->Superblock = superblock;
+        // growing a block which is already a superblock or which
+        // ended for a different reason than its size or a loop isn't worth it
+        block->CanGrow = Superblocks && (truncated || branchesBack) && !superblock;
 
         FloodFillSetFlags(instrs, i - 1, 0xF);
 
+        bool loaded;
+        bool queue = Async && !superblock && !AsyncFailed.count(blockKey);
         JitEnableWrite();
-        block->EntryPoint = JITCompiler.CompileBlock(cpu, thumb, instrs, i, hasMemoryInstr);
+        block->EntryPoint = CompileOrLoad(cpu, thumb, instrs, i, hasMemoryInstr, block, loaded, queue);
         JitEnableExecute();
 
+        if (!block->EntryPoint)
+        {
+            // counted once it's done
+            block->Queued = true;
+            QueuedBlocks.insert(blockKey);
+        }
+        else if (loaded)
+        {
+            Stats.BlocksLoaded++;
+            EvictedBlocks.erase(blockKey);
+        }
+        else
+        {
+            Stats.BlocksCompiled++;
+            if (EvictedBlocks.erase(blockKey))
+                Stats.BlocksRecompiled++;
+        }
+        if (superblock)
+            Stats.SuperblocksCompiled++;
+
         JIT_DEBUGPRINT("block start %p\n", block->EntryPoint);
     }
     else
     {
         JIT_DEBUGPRINT("restored! %p\n", prevBlock);
         block = prevBlock;
+        Stats.BlocksRestored++;
     }
 
     assert((localAddr & 1) == 0);
@@ -924,16 +1096,185 @@ void ARMJIT::CompileBlock(ARM* cpu) noexcept
         range->Blocks.Add(block);
     }
 
-    if (cpu->Num == 0)
-        JitBlocks9[blockAddr] = block;
-    else
-        JitBlocks7[blockAddr] = block;
+    // it's put into the code index right away, so that
+    // it's invalidated if the code is changed in the meantime
+    if (block->Queued)
+        return;
+
+    TraceMapOp(cpu->Num, JitMapOp::Insert, blockAddr);
+    map.Insert(blockAddr, block);
 
     u64* entry = &FastBlockLookupRegions[(localAddr >> 27)][(localAddr & 0x7FFFFFF) / 2];
     *entry = ((u64)blockAddr | cpu->Num) << 32;
     *entry |= JITCompiler.SubEntryOffset(block->EntryPoint);
 }
 
+u32 ARMJIT::CompileContextHash(ARM* cpu, bool thumb, const FetchedInstr instrs[], int instrsCount) const noexcept
+{
+    // everything the compiler goes by apart from the instructions themselves,
+    // except for what it looks up in memory (see CompileProbe)
+    u32 values[2 + 32 * SuperblockScale * 9];
+    u32 n = 0;
+
+    values[n++] = cpu->Num | (thumb << 1) | (LiteralOptimizations << 2) | (FastMemory << 3) | (NDS.ConsoleType << 4);
+    values[n++] = instrsCount;
+    for (int i = 0; i < instrsCount; i++)
+    {
+        const FetchedInstr& instr = instrs[i];
+        values[n++] = instr.Instr;
+        values[n++] = instr.Addr;
+        values[n++] = instr.BranchFlags | (instr.SetFlags << 8) | (instr.DataCycles << 16);
+        values[n++] = instr.CodeCycles | (instr.Info.Kind << 16);
+        values[n++] = instr.DataRegion;
+        values[n++] = instr.Info.DstRegs | (instr.Info.SrcRegs << 16);
+        values[n++] = instr.Info.NotStrictlyNeeded | (instr.Info.SpecialKind << 16) | (instr.Info.ReadFlags << 24);
+        values[n++] = instr.Info.WriteFlags | (instr.Info.EndBlock << 8);
+        if (cpu->Num == 1)
+            memcpy(&values[n++], instr.CodeTimings, 4);
+    }
+
+    return (u32)XXH3_64bits(values, n * 4);
+}
+
+JitBlockEntry ARMJIT::CompileOrLoad(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemoryInstr, JitBlock* block, bool& loaded, bool queue) noexcept
+{
+    loaded = false;
+    if ((!CodeCaching && !queue) || !JITCompiler.CanCacheCode())
+        return JITCompiler.CompileBlock(cpu, thumb, instrs, instrsCount, hasMemoryInstr);
+
+    u32 contextHash = CompileContextHash(cpu, thumb, instrs, instrsCount);
+
+    const CachedBlock* cached = CodeCaching
+        ? CachedCode.Find(CodeCache::Key(cpu->Num, block->StartAddr, block->InstrHash))
+        : nullptr;
+    if (cached
+        && cached->LiteralHash == block->LiteralHash
+        && cached->ContextHash == contextHash
+        && cached->AddressRanges.size() == block->NumAddresses
+        && cached->Literals.size() == block->NumLiterals
+        && std::equal(cached->AddressRanges.begin(), cached->AddressRanges.end(), block->AddressRanges())
+        && std::equal(cached->AddressMasks.begin(), cached->AddressMasks.end(), block->AddressMasks())
+        && std::equal(cached->Literals.begin(), cached->Literals.end(), block->Literals())
+        && JITCompiler.ReplayProbes(cpu, cached->Probes))
+    {
+        JitBlockEntry entry = JITCompiler.LoadBlock(*cached, thumb);
+        if (entry)
+        {
+            loaded = true;
+            return entry;
+        }
+    }
+
+    if (queue)
+    {
+        AsyncCompiler::Job job {block, cpu, thumb, hasMemoryInstr, contextHash,
+            std::vector<FetchedInstr>(instrs, instrs + instrsCount), {}};
+        if (Async->Queue(std::move(job)))
+            return NULL;
+
+        // too much is queued already
+        if (!CodeCaching)
+            return JITCompiler.CompileBlock(cpu, thumb, instrs, instrsCount, hasMemoryInstr);
+    }
+
+    CachedBlock captured;
+    JITCompiler.Capture = &captured;
+    JitBlockEntry entry = JITCompiler.CompileBlock(cpu, thumb, instrs, instrsCount, hasMemoryInstr);
+    JITCompiler.Capture = nullptr;
+
+    if (!captured.Code.empty())
+        AddToCodeCache(std::move(captured), block, contextHash);
+
+    return entry;
+}
+
+void ARMJIT::AddToCodeCache(CachedBlock&& captured, const JitBlock* block, u32 contextHash) noexcept
+{
+    captured.Num = block->Num;
+    captured.StartAddr = block->StartAddr;
+    captured.InstrHash = block->InstrHash;
+    captured.LiteralHash = block->LiteralHash;
+    captured.ContextHash = contextHash;
+    captured.AddressRanges.assign(block->AddressRanges(), block->AddressRanges() + block->NumAddresses);
+    captured.AddressMasks.assign(block->AddressMasks(), block->AddressMasks() + block->NumAddresses);
+    captured.Literals.assign(block->Literals(), block->Literals() + block->NumLiterals);
+    CachedCode.Add(std::move(captured));
+}
+
+void ARMJIT::PollAsyncCompiler() noexcept
+{
+    std::vector<AsyncCompiler::Job> finished;
+    Async->Poll(JITCompiler, finished);
+    for (AsyncCompiler::Job& job : finished)
+        InstallAsyncBlock(job);
+}
+
+void ARMJIT::InstallAsyncBlock(AsyncCompiler::Job& job) noexcept
+{
+    JitBlock* block = job.Block;
+    u64 blockKey = ((u64)block->Num << 32) | block->StartAddr;
+    QueuedBlocks.erase(blockKey);
+    block->Queued = false;
+
+    if (block->Discarded)
+    {
+        // InvalidateByAddr already took it out of the code index
+        delete block;
+        return;
+    }
+
+    JitBlockEntry entry = NULL;
+    // the memory timings might have changed while it was compiled
+    if (!job.Result.Code.empty()
+        && job.ContextHash == CompileContextHash(job.CPU, job.Thumb, job.Instrs.data(), (int)job.Instrs.size()))
+    {
+        JitEnableWrite();
+        entry = JITCompiler.LoadBlock(job.Result, job.Thumb);
+        JitEnableExecute();
+    }
+
+    if (!entry)
+    {
+        // it's compiled right away the next time it's run
+        AsyncFailed.insert(blockKey);
+        RemoveFromCodeIndex(block);
+        delete block;
+        return;
+    }
+
+    block->EntryPoint = entry;
+    if (CodeCaching)
+        AddToCodeCache(std::move(job.Result), block, job.ContextHash);
+
+    Stats.BlocksCompiled++;
+    Stats.BlocksCompiledAsync++;
+    if (EvictedBlocks.erase(blockKey))
+        Stats.BlocksRecompiled++;
+
+    TraceMapOp(block->Num, JitMapOp::Insert, block->StartAddr);
+    (block->Num == 0 ? JitBlocks9 : JitBlocks7).Insert(block->StartAddr, block);
+
+    u64* fastEntry = &FastBlockLookupRegions[block->StartAddrLocal >> 27][(block->StartAddrLocal & 0x7FFFFFF) / 2];
+    *fastEntry = ((u64)block->StartAddr | block->Num) << 32;
+    *fastEntry |= JITCompiler.SubEntryOffset(block->EntryPoint);
+}
+
+bool ARMJIT::LoadCodeCache(const std::string& path) noexcept
+{
+    if (!JITCompiler.CanCacheCode())
+        return false;
+
+    return CachedCode.Load(path, JITCompiler.GetCodeFingerprint());
+}
+
+bool ARMJIT::SaveCodeCache(const std::string& path) noexcept
+{
+    if (!JITCompiler.CanCacheCode())
+        return false;
+
+    return CachedCode.Save(path, JITCompiler.GetCodeFingerprint());
+}
+
 void ARMJIT::InvalidateByAddr(u32 localAddr) noexcept
 {
     JIT_DEBUGPRINT("invalidating by addr %x\n", localAddr);
@@ -943,6 +1284,23 @@ void ARMJIT::InvalidateByAddr(u32 localAddr) noexcept
     u32 mask = 1 << ((localAddr & 0x1FF) / 16);
 
     range->Code = 0;
+    for (auto& map : DecodedPages)
+    {
+        DecodedPage* page = map.Find(localAddr & ~0x1FF);
+        if (!page)
+            continue;
+
+        if (page->Code & mask)
+        {
+            u32 offset = localAddr & 0x1F0;
+            for (u32 i = 0; i < 16 / 4; i++)
+                page->ARMInstrs[offset / 4 + i].Handler = nullptr;
+            for (u32 i = 0; i < 16 / 2; i++)
+                page->THUMBInstrs[offset / 2 + i].Handler = nullptr;
+            page->Code &= ~mask;
+        }
+        range->Code |= page->Code;
+    }
     for (int i = 0; i < range->Blocks.Length;)
     {
         JitBlock* block = range->Blocks[i];
@@ -1011,11 +1369,16 @@ void ARMJIT::InvalidateByAddr(u32 localAddr) noexcept
             }
         }
 
+        if (block->Queued)
+        {
+            // it's not in the block maps yet, the code is thrown away once it's done
+            block->Discarded = true;
+            continue;
+        }
+
         FastBlockLookupRegions[block->StartAddrLocal >> 27][(block->StartAddrLocal & 0x7FFFFFF) / 2] = (u64)UINT32_MAX << 32;
-        if (block->Num == 0)
-            JitBlocks9.erase(block->StartAddr);
-        else
-            JitBlocks7.erase(block->StartAddr);
+        TraceMapOp(block->Num, JitMapOp::Erase, block->StartAddr);
+        (block->Num == 0 ? JitBlocks9 : JitBlocks7).Erase(block->StartAddr);
 
         if (!literalInvalidation)
         {
@@ -1028,45 +1391,65 @@ void ARMJIT::InvalidateByAddr(u32 localAddr) noexcept
     }
 }
 
-void ARMJIT::CheckAndInvalidateITCM() noexcept
+void ARMJIT::CheckAndInvalidateRange(int region, u32 offset, u32 size) noexcept
 {
-    for (u32 i = 0; i < ITCMPhysicalSize; i+=512)
+    AddressRange* ranges = CodeMemRegions[region];
+    for (u32 i = offset & ~0x1FF; i < offset + size; i += 512)
     {
-        if (CodeIndexITCM[i / 512].Code)
+        if (ranges[i / 512].Code)
         {
             // maybe using bitscan would be better here?
             // The thing is that in densely populated sets
             // The old fashioned way can actually be faster
             for (u32 j = 0; j < 512; j += 16)
             {
-                if (CodeIndexITCM[i / 512].Code & (1 << ((j & 0x1FF) / 16)))
-                    InvalidateByAddr((i+j) | (ARMJIT_Memory::memregion_ITCM << 27));
+                if (ranges[i / 512].Code & (1 << ((j & 0x1FF) / 16)))
+                    InvalidateByAddr((i+j) | (region << 27));
             }
         }
     }
 }
 
+void ARMJIT::CheckAndInvalidateITCM() noexcept
+{
+    CheckAndInvalidateRange(ARMJIT_Memory::memregion_ITCM, 0, ITCMPhysicalSize);
+}
+
 void ARMJIT::CheckAndInvalidateWVRAM(int bank) noexcept
 {
-    u32 start = bank == 1 ? 0x20000 : 0;
-    for (u32 i = start; i < start+0x20000; i+=512)
-    {
-        if (CodeIndexARM7WVRAM[i / 512].Code)
-        {
-            for (u32 j = 0; j < 512; j += 16)
-            {
-                if (CodeIndexARM7WVRAM[i / 512].Code & (1 << ((j & 0x1FF) / 16)))
-                    InvalidateByAddr((i+j) | (ARMJIT_Memory::memregion_VWRAM << 27));
-            }
-        }
-    }
+    CheckAndInvalidateRange(ARMJIT_Memory::memregion_VWRAM, bank == 1 ? 0x20000 : 0, 0x20000);
 }
 
 JitBlockEntry ARMJIT::LookUpBlock(u32 num, u64* entries, u32 offset, u32 addr) noexcept
 {
+    // in between two blocks is a safe point to do lookups
+    // for the compiler thread and to put its blocks in place
+    if (Async && Async->HasWork())
+        PollAsyncCompiler();
+
     u64* entry = &entries[offset / 2];
     if (*entry >> 32 == (addr | num))
+    {
+        Stats.BlocksDispatched++;
+
+        if (Superblocks && ++BlockHeat[num][(addr >> 1) & (BlockHeatSize - 1)] >= HotBlockThreshold)
+        {
+            // blocks sharing a counter only become hot a bit earlier
+            BlockHeat[num][(addr >> 1) & (BlockHeatSize - 1)] = 0;
+
+            TraceMapOp(num, JitMapOp::Find, addr);
+            JitBlock* block = (num == 0 ? JitBlocks9 : JitBlocks7).Find(addr);
+            if (block && block->CanGrow)
+            {
+                // let CompileBlock replace it
+                HotBlock = block;
+                return NULL;
+            }
+        }
+
+        SegmentLastUse[(u32)*entry >> ARMJIT_Global::CodeSegmentShift] = CodeEpoch;
         return JITCompiler.AddEntryOffset((u32)*entry);
+    }
     return NULL;
 }
 
@@ -1123,12 +1506,11 @@ void ARMJIT::ResetBlockCache() noexcept
         if (FastBlockLookupRegions[i])
             memset(FastBlockLookupRegions[i], 0xFF, CodeRegionSizes[i] * sizeof(u64) / 2);
     }
-    for (auto it = RestoreCandidates.begin(); it != RestoreCandidates.end(); it++)
-        delete it->second;
-    RestoreCandidates.clear();
-    for (auto it : JitBlocks9)
+    RestoreCandidates.ForEach([](u32, JitBlock* block) { delete block; });
+    RestoreCandidates.Clear();
+
+    auto clearCodeIndex = [this](JitBlock* block)
     {
-        JitBlock* block = it.second;
         for (int j = 0; j < block->NumAddresses; j++)
         {
             u32 addr = block->AddressRanges()[j];
@@ -1136,24 +1518,144 @@ void ARMJIT::ResetBlockCache() noexcept
             range->Blocks.Clear();
             range->Code = 0;
         }
-        delete block;
+    };
+    if (Async)
+    {
+        for (AsyncCompiler::Job& job : Async->Cancel())
+        {
+            if (!job.Block->Discarded)
+                clearCodeIndex(job.Block);
+            delete job.Block;
+        }
+    }
+    QueuedBlocks.clear();
+    AsyncFailed.clear();
+
+    for (auto* map : {&JitBlocks9, &JitBlocks7})
+    {
+        map->ForEach([&](u32, JitBlock* block)
+        {
+            clearCodeIndex(block);
+            delete block;
+        });
+        map->Clear();
     }
-    for (auto it : JitBlocks7)
+    for (u8 map = 0; map < 3; map++)
+        TraceMapOp(map, JitMapOp::Clear, 0);
+    EvictedBlocks.clear();
+    memset(BlockHeat, 0, sizeof(BlockHeat));
+    HotBlock = nullptr;
+
+    memset(SegmentLastUse, 0, sizeof(SegmentLastUse));
+    SegmentLastUse[0] = CodeEpoch;
+    Stats.CacheResets++;
+
+    JITCompiler.Reset();
+}
+
+void ARMJIT::RemoveFromCodeIndex(JitBlock* block) noexcept
+{
+    for (int j = 0; j < block->NumAddresses; j++)
     {
-        JitBlock* block = it.second;
-        for (int j = 0; j < block->NumAddresses; j++)
+        u32 addr = block->AddressRanges()[j];
+        AddressRange* region = CodeMemRegions[addr >> 27];
+        AddressRange* range = &region[(addr & 0x7FFFFFF) / 512];
+
+        bool removed = range->Blocks.RemoveByValue(block);
+        assert(removed);
+
+        // the other blocks might share some of the instructions
+        range->Code = 0;
+        for (int k = 0; k < range->Blocks.Length; k++)
         {
-            u32 addr = block->AddressRanges()[j];
-            AddressRange* range = &CodeMemRegions[addr >> 27][(addr & 0x7FFFFFF) / 512];
-            range->Blocks.Clear();
-            range->Code = 0;
+            JitBlock* other = range->Blocks[k];
+            for (int l = 0; l < other->NumAddresses; l++)
+            {
+                if (other->AddressRanges()[l] == addr)
+                {
+                    range->Code |= other->AddressMasks()[l];
+                    break;
+                }
+            }
         }
+
+        if (range->Blocks.Length == 0
+            && !PageContainsCode(&region[(addr & 0x7FFF000 & ~(Memory.PageSize - 1)) / 512], Memory.PageSize))
+        {
+            Memory.SetCodeProtection(addr >> 27, addr & 0x7FFFFFF, false);
+        }
+    }
+}
+
+void ARMJIT::EvictCodeSegment() noexcept
+{
+    u32 numSegments = JITCompiler.GetNumCodeSegments();
+    if (numSegments < 2)
+    {
+        ResetBlockCache();
+        return;
+    }
+
+    // pick the segment which wasn't used for the longest time,
+    // going round in order if there's a tie (e.g. when none were filled yet)
+    u32 current = JITCompiler.GetCurCodeSegment();
+    u32 victim = (current + 1) % numSegments;
+    for (u32 i = 2; i < numSegments; i++)
+    {
+        u32 segment = (current + i) % numSegments;
+        if (SegmentLastUse[segment] < SegmentLastUse[victim])
+            victim = segment;
+    }
+
+    Log(LogLevel::Debug, "JIT code segment %d full, continuing in segment %d\n", current, victim);
+
+    auto inVictim = [&](JitBlock* block)
+    {
+        return (JITCompiler.SubEntryOffset(block->EntryPoint) >> ARMJIT_Global::CodeSegmentShift) == victim;
+    };
+
+    u32 evicted = 0;
+    for (auto* map : {&JitBlocks9, &JitBlocks7})
+    {
+        map->EraseIf([&](u32 addr, JitBlock* block)
+        {
+            if (!inVictim(block))
+                return false;
+
+            RemoveFromCodeIndex(block);
+
+            u64* entry = &FastBlockLookupRegions[block->StartAddrLocal >> 27][(block->StartAddrLocal & 0x7FFFFFF) / 2];
+            if (((u32)*entry >> ARMJIT_Global::CodeSegmentShift) == victim)
+                *entry = (u64)UINT32_MAX << 32;
+
+            TraceMapOp(block->Num, JitMapOp::Erase, addr);
+            EvictedBlocks.insert(((u64)block->Num << 32) | block->StartAddr);
+            delete block;
+            evicted++;
+            return true;
+        });
+    }
+
+    RestoreCandidates.EraseIf([&](u32 hash, JitBlock* block)
+    {
+        if (!inVictim(block))
+            return false;
+
+        TraceMapOp(JitMapOp::RestoreCandidates, JitMapOp::Erase, hash);
         delete block;
+        return true;
+    });
+
+    // empty segments are only filled for the first time
+    if (SegmentLastUse[victim])
+    {
+        Stats.SegmentsEvicted++;
+        Stats.BlocksEvicted += evicted;
     }
-    JitBlocks9.clear();
-    JitBlocks7.clear();
 
-    JITCompiler.Reset();
+    CodeEpoch++;
+    SegmentLastUse[victim] = CodeEpoch;
+    JITCompiler.StartCodeSegment(victim);
 }
 
 void ARMJIT::JitEnableWrite() noexcept
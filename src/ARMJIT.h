@@ -22,10 +22,80 @@
 #include <algorithm>
 #include <optional>
 #include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
 #include "types.h"
 #include "MemConstants.h"
 #include "Args.h"
 #include "ARMJIT_Memory.h"
+#include "FlatHashMap.h"
+
+namespace melonDS
+{
+/// Counters for the JIT block cache,
+/// kept for as long as the JIT exists.
+struct ARMJITStats
+{
+    u64 BlocksCompiled;
+
+    /// Blocks that were invalidated, then found unchanged
+    /// and put back without compiling them again.
+    u64 BlocksRestored;
+
+    /// Code segments that were thrown out to make room for new code.
+    u64 SegmentsEvicted;
+
+    /// Blocks that were thrown out with their code segment.
+    u64 BlocksEvicted;
+
+    /// Evicted blocks that were needed again and had to be recompiled.
+    u64 BlocksRecompiled;
+
+    /// Times the whole block cache was thrown out,
+    /// which also happens when the console is reset.
+    u64 CacheResets;
+
+    /// Blocks which were taken from the code cache
+    /// instead of being compiled.
+    u64 BlocksLoaded;
+
+    /// Blocks which were run often enough to be compiled
+    /// again as superblocks (see JITArgs::Superblocks).
+    /// Also counted in BlocksCompiled or BlocksLoaded.
+    u64 SuperblocksCompiled;
+
+    /// Blocks which were compiled in the background
+    /// (see JITArgs::AsyncCompile). Also counted in BlocksCompiled.
+    u64 BlocksCompiledAsync;
+
+    /// Times a block was looked up and run. Every block returns to the
+    /// dispatcher, so fewer dispatches for the same work means longer blocks.
+    u64 BlocksDispatched;
+};
+
+/// An operation on one of the JIT's block maps, see ARMJIT::MapTrace.
+struct JitMapOp
+{
+    enum : u8
+    {
+        JitBlocks9,
+        JitBlocks7,
+        RestoreCandidates,
+    };
+    enum : u8
+    {
+        Find,
+        Insert,
+        Erase,
+        Clear,
+    };
+
+    u8 Map;
+    u8 Op;
+    u32 Key;
+};
+}
 
 #ifdef JIT_ENABLED
 #include "JitBlock.h"
@@ -35,10 +105,14 @@
 #endif
 
 #include "ARMJIT_Compiler.h"
+#include "ARMJIT_Global.h"
+#include "ARMJIT_CodeCache.h"
+#include "ARMJIT_AsyncCompiler.h"
 
 namespace melonDS
 {
 class ARM;
+struct DecodedPage;
 
 class JitBlock;
 class ARMJIT
@@ -49,11 +123,17 @@ public:
     void InvalidateByAddr(u32) noexcept;
     void CheckAndInvalidateWVRAM(int) noexcept;
     void CheckAndInvalidateITCM() noexcept;
+    /// Invalidates the blocks which have code in a part of one of the memory regions.
+    void CheckAndInvalidateRange(int region, u32 offset, u32 size) noexcept;
     void Reset() noexcept;
     void JitEnableWrite() noexcept;
     void JitEnableExecute() noexcept;
     void CompileBlock(ARM* cpu) noexcept;
     void ResetBlockCache() noexcept;
+    /// Called by the compiler when the code segment it's writing to is full.
+    /// Throws out the least recently used other segment with all of its
+    /// blocks and makes it the one to compile into next.
+    void EvictCodeSegment() noexcept;
 
     template <u32 num, int region>
     void CheckAndInvalidate(u32 addr) noexcept
@@ -66,12 +146,67 @@ public:
     bool SetupExecutableRegion(u32 num, u32 blockAddr, u64*& entry, u32& start, u32& size) noexcept;
     u32 LocaliseCodeAddress(u32 num, u32 addr) const noexcept;
 
+    /// The interpreter's decoded instructions for the 512 bytes at addr,
+    /// created if there are none yet. NULL while the JIT is enabled or if
+    /// addr isn't in code memory which is kept track of.
+    DecodedPage* GetDecodedPage(u32 num, u32 addr) noexcept;
+    /// Adds an instruction decoded into page to the code index,
+    /// so that it's dropped again once it's written to.
+    void AddDecodedInstr(DecodedPage* page, u32 addr) noexcept;
+    /// Throws out all of the interpreter's decoded instructions.
+    void ResetDecodedPages() noexcept;
+
+    /// Replaces the blocks in the code cache with the ones saved in a file.
+    /// @return false if the file doesn't exist, or was written by a
+    /// different build of melonDS or on a different CPU.
+    bool LoadCodeCache(const std::string& path) noexcept;
+    /// Saves the blocks in the code cache to a file.
+    bool SaveCodeCache(const std::string& path) noexcept;
+
     ARMJIT_Memory Memory;
+    ARMJITStats Stats {};
 private:
+    void RemoveFromCodeIndex(JitBlock* block) noexcept;
+    void TraceMapOp(u8 map, u8 op, u32 key) noexcept
+    {
+        if (MapTrace)
+            MapTrace->push_back({map, op, key});
+    }
+    // returns NULL if the block was queued to be compiled in the background
+    JitBlockEntry CompileOrLoad(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemoryInstr, JitBlock* block, bool& loaded, bool queue) noexcept;
+    u32 CompileContextHash(ARM* cpu, bool thumb, const FetchedInstr instrs[], int instrsCount) const noexcept;
+    void AddToCodeCache(CachedBlock&& captured, const JitBlock* block, u32 contextHash) noexcept;
+    void UpdateAsyncCompiler() noexcept;
+    void PollAsyncCompiler() noexcept;
+    void InstallAsyncBlock(AsyncCompiler::Job& job) noexcept;
+
     int MaxBlockSize {};
     bool LiteralOptimizations = false;
     bool BranchOptimizations = false;
     bool FastMemory = false;
+    bool CodeCaching = false;
+    JITPerfMap PerfMap = JITPerfMap::None;
+    bool Superblocks = false;
+    CodeCache CachedCode {};
+
+    // superblocks can be this many times longer than MaxBlockSize
+    static constexpr int SuperblockScale = 4;
+    // how often a block has to be looked up before it's grown into a superblock
+    static constexpr u16 HotBlockThreshold = 1024;
+    static constexpr u32 BlockHeatSize = 4096;
+    // lookup counters for the blocks, by guest address
+    // there are a lot less of them than there are blocks, so they're shared
+    u16 BlockHeat[2][BlockHeatSize] {};
+    // the block LookUpBlock asked CompileBlock to replace
+    JitBlock* HotBlock = nullptr;
+
+    bool AsyncCompilation = false;
+    std::unique_ptr<AsyncCompiler> Async {};
+    // blocks which are being compiled in the background, by (Num << 32) | StartAddr
+    // they're already in the code index, but not in the block maps yet
+    std::unordered_set<u64> QueuedBlocks {};
+    // blocks which couldn't be compiled in the background, by (Num << 32) | StartAddr
+    std::unordered_set<u64> AsyncFailed {};
 
 public:
     melonDS::NDS& NDS;
@@ -84,6 +219,10 @@ public:
     bool LiteralOptimizationsEnabled() const noexcept { return LiteralOptimizations; }
     bool BranchOptimizationsEnabled() const noexcept { return BranchOptimizations; }
     bool FastMemoryEnabled() const noexcept { return FastMemory; }
+    bool CodeCacheEnabled() const noexcept { return CodeCaching; }
+    JITPerfMap GetPerfMap() const noexcept { return PerfMap; }
+    bool SuperblocksEnabled() const noexcept { return Superblocks; }
+    bool AsyncCompileEnabled() const noexcept { return Async != nullptr; }
 
     void SetJITArgs(JITArgs args) noexcept;
     void SetMaxBlockSize(int size) noexcept;
@@ -92,10 +231,25 @@ public:
     void SetFastMemory(bool enabled) noexcept;
 
     Compiler JITCompiler;
-    std::unordered_map<u32, JitBlock*> JitBlocks9 {};
-    std::unordered_map<u32, JitBlock*> JitBlocks7 {};
+    FlatHashMap<JitBlock> JitBlocks9 {};
+    FlatHashMap<JitBlock> JitBlocks7 {};
+
+    // retired blocks, by instruction hash
+    FlatHashMap<JitBlock> RestoreCandidates {};
+
+    // the interpreter's decoded instructions for each CPU, by local address
+    FlatHashMap<DecodedPage> DecodedPages[2] {};
+
+    /// When set, every operation on the three maps above is appended to it.
+    /// Used by melonDS-bench to replay the same operations on other containers.
+    std::vector<JitMapOp>* MapTrace = nullptr;
 
-    std::unordered_map<u32, JitBlock*> RestoreCandidates {};
+    // the epoch is advanced every time a segment is evicted,
+    // a segment is stamped with it whenever a block in it is looked up
+    u32 SegmentLastUse[ARMJIT_Global::MaxCodeSegments] {};
+    u32 CodeEpoch = 1;
+    // blocks which were evicted, by (Num << 32) | StartAddr
+    std::unordered_set<u64> EvictedBlocks {};
 
 
     AddressRange CodeIndexITCM[ITCMPhysicalSize / 512] {};
@@ -189,15 +343,21 @@ public:
     void InvalidateByAddr(u32) noexcept {}
     void CheckAndInvalidateWVRAM(int) noexcept {}
     void CheckAndInvalidateITCM() noexcept {}
+    void CheckAndInvalidateRange(int, u32, u32) noexcept {}
     void Reset() noexcept {}
     void JitEnableWrite() noexcept {}
     void JitEnableExecute() noexcept {}
     void CompileBlock(ARM*) noexcept {}
     void ResetBlockCache() noexcept {}
+    void ResetDecodedPages() noexcept {}
     template <u32, int>
     void CheckAndInvalidate(u32 addr) noexcept {}
+    bool LoadCodeCache(const std::string&) noexcept { return false; }
+    bool SaveCodeCache(const std::string&) noexcept { return false; }
+    bool CodeCacheEnabled() const noexcept { return false; }
 
     ARMJIT_Memory Memory;
+    ARMJITStats Stats {};
 };
 }
 #endif // JIT_ENABLED
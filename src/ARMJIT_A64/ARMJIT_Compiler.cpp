@@ -23,6 +23,7 @@
 #include "../ARMJIT.h"
 #include "../NDS.h"
 #include "../ARMJIT_Global.h"
+#include "../ARMJIT_PerfMap.h"
 
 #include <stdlib.h>
 
@@ -358,15 +359,8 @@ Compiler::Compiler(melonDS::NDS& nds) : Arm64Gen::ARM64XEmitter(), NDS(nds)
                         continue;
                     ARM64Reg rdMapped = (ARM64Reg)reg;
                     PatchedStoreFuncs[consoleType][num][size][reg] = GetRXPtr();
-                    if (num == 0)
-                    {
-                        MOV(X1, RCPU);
-                        MOV(W2, rdMapped);
-                    }
-                    else
-                    {
-                        MOV(W1, rdMapped);
-                    }
+                    MOV(X1, RCPU);
+                    MOV(W2, rdMapped);
                     ABI_PushRegisters(BitSet32({30}) | CallerSavedPushRegs);
                     if (consoleType == 0)
                     {
@@ -399,8 +393,7 @@ Compiler::Compiler(melonDS::NDS& nds) : Arm64Gen::ARM64XEmitter(), NDS(nds)
                     for (int signextend = 0; signextend < 2; signextend++)
                     {
                         PatchedLoadFuncs[consoleType][num][size][signextend][reg] = GetRXPtr();
-                        if (num == 0)
-                            MOV(X1, RCPU);
+                        MOV(X1, RCPU);
                         ABI_PushRegisters(BitSet32({30}) | CallerSavedPushRegs);
                         if (consoleType == 0)
                         {
@@ -442,10 +435,13 @@ Compiler::Compiler(melonDS::NDS& nds) : Arm64Gen::ARM64XEmitter(), NDS(nds)
 
     FlushIcache();
 
-    JitMemSecondarySize = 1024*1024*4;
-
-    JitMemMainSize -= GetCodeOffset();
-    JitMemMainSize -= JitMemSecondarySize;
+    // roughly 4MB go to the secondary region, the main region is
+    // rounded down to whole segments
+    u32 available = JitMemMainSize - GetCodeOffset();
+    NumCodeSegments = std::min((available - 1024*1024*4) >> ARMJIT_Global::CodeSegmentShift, ARMJIT_Global::MaxCodeSegments);
+    JitMemMainSize = NumCodeSegments << ARMJIT_Global::CodeSegmentShift;
+    JitMemSecondarySize = available - JitMemMainSize;
+    SecondarySegmentSize = (JitMemSecondarySize / NumCodeSegments) & ~3;
 
     SetCodeBase((u8*)GetRWPtr(), (u8*)GetRXPtr());
 }
@@ -675,18 +671,15 @@ void Compiler::Comp_BranchSpecialBehaviour(bool taken)
 
 JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemInstr)
 {
-    if (JitMemMainSize - GetCodeOffset() < 1024 * 16)
-    {
-        Log(LogLevel::Debug, "JIT near memory full, resetting...\n");
-        NDS.JIT.ResetBlockCache();
-    }
-    if ((JitMemMainSize +  JitMemSecondarySize) - OtherCodeRegion < 1024 * 8)
-    {
-        Log(LogLevel::Debug, "JIT far memory full, resetting...\n");
-        NDS.JIT.ResetBlockCache();
-    }
+    ptrdiff_t mainEnd = (ptrdiff_t)(CurCodeSegment + 1) << ARMJIT_Global::CodeSegmentShift;
+    ptrdiff_t secondaryEnd = JitMemMainSize + (CurCodeSegment + 1) * SecondarySegmentSize;
+    // superblocks can be longer than 32 instructions
+    int room = std::max(instrsCount, 32);
+    if (mainEnd - GetCodeOffset() < 512 * room || secondaryEnd - OtherCodeRegion < 256 * room)
+        NDS.JIT.EvictCodeSegment();
 
     JitBlockEntry res = (JitBlockEntry)GetRXPtr();
+    ptrdiff_t secondaryStart = OtherCodeRegion;
 
     Thumb = thumb;
     Num = cpu->Num;
@@ -825,6 +818,10 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
 
     FlushIcache();
 
+    ARMJIT_PerfMap::AddBlock(NDS.JIT.GetPerfMap(), Num, Thumb, instrs[0].Addr,
+        (void*)res, (u8*)GetRXPtr() - (u8*)res,
+        GetRXBase() + secondaryStart, OtherCodeRegion - secondaryStart);
+
     return res;
 }
 
@@ -834,17 +831,55 @@ void Compiler::Reset()
 
     SetCodePtr(0);
     OtherCodeRegion = JitMemMainSize;
+    CurCodeSegment = 0;
 
     const u32 brk_0 = 0xD4200000;
 
     for (int i = 0; i < (JitMemMainSize + JitMemSecondarySize) / 4; i++)
         *(((u32*)GetRWPtr()) + i) = brk_0;
+
+    // the stubs never change, they only need to be named once
+    if (NDS.JIT.GetPerfMap() != StubsPerfMap)
+    {
+        StubsPerfMap = NDS.JIT.GetPerfMap();
+        ARMJIT_PerfMap::AddCode(StubsPerfMap, CodeMemBase, GetRXBase() - (u8*)CodeMemBase, "melonDS_JIT_stubs");
+    }
+}
+
+void Compiler::StartCodeSegment(u32 segment)
+{
+    u32 mainSegmentSize = 1 << ARMJIT_Global::CodeSegmentShift;
+    ptrdiff_t mainStart = (ptrdiff_t)segment * mainSegmentSize;
+    ptrdiff_t secondaryStart = JitMemMainSize + (ptrdiff_t)segment * SecondarySegmentSize;
+
+    for (auto it = LoadStorePatches.begin(); it != LoadStorePatches.end();)
+    {
+        if (it->first >= mainStart && it->first < mainStart + mainSegmentSize)
+            it = LoadStorePatches.erase(it);
+        else
+            it++;
+    }
+
+    const u32 brk_0 = 0xD4200000;
+
+    SetCodePtr(secondaryStart);
+    for (u32 i = 0; i < SecondarySegmentSize / 4; i++)
+        *(((u32*)GetRWPtr()) + i) = brk_0;
+    FlushIcacheSection(GetRXBase() + secondaryStart, GetRXBase() + secondaryStart + SecondarySegmentSize);
+
+    SetCodePtr(mainStart);
+    for (u32 i = 0; i < mainSegmentSize / 4; i++)
+        *(((u32*)GetRWPtr()) + i) = brk_0;
+    FlushIcacheSection(GetRXBase() + mainStart, GetRXBase() + mainStart + mainSegmentSize);
+
+    OtherCodeRegion = secondaryStart;
+    CurCodeSegment = segment;
 }
 
 void Compiler::Comp_AddCycles_C(bool forceNonConstant)
 {
     s32 cycles = Num ?
-        NDS.ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 1 : 3]
+        CurInstr.CodeTimings[Thumb ? 1 : 3]
         : ((R15 & 0x2) ? 0 : CurInstr.CodeCycles);
 
     if (forceNonConstant)
@@ -858,7 +893,7 @@ void Compiler::Comp_AddCycles_CI(u32 numI)
     IrregularCycles = true;
 
     s32 cycles = (Num ?
-        NDS.ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 0 : 2]
+        CurInstr.CodeTimings[Thumb ? 0 : 2]
         : ((R15 & 0x2) ? 0 : CurInstr.CodeCycles)) + numI;
 
     if (Thumb || CurInstr.Cond() == 0xE)
@@ -872,7 +907,7 @@ void Compiler::Comp_AddCycles_CI(u32 c, ARM64Reg numI, ArithOption shift)
     IrregularCycles = true;
 
     s32 cycles = (Num ?
-        NDS.ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 0 : 2]
+        CurInstr.CodeTimings[Thumb ? 0 : 2]
         : ((R15 & 0x2) ? 0 : CurInstr.CodeCycles)) + c;
 
     ADD(RCycles, RCycles, cycles);
@@ -892,7 +927,7 @@ void Compiler::Comp_AddCycles_CDI()
 
         s32 cycles;
 
-        s32 numC = NDS.ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 0 : 2];
+        s32 numC = CurInstr.CodeTimings[Thumb ? 0 : 2];
         s32 numD = CurInstr.DataCycles;
 
         if ((CurInstr.DataRegion >> 24) == 0x02) // mainRAM
@@ -937,7 +972,7 @@ void Compiler::Comp_AddCycles_CD()
     }
     else
     {
-        s32 numC = NDS.ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 0 : 2];
+        s32 numC = CurInstr.CodeTimings[Thumb ? 0 : 2];
         s32 numD = CurInstr.DataCycles;
 
         if ((CurInstr.DataRegion >> 24) == 0x02)
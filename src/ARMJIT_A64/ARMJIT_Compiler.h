@@ -27,12 +27,15 @@
 
 #include "../ARMJIT_Internal.h"
 #include "../ARMJIT_RegisterCache.h"
+#include "../ARMJIT_CodeCache.h"
+#include "../Args.h"
 
 #include <unordered_map>
 
 namespace melonDS
 {
 class ARMJIT;
+class AsyncCompiler;
 const Arm64Gen::ARM64Reg RMemBase = Arm64Gen::X26;
 const Arm64Gen::ARM64Reg RCPSR = Arm64Gen::W27;
 const Arm64Gen::ARM64Reg RCycles = Arm64Gen::W28;
@@ -112,6 +115,16 @@ public:
 
     JitBlockEntry CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemInstr);
 
+    // the code isn't relocatable yet, so nothing is put into the code cache
+    bool CanCacheCode() const { return false; }
+    u64 GetCodeFingerprint() const { return 0; }
+    JitBlockEntry LoadBlock(const CachedBlock& block, bool thumb) { return nullptr; }
+    bool ReplayProbes(ARM* cpu, const std::vector<CompileProbe>& probes) { return false; }
+    void RunProbeFor(ARM* cpu, CompileProbe& probe) {}
+    CachedBlock* Capture = nullptr;
+    // blocks can't be compiled in the background for the same reason
+    AsyncCompiler* Async = nullptr;
+
     bool CanCompile(bool thumb, u16 kind);
 
     bool FlagsNZNeeded() const
@@ -121,6 +134,11 @@ public:
 
     void Reset();
 
+    u32 GetNumCodeSegments() const { return NumCodeSegments; }
+    u32 GetCurCodeSegment() const { return CurCodeSegment; }
+    // throws out everything in the given code segment and continues compiling there
+    void StartCodeSegment(u32 segment);
+
     void Comp_AddCycles_C(bool forceNonConstant = false);
     void Comp_AddCycles_CI(u32 numI);
     void Comp_AddCycles_CI(u32 c, Arm64Gen::ARM64Reg numI, Arm64Gen::ArithOption shift);
@@ -262,6 +280,11 @@ public:
     u32 JitMemSecondarySize;
     u32 JitMemMainSize;
 
+    // each segment has 2MB of the main region and an equal share of the secondary one
+    u32 NumCodeSegments;
+    u32 CurCodeSegment = 0;
+    u32 SecondarySegmentSize;
+
     std::unordered_map<ptrdiff_t, LoadStorePatch> LoadStorePatches; 
 
     RegisterCache<Compiler, Arm64Gen::ARM64Reg> RegCache;
@@ -276,6 +299,7 @@ public:
     void* JitRXStart;
 #endif
     void* CodeMemBase;
+    JITPerfMap StubsPerfMap = JITPerfMap::None;
 
     void* ReadBanked, *WriteBanked;
 
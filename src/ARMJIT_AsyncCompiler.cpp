@@ -0,0 +1,203 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "ARMJIT_AsyncCompiler.h"
+#include "ARMJIT_Compiler.h"
+
+namespace melonDS
+{
+using namespace Platform;
+
+AsyncCompiler::AsyncCompiler(melonDS::NDS& nds) noexcept
+{
+    Worker = std::make_unique<Compiler>(nds);
+    Worker->Async = this;
+
+    Lock = Mutex_Create();
+    WorkSema = Semaphore_Create();
+    DoneSema = Semaphore_Create();
+    ProbeSema = Semaphore_Create();
+}
+
+AsyncCompiler::~AsyncCompiler()
+{
+    if (Thread)
+    {
+        Mutex_Lock(Lock);
+        Stopping = true;
+        Aborting = true;
+        if (PendingProbe)
+        {
+            PendingProbe = nullptr;
+            Semaphore_Post(ProbeSema);
+        }
+        Mutex_Unlock(Lock);
+        Semaphore_Post(WorkSema);
+
+        Thread_Wait(Thread);
+        Thread_Free(Thread);
+    }
+
+    Semaphore_Free(ProbeSema);
+    Semaphore_Free(DoneSema);
+    Semaphore_Free(WorkSema);
+    Mutex_Free(Lock);
+}
+
+u64 AsyncCompiler::GetCodeFingerprint() const noexcept
+{
+    return Worker->GetCodeFingerprint();
+}
+
+void AsyncCompiler::UpdateWork() noexcept
+{
+    Work.store(PendingProbe || !Finished.empty(), std::memory_order_relaxed);
+}
+
+bool AsyncCompiler::Queue(Job&& job) noexcept
+{
+    if (!Thread)
+        Thread = Thread_Create([this]() { ThreadFunc(); });
+
+    Mutex_Lock(Lock);
+    bool full = Jobs.size() + Finished.size() + Compiling >= MaxQueuedJobs;
+    if (!full)
+        Jobs.push_back(std::move(job));
+    Mutex_Unlock(Lock);
+
+    if (full)
+        return false;
+
+    Semaphore_Post(WorkSema);
+    return true;
+}
+
+void AsyncCompiler::Poll(Compiler& compiler, std::vector<Job>& finished) noexcept
+{
+    Mutex_Lock(Lock);
+    if (PendingProbe)
+    {
+        compiler.RunProbeFor(ProbeCPU, *PendingProbe);
+        PendingProbe = nullptr;
+        Semaphore_Post(ProbeSema);
+    }
+
+    for (Job& job : Finished)
+        finished.push_back(std::move(job));
+    Finished.clear();
+
+    UpdateWork();
+    Mutex_Unlock(Lock);
+}
+
+std::vector<AsyncCompiler::Job> AsyncCompiler::Cancel() noexcept
+{
+    std::vector<Job> jobs;
+
+    Mutex_Lock(Lock);
+    Aborting = true;
+    if (PendingProbe)
+    {
+        PendingProbe = nullptr;
+        Semaphore_Post(ProbeSema);
+    }
+    for (Job& job : Jobs)
+        jobs.push_back(std::move(job));
+    Jobs.clear();
+    Semaphore_Reset(DoneSema);
+    Mutex_Unlock(Lock);
+
+    // the block which is being compiled can't be stopped halfway,
+    // but it won't wait for any lookups anymore
+    for (;;)
+    {
+        Mutex_Lock(Lock);
+        bool idle = !Compiling;
+        Mutex_Unlock(Lock);
+
+        if (idle) break;
+        Semaphore_Wait(DoneSema);
+    }
+
+    Mutex_Lock(Lock);
+    for (Job& job : Finished)
+        jobs.push_back(std::move(job));
+    Finished.clear();
+    Aborting = false;
+    UpdateWork();
+    Mutex_Unlock(Lock);
+
+    return jobs;
+}
+
+void AsyncCompiler::RunProbe(ARM* cpu, CompileProbe& probe) noexcept
+{
+    Mutex_Lock(Lock);
+    if (Aborting)
+    {
+        // the results stay zero, the block is dropped anyway
+        Mutex_Unlock(Lock);
+        return;
+    }
+    ProbeCPU = cpu;
+    PendingProbe = &probe;
+    UpdateWork();
+    Mutex_Unlock(Lock);
+
+    Semaphore_Wait(ProbeSema);
+}
+
+void AsyncCompiler::ThreadFunc() noexcept
+{
+    for (;;)
+    {
+        Semaphore_Wait(WorkSema);
+
+        Mutex_Lock(Lock);
+        if (Stopping)
+        {
+            Mutex_Unlock(Lock);
+            return;
+        }
+        if (Jobs.empty())
+        {
+            // the job was cancelled
+            Mutex_Unlock(Lock);
+            continue;
+        }
+
+        Job job = std::move(Jobs.front());
+        Jobs.pop_front();
+        Compiling = true;
+        Mutex_Unlock(Lock);
+
+        Worker->Capture = &job.Result;
+        Worker->CompileBlock(job.CPU, job.Thumb, job.Instrs.data(), (int)job.Instrs.size(), job.HasMemoryInstr);
+        Worker->Capture = nullptr;
+
+        Mutex_Lock(Lock);
+        Compiling = false;
+        Finished.push_back(std::move(job));
+        UpdateWork();
+        Mutex_Unlock(Lock);
+
+        Semaphore_Post(DoneSema);
+    }
+}
+
+}
@@ -0,0 +1,123 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef ARMJIT_ASYNCCOMPILER_H
+#define ARMJIT_ASYNCCOMPILER_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+#include "types.h"
+#include "ARMJIT_Internal.h"
+#include "ARMJIT_CodeCache.h"
+#include "Platform.h"
+
+namespace melonDS
+{
+class ARM;
+class Compiler;
+class NDS;
+
+/// Compiles blocks on a thread of its own (see JITArgs::AsyncCompile).
+///
+/// The compiler thread has a compiler of its own, which puts every block
+/// into the form used by the code cache, so that it can be loaded into the
+/// code memory the blocks are run from once it's done. The timings of the
+/// instructions are copied into the job along with them (see
+/// FetchedInstr::CodeTimings), whatever else the compiler looks up about
+/// the emulated console (see CompileProbe) is looked up on the emulation
+/// thread, in between two blocks.
+class AsyncCompiler
+{
+public:
+    struct Job
+    {
+        JitBlock* Block;
+        ARM* CPU;
+        bool Thumb;
+        bool HasMemoryInstr;
+        /// See ARMJIT::CompileContextHash, for checking that nothing
+        /// the compiler thread went by changed in the meantime.
+        u32 ContextHash;
+        std::vector<FetchedInstr> Instrs;
+
+        /// Left empty if the block couldn't be compiled into a form
+        /// which can be loaded.
+        CachedBlock Result;
+    };
+
+    /// Blocks queued at once, any more are compiled right away.
+    static constexpr u32 MaxQueuedJobs = 256;
+
+    explicit AsyncCompiler(melonDS::NDS& nds) noexcept;
+    ~AsyncCompiler();
+    AsyncCompiler(const AsyncCompiler&) = delete;
+    AsyncCompiler& operator=(const AsyncCompiler&) = delete;
+
+    /// The compiler thread's compiler, the code it generates
+    /// can only be used if this matches the one of the main compiler.
+    u64 GetCodeFingerprint() const noexcept;
+
+    /// @return false if too many blocks are queued already.
+    bool Queue(Job&& job) noexcept;
+
+    /// Whether Poll has anything to do.
+    /// Cheap enough to be checked in between every two blocks.
+    bool HasWork() const noexcept { return Work.load(std::memory_order_relaxed); }
+
+    /// Does the lookup the compiler thread is waiting for, if there is one,
+    /// and takes the jobs which were finished.
+    /// Has to be called on the emulation thread, in between two blocks.
+    void Poll(Compiler& compiler, std::vector<Job>& finished) noexcept;
+
+    /// Drops every job, including the one being compiled.
+    /// @return The jobs, so that their blocks can be freed.
+    std::vector<Job> Cancel() noexcept;
+
+    /// Called by the compiler thread's compiler instead of running a lookup itself.
+    void RunProbe(ARM* cpu, CompileProbe& probe) noexcept;
+
+private:
+    void ThreadFunc() noexcept;
+    void UpdateWork() noexcept;
+
+    std::unique_ptr<Compiler> Worker;
+
+    Platform::Thread* Thread = nullptr;
+    Platform::Mutex* Lock;
+    Platform::Semaphore* WorkSema;
+    Platform::Semaphore* DoneSema;
+    Platform::Semaphore* ProbeSema;
+
+    std::atomic<bool> Work = false;
+
+    // all of these are protected by Lock
+    std::deque<Job> Jobs;
+    std::vector<Job> Finished;
+    bool Compiling = false;
+    bool Stopping = false;
+    // set while cancelling, lookups are skipped since the code is thrown away
+    bool Aborting = false;
+    ARM* ProbeCPU = nullptr;
+    CompileProbe* PendingProbe = nullptr;
+};
+
+}
+
+#endif // ARMJIT_ASYNCCOMPILER_H
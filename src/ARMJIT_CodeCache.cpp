@@ -0,0 +1,371 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <string.h>
+#include "ARMJIT_CodeCache.h"
+#include "LZ.h"
+#include "Platform.h"
+
+namespace melonDS
+{
+using namespace Platform;
+
+/*
+    File format
+
+    * magic "MELNJITC"
+    * u32 format version
+    * u32 number of blocks
+    * u64 fingerprint of the code outside of blocks
+    * u32 size of the block data
+    * u32 size of the block data once compressed
+    * the block data, compressed with LZCompress
+
+    All values are in host byte order, a cache file is only ever
+    used on the machine which wrote it.
+*/
+
+static constexpr char Magic[8] = {'M', 'E', 'L', 'N', 'J', 'I', 'T', 'C'};
+static constexpr u32 Version = 1;
+static constexpr u32 HeaderSize = 8 + 4 + 4 + 8 + 4 + 4;
+
+// compiled code isn't much smaller than the code memory,
+// so this is plenty for one game
+static constexpr u32 MaxTotalSize = 64 * 1024 * 1024;
+
+// limits for reading a block, far beyond what the compiler generates
+static constexpr u32 MaxAddresses = 256;
+static constexpr u32 MaxProbes = 1024;
+static constexpr u32 MaxCodeSize = 1024 * 1024;
+
+// a block with nothing in it: the header, five empty vectors apart from
+// at least a byte of code, the near size and no relocs or patches
+static constexpr u32 MinBlockSize = 1 + 4 * 4 + 5 * 4 + 1 + 4 + 4 + 4;
+
+static void Put(std::vector<u8>& data, const void* src, u32 len)
+{
+    data.insert(data.end(), (const u8*)src, (const u8*)src + len);
+}
+
+template <typename T>
+static void Put(std::vector<u8>& data, T val)
+{
+    Put(data, &val, sizeof(T));
+}
+
+template <typename T>
+static void PutVector(std::vector<u8>& data, const std::vector<T>& vec)
+{
+    Put<u32>(data, (u32)vec.size());
+    Put(data, vec.data(), (u32)(vec.size() * sizeof(T)));
+}
+
+static void PutReloc(std::vector<u8>& data, const CachedReloc& reloc)
+{
+    Put(data, reloc.Site);
+    Put(data, reloc.Type);
+    Put(data, reloc.Base);
+    Put(data, reloc.Offset);
+}
+
+// reads from a buffer, failing once it would go past the end
+struct CacheReader
+{
+    const u8* Pos;
+    const u8* End;
+    bool Error = false;
+
+    bool Get(void* dst, u32 len)
+    {
+        if (Error || (u32)(End - Pos) < len)
+        {
+            Error = true;
+            return false;
+        }
+        memcpy(dst, Pos, len);
+        Pos += len;
+        return true;
+    }
+
+    template <typename T>
+    T Get()
+    {
+        T val {};
+        Get(&val, sizeof(T));
+        return val;
+    }
+
+    template <typename T>
+    bool GetVector(std::vector<T>& vec, u32 maxlen)
+    {
+        u32 len = Get<u32>();
+        if (Error || len > maxlen || len > (u32)(End - Pos) / sizeof(T))
+        {
+            Error = true;
+            return false;
+        }
+        vec.resize(len);
+        return Get(vec.data(), len * sizeof(T));
+    }
+
+    bool GetReloc(CachedReloc& reloc, u32 codeSize)
+    {
+        reloc.Site = Get<u32>();
+        reloc.Type = Get<u8>();
+        reloc.Base = Get<u8>();
+        reloc.Offset = Get<s64>();
+        if (reloc.Site >= codeSize || reloc.Type >= CachedReloc::NumTypes
+            || reloc.Base >= CachedReloc::Base_Count)
+            Error = true;
+        return !Error;
+    }
+};
+
+static bool ReadBlock(CacheReader& in, CachedBlock& block)
+{
+    block.Num = in.Get<u8>();
+    block.StartAddr = in.Get<u32>();
+    block.InstrHash = in.Get<u32>();
+    block.LiteralHash = in.Get<u32>();
+    block.ContextHash = in.Get<u32>();
+    if (block.Num > 1)
+        return false;
+
+    if (!in.GetVector(block.AddressRanges, MaxAddresses)
+        || !in.GetVector(block.AddressMasks, MaxAddresses)
+        || !in.GetVector(block.Literals, MaxAddresses)
+        || !in.GetVector(block.Probes, MaxProbes)
+        || !in.GetVector(block.Code, MaxCodeSize))
+        return false;
+    if (block.AddressRanges.size() != block.AddressMasks.size())
+        return false;
+
+    u32 codeSize = (u32)block.Code.size();
+    block.NearSize = in.Get<u32>();
+    if (in.Error || block.NearSize == 0 || block.NearSize > codeSize)
+        return false;
+
+    u32 numRelocs = in.Get<u32>();
+    if (in.Error || numRelocs > codeSize)
+        return false;
+    block.Relocs.resize(numRelocs);
+    for (CachedReloc& reloc : block.Relocs)
+    {
+        // the whole field has to be inside of the code, not just its start
+        if (!in.GetReloc(reloc, codeSize) || codeSize - reloc.Site < CachedReloc::FieldSizes[reloc.Type])
+            return false;
+    }
+
+    u32 numPatches = in.Get<u32>();
+    if (in.Error || numPatches > block.NearSize)
+        return false;
+    block.Patches.resize(numPatches);
+    for (CachedPatch& patch : block.Patches)
+    {
+        patch.Site = in.Get<u32>();
+        patch.Offset = in.Get<s16>();
+        patch.Size = in.Get<u16>();
+        if (!in.GetReloc(patch.Func, codeSize) || patch.Site >= block.NearSize)
+            return false;
+    }
+
+    return !in.Error;
+}
+
+static void WriteBlock(std::vector<u8>& data, const CachedBlock& block)
+{
+    Put<u8>(data, block.Num);
+    Put(data, block.StartAddr);
+    Put(data, block.InstrHash);
+    Put(data, block.LiteralHash);
+    Put(data, block.ContextHash);
+
+    PutVector(data, block.AddressRanges);
+    PutVector(data, block.AddressMasks);
+    PutVector(data, block.Literals);
+    PutVector(data, block.Probes);
+    PutVector(data, block.Code);
+    Put(data, block.NearSize);
+
+    Put<u32>(data, (u32)block.Relocs.size());
+    for (const CachedReloc& reloc : block.Relocs)
+        PutReloc(data, reloc);
+
+    Put<u32>(data, (u32)block.Patches.size());
+    for (const CachedPatch& patch : block.Patches)
+    {
+        Put(data, patch.Site);
+        Put(data, patch.Offset);
+        Put(data, patch.Size);
+        PutReloc(data, patch.Func);
+    }
+}
+
+u32 CodeCache::Footprint(const CachedBlock& block)
+{
+    return sizeof(CachedBlock)
+        + (u32)block.Code.size()
+        + (u32)(block.AddressRanges.size() + block.AddressMasks.size() + block.Literals.size()) * 4
+        + (u32)block.Probes.size() * sizeof(CompileProbe)
+        + (u32)block.Relocs.size() * sizeof(CachedReloc)
+        + (u32)block.Patches.size() * sizeof(CachedPatch);
+}
+
+const CachedBlock* CodeCache::Find(u64 key) const
+{
+    auto it = Blocks.find(key);
+    return it != Blocks.end() ? &it->second : nullptr;
+}
+
+void CodeCache::Add(CachedBlock&& block)
+{
+    u64 key = Key(block.Num, block.StartAddr, block.InstrHash);
+    u32 size = Footprint(block);
+
+    auto it = Blocks.find(key);
+    if (it != Blocks.end())
+    {
+        TotalSize -= Footprint(it->second);
+        Blocks.erase(it);
+    }
+
+    if (TotalSize + size > MaxTotalSize)
+        return;
+
+    TotalSize += size;
+    Blocks.emplace(key, std::move(block));
+}
+
+void CodeCache::Clear()
+{
+    Blocks.clear();
+    TotalSize = 0;
+}
+
+bool CodeCache::Load(const std::string& path, u64 fingerprint)
+{
+    Clear();
+
+    FileHandle* file = OpenFile(path, FileMode::Read);
+    if (!file)
+        return false;
+
+    u64 length = FileLength(file);
+    u8 header[HeaderSize];
+    if (length < HeaderSize || FileRead(header, HeaderSize, 1, file) != 1)
+    {
+        CloseFile(file);
+        Log(LogLevel::Warn, "JIT code cache %s is truncated\n", path.c_str());
+        return false;
+    }
+
+    CacheReader in {header, header + HeaderSize};
+    char magic[8];
+    in.Get(magic, sizeof(magic));
+    u32 version = in.Get<u32>();
+    u32 numBlocks = in.Get<u32>();
+    u64 fileFingerprint = in.Get<u64>();
+    u32 rawSize = in.Get<u32>();
+    u32 compressedSize = in.Get<u32>();
+
+    if (memcmp(magic, Magic, sizeof(Magic)) != 0 || version != Version)
+    {
+        CloseFile(file);
+        Log(LogLevel::Warn, "JIT code cache %s has an unknown format\n", path.c_str());
+        return false;
+    }
+    if (fileFingerprint != fingerprint)
+    {
+        // written by a different build, or on a different CPU
+        CloseFile(file);
+        Log(LogLevel::Info, "JIT code cache %s doesn't match this build, ignoring it\n", path.c_str());
+        return false;
+    }
+    if (compressedSize != length - HeaderSize || rawSize > MaxTotalSize * 2
+        || numBlocks > rawSize / MinBlockSize)
+    {
+        CloseFile(file);
+        Log(LogLevel::Warn, "JIT code cache %s is corrupted\n", path.c_str());
+        return false;
+    }
+
+    std::vector<u8> compressed(compressedSize);
+    bool success = FileRead(compressed.data(), compressedSize, 1, file) == 1;
+    CloseFile(file);
+
+    std::vector<u8> data(rawSize);
+    success = success && LZDecompress(compressed.data(), compressedSize, data.data(), rawSize);
+
+    // a file which is corrupted anywhere is thrown out as a whole
+    std::vector<CachedBlock> blocks;
+    if (success)
+    {
+        in = CacheReader {data.data(), data.data() + rawSize};
+        blocks.resize(numBlocks);
+        for (u32 i = 0; i < numBlocks && success; i++)
+            success = ReadBlock(in, blocks[i]);
+        success = success && in.Pos == in.End;
+    }
+    if (!success)
+    {
+        Log(LogLevel::Warn, "JIT code cache %s is corrupted\n", path.c_str());
+        return false;
+    }
+
+    for (CachedBlock& block : blocks)
+        Add(std::move(block));
+
+    Log(LogLevel::Info, "Loaded %u blocks from JIT code cache %s\n", NumBlocks(), path.c_str());
+    return true;
+}
+
+bool CodeCache::Save(const std::string& path, u64 fingerprint) const
+{
+    std::vector<u8> data;
+    data.reserve(TotalSize);
+    for (auto& it : Blocks)
+        WriteBlock(data, it.second);
+
+    std::vector<u8> compressed(LZCompressBound((u32)data.size()));
+    u32 compressedSize = LZCompress(data.data(), (u32)data.size(), compressed.data(), (u32)compressed.size());
+
+    std::vector<u8> header;
+    Put(header, Magic, sizeof(Magic));
+    Put(header, Version);
+    Put<u32>(header, (u32)Blocks.size());
+    Put(header, fingerprint);
+    Put<u32>(header, (u32)data.size());
+    Put(header, compressedSize);
+
+    FileHandle* file = OpenFile(path, FileMode::Write);
+    if (!file)
+    {
+        Log(LogLevel::Error, "Failed to open JIT code cache %s for writing\n", path.c_str());
+        return false;
+    }
+
+    bool success = FileWrite(header.data(), header.size(), 1, file) == 1
+        && FileWrite(compressed.data(), compressedSize, 1, file) == 1;
+    CloseFile(file);
+
+    if (!success)
+        Log(LogLevel::Error, "Failed to write JIT code cache %s\n", path.c_str());
+    return success;
+}
+
+}
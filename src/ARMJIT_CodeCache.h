@@ -0,0 +1,162 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef ARMJIT_CODECACHE_H
+#define ARMJIT_CODECACHE_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "types.h"
+
+namespace melonDS
+{
+/// Something the compiler looked up while compiling a block which isn't
+/// covered by the instructions themselves, like the memory timings at a
+/// branch target. Before cached code is used, every lookup is done again
+/// in the same order (some of them have side effects, like filling the
+/// ARM9 instruction cache), and the code is only used if they all give
+/// the same results.
+struct CompileProbe
+{
+    enum : u32
+    {
+        /// Cycles taken by fetching the first instructions at a static branch target.
+        JumpTarget,
+        /// Memory region a load or store went to while the block was analysed.
+        ClassifyAddress,
+        /// Function handling a load or store to a static address.
+        FuncForAddr,
+        /// A literal which is put into the code as a constant.
+        Literal8,
+        Literal16,
+        Literal32,
+    };
+
+    u32 Kind;
+    u32 Args[2];
+    u32 Results[2];
+};
+
+/// A place in cached code which refers to something outside of the block.
+/// Relative branches within the same part of a block are left alone.
+struct CachedReloc
+{
+    /// What the target is relative to.
+    enum : u8
+    {
+        BlockNear,
+        BlockFar,
+        Stubs,
+        FastMem,
+        Binary,
+        Base_Count
+    };
+
+    /// Offset of the field into the code, near code first.
+    u32 Site;
+    /// How the field is encoded, depends on the architecture.
+    u8 Type;
+    u8 Base;
+    s64 Offset;
+
+    /// Bytes taken by the field for each Type, going by the x64 emitter's
+    /// CodeReloc::Type, as that's the only compiler which caches code.
+    static constexpr u8 FieldSizes[] = {1, 4, 4, 8};
+    static constexpr u32 NumTypes = sizeof(FieldSizes);
+};
+
+/// A fast memory access which is turned into a call when it faults.
+struct CachedPatch
+{
+    u32 Site;
+    s16 Offset;
+    u16 Size;
+    CachedReloc Func;
+};
+
+/// A compiled block, along with everything that needs to be the same
+/// for the code to be used again.
+struct CachedBlock
+{
+    u32 Num;
+    u32 StartAddr;
+    u32 InstrHash;
+    u32 LiteralHash;
+    /// Hash of the decoded instructions and compile settings, see ARMJIT::CompileContextHash.
+    u32 ContextHash;
+
+    std::vector<u32> AddressRanges;
+    std::vector<u32> AddressMasks;
+    std::vector<u32> Literals;
+    std::vector<CompileProbe> Probes;
+
+    /// The near code, followed by the far code.
+    std::vector<u8> Code;
+    u32 NearSize;
+    std::vector<CachedReloc> Relocs;
+    std::vector<CachedPatch> Patches;
+};
+
+/// Compiled blocks which can be loaded back into the code memory,
+/// so that they don't have to be compiled again.
+///
+/// Blocks are added as they are compiled and kept after they are thrown
+/// out of the code memory, so they can be put back after a reset or after
+/// their code segment was evicted. The cache can be saved to a file and
+/// loaded in a later session, which saves compiling the same code for
+/// every boot.
+class CodeCache
+{
+public:
+    static u64 Key(u32 num, u32 startAddr, u32 instrHash)
+    {
+        return ((u64)(startAddr | num) << 32) | instrHash;
+    }
+
+    /// @return The block with this key, or nullptr if there is none.
+    const CachedBlock* Find(u64 key) const;
+
+    /// Adds a block, replacing any with the same key.
+    /// Blocks are dropped once the cache is full.
+    void Add(CachedBlock&& block);
+
+    void Clear();
+
+    u32 NumBlocks() const { return (u32)Blocks.size(); }
+
+    /// Replaces the contents with what's in a file.
+    /// @param fingerprint Identifies the code the compiler generates
+    /// outside of blocks (stubs, functions in the binary, CPU features).
+    /// Files with a different one are ignored.
+    /// @return false if the file doesn't exist or can't be used,
+    /// in which case the cache is left empty.
+    bool Load(const std::string& path, u64 fingerprint);
+
+    bool Save(const std::string& path, u64 fingerprint) const;
+
+private:
+    static u32 Footprint(const CachedBlock& block);
+
+    std::unordered_map<u64, CachedBlock> Blocks;
+    u32 TotalSize = 0;
+};
+
+}
+
+#endif // ARMJIT_CODECACHE_H
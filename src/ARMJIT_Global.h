@@ -31,6 +31,12 @@ namespace ARMJIT_Global
 
 static constexpr size_t CodeMemorySliceSize = 1024*1024*32;
 
+// The code memory is split into segments of this size, which are filled
+// one after another. When the last free one is full, the least recently
+// used segment is thrown out along with the blocks in it.
+static constexpr u32 CodeSegmentShift = 21;
+static constexpr u32 MaxCodeSegments = CodeMemorySliceSize >> CodeSegmentShift;
+
 void Init();
 void DeInit();
 
@@ -49,6 +49,7 @@
 #include "SPU.h"
 
 #include <stdlib.h>
+#include <atomic>
 
 /*
     We're handling fastmem here.
@@ -111,6 +112,20 @@ using Platform::LogLevel;
 #define ASHMEM_DEVICE "/dev/ashmem"
 #endif
 
+/*
+    The fault handler is shared by the whole process, and may be invoked
+    on any thread that happens to be running an instance. Every instance
+    registers its fast memory areas here, so the handler can tell which
+    instance (and which CPU of it) an address belongs to without relying
+    on anything thread-local.
+
+    This has to be safe to read from inside a signal handler, so it's
+    a plain array of atomics. Slots are only cleared when an instance is
+    destroyed, at which point nothing can run its code anymore.
+*/
+static constexpr int MaxFastMemInstances = 1024;
+static std::atomic<ARMJIT_Memory*> FastMemInstances[MaxFastMemInstances] {};
+
 #if defined(__SWITCH__)
 // with LTO the symbols seem to be not properly overriden
 // if they're somewhere else
@@ -130,10 +145,7 @@ u64 __nx_exception_stack_size = 0x8000;
 
 void __libnx_exception_handler(ThreadExceptionDump* ctx)
 {
-    ARMJIT_Memory::FaultDescription desc;
-    u8* curArea = (u8*)(NDS::CurCPU == 0 ? ARMJIT_Memory::FastMem9Start : ARMJIT_Memory::FastMem7Start);
-    desc.EmulatedFaultAddr = (u8*)ctx->far.x - curArea;
-    desc.FaultPC = (u8*)ctx->pc.x;
+    u8* faultPC = (u8*)ctx->pc.x;
 
     u64 integerRegisters[33];
     memcpy(integerRegisters, &ctx->cpu_gprs[0].x, 8*29);
@@ -142,9 +154,9 @@ void __libnx_exception_handler(ThreadExceptionDump* ctx)
     integerRegisters[31] = ctx->sp.x;
     integerRegisters[32] = ctx->pc.x;
 
-    if (Melon::FaultHandler(desc))
+    if (ARMJIT_Memory::HandleFault((u8*)ctx->far.x, faultPC))
     {
-        integerRegisters[32] = (u64)desc.FaultPC;
+        integerRegisters[32] = (u64)faultPC;
 
         ARM_RestoreContext(integerRegisters);
     }
@@ -172,14 +184,11 @@ LONG ARMJIT_Memory::ExceptionHandler(EXCEPTION_POINTERS* exceptionInfo)
         return EXCEPTION_CONTINUE_SEARCH;
     }
 
-    u8* curArea = (u8*)(NDS::Current->CurCPU == 0 ? NDS::Current->JIT.Memory.FastMem9Start : NDS::Current->JIT.Memory.FastMem7Start);
-    FaultDescription desc {};
-    desc.EmulatedFaultAddr = (u8*)exceptionInfo->ExceptionRecord->ExceptionInformation[1] - curArea;
-    desc.FaultPC = (u8*)exceptionInfo->ContextRecord->CONTEXT_PC;
+    u8* faultPC = (u8*)exceptionInfo->ContextRecord->CONTEXT_PC;
 
-    if (FaultHandler(desc, *NDS::Current))
+    if (HandleFault((u8*)exceptionInfo->ExceptionRecord->ExceptionInformation[1], faultPC))
     {
-        exceptionInfo->ContextRecord->CONTEXT_PC = (u64)desc.FaultPC;
+        exceptionInfo->ContextRecord->CONTEXT_PC = (u64)faultPC;
         return EXCEPTION_CONTINUE_EXECUTION;
     }
 
@@ -207,15 +216,11 @@ void ARMJIT_Memory::SigsegvHandler(int sig, siginfo_t* info, void* rawContext)
 
     ucontext_t* context = (ucontext_t*)rawContext;
 
-    FaultDescription desc {};
-    u8* curArea = (u8*)(NDS::Current->CurCPU == 0 ? NDS::Current->JIT.Memory.FastMem9Start : NDS::Current->JIT.Memory.FastMem7Start);
+    u8* faultPC = (u8*)context->CONTEXT_PC;
 
-    desc.EmulatedFaultAddr = (u8*)info->si_addr - curArea;
-    desc.FaultPC = (u8*)context->CONTEXT_PC;
-
-    if (FaultHandler(desc, *NDS::Current))
+    if (HandleFault((u8*)info->si_addr, faultPC))
     {
-        context->CONTEXT_PC = (u64)desc.FaultPC;
+        context->CONTEXT_PC = (u64)faultPC;
         return;
     }
 
@@ -625,10 +630,8 @@ void ARMJIT_Memory::RemapSWRAM() noexcept
     Mappings[memregion_SharedWRAM].Clear();
 }
 
-bool ARMJIT_Memory::MapAtAddress(u32 addr) noexcept
+bool ARMJIT_Memory::MapAtAddress(u32 addr, u32 num) noexcept
 {
-    u32 num = NDS.CurCPU;
-
     int region = num == 0
         ? ClassifyAddress9(addr)
         : ClassifyAddress7(addr);
@@ -742,23 +745,23 @@ bool ARMJIT_Memory::IsFastMemSupported()
 #ifdef __APPLE__
     return false;
 #else
-    static bool initialised = false;
-    static bool isSupported = false;
-    if (!initialised)
+    // instances may be created on several threads at once
+    static const bool isSupported = []()
     {
+        bool supported;
 #ifdef _WIN32
         ARMJIT_Global::Init();
-        isSupported = virtualAlloc2Ptr != nullptr;
+        supported = virtualAlloc2Ptr != nullptr;
         ARMJIT_Global::DeInit();
 
         PageSize = RegularPageSize;
 #else
         PageSize = sysconf(_SC_PAGESIZE);
-        isSupported = PageSize == RegularPageSize || PageSize == LargePageSize;
+        supported = PageSize == RegularPageSize || PageSize == LargePageSize;
 #endif
         PageShift = __builtin_ctz(PageSize);
-        initialised = true;
-    }
+        return supported;
+    }();
     return isSupported;
 #endif
 }
@@ -814,19 +817,55 @@ void ARMJIT_Memory::UnregisterFaultHandler()
 #endif
 }
 
-bool ARMJIT_Memory::FaultHandler(FaultDescription& faultDesc, melonDS::NDS& nds)
+bool ARMJIT_Memory::HandleFault(u8* faultAddr, u8*& faultPC)
 {
-    if (nds.JIT.JITCompiler.IsJITFault(faultDesc.FaultPC))
+    for (int i = 0; i < MaxFastMemInstances; i++)
+    {
+        ARMJIT_Memory* memory = FastMemInstances[i].load(std::memory_order_acquire);
+        if (!memory)
+            continue;
+
+        FaultDescription desc {};
+        desc.FaultPC = faultPC;
+
+        u32 num;
+        if (faultAddr >= (u8*)memory->FastMem9Start && faultAddr < (u8*)memory->FastMem9Start + AddrSpaceSize)
+        {
+            num = 0;
+            desc.EmulatedFaultAddr = faultAddr - (u8*)memory->FastMem9Start;
+        }
+        else if (faultAddr >= (u8*)memory->FastMem7Start && faultAddr < (u8*)memory->FastMem7Start + AddrSpaceSize)
+        {
+            num = 1;
+            desc.EmulatedFaultAddr = faultAddr - (u8*)memory->FastMem7Start;
+        }
+        else
+        {
+            continue;
+        }
+
+        if (!memory->FaultHandler(desc, num))
+            return false;
+
+        faultPC = desc.FaultPC;
+        return true;
+    }
+    return false;
+}
+
+bool ARMJIT_Memory::FaultHandler(FaultDescription& faultDesc, u32 num)
+{
+    if (NDS.JIT.JITCompiler.IsJITFault(faultDesc.FaultPC))
     {
         bool rewriteToSlowPath = true;
 
-        u8* memStatus = nds.CurCPU == 0 ? nds.JIT.Memory.MappingStatus9 : nds.JIT.Memory.MappingStatus7;
+        u8* memStatus = num == 0 ? MappingStatus9 : MappingStatus7;
 
         if (memStatus[faultDesc.EmulatedFaultAddr >> PageShift] == memstate_Unmapped)
-            rewriteToSlowPath = !nds.JIT.Memory.MapAtAddress(faultDesc.EmulatedFaultAddr);
+            rewriteToSlowPath = !MapAtAddress(faultDesc.EmulatedFaultAddr, num);
 
         if (rewriteToSlowPath)
-            faultDesc.FaultPC = nds.JIT.JITCompiler.RewriteMemAccess(faultDesc.FaultPC);
+            faultDesc.FaultPC = NDS.JIT.JITCompiler.RewriteMemAccess(faultDesc.FaultPC);
 
         return true;
     }
@@ -899,8 +938,11 @@ ARMJIT_Memory::ARMJIT_Memory(melonDS::NDS& nds) : NDS(nds)
         MemoryFile = fd;
     }
 #else
-    char fastmemPidName[snprintf(NULL, 0, "/melondsfastmem%d", getpid()) + 1];
-    snprintf(fastmemPidName, sizeof(fastmemPidName), "/melondsfastmem%d", getpid());
+    // several instances can be created at once, so the name has to be unique within the process as well
+    static std::atomic<u32> fastmemCounter = 0;
+    u32 fastmemId = fastmemCounter++;
+    char fastmemPidName[snprintf(NULL, 0, "/melondsfastmem%d_%u", getpid(), fastmemId) + 1];
+    snprintf(fastmemPidName, sizeof(fastmemPidName), "/melondsfastmem%d_%u", getpid(), fastmemId);
     MemoryFile = shm_open(fastmemPidName, O_RDWR | O_CREAT | O_EXCL, 0600);
     if (MemoryFile == -1)
     {
@@ -917,10 +959,26 @@ ARMJIT_Memory::ARMJIT_Memory(melonDS::NDS& nds) : NDS(nds)
 #endif
     FastMem9Start = MemoryBase+MemoryTotalSize;
     FastMem7Start = static_cast<u8*>(FastMem9Start)+AddrSpaceSize;
+
+    bool registered = false;
+    for (int i = 0; i < MaxFastMemInstances && !registered; i++)
+    {
+        ARMJIT_Memory* expected = nullptr;
+        registered = FastMemInstances[i].compare_exchange_strong(expected, this, std::memory_order_acq_rel);
+    }
+    if (!registered)
+        Log(LogLevel::Error, "Too many JIT instances, fast memory faults of this one won't be handled!\n");
 }
 
 ARMJIT_Memory::~ARMJIT_Memory() noexcept
 {
+    for (int i = 0; i < MaxFastMemInstances; i++)
+    {
+        ARMJIT_Memory* expected = this;
+        if (FastMemInstances[i].compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel))
+            break;
+    }
+
 #if defined(__SWITCH__)
     virtmemLock();
     if (FastMem9Reservation)
@@ -1359,135 +1417,135 @@ u32 WifiRead32(u32 addr)
 }*/
 
 template <typename T>
-void VRAMWrite(u32 addr, T val)
+void VRAMWrite(u32 addr, ARM* cpu, T val)
 {
     switch (addr & 0x00E00000)
     {
-    case 0x00000000: NDS::Current->GPU.WriteVRAM_ABG<T>(addr, val); return;
-    case 0x00200000: NDS::Current->GPU.WriteVRAM_BBG<T>(addr, val); return;
-    case 0x00400000: NDS::Current->GPU.WriteVRAM_AOBJ<T>(addr, val); return;
-    case 0x00600000: NDS::Current->GPU.WriteVRAM_BOBJ<T>(addr, val); return;
-    default: NDS::Current->GPU.WriteVRAM_LCDC<T>(addr, val); return;
+    case 0x00000000: cpu->NDS.GPU.WriteVRAM_ABG<T>(addr, val); return;
+    case 0x00200000: cpu->NDS.GPU.WriteVRAM_BBG<T>(addr, val); return;
+    case 0x00400000: cpu->NDS.GPU.WriteVRAM_AOBJ<T>(addr, val); return;
+    case 0x00600000: cpu->NDS.GPU.WriteVRAM_BOBJ<T>(addr, val); return;
+    default: cpu->NDS.GPU.WriteVRAM_LCDC<T>(addr, val); return;
     }
 }
 template <typename T>
-T VRAMRead(u32 addr)
+T VRAMRead(u32 addr, ARM* cpu)
 {
     switch (addr & 0x00E00000)
     {
-    case 0x00000000: return NDS::Current->GPU.ReadVRAM_ABG<T>(addr);
-    case 0x00200000: return NDS::Current->GPU.ReadVRAM_BBG<T>(addr);
-    case 0x00400000: return NDS::Current->GPU.ReadVRAM_AOBJ<T>(addr);
-    case 0x00600000: return NDS::Current->GPU.ReadVRAM_BOBJ<T>(addr);
-    default: return NDS::Current->GPU.ReadVRAM_LCDC<T>(addr);
+    case 0x00000000: return cpu->NDS.GPU.ReadVRAM_ABG<T>(addr);
+    case 0x00200000: return cpu->NDS.GPU.ReadVRAM_BBG<T>(addr);
+    case 0x00400000: return cpu->NDS.GPU.ReadVRAM_AOBJ<T>(addr);
+    case 0x00600000: return cpu->NDS.GPU.ReadVRAM_BOBJ<T>(addr);
+    default: return cpu->NDS.GPU.ReadVRAM_LCDC<T>(addr);
     }
 }
 
-static u8 GPU3D_Read8(u32 addr) noexcept
+static u8 GPU3D_Read8(u32 addr, ARM* cpu) noexcept
 {
-    return NDS::Current->GPU.GPU3D.Read8(addr);
+    return cpu->NDS.GPU.GPU3D.Read8(addr);
 }
 
-static u16 GPU3D_Read16(u32 addr) noexcept
+static u16 GPU3D_Read16(u32 addr, ARM* cpu) noexcept
 {
-    return NDS::Current->GPU.GPU3D.Read16(addr);
+    return cpu->NDS.GPU.GPU3D.Read16(addr);
 }
 
-static u32 GPU3D_Read32(u32 addr) noexcept
+static u32 GPU3D_Read32(u32 addr, ARM* cpu) noexcept
 {
-    return NDS::Current->GPU.GPU3D.Read32(addr);
+    return cpu->NDS.GPU.GPU3D.Read32(addr);
 }
 
-static void GPU3D_Write8(u32 addr, u8 val) noexcept
+static void GPU3D_Write8(u32 addr, ARM* cpu, u8 val) noexcept
 {
-    NDS::Current->GPU.GPU3D.Write8(addr, val);
+    cpu->NDS.GPU.GPU3D.Write8(addr, val);
 }
 
-static void GPU3D_Write16(u32 addr, u16 val) noexcept
+static void GPU3D_Write16(u32 addr, ARM* cpu, u16 val) noexcept
 {
-    NDS::Current->GPU.GPU3D.Write16(addr, val);
+    cpu->NDS.GPU.GPU3D.Write16(addr, val);
 }
 
-static void GPU3D_Write32(u32 addr, u32 val) noexcept
+static void GPU3D_Write32(u32 addr, ARM* cpu, u32 val) noexcept
 {
-    NDS::Current->GPU.GPU3D.Write32(addr, val);
+    cpu->NDS.GPU.GPU3D.Write32(addr, val);
 }
 
 template<class T>
-static T GPU_ReadVRAM_ARM7(u32 addr) noexcept
+static T GPU_ReadVRAM_ARM7(u32 addr, ARM* cpu) noexcept
 {
-    return NDS::Current->GPU.ReadVRAM_ARM7<T>(addr);
+    return cpu->NDS.GPU.ReadVRAM_ARM7<T>(addr);
 }
 
 template<class T>
-static void GPU_WriteVRAM_ARM7(u32 addr, T val) noexcept
+static void GPU_WriteVRAM_ARM7(u32 addr, ARM* cpu, T val) noexcept
 {
-    NDS::Current->GPU.WriteVRAM_ARM7<T>(addr, val);
+    cpu->NDS.GPU.WriteVRAM_ARM7<T>(addr, val);
 }
 
-u32 NDSCartSlot_ReadROMData()
-{ // TODO: Add a NDS* parameter, when NDS* is eventually implemented
-    return NDS::Current->NDSCartSlot.ReadROMData();
+static u32 NDSCartSlot_ReadROMData(u32 addr, ARM* cpu)
+{
+    return cpu->NDS.NDSCartSlot.ReadROMData();
 }
 
-static u8 NDS_ARM9IORead8(u32 addr)
+static u8 NDS_ARM9IORead8(u32 addr, ARM* cpu)
 {
-    return NDS::Current->ARM9IORead8(addr);
+    return cpu->NDS.ARM9IORead8(addr);
 }
 
-static u16 NDS_ARM9IORead16(u32 addr)
+static u16 NDS_ARM9IORead16(u32 addr, ARM* cpu)
 {
-    return NDS::Current->ARM9IORead16(addr);
+    return cpu->NDS.ARM9IORead16(addr);
 }
 
-static u32 NDS_ARM9IORead32(u32 addr)
+static u32 NDS_ARM9IORead32(u32 addr, ARM* cpu)
 {
-    return NDS::Current->ARM9IORead32(addr);
+    return cpu->NDS.ARM9IORead32(addr);
 }
 
-static void NDS_ARM9IOWrite8(u32 addr, u8 val)
+static void NDS_ARM9IOWrite8(u32 addr, ARM* cpu, u8 val)
 {
-    NDS::Current->ARM9IOWrite8(addr, val);
+    cpu->NDS.ARM9IOWrite8(addr, val);
 }
 
-static void NDS_ARM9IOWrite16(u32 addr, u16 val)
+static void NDS_ARM9IOWrite16(u32 addr, ARM* cpu, u16 val)
 {
-    NDS::Current->ARM9IOWrite16(addr, val);
+    cpu->NDS.ARM9IOWrite16(addr, val);
 }
 
-static void NDS_ARM9IOWrite32(u32 addr, u32 val)
+static void NDS_ARM9IOWrite32(u32 addr, ARM* cpu, u32 val)
 {
-    NDS::Current->ARM9IOWrite32(addr, val);
+    cpu->NDS.ARM9IOWrite32(addr, val);
 }
 
-static u8 NDS_ARM7IORead8(u32 addr)
+static u8 NDS_ARM7IORead8(u32 addr, ARM* cpu)
 {
-    return NDS::Current->ARM7IORead8(addr);
+    return cpu->NDS.ARM7IORead8(addr);
 }
 
-static u16 NDS_ARM7IORead16(u32 addr)
+static u16 NDS_ARM7IORead16(u32 addr, ARM* cpu)
 {
-    return NDS::Current->ARM7IORead16(addr);
+    return cpu->NDS.ARM7IORead16(addr);
 }
 
-static u32 NDS_ARM7IORead32(u32 addr)
+static u32 NDS_ARM7IORead32(u32 addr, ARM* cpu)
 {
-    return NDS::Current->ARM7IORead32(addr);
+    return cpu->NDS.ARM7IORead32(addr);
 }
 
-static void NDS_ARM7IOWrite8(u32 addr, u8 val)
+static void NDS_ARM7IOWrite8(u32 addr, ARM* cpu, u8 val)
 {
-    NDS::Current->ARM7IOWrite8(addr, val);
+    cpu->NDS.ARM7IOWrite8(addr, val);
 }
 
-static void NDS_ARM7IOWrite16(u32 addr, u16 val)
+static void NDS_ARM7IOWrite16(u32 addr, ARM* cpu, u16 val)
 {
-    NDS::Current->ARM7IOWrite16(addr, val);
+    cpu->NDS.ARM7IOWrite16(addr, val);
 }
 
-static void NDS_ARM7IOWrite32(u32 addr, u32 val)
+static void NDS_ARM7IOWrite32(u32 addr, ARM* cpu, u32 val)
 {
-    NDS::Current->ARM7IOWrite32(addr, val);
+    cpu->NDS.ARM7IOWrite32(addr, val);
 }
 
 void* ARMJIT_Memory::GetFuncForAddr(ARM* cpu, u32 addr, bool store, int size) const noexcept
@@ -1528,7 +1586,7 @@ void* ARMJIT_Memory::GetFuncForAddr(ARM* cpu, u32 addr, bool store, int size) co
             case 32: return (void*)NDS_ARM9IORead32;
             case 33: return (void*)NDS_ARM9IOWrite32;
             }
-            // NDS::Current will delegate to the DSi versions of these methods
+            // NDS will delegate to the DSi versions of these methods
             // if it's really a DSi
             break;
         case 0x06000000:
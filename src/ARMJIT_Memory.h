@@ -137,13 +137,20 @@ public:
     u32 LocaliseAddress(int region, u32 num, u32 addr) const noexcept;
     bool IsFastmemCompatible(int region) const noexcept;
     void* GetFuncForAddr(ARM* cpu, u32 addr, bool store, int size) const noexcept;
-    bool MapAtAddress(u32 addr) noexcept;
+    bool MapAtAddress(u32 addr, u32 num) noexcept;
 
     static bool IsFastMemSupported();
 
     static void RegisterFaultHandler();
     static void UnregisterFaultHandler();
 
+    /// Called by the platform specific fault handler, on whichever thread the fault happened.
+    /// @param faultAddr The host address that was accessed.
+    /// @param faultPC The host code address of the access,
+    /// updated to where execution should resume if the fault was handled.
+    /// @return true if the fault was a fast memory access of one of the instances.
+    static bool HandleFault(u8* faultAddr, u8*& faultPC);
+
     static u32 PageSize;
     static u32 PageShift;
 private:
@@ -162,7 +169,7 @@ private:
         u32 EmulatedFaultAddr;
         u8* FaultPC;
     };
-    static bool FaultHandler(FaultDescription& faultDesc, melonDS::NDS& nds);
+    bool FaultHandler(FaultDescription& faultDesc, u32 num);
     bool MapIntoRange(u32 addr, u32 num, u32 offset, u32 size) noexcept;
     bool UnmapFromRange(u32 addr, u32 num, u32 offset, u32 size) noexcept;
     void SetCodeProtectionRange(u32 addr, u32 size, u32 num, int protection) noexcept;
@@ -0,0 +1,239 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "ARMJIT_PerfMap.h"
+#include "Platform.h"
+
+#ifdef __linux__
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <mutex>
+#include <vector>
+
+namespace melonDS
+{
+
+namespace ARMJIT_PerfMap
+{
+using Platform::Log;
+using Platform::LogLevel;
+
+#ifdef __linux__
+
+/*
+    jitdump format, as described in tools/perf/Documentation/jitdump-specification.txt
+    in the Linux source tree. Everything is in host byte order.
+*/
+
+struct JitDumpHeader
+{
+    u32 Magic;
+    u32 Version;
+    u32 TotalSize;
+    u32 ElfMach;
+    u32 Pad;
+    u32 Pid;
+    u64 Timestamp;
+    u64 Flags;
+};
+
+struct JitDumpCodeLoad
+{
+    u32 Id;
+    u32 TotalSize;
+    u64 Timestamp;
+    u32 Pid;
+    u32 Tid;
+    u64 VMA;
+    u64 CodeAddr;
+    u64 CodeSize;
+    u64 CodeIndex;
+    // followed by the name with its terminator, then the code
+};
+
+static constexpr u32 JitDumpMagic = 0x4A695444;
+static constexpr u32 JitDumpCodeLoadId = 0;
+
+static std::mutex Lock;
+static int PerfMapFile = -1;
+static int JitDumpFile = -1;
+static bool Failed[2] {};
+static u64 CodeIndex = 0;
+
+static u64 Timestamp()
+{
+    // has to be the same clock perf record -k 1 uses
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bool WriteAll(int fd, const void* data, size_t len)
+{
+    const u8* pos = (const u8*)data;
+    while (len)
+    {
+        ssize_t written = write(fd, pos, len);
+        if (written <= 0)
+            return false;
+        pos += written;
+        len -= written;
+    }
+    return true;
+}
+
+static int OpenJitDump()
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/jit-%d.dump", getpid());
+    int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0666);
+    if (fd < 0)
+        return -1;
+
+    // perf finds the file through this executable mapping,
+    // it has to stay around for as long as the process runs
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if (mmap(nullptr, pageSize, PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0) == MAP_FAILED)
+    {
+        close(fd);
+        return -1;
+    }
+
+    JitDumpHeader header {};
+    header.Magic = JitDumpMagic;
+    header.Version = 1;
+    header.TotalSize = sizeof(JitDumpHeader);
+#if defined(__x86_64__)
+    header.ElfMach = EM_X86_64;
+#elif defined(__aarch64__)
+    header.ElfMach = EM_AARCH64;
+#endif
+    header.Pid = getpid();
+    header.Timestamp = Timestamp();
+    if (!WriteAll(fd, &header, sizeof(header)))
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int OpenPerfMap()
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/perf-%d.map", getpid());
+    return open(path, O_CREAT | O_TRUNC | O_WRONLY | O_APPEND, 0666);
+}
+
+void AddCode(JITPerfMap format, const void* start, u32 size, const char* name)
+{
+    if (format == JITPerfMap::None || size == 0)
+        return;
+
+    std::lock_guard guard(Lock);
+
+    bool jitdump = format == JITPerfMap::JitDump;
+    int& fd = jitdump ? JitDumpFile : PerfMapFile;
+    if (fd < 0)
+    {
+        if (Failed[jitdump])
+            return;
+
+        fd = jitdump ? OpenJitDump() : OpenPerfMap();
+        if (fd < 0)
+        {
+            Failed[jitdump] = true;
+            Log(LogLevel::Error, "JIT: couldn't create the %s file for perf\n", jitdump ? "jitdump" : "perf map");
+            return;
+        }
+    }
+
+    // the files are written unbuffered, so nothing is lost
+    // if the process doesn't exit cleanly
+    bool ok;
+    if (jitdump)
+    {
+        u32 nameLen = strlen(name) + 1;
+
+        JitDumpCodeLoad record {};
+        record.Id = JitDumpCodeLoadId;
+        record.TotalSize = sizeof(record) + nameLen + size;
+        record.Timestamp = Timestamp();
+        record.Pid = getpid();
+        record.Tid = syscall(SYS_gettid);
+        record.VMA = (u64)start;
+        record.CodeAddr = (u64)start;
+        record.CodeSize = size;
+        record.CodeIndex = CodeIndex++;
+
+        std::vector<u8> data(record.TotalSize);
+        memcpy(&data[0], &record, sizeof(record));
+        memcpy(&data[sizeof(record)], name, nameLen);
+        memcpy(&data[sizeof(record) + nameLen], start, size);
+        ok = WriteAll(fd, data.data(), data.size());
+    }
+    else
+    {
+        char line[128];
+        int len = snprintf(line, sizeof(line), "%lx %x %s\n", (unsigned long)start, size, name);
+        ok = WriteAll(fd, line, len);
+    }
+
+    if (!ok)
+    {
+        close(fd);
+        fd = -1;
+        Failed[jitdump] = true;
+        Log(LogLevel::Error, "JIT: couldn't write to the %s file for perf\n", jitdump ? "jitdump" : "perf map");
+    }
+}
+
+#else
+
+void AddCode(JITPerfMap, const void*, u32, const char*)
+{
+}
+
+#endif
+
+void AddBlock(JITPerfMap format, u32 num, bool thumb, u32 addr,
+    const void* start, u32 size, const void* farStart, u32 farSize)
+{
+    if (format == JITPerfMap::None)
+        return;
+
+    char name[64];
+    snprintf(name, sizeof(name), "ARM%d_%s_%08X", num ? 7 : 9, thumb ? "THUMB" : "ARM", addr);
+    AddCode(format, start, size, name);
+
+    strcat(name, "_far");
+    AddCode(format, farStart, farSize, name);
+}
+
+}
+
+}
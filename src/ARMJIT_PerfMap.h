@@ -0,0 +1,46 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef ARMJIT_PERFMAP_H
+#define ARMJIT_PERFMAP_H
+
+#include "types.h"
+#include "Args.h"
+
+namespace melonDS
+{
+
+// Writes the symbol files for perf (see JITPerfMap).
+// There is one file per process, shared by every JIT instance.
+namespace ARMJIT_PerfMap
+{
+
+// names a range of generated code
+void AddCode(JITPerfMap format, const void* start, u32 size, const char* name);
+
+// names the code of a block, after the CPU, the mode and the guest address
+// the part of the block which is kept out of the way (slow paths)
+// gets a name of its own
+void AddBlock(JITPerfMap format, u32 num, bool thumb, u32 addr,
+    const void* start, u32 size, const void* farStart, u32 farSize);
+
+}
+
+}
+
+#endif
@@ -52,21 +52,65 @@ void Compiler::Comp_JumpTo(u32 addr, bool forceNonConstantCycles)
         AND(32, R(RCPSR), Imm32(~0x20));
     }
 
+    if (Num == 0)
+    {
+        u32 regionCodeCycles;
+        cycles = Probe(CompileProbe::JumpTarget, addr, R15, &regionCodeCycles);
+
+        if (Exit)
+            MOV(32, MDisp(RCPU, offsetof(ARMv5, RegionCodeCycles)), Imm32(regionCodeCycles));
+    }
+    else
+    {
+        u32 codeRegion = addr >> 24;
+        u32 codeCycles = addr >> 15; // cheato
+
+        if (Exit)
+        {
+            MOV(32, MDisp(RCPU, offsetof(ARM, CodeRegion)), Imm32(codeRegion));
+            MOV(32, MDisp(RCPU, offsetof(ARM, CodeCycles)), Imm32(codeCycles));
+        }
+
+        cycles = Probe(CompileProbe::JumpTarget, addr, R15);
+    }
+
+    if (addr & 0x1)
+    {
+        addr &= ~0x1;
+        newPC = addr+2;
+    }
+    else
+    {
+        addr &= ~0x3;
+        newPC = addr+4;
+    }
+
+    if (Exit)
+        MOV(32, MDisp(RCPU, offsetof(ARM, R[15])), Imm32(newPC));
+    if ((Thumb || CurInstr.Cond() >= 0xE) && !forceNonConstantCycles)
+        ConstantCycles += cycles;
+    else
+        ADD(32, MDisp(RCPU, offsetof(ARM, Cycles)), Imm8(cycles));
+}
+
+// only ever run through CompileProbe::JumpTarget, so on the emulation
+// thread, since it goes by the live timing tables and fetches like the CPU does
+u32 Compiler::JumpTargetCycles(u32 addr, u32 r15, u32& regionCodeCycles)
+{
+    u32 cycles = 0;
+    regionCodeCycles = 0;
+
     if (Num == 0)
     {
         ARMv5* cpu9 = (ARMv5*)CurCPU;
 
-        u32 regionCodeCycles = cpu9->MemTimings[addr >> 12][0];
+        regionCodeCycles = cpu9->MemTimings[addr >> 12][0];
         u32 compileTimeCodeCycles = cpu9->RegionCodeCycles;
         cpu9->RegionCodeCycles = regionCodeCycles;
 
-        if (Exit)
-            MOV(32, MDisp(RCPU, offsetof(ARMv5, RegionCodeCycles)), Imm32(regionCodeCycles));
-
         if (addr & 0x1)
         {
             addr &= ~0x1;
-            newPC = addr+2;
 
             // two-opcodes-at-once fetch
             // doesn't matter if we put garbage in the MSbs there
@@ -86,7 +130,6 @@ void Compiler::Comp_JumpTo(u32 addr, bool forceNonConstantCycles)
         else
         {
             addr &= ~0x3;
-            newPC = addr+4;
 
             cpu9->CodeRead32(addr, true);
             cycles += cpu9->CodeCycles;
@@ -100,54 +143,27 @@ void Compiler::Comp_JumpTo(u32 addr, bool forceNonConstantCycles)
     {
         ARMv4* cpu7 = (ARMv4*)CurCPU;
 
-        u32 codeRegion = addr >> 24;
         u32 codeCycles = addr >> 15; // cheato
 
-        cpu7->CodeRegion = codeRegion;
+        cpu7->CodeRegion = addr >> 24;
         cpu7->CodeCycles = codeCycles;
 
-        if (Exit)
-        {
-            MOV(32, MDisp(RCPU, offsetof(ARM, CodeRegion)), Imm32(codeRegion));
-            MOV(32, MDisp(RCPU, offsetof(ARM, CodeCycles)), Imm32(codeCycles));
-        }
+        // this is necessary because ARM7 bios protection
+        u32 compileTimePC = CurCPU->R[15];
+        CurCPU->R[15] = (addr & 0x1) ? (addr & ~0x1) + 2 : (addr & ~0x3) + 4;
 
         if (addr & 0x1)
-        {
-            addr &= ~0x1;
-            newPC = addr+2;
-
-            // this is necessary because ARM7 bios protection
-            u32 compileTimePC = CurCPU->R[15];
-            CurCPU->R[15] = newPC;
-
             cycles += NDS.ARM7MemTimings[codeCycles][0] + NDS.ARM7MemTimings[codeCycles][1];
-
-            CurCPU->R[15] = compileTimePC;
-        }
         else
-        {
-            addr &= ~0x3;
-            newPC = addr+4;
-
-            u32 compileTimePC = CurCPU->R[15];
-            CurCPU->R[15] = newPC;
-
             cycles += NDS.ARM7MemTimings[codeCycles][2] + NDS.ARM7MemTimings[codeCycles][3];
 
-            CurCPU->R[15] = compileTimePC;
-        }
+        CurCPU->R[15] = compileTimePC;
 
-        cpu7->CodeRegion = R15 >> 24;
+        cpu7->CodeRegion = r15 >> 24;
         cpu7->CodeCycles = addr >> 15;
     }
 
-    if (Exit)
-        MOV(32, MDisp(RCPU, offsetof(ARM, R[15])), Imm32(newPC));
-    if ((Thumb || CurInstr.Cond() >= 0xE) && !forceNonConstantCycles)
-        ConstantCycles += cycles;
-    else
-        ADD(32, MDisp(RCPU, offsetof(ARM, Cycles)), Imm8(cycles));
+    return cycles;
 }
 
 void ARMv4JumpToTrampoline(ARMv4* arm, u32 addr, bool restorecpsr)
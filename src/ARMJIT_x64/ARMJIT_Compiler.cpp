@@ -22,11 +22,16 @@
 #include "../ARMInterpreter.h"
 #include "../NDS.h"
 #include "../ARMJIT_Global.h"
+#include "../ARMJIT_PerfMap.h"
 
 #include <assert.h>
 #include <stdarg.h>
 
 #include "../dolphin/CommonFuncs.h"
+#include "../dolphin/CPUDetect.h"
+
+#define XXH_STATIC_LINKING_ONLY
+#include "../xxhash/xxhash.h"
 
 using namespace Gen;
 using namespace Common;
@@ -234,6 +239,10 @@ Compiler::Compiler(melonDS::NDS& nds) : XEmitter(), NDS(nds)
 
     Reset();
 
+    // the stubs are part of the fingerprint for the code cache
+    std::vector<CodeReloc> stubRelocs;
+    SetRelocRecorder(&stubRelocs);
+
     {
         // RSCRATCH mode
         // RSCRATCH2 reg number
@@ -343,16 +352,9 @@ Compiler::Compiler(melonDS::NDS& nds) : XEmitter(), NDS(nds)
                     PatchedStoreFuncs[consoleType][num][size][reg] = GetWritableCodePtr();
                     if (RSCRATCH3 != ABI_PARAM1)
                         MOV(32, R(ABI_PARAM1), R(RSCRATCH3));
-                    if (num == 0)
-                    {
-                        MOV(64, R(ABI_PARAM2), R(RCPU));
-                        if (rdMapped != ABI_PARAM3)
-                            MOV(32, R(ABI_PARAM3), R(rdMapped));
-                    }
-                    else
-                    {
-                        MOV(32, R(ABI_PARAM2), R(rdMapped));
-                    }
+                    MOV(64, R(ABI_PARAM2), R(RCPU));
+                    if (rdMapped != ABI_PARAM3)
+                        MOV(32, R(ABI_PARAM3), R(rdMapped));
                     ABI_PushRegistersAndAdjustStack(CallerSavedPushRegs, 8);
                     if (consoleType == 0)
                     {
@@ -390,8 +392,7 @@ Compiler::Compiler(melonDS::NDS& nds) : XEmitter(), NDS(nds)
                         PatchedLoadFuncs[consoleType][num][size][signextend][reg] = GetWritableCodePtr();
                         if (RSCRATCH3 != ABI_PARAM1)
                             MOV(32, R(ABI_PARAM1), R(RSCRATCH3));
-                        if (num == 0)
-                            MOV(64, R(ABI_PARAM2), R(RCPU));
+                        MOV(64, R(ABI_PARAM2), R(RCPU));
                         ABI_PushRegistersAndAdjustStack(CallerSavedPushRegs, 8);
                         if (consoleType == 0)
                         {
@@ -433,15 +434,63 @@ Compiler::Compiler(melonDS::NDS& nds) : XEmitter(), NDS(nds)
         }
     }
 
+    SetRelocRecorder(nullptr);
+
     // move the region forward to prevent overwriting the generated functions
     CodeMemSize -= GetWritableCodePtr() - ResetStart;
     ResetStart = GetWritableCodePtr();
 
+    {
+        // cached blocks call into the stubs and into functions in the binary,
+        // so those have to be in the same place. They also mustn't
+        // use any instructions this CPU doesn't support.
+        // The position of the stubs' code doesn't matter, so the
+        // places where they refer to something are replaced by what they refer to.
+        std::vector<u8> fingerprint(CodeMemBase, ResetStart);
+        for (const CodeReloc& reloc : stubRelocs)
+        {
+            u32 site = reloc.ptr - CodeMemBase;
+            u32 size = reloc.type == CodeReloc::Type::Rel8 ? 1 : (reloc.type == CodeReloc::Type::Imm64 ? 8 : 4);
+            memset(&fingerprint[site], 0, size);
+
+            u8* target = (u8*)reloc.target;
+            s64 offset = target >= CodeMemBase && target < ResetStart
+                ? target - CodeMemBase
+                : target - (u8*)ARM_Ret;
+            fingerprint.insert(fingerprint.end(), (u8*)&site, (u8*)&site + 4);
+            fingerprint.insert(fingerprint.end(), (u8*)&offset, (u8*)&offset + 8);
+        }
+
+        for (int i = 0; i < ARMInstrInfo::ak_Count; i++)
+        {
+            s64 offset = (u8*)InterpretARM[i] - (u8*)ARM_Ret;
+            fingerprint.insert(fingerprint.end(), (u8*)&offset, (u8*)&offset + 8);
+        }
+        for (int i = 0; i < ARMInstrInfo::tk_Count; i++)
+        {
+            s64 offset = (u8*)InterpretTHUMB[i] - (u8*)ARM_Ret;
+            fingerprint.insert(fingerprint.end(), (u8*)&offset, (u8*)&offset + 8);
+        }
+
+        bool features[] =
+        {
+            cpu_info.bSSE3, cpu_info.bSSSE3, cpu_info.bPOPCNT, cpu_info.bSSE4_1, cpu_info.bSSE4_2,
+            cpu_info.bLZCNT, cpu_info.bAVX, cpu_info.bAVX2, cpu_info.bBMI1, cpu_info.bBMI2,
+            cpu_info.bFMA, cpu_info.bFMA4, cpu_info.bMOVBE, cpu_info.bLAHFSAHF64
+        };
+        fingerprint.insert(fingerprint.end(), (u8*)features, (u8*)features + sizeof(features));
+
+        CodeFingerprint = XXH3_64bits(fingerprint.data(), fingerprint.size());
+    }
+
     NearStart = ResetStart;
     FarStart = ResetStart + 1024*1024*24;
 
     NearSize = FarStart - ResetStart;
     FarSize = (ResetStart + CodeMemSize) - FarStart;
+
+    NumCodeSegments = NearSize >> ARMJIT_Global::CodeSegmentShift;
+    FarSegmentSize = FarSize / NumCodeSegments;
 }
 
 Compiler::~Compiler()
@@ -639,8 +688,39 @@ void Compiler::Reset()
 
     NearCode = NearStart;
     FarCode = FarStart;
+    CurCodeSegment = 0;
 
     LoadStorePatches.clear();
+
+    // the stubs never change, they only need to be named once
+    if (NDS.JIT.GetPerfMap() != StubsPerfMap)
+    {
+        StubsPerfMap = NDS.JIT.GetPerfMap();
+        ARMJIT_PerfMap::AddCode(StubsPerfMap, CodeMemBase, ResetStart - CodeMemBase, "melonDS_JIT_stubs");
+    }
+}
+
+void Compiler::StartCodeSegment(u32 segment)
+{
+    u32 nearSegmentSize = 1 << ARMJIT_Global::CodeSegmentShift;
+    u8* nearStart = NearStart + segment * nearSegmentSize;
+    u8* farStart = FarStart + segment * FarSegmentSize;
+
+    memset(nearStart, 0xcc, nearSegmentSize);
+    memset(farStart, 0xcc, FarSegmentSize);
+
+    for (auto it = LoadStorePatches.begin(); it != LoadStorePatches.end();)
+    {
+        if (it->first >= nearStart && it->first < nearStart + nearSegmentSize)
+            it = LoadStorePatches.erase(it);
+        else
+            it++;
+    }
+
+    SetCodePtr(nearStart);
+    NearCode = nearStart;
+    FarCode = farStart;
+    CurCodeSegment = segment;
 }
 
 bool Compiler::IsJITFault(const u8* addr)
@@ -688,15 +768,28 @@ void Compiler::CreateMethod(const char* namefmt, void* start, ...)
 
 JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemoryInstr)
 {
-    if (NearSize - (GetCodePtr() - NearStart) < 1024 * 32) // guess...
+    u8* nearEnd = NearStart + ((CurCodeSegment + 1) << ARMJIT_Global::CodeSegmentShift);
+    u8* farEnd = FarStart + (CurCodeSegment + 1) * FarSegmentSize;
+    // guess... (superblocks can be longer than 32 instructions)
+    int room = 1024 * std::max(instrsCount, 32);
+    if (Async)
     {
-        Log(LogLevel::Debug, "near reset\n");
-        NDS.JIT.ResetBlockCache();
+        // the block is only captured, so every block can go to the same place
+        SetCodePtr(NearStart);
+        NearCode = NearStart;
+        FarCode = FarStart;
+        LoadStorePatches.clear();
     }
-    if (FarSize - (FarCode - FarStart) < 1024 * 32) // guess...
+    else if (nearEnd - GetCodePtr() < room || farEnd - FarCode < room)
+        NDS.JIT.EvictCodeSegment();
+
+    u8* farStart = FarCode;
+    if (Capture)
     {
-        Log(LogLevel::Debug, "far reset\n");
-        NDS.JIT.ResetBlockCache();
+        Capture->Probes.clear();
+        CapturedRelocs.clear();
+        CapturedPatches.clear();
+        SetRelocRecorder(&CapturedRelocs);
     }
 
     ConstantCycles = 0;
@@ -824,9 +917,15 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
         ADD(32, MDisp(RCPU, offsetof(ARM, Cycles)), Imm32(ConstantCycles));
     ABI_TailCall(ARM_Ret);
 
+    // blocks compiled in the background are named once they're loaded
+    if (!Async)
+    {
 #ifdef JIT_PROFILING_ENABLED
-    CreateMethod("JIT_Block_%d_%d_%08X", (void*)res, Num, Thumb, instrs[0].Addr);
+        CreateMethod("JIT_Block_%d_%d_%08X", (void*)res, Num, Thumb, instrs[0].Addr);
 #endif
+        ARMJIT_PerfMap::AddBlock(NDS.JIT.GetPerfMap(), Num, Thumb, instrs[0].Addr,
+            (void*)res, GetWritableCodePtr() - (u8*)res, farStart, FarCode - farStart);
+    }
 
     /*FILE* codeout = fopen("codeout", "a");
     fprintf(codeout, "beginning block argargarg__ %x!!!", instrs[0].Addr);
@@ -834,13 +933,358 @@ JitBlockEntry Compiler::CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[]
 
     fclose(codeout);*/
 
+    if (Capture)
+    {
+        SetRelocRecorder(nullptr);
+        if (!CaptureBlock((u8*)res, farStart, *Capture))
+            Capture->Code.clear();
+    }
+
     return res;
 }
 
+static u8* BinaryAnchor()
+{
+    return (u8*)ARM_Ret;
+}
+
+bool Compiler::ClassifyTarget(u8* target, u8* nearStart, u8* nearEnd, u8* farStart, u8* farEnd, CachedReloc& reloc)
+{
+    bool absolute = reloc.Type == (u8)CodeReloc::Type::Imm32 || reloc.Type == (u8)CodeReloc::Type::Imm64;
+
+    if (target >= nearStart && target <= nearEnd)
+    {
+        reloc.Base = CachedReloc::BlockNear;
+        reloc.Offset = target - nearStart;
+    }
+    else if (target >= farStart && target <= farEnd)
+    {
+        reloc.Base = CachedReloc::BlockFar;
+        reloc.Offset = target - farStart;
+    }
+    else if (target >= CodeMemBase && target < ResetStart)
+    {
+        reloc.Base = CachedReloc::Stubs;
+        reloc.Offset = target - CodeMemBase;
+    }
+    else if (target >= ResetStart && target < ResetStart + CodeMemSize)
+    {
+        // blocks never go directly to other blocks
+        return false;
+    }
+    else if (absolute && (target == NDS.JIT.Memory.FastMem9Start || target == NDS.JIT.Memory.FastMem7Start))
+    {
+        reloc.Base = CachedReloc::FastMem;
+        reloc.Offset = target == NDS.JIT.Memory.FastMem7Start;
+    }
+    else
+    {
+        // the only other things blocks refer to are functions
+        reloc.Base = CachedReloc::Binary;
+        reloc.Offset = target - BinaryAnchor();
+    }
+
+    return true;
+}
+
+static_assert(CachedReloc::NumTypes == (u32)CodeReloc::Type::Imm64 + 1
+    && CachedReloc::FieldSizes[(u32)CodeReloc::Type::Rel8] == 1
+    && CachedReloc::FieldSizes[(u32)CodeReloc::Type::Rel32] == 4
+    && CachedReloc::FieldSizes[(u32)CodeReloc::Type::Imm32] == 4
+    && CachedReloc::FieldSizes[(u32)CodeReloc::Type::Imm64] == 8,
+    "CachedReloc::FieldSizes has to match CodeReloc::Type");
+
+bool Compiler::CaptureBlock(u8* nearStart, u8* farStart, CachedBlock& block)
+{
+    u8* nearEnd = GetWritableCodePtr();
+    u8* farEnd = FarCode;
+    u32 nearSize = nearEnd - nearStart;
+    u32 farSize = farEnd - farStart;
+
+    block.Code.resize(nearSize + farSize);
+    memcpy(block.Code.data(), nearStart, nearSize);
+    memcpy(block.Code.data() + nearSize, farStart, farSize);
+    block.NearSize = nearSize;
+    block.Relocs.clear();
+    block.Patches.clear();
+
+    for (const CodeReloc& reloc : CapturedRelocs)
+    {
+        CachedReloc cached {};
+        bool inNear = reloc.ptr >= nearStart && reloc.ptr < nearEnd;
+        if (inNear)
+            cached.Site = reloc.ptr - nearStart;
+        else if (reloc.ptr >= farStart && reloc.ptr < farEnd)
+            cached.Site = nearSize + (reloc.ptr - farStart);
+        else
+            return false;
+
+        cached.Type = (u8)reloc.type;
+        if (!ClassifyTarget((u8*)reloc.target, nearStart, nearEnd, farStart, farEnd, cached))
+            return false;
+
+        // branches within near or far code stay the same wherever the block is put
+        bool relative = reloc.type == CodeReloc::Type::Rel8 || reloc.type == CodeReloc::Type::Rel32;
+        if (relative && cached.Base == (inNear ? CachedReloc::BlockNear : CachedReloc::BlockFar))
+            continue;
+
+        block.Relocs.push_back(cached);
+    }
+
+    for (auto& it : CapturedPatches)
+    {
+        if (it.first < nearStart || it.first >= nearEnd)
+            return false;
+
+        CachedPatch cached {};
+        cached.Site = it.first - nearStart;
+        cached.Offset = it.second.Offset;
+        cached.Size = it.second.Size;
+        cached.Func.Site = cached.Site;
+        cached.Func.Type = (u8)CodeReloc::Type::Imm64;
+        if (!ClassifyTarget((u8*)it.second.PatchFunc, nearStart, nearEnd, farStart, farEnd, cached.Func))
+            return false;
+
+        block.Patches.push_back(cached);
+    }
+
+    return true;
+}
+
+u8* Compiler::ResolveTarget(const CachedReloc& reloc, u8* nearStart, u32 nearSize, u8* farStart, u32 farSize)
+{
+    switch (reloc.Base)
+    {
+    case CachedReloc::BlockNear:
+        return reloc.Offset >= 0 && reloc.Offset <= nearSize ? nearStart + reloc.Offset : NULL;
+    case CachedReloc::BlockFar:
+        return reloc.Offset >= 0 && reloc.Offset <= farSize ? farStart + reloc.Offset : NULL;
+    case CachedReloc::Stubs:
+        return reloc.Offset >= 0 && reloc.Offset < ResetStart - CodeMemBase ? CodeMemBase + reloc.Offset : NULL;
+    case CachedReloc::FastMem:
+        if (!NDS.JIT.FastMemoryEnabled())
+            return NULL;
+        return (u8*)(reloc.Offset ? NDS.JIT.Memory.FastMem7Start : NDS.JIT.Memory.FastMem9Start);
+    default:
+        return BinaryAnchor() + reloc.Offset;
+    }
+}
+
+JitBlockEntry Compiler::LoadBlock(const CachedBlock& block, bool thumb)
+{
+    u32 nearSize = block.NearSize;
+    u32 farSize = block.Code.size() - nearSize;
+
+    u8* nearEnd = NearStart + ((CurCodeSegment + 1) << ARMJIT_Global::CodeSegmentShift);
+    u8* farEnd = FarStart + (CurCodeSegment + 1) * FarSegmentSize;
+    if (nearEnd - GetCodePtr() < nearSize + 1024 * 32 || farEnd - FarCode < farSize + 1024 * 32)
+    {
+        if (nearSize + 1024 * 32 > (1u << ARMJIT_Global::CodeSegmentShift) || farSize + 1024 * 32 > FarSegmentSize)
+            return NULL;
+        NDS.JIT.EvictCodeSegment();
+    }
+
+    u8* nearStart = GetWritableCodePtr();
+    u8* farStart = FarCode;
+    memcpy(nearStart, block.Code.data(), nearSize);
+    memcpy(farStart, block.Code.data() + nearSize, farSize);
+
+    for (const CachedReloc& reloc : block.Relocs)
+    {
+        bool inNear = reloc.Site < nearSize;
+        u8* field = inNear ? nearStart + reloc.Site : farStart + (reloc.Site - nearSize);
+        u32 room = inNear ? nearSize - reloc.Site : block.Code.size() - reloc.Site;
+
+        u8* target = ResolveTarget(reloc, nearStart, nearSize, farStart, farSize);
+        if (!target)
+            return NULL;
+
+        switch ((CodeReloc::Type)reloc.Type)
+        {
+        case CodeReloc::Type::Rel8:
+            {
+                s64 distance = target - (field + 1);
+                if (room < 1 || distance != (s8)distance)
+                    return NULL;
+                *field = (u8)(s8)distance;
+            }
+            break;
+        case CodeReloc::Type::Rel32:
+            {
+                s64 distance = target - (field + 4);
+                if (room < 4 || distance != (s32)distance)
+                    return NULL;
+                s32 value = distance;
+                memcpy(field, &value, 4);
+            }
+            break;
+        case CodeReloc::Type::Imm32:
+            {
+                s64 value = (s64)target;
+                if (room < 4 || value != (s32)value)
+                    return NULL;
+                s32 value32 = value;
+                memcpy(field, &value32, 4);
+            }
+            break;
+        case CodeReloc::Type::Imm64:
+            if (room < 8)
+                return NULL;
+            memcpy(field, &target, 8);
+            break;
+        default:
+            return NULL;
+        }
+    }
+
+    std::vector<std::pair<u8*, LoadStorePatch>> patches;
+    for (const CachedPatch& patch : block.Patches)
+    {
+        u8* func = ResolveTarget(patch.Func, nearStart, nearSize, farStart, farSize);
+        s64 start = (s64)patch.Site + patch.Offset;
+        if (!func || start < 0 || start + patch.Size > nearSize || patch.Size < 5)
+            return NULL;
+
+        patches.push_back({nearStart + patch.Site, LoadStorePatch {func, patch.Offset, patch.Size}});
+    }
+    for (auto& it : patches)
+        LoadStorePatches[it.first] = it.second;
+
+    SetCodePtr(nearStart + nearSize);
+    FarCode = farStart + farSize;
+
+#ifdef JIT_PROFILING_ENABLED
+    CreateMethod("JIT_CachedBlock_%d_%08X", nearStart, block.Num, block.StartAddr);
+#endif
+    ARMJIT_PerfMap::AddBlock(NDS.JIT.GetPerfMap(), block.Num, thumb, block.StartAddr,
+        nearStart, nearSize, farStart, farSize);
+
+    return (JitBlockEntry)nearStart;
+}
+
+void Compiler::AddLoadStorePatch(u8* pc, const LoadStorePatch& patch)
+{
+    LoadStorePatches[pc] = patch;
+    if (Capture)
+        CapturedPatches.push_back({pc, patch});
+}
+
+void Compiler::RunProbe(CompileProbe& probe)
+{
+    switch (probe.Kind)
+    {
+    case CompileProbe::JumpTarget:
+        probe.Results[0] = JumpTargetCycles(probe.Args[0], probe.Args[1], probe.Results[1]);
+        break;
+    case CompileProbe::ClassifyAddress:
+        probe.Results[0] = Num == 0
+            ? NDS.JIT.Memory.ClassifyAddress9(probe.Args[0])
+            : NDS.JIT.Memory.ClassifyAddress7(probe.Args[0]);
+        break;
+    case CompileProbe::FuncForAddr:
+        {
+            void* func = NDS.JIT.Memory.GetFuncForAddr(CurCPU, probe.Args[0], probe.Args[1] & 1, probe.Args[1] >> 1);
+            u64 offset = func ? (u64)((u8*)func - BinaryAnchor()) : 0;
+            probe.Results[0] = (u32)offset;
+            probe.Results[1] = offset >> 32;
+        }
+        break;
+    case CompileProbe::Literal8:
+    case CompileProbe::Literal16:
+    case CompileProbe::Literal32:
+        {
+            u32 addr = probe.Args[0];
+            probe.Results[1] = NDS.JIT.InvalidLiterals.Find(NDS.JIT.LocaliseCodeAddress(Num, addr)) != -1;
+            if (probe.Results[1])
+                break;
+
+            // make sure arm7 bios is accessible
+            u32 tmpR15 = CurCPU->R[15];
+            CurCPU->R[15] = probe.Args[1];
+            if (probe.Kind == CompileProbe::Literal32)
+                CurCPU->DataRead32(addr & ~0x3, &probe.Results[0]);
+            else if (probe.Kind == CompileProbe::Literal16)
+                CurCPU->DataRead16(addr & ~0x1, &probe.Results[0]);
+            else
+                CurCPU->DataRead8(addr, &probe.Results[0]);
+            CurCPU->R[15] = tmpR15;
+        }
+        break;
+    }
+}
+
+void Compiler::RunProbeFor(ARM* cpu, CompileProbe& probe)
+{
+    // this doesn't happen right after the block was analysed,
+    // so whatever the lookups change has to be put back
+    ARM* curCPU = CurCPU;
+    u32 num = Num;
+    u32 r15 = cpu->R[15];
+    u32 codeRegion = cpu->CodeRegion;
+    s32 codeCycles = cpu->CodeCycles;
+    u32 dataRegion = cpu->DataRegion;
+    s32 dataCycles = cpu->DataCycles;
+
+    CurCPU = cpu;
+    Num = cpu->Num;
+    RunProbe(probe);
+
+    cpu->R[15] = r15;
+    cpu->CodeRegion = codeRegion;
+    cpu->CodeCycles = codeCycles;
+    cpu->DataRegion = dataRegion;
+    cpu->DataCycles = dataCycles;
+    CurCPU = curCPU;
+    Num = num;
+}
+
+u32 Compiler::Probe(u32 kind, u32 arg0, u32 arg1, u32* result1)
+{
+    CompileProbe probe {kind, {arg0, arg1}, {0, 0}};
+    if (Async)
+        Async->RunProbe(CurCPU, probe);
+    else
+        RunProbe(probe);
+    if (Capture)
+        Capture->Probes.push_back(probe);
+
+    if (result1)
+        *result1 = probe.Results[1];
+    return probe.Results[0];
+}
+
+bool Compiler::ReplayProbes(ARM* cpu, const std::vector<CompileProbe>& probes)
+{
+    CurCPU = cpu;
+    Num = cpu->Num;
+
+    for (const CompileProbe& probe : probes)
+    {
+        CompileProbe replay {probe.Kind, {probe.Args[0], probe.Args[1]}, {0, 0}};
+        RunProbe(replay);
+        if (replay.Results[0] != probe.Results[0] || replay.Results[1] != probe.Results[1])
+            return false;
+    }
+    return true;
+}
+
+int Compiler::ClassifyAddress(u32 addr)
+{
+    return Probe(CompileProbe::ClassifyAddress, addr, 0);
+}
+
+void* Compiler::GetFuncForAddr(u32 addr, bool store, int size)
+{
+    u32 high;
+    u32 low = Probe(CompileProbe::FuncForAddr, addr, store | (size << 1), &high);
+    u64 offset = ((u64)high << 32) | low;
+    return offset ? BinaryAnchor() + (s64)offset : NULL;
+}
+
 void Compiler::Comp_AddCycles_C(bool forceNonConstant)
 {
     s32 cycles = Num ?
-        NDS.ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 1 : 3]
+        CurInstr.CodeTimings[Thumb ? 1 : 3]
         : ((R15 & 0x2) ? 0 : CurInstr.CodeCycles);
 
     if ((!Thumb && CurInstr.Cond() < 0xE) || forceNonConstant)
@@ -852,7 +1296,7 @@ void Compiler::Comp_AddCycles_C(bool forceNonConstant)
 void Compiler::Comp_AddCycles_CI(u32 i)
 {
     s32 cycles = (Num ?
-        NDS.ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 0 : 2]
+        CurInstr.CodeTimings[Thumb ? 0 : 2]
         : ((R15 & 0x2) ? 0 : CurInstr.CodeCycles)) + i;
 
     if (!Thumb && CurInstr.Cond() < 0xE)
@@ -864,7 +1308,7 @@ void Compiler::Comp_AddCycles_CI(u32 i)
 void Compiler::Comp_AddCycles_CI(Gen::X64Reg i, int add)
 {
     s32 cycles = Num ?
-        NDS.ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 0 : 2]
+        CurInstr.CodeTimings[Thumb ? 0 : 2]
         : ((R15 & 0x2) ? 0 : CurInstr.CodeCycles);
 
     if (!Thumb && CurInstr.Cond() < 0xE)
@@ -889,7 +1333,7 @@ void Compiler::Comp_AddCycles_CDI()
 
         s32 cycles;
 
-        s32 numC = NDS.ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 0 : 2];
+        s32 numC = CurInstr.CodeTimings[Thumb ? 0 : 2];
         s32 numD = CurInstr.DataCycles;
 
         if ((CurInstr.DataRegion >> 24) == 0x02) // mainRAM
@@ -934,7 +1378,7 @@ void Compiler::Comp_AddCycles_CD()
     }
     else
     {
-        s32 numC = NDS.ARM7MemTimings[CurInstr.CodeCycles][Thumb ? 0 : 2];
+        s32 numC = CurInstr.CodeTimings[Thumb ? 0 : 2];
         s32 numD = CurInstr.DataCycles;
 
         if ((CurInstr.DataRegion >> 4) == 0x02)
@@ -25,17 +25,21 @@
 
 #include "../ARMJIT_Internal.h"
 #include "../ARMJIT_RegisterCache.h"
+#include "../ARMJIT_CodeCache.h"
+#include "../Args.h"
 
 #ifdef JIT_PROFILING_ENABLED
 #include <jitprofiling.h>
 #endif
 
 #include <unordered_map>
+#include <vector>
 
 
 namespace melonDS
 {
 class ARMJIT;
+class AsyncCompiler;
 class ARMJIT_Memory;
 class NDS;
 const Gen::X64Reg RCPU = Gen::RBP;
@@ -88,8 +92,24 @@ public:
 
     void Reset();
 
+    u32 GetNumCodeSegments() const { return NumCodeSegments; }
+    u32 GetCurCodeSegment() const { return CurCodeSegment; }
+    // throws out everything in the given code segment and continues compiling there
+    void StartCodeSegment(u32 segment);
+
     JitBlockEntry CompileBlock(ARM* cpu, bool thumb, FetchedInstr instrs[], int instrsCount, bool hasMemoryInstr);
 
+    bool CanCacheCode() const { return true; }
+    u64 GetCodeFingerprint() const { return CodeFingerprint; }
+    // puts a block from the code cache into the code memory
+    // returns NULL if it can't be placed here
+    JitBlockEntry LoadBlock(const CachedBlock& block, bool thumb);
+    // does the lookups made while compiling a cached block again
+    // returns whether they all still give the same results
+    bool ReplayProbes(ARM* cpu, const std::vector<CompileProbe>& probes);
+    // does a lookup for the compiler of an AsyncCompiler
+    void RunProbeFor(ARM* cpu, CompileProbe& probe);
+
     void LoadReg(int reg, Gen::X64Reg nativeReg);
     void SaveReg(int reg, Gen::X64Reg nativeReg);
 
@@ -238,6 +258,17 @@ public:
     bool IsJITFault(const u8* addr);
 
     u8* RewriteMemAccess(u8* pc);
+    void AddLoadStorePatch(u8* pc, const LoadStorePatch& patch);
+
+    void RunProbe(CompileProbe& probe);
+    u32 Probe(u32 kind, u32 arg0, u32 arg1, u32* result1 = nullptr);
+    u32 JumpTargetCycles(u32 addr, u32 r15, u32& regionCodeCycles);
+    int ClassifyAddress(u32 addr);
+    void* GetFuncForAddr(u32 addr, bool store, int size);
+
+    bool CaptureBlock(u8* nearStart, u8* farStart, CachedBlock& block);
+    bool ClassifyTarget(u8* target, u8* nearStart, u8* nearEnd, u8* farStart, u8* farEnd, CachedReloc& reloc);
+    u8* ResolveTarget(const CachedReloc& reloc, u8* nearStart, u32 nearSize, u8* farStart, u32 farSize);
 
 #ifdef JIT_PROFILING_ENABLED
     void CreateMethod(const char* namefmt, void* start, ...);
@@ -252,13 +283,29 @@ public:
     u8* NearStart {};
     u8* FarStart {};
 
+    // each segment has 2MB of near code and an equal share of the far code
+    u32 NumCodeSegments {};
+    u32 CurCodeSegment {};
+    u32 FarSegmentSize {};
+
     void* PatchedStoreFuncs[2][2][3][16] {};
     void* PatchedLoadFuncs[2][2][3][2][16] {};
 
     std::unordered_map<u8*, LoadStorePatch> LoadStorePatches {};
 
+    // while set, CompileBlock also puts the block into it in a form
+    // which can be loaded again, or leaves its code empty if that's not possible
+    CachedBlock* Capture = nullptr;
+    // set for the compiler which runs on the thread of an AsyncCompiler,
+    // it leaves the lookups to the emulation thread
+    AsyncCompiler* Async = nullptr;
+    std::vector<Gen::CodeReloc> CapturedRelocs {};
+    std::vector<std::pair<u8*, LoadStorePatch>> CapturedPatches {};
+    u64 CodeFingerprint {};
+
     u8* CodeMemBase;
     u8* ResetStart {};
+    JITPerfMap StubsPerfMap = JITPerfMap::None;
     u32 CodeMemSize {};
 
     bool Exit {};
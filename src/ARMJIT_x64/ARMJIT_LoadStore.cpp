@@ -69,38 +69,32 @@ u8* Compiler::RewriteMemAccess(u8* pc)
 
 bool Compiler::Comp_MemLoadLiteral(int size, bool signExtend, int rd, u32 addr)
 {
-    u32 localAddr = NDS.JIT.LocaliseCodeAddress(Num, addr);
-
-    int invalidLiteralIdx = NDS.JIT.InvalidLiterals.Find(localAddr);
-    if (invalidLiteralIdx != -1)
-    {
-        return false;
-    }
-
-    Comp_AddCycles_CDI();
-
+    u32 invalidLiteral;
     u32 val;
-    // make sure arm7 bios is accessible
-    u32 tmpR15 = CurCPU->R[15];
-    CurCPU->R[15] = R15;
     if (size == 32)
     {
-        CurCPU->DataRead32(addr & ~0x3, &val);
+        val = Probe(CompileProbe::Literal32, addr, R15, &invalidLiteral);
         val = melonDS::ROR(val, (addr & 0x3) << 3);
     }
     else if (size == 16)
     {
-        CurCPU->DataRead16(addr & ~0x1, &val);
+        val = Probe(CompileProbe::Literal16, addr, R15, &invalidLiteral);
         if (signExtend)
             val = ((s32)val << 16) >> 16;
     }
     else
     {
-        CurCPU->DataRead8(addr, &val);
+        val = Probe(CompileProbe::Literal8, addr, R15, &invalidLiteral);
         if (signExtend)
             val = ((s32)val << 24) >> 24;
     }
-    CurCPU->R[15] = tmpR15;
+
+    if (invalidLiteral)
+    {
+        return false;
+    }
+
+    Comp_AddCycles_CDI();
 
     MOV(32, MapReg(rd), Imm32(val));
 
@@ -196,9 +190,7 @@ void Compiler::Comp_MemAccess(int rd, int rn, const Op2& op2, int size, int flag
     if ((flags & memop_Writeback) && !(flags & memop_Post))
         MOV(32, rnMapped, R(finalAddr));
 
-    u32 expectedTarget = Num == 0
-        ? NDS.JIT.Memory.ClassifyAddress9(CurInstr.DataRegion)
-        : NDS.JIT.Memory.ClassifyAddress7(CurInstr.DataRegion);
+    u32 expectedTarget = ClassifyAddress(CurInstr.DataRegion);
 
     if (NDS.JIT.FastMemoryEnabled() && ((!Thumb && CurInstr.Cond() != 0xE) || NDS.JIT.Memory.IsFastmemCompatible(expectedTarget)))
     {
@@ -261,7 +253,7 @@ void Compiler::Comp_MemAccess(int rd, int rn, const Op2& op2, int size, int flag
 
         assert(patch.Size >= 5);
 
-        LoadStorePatches[memopLoadStoreLocation] = patch;
+        AddLoadStorePatch(memopLoadStoreLocation, patch);
     }
     else
     {
@@ -269,16 +261,19 @@ void Compiler::Comp_MemAccess(int rd, int rn, const Op2& op2, int size, int flag
 
         void* func = NULL;
         if (addrIsStatic)
-            func = NDS.JIT.Memory.GetFuncForAddr(CurCPU, staticAddress, flags & memop_Store, size);
+            func = GetFuncForAddr(staticAddress, flags & memop_Store, size);
 
         if (func)
         {
             AND(32, R(RSCRATCH3), Imm8(addressMask));
 
+            // on Windows param 3 is R8 which is also scratch 4 which can be used for rd
+            if (flags & memop_Store)
+                MOV(32, R(ABI_PARAM3), rdMapped);
+
+            MOV(64, R(ABI_PARAM2), R(RCPU));
             if (ABI_PARAM1 != RSCRATCH3)
                 MOV(32, R(ABI_PARAM1), R(RSCRATCH3));
-            if (flags & memop_Store)
-                MOV(32, R(ABI_PARAM2), rdMapped);
 
             ABI_CallFunction((void (*)())func);
 
@@ -303,15 +298,16 @@ void Compiler::Comp_MemAccess(int rd, int rn, const Op2& op2, int size, int flag
         }
         else
         {
+            // on Windows param 3 is R8 which is also scratch 4 which can be used for rd
+            if (flags & memop_Store)
+                MOV(32, R(ABI_PARAM3), rdMapped);
+
+            MOV(64, R(ABI_PARAM2), R(RCPU));
+            if (ABI_PARAM1 != RSCRATCH3)
+                MOV(32, R(ABI_PARAM1), R(RSCRATCH3));
+
             if (Num == 0)
             {
-                // on Windows param 3 is R8 which is also scratch 4 which can be used for rd
-                if (flags & memop_Store)
-                    MOV(32, R(ABI_PARAM3), rdMapped);
-
-                MOV(64, R(ABI_PARAM2), R(RCPU));
-                if (ABI_PARAM1 != RSCRATCH3)
-                    MOV(32, R(ABI_PARAM1), R(RSCRATCH3));
                 if (flags & memop_Store)
                 {
                     switch (size | NDS.ConsoleType)
@@ -339,12 +335,8 @@ void Compiler::Comp_MemAccess(int rd, int rn, const Op2& op2, int size, int flag
             }
             else
             {
-                if (ABI_PARAM1 != RSCRATCH3)
-                    MOV(32, R(ABI_PARAM1), R(RSCRATCH3));
                 if (flags & memop_Store)
                 {
-                    MOV(32, R(ABI_PARAM2), rdMapped);
-
                     switch (size | NDS.ConsoleType)
                     {
                     case 32: ABI_CallFunction(&SlowWrite7<u32, 0>); break;
@@ -422,9 +414,7 @@ s32 Compiler::Comp_MemAccessBlock(int rn, BitSet16 regs, bool store, bool preinc
 
     s32 offset = (regsCount * 4) * (decrement ? -1 : 1);
 
-    int expectedTarget = Num == 0
-        ? NDS.JIT.Memory.ClassifyAddress9(CurInstr.DataRegion)
-        : NDS.JIT.Memory.ClassifyAddress7(CurInstr.DataRegion);
+    int expectedTarget = ClassifyAddress(CurInstr.DataRegion);
 
     if (!store)
         Comp_AddCycles_CDI();
@@ -505,7 +495,7 @@ s32 Compiler::Comp_MemAccessBlock(int rn, BitSet16 regs, bool store, bool preinc
         for (i = 0; i < regsCount; i++)
         {
             patch.Offset = fastPathStart - loadStoreAddr[i];
-            LoadStorePatches[loadStoreAddr[i]] = patch;
+            AddLoadStorePatch(loadStoreAddr[i], patch);
         }
     }
 
@@ -521,8 +511,7 @@ s32 Compiler::Comp_MemAccessBlock(int rn, BitSet16 regs, bool store, bool preinc
         else
             LEA(64, ABI_PARAM2, MDisp(RSP, allocOffset));
 
-        if (Num == 0)
-            MOV(64, R(ABI_PARAM4), R(RCPU));
+        MOV(64, R(ABI_PARAM4), R(RCPU));
 
         switch (Num * 2 | NDS.ConsoleType)
         {
@@ -625,8 +614,7 @@ s32 Compiler::Comp_MemAccessBlock(int rn, BitSet16 regs, bool store, bool preinc
             MOV(64, R(ABI_PARAM2), R(RSP));
 
         MOV(32, R(ABI_PARAM3), Imm32(regsCount));
-        if (Num == 0)
-            MOV(64, R(ABI_PARAM4), R(RCPU));
+        MOV(64, R(ABI_PARAM4), R(RCPU));
 
         switch (Num * 2 | NDS.ConsoleType)
         {
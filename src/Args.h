@@ -54,6 +54,25 @@ constexpr std::array<u8, N> BrokenBIOS = []() constexpr {
     return broken;
 }();
 
+/// Symbol files which tell the Linux perf profiler what the code the JIT
+/// generates belongs to. Without them, all samples in JIT code end up
+/// in a single anonymous mapping.
+enum class JITPerfMap
+{
+    None,
+
+    /// Writes /tmp/perf-<pid>.map, which perf report reads by itself.
+    /// Code memory that gets reused may still show the name
+    /// of a block that was compiled there before.
+    PerfMap,
+
+    /// Writes /tmp/jit-<pid>.dump, which needs to be merged into the
+    /// recording with perf inject --jit. The recording needs to be done
+    /// with perf record -k 1. Keeps track of reused code memory and
+    /// includes the code, so it can be annotated.
+    JitDump,
+};
+
 /// Arguments that configure the JIT.
 /// Ignored in builds that don't have the JIT included.
 struct JITArgs
@@ -67,6 +86,27 @@ struct JITArgs
     /// Enabled by default, but frontends should disable this when debugging
     /// so the constants segfaults don't hinder debugging.
     bool FastMemory = true;
+
+    /// Keep compiled blocks around so they can be used again
+    /// instead of being compiled another time, including in
+    /// later sessions (see ARMJIT::SaveCodeCache).
+    /// Only supported on x86-64, ignored elsewhere.
+    bool CodeCache = false;
+
+    /// Only supported on Linux, ignored elsewhere.
+    JITPerfMap PerfMap = JITPerfMap::None;
+
+    /// Compile blocks which are run often a second time,
+    /// following branches for up to four times MaxBlockSize instructions,
+    /// going around short loops several times.
+    /// Makes IRQs be serviced later, so this is off by default.
+    bool Superblocks = false;
+
+    /// Compile blocks on a thread of their own, and interpret them
+    /// until they're done. Makes how far the emulation gets in a frame
+    /// depend on how fast the host is, so runs can't be reproduced exactly.
+    /// Only supported on x86-64, ignored elsewhere.
+    bool AsyncCompile = false;
 };
 
 using ARM9BIOSImage = std::array<u8, ARM9BIOSSize>;
@@ -112,6 +152,28 @@ struct NDSArgs
     /// Ignored in builds that don't have the GDB stub included.
     std::optional<GDBArgs> GDB = std::nullopt;
 
+    /// Run the BIOS functions for decompression (LZ77, RL, diff filters),
+    /// memory copies (CpuSet, CpuFastSet), math (Div, Sqrt) and GetCRC16
+    /// natively instead of running the BIOS code for them.
+    /// Works with both FreeBIOS and real BIOS dumps,
+    /// though the time they take is only estimated.
+    /// Can be changed later with NDS::SetBIOSHLE.
+    bool BIOSHLE = false;
+
+    /// Let the interpreter skip ahead to the next event when a CPU
+    /// is in a loop that waits for one (see ARM::CheckIdleLoop),
+    /// like the JIT always does for the idle loops it finds.
+    /// Loops are only told apart by the CPU state and memory writes,
+    /// so this is off by default.
+    /// Can be changed later with NDS::SetIdleLoopSkip.
+    bool IdleLoopSkip = false;
+
+    /// Time the ARM9's code fetches from cached memory by looking them up
+    /// in its instruction cache, instead of assuming the same average
+    /// timing for all of them. Only the interpreter takes this into account.
+    /// Can be changed later with NDS::SetICacheTiming.
+    bool ICacheTiming = false;
+
     /// The 3D renderer to initialize the DS with.
     /// Defaults to the software renderer.
     /// Can be changed later at any time.
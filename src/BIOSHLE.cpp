@@ -0,0 +1,496 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "BIOSHLE.h"
+#include "NDS.h"
+#include "ARM.h"
+#include "SPI.h"
+
+namespace melonDS::BIOSHLE
+{
+
+enum
+{
+    SWI_Div = 0x09,
+    SWI_CpuSet = 0x0B,
+    SWI_CpuFastSet = 0x0C,
+    SWI_Sqrt = 0x0D,
+    SWI_GetCRC16 = 0x0E,
+    SWI_LZ77UnCompWram = 0x11,
+    SWI_RLUnCompWram = 0x14,
+    SWI_Diff8bitUnFilter = 0x16,
+    SWI_Diff16bitUnFilter = 0x18,
+};
+
+// the ...ReadByCallback variants (LZ77/RL to VRAM, Huffman) read
+// their data through functions of the game, so they're left to the BIOS
+
+// the BIOS itself can't be read from (and the BIOS would return nothing)
+bool IsBIOS(ARM* cpu, u32 addr)
+{
+    if (cpu->Num == 0)
+        return addr >= 0xFFFF0000;
+    else
+        return addr < 0x00004000;
+}
+
+// how many bytes from addr on are plain main RAM, which can be accessed
+// directly instead of one unit at a time through the bus
+u32 DirectMainRAM(ARM* cpu, u32 addr, u32 len)
+{
+    melonDS::NDS& nds = cpu->NDS;
+    if ((addr & 0xFF000000) != 0x02000000)
+        return 0;
+
+    len = std::min(len, nds.MainRAMMask + 1 - (addr & nds.MainRAMMask));
+    len = std::min(len, 0x03000000 - addr);
+
+    if (cpu->Num == 0)
+    {
+        ARMv5* arm9 = (ARMv5*)cpu;
+        if (addr < arm9->ITCMSize)
+            return 0;
+
+        if (arm9->DTCMMask)
+        {
+            u32 dtcmStart = arm9->DTCMBase;
+            u32 dtcmEnd = dtcmStart + ~arm9->DTCMMask + 1;
+            if (addr >= dtcmStart && addr < dtcmEnd)
+                return 0;
+            if (addr < dtcmStart && addr + len > dtcmStart)
+                len = dtcmStart - addr;
+        }
+    }
+
+    return len;
+}
+
+// drops the compiled blocks, or the interpreter's decoded instructions,
+// for the code that's overwritten
+void InvalidateMainRAM(ARM* cpu, u32 addr, u32 len)
+{
+#ifdef JIT_ENABLED
+    for (u32 i = addr & ~0xF; i < addr + len; i += 16)
+    {
+        if (cpu->Num == 0)
+            cpu->NDS.JIT.CheckAndInvalidate<0, ARMJIT_Memory::memregion_MainRAM>(i);
+        else
+            cpu->NDS.JIT.CheckAndInvalidate<1, ARMJIT_Memory::memregion_MainRAM>(i);
+    }
+#endif
+}
+
+u32 ReadUnit(ARM* cpu, u32 addr, u32 width)
+{
+    u32 val;
+    switch (width)
+    {
+    case 1: cpu->DataRead8(addr, &val); return val;
+    case 2: cpu->DataRead16(addr, &val); return val;
+    default: cpu->DataRead32(addr, &val); return val;
+    }
+}
+
+void WriteUnit(ARM* cpu, u32 addr, u32 val, u32 width)
+{
+    switch (width)
+    {
+    case 1: cpu->DataWrite8(addr, val); break;
+    case 2: cpu->DataWrite16(addr, val); break;
+    default: cpu->DataWrite32(addr, val); break;
+    }
+}
+
+// width is the size of the accesses the BIOS would do, which
+// only matters outside of main RAM (e.g. 8-bit writes to VRAM are dropped)
+void ReadBlock(ARM* cpu, u32 addr, u8* data, u32 len, u32 width)
+{
+    while (len)
+    {
+        u32 direct = DirectMainRAM(cpu, addr, len);
+        if (direct)
+        {
+            memcpy(data, &cpu->NDS.MainRAM[addr & cpu->NDS.MainRAMMask], direct);
+        }
+        else
+        {
+            direct = width;
+            u32 val = ReadUnit(cpu, addr, width);
+            memcpy(data, &val, width);
+        }
+
+        addr += direct;
+        data += direct;
+        len -= direct;
+    }
+}
+
+void WriteBlock(ARM* cpu, u32 addr, const u8* data, u32 len, u32 width)
+{
+    while (len)
+    {
+        u32 direct = DirectMainRAM(cpu, addr, len);
+        if (direct)
+        {
+            InvalidateMainRAM(cpu, addr, direct);
+            memcpy(&cpu->NDS.MainRAM[addr & cpu->NDS.MainRAMMask], data, direct);
+        }
+        else
+        {
+            direct = width;
+            u32 val = 0;
+            memcpy(&val, data, width);
+            WriteUnit(cpu, addr, val, width);
+        }
+
+        addr += direct;
+        data += direct;
+        len -= direct;
+    }
+}
+
+// reads compressed data, for which the length isn't known beforehand
+class SourceReader
+{
+public:
+    SourceReader(ARM* cpu, u32 addr) : CPU(cpu), Addr(addr) {}
+
+    u8 Read8()
+    {
+        if (Pos == End)
+            Refill();
+        Addr++;
+        return *Pos++;
+    }
+
+    u32 Read32()
+    {
+        u32 val = Read8();
+        val |= Read8() << 8;
+        val |= Read8() << 16;
+        val |= Read8() << 24;
+        return val;
+    }
+
+private:
+    void Refill()
+    {
+        u32 direct = DirectMainRAM(CPU, Addr, 0x1000);
+        if (direct)
+        {
+            Pos = &CPU->NDS.MainRAM[Addr & CPU->NDS.MainRAMMask];
+            End = Pos + direct;
+        }
+        else
+        {
+            // byte by byte, so that nothing past the end is touched
+            Byte = ReadUnit(CPU, Addr, 1);
+            Pos = &Byte;
+            End = Pos + 1;
+        }
+    }
+
+    ARM* CPU;
+    u32 Addr;
+    const u8* Pos = nullptr;
+    const u8* End = nullptr;
+    u8 Byte;
+};
+
+bool Div(ARM* cpu)
+{
+    s32 num = (s32)cpu->R[0];
+    s32 den = (s32)cpu->R[1];
+    if (den == 0 || (num == INT32_MIN && den == -1))
+        return false;
+
+    s32 quot = num / den;
+    cpu->R[0] = (u32)quot;
+    cpu->R[1] = (u32)(num % den);
+    cpu->R[3] = (u32)(quot < 0 ? -quot : quot);
+    return true;
+}
+
+bool Sqrt(ARM* cpu)
+{
+    u32 val = cpu->R[0];
+    u32 res = 0;
+    u32 bit = 1 << 30;
+    while (bit > val)
+        bit >>= 2;
+
+    while (bit)
+    {
+        if (val >= res + bit)
+        {
+            val -= res + bit;
+            res = (res >> 1) + bit;
+        }
+        else
+            res >>= 1;
+        bit >>= 2;
+    }
+
+    cpu->R[0] = res;
+    return true;
+}
+
+bool CpuSet(ARM* cpu, u32& units, bool fast)
+{
+    u32 src = cpu->R[0];
+    u32 dst = cpu->R[1];
+    u32 count = cpu->R[2] & 0x1FFFFF;
+    bool fill = cpu->R[2] & (1 << 24);
+    u32 width = (fast || (cpu->R[2] & (1 << 26))) ? 4 : 2;
+
+    if (fast)
+        count = (count + 7) & ~7;
+
+    src &= ~(width - 1);
+    dst &= ~(width - 1);
+    if (IsBIOS(cpu, src))
+        return false;
+
+    u32 len = count * width;
+    units = count;
+    if (!len)
+        return true;
+
+    std::vector<u8> buffer(len);
+    if (fill)
+    {
+        u32 val = ReadUnit(cpu, src, width);
+        for (u32 i = 0; i < len; i += width)
+            memcpy(&buffer[i], &val, width);
+    }
+    else if (dst > src && dst < src + len)
+    {
+        // the BIOS copies forwards, a unit at a time, so the
+        // overlapping part is filled with the start over and over
+        for (u32 i = 0; i < len; i += width)
+            WriteUnit(cpu, dst + i, ReadUnit(cpu, src + i, width), width);
+        return true;
+    }
+    else
+        ReadBlock(cpu, src, buffer.data(), len, width);
+
+    WriteBlock(cpu, dst, buffer.data(), len, width);
+    return true;
+}
+
+bool GetCRC16(ARM* cpu, u32& units)
+{
+    u32 addr = cpu->R[1] & ~1;
+    u32 len = cpu->R[2] & ~1;
+    if (IsBIOS(cpu, addr))
+        return false;
+
+    units = len / 2;
+    if (!len)
+        return true;
+
+    std::vector<u8> buffer(len);
+    ReadBlock(cpu, addr, buffer.data(), len, 2);
+
+    cpu->R[0] = CRC16(buffer.data(), len, cpu->R[0] & 0xFFFF);
+    cpu->R[3] = buffer[len - 2] | (buffer[len - 1] << 8);
+    return true;
+}
+
+bool LZ77UnComp(ARM* cpu, u32& units)
+{
+    if (IsBIOS(cpu, cpu->R[0]))
+        return false;
+
+    SourceReader src(cpu, cpu->R[0]);
+    u32 header = src.Read32();
+    u32 len = header >> 8;
+    if ((header & 0xF0) != 0x10 || !len)
+        return false;
+
+    std::vector<u8> out(len);
+    u32 pos = 0;
+    while (pos < len)
+    {
+        u8 flags = src.Read8();
+        for (int i = 0; i < 8 && pos < len; i++, flags <<= 1)
+        {
+            if (!(flags & 0x80))
+            {
+                out[pos++] = src.Read8();
+                continue;
+            }
+
+            u8 b0 = src.Read8();
+            u8 b1 = src.Read8();
+            u32 disp = (((b0 & 0xF) << 8) | b1) + 1;
+            u32 count = std::min<u32>((b0 >> 4) + 3, len - pos);
+            if (disp > pos)
+            {
+                // refers to what was in memory before the data
+                return false;
+            }
+
+            // byte by byte, the ranges overlap for runs
+            for (u32 j = 0; j < count; j++, pos++)
+                out[pos] = out[pos - disp];
+        }
+    }
+
+    WriteBlock(cpu, cpu->R[1], out.data(), len, 1);
+    units = len;
+    return true;
+}
+
+bool RLUnComp(ARM* cpu, u32& units)
+{
+    if (IsBIOS(cpu, cpu->R[0]))
+        return false;
+
+    SourceReader src(cpu, cpu->R[0]);
+    u32 header = src.Read32();
+    u32 len = header >> 8;
+    if ((header & 0xF0) != 0x30 || !len)
+        return false;
+
+    std::vector<u8> out(len);
+    u32 pos = 0;
+    while (pos < len)
+    {
+        u8 flag = src.Read8();
+        if (flag & 0x80)
+        {
+            u32 count = std::min<u32>((flag & 0x7F) + 3, len - pos);
+            memset(&out[pos], src.Read8(), count);
+            pos += count;
+        }
+        else
+        {
+            u32 count = std::min<u32>((flag & 0x7F) + 1, len - pos);
+            for (u32 j = 0; j < count; j++)
+                out[pos++] = src.Read8();
+        }
+    }
+
+    WriteBlock(cpu, cpu->R[1], out.data(), len, 1);
+    units = len;
+    return true;
+}
+
+bool DiffUnFilter(ARM* cpu, u32& units, u32 width)
+{
+    if (IsBIOS(cpu, cpu->R[0]))
+        return false;
+
+    SourceReader src(cpu, cpu->R[0]);
+    u32 header = src.Read32();
+    u32 len = (header >> 8) & ~(width - 1);
+    if ((header & 0xF0) != 0x80 || !len)
+        return false;
+
+    std::vector<u8> out(len);
+    if (width == 1)
+    {
+        u8 acc = 0;
+        for (u32 i = 0; i < len; i++)
+            out[i] = acc += src.Read8();
+    }
+    else
+    {
+        u16 acc = 0;
+        for (u32 i = 0; i < len; i += 2)
+        {
+            u16 delta = src.Read8();
+            delta |= src.Read8() << 8;
+            acc += delta;
+            out[i] = acc & 0xFF;
+            out[i + 1] = acc >> 8;
+        }
+    }
+
+    WriteBlock(cpu, cpu->R[1], out.data(), len, width);
+    units = len / width;
+    return true;
+}
+
+bool HandleSWI(ARM* cpu, u32 num)
+{
+    // the costs are in bus cycles, estimated from the instructions
+    // the loops of the BIOS functions take for one unit of work
+    u32 units = 0;
+    u32 baseCost, unitCost;
+    bool handled;
+    switch (num)
+    {
+    case SWI_Div:
+        handled = Div(cpu);
+        baseCost = 160; unitCost = 0;
+        break;
+    case SWI_CpuSet:
+        handled = CpuSet(cpu, units, false);
+        baseCost = 40; unitCost = 10; // per halfword/word
+        break;
+    case SWI_CpuFastSet:
+        handled = CpuSet(cpu, units, true);
+        baseCost = 40; unitCost = 3; // per word
+        break;
+    case SWI_Sqrt:
+        handled = Sqrt(cpu);
+        baseCost = 120; unitCost = 0;
+        break;
+    case SWI_GetCRC16:
+        handled = GetCRC16(cpu, units);
+        baseCost = 40; unitCost = 36; // per halfword
+        break;
+    case SWI_LZ77UnCompWram:
+        handled = LZ77UnComp(cpu, units);
+        baseCost = 60; unitCost = 9; // per byte written
+        break;
+    case SWI_RLUnCompWram:
+        handled = RLUnComp(cpu, units);
+        baseCost = 60; unitCost = 7; // per byte written
+        break;
+    // these two only exist on the ARM9
+    case SWI_Diff8bitUnFilter:
+        handled = cpu->Num == 0 && DiffUnFilter(cpu, units, 1);
+        baseCost = 50; unitCost = 8; // per byte
+        break;
+    case SWI_Diff16bitUnFilter:
+        handled = cpu->Num == 0 && DiffUnFilter(cpu, units, 2);
+        baseCost = 50; unitCost = 8; // per halfword
+        break;
+    default:
+        return false;
+    }
+
+    if (!handled)
+        return false;
+
+    // the ARM9 runs the BIOS from uncached memory, so it waits on the bus all the time
+    u64 cycles = baseCost + (u64)unitCost * units;
+    if (cpu->Num == 0)
+        cycles <<= cpu->NDS.ARM9ClockShift;
+    cpu->Cycles += (s32)std::min<u64>(cycles, INT32_MAX / 2);
+    cpu->AddCycles_C();
+    return true;
+}
+
+}
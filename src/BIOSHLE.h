@@ -0,0 +1,44 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef BIOSHLE_H
+#define BIOSHLE_H
+
+#include "types.h"
+
+namespace melonDS
+{
+class ARM;
+
+// Native versions of the BIOS functions which games spend the most time in
+// (decompression, memory copies and math), see NDSArgs::BIOSHLE.
+// They work the same with FreeBIOS and with real BIOS dumps.
+namespace BIOSHLE
+{
+
+// runs SWI num, instead of jumping to the BIOS
+// returns false if it's none of the supported ones, or for the cases
+// where the result would depend on the BIOS (e.g. reading from the BIOS,
+// dividing by zero), then the BIOS has to run it as usual
+bool HandleSWI(ARM* cpu, u32 num);
+
+}
+
+}
+
+#endif // BIOSHLE_H
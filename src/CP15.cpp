@@ -18,12 +18,16 @@
 
 #include <stdio.h>
 #include <string.h>
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#endif
 #include "NDS.h"
 #include "DSi.h"
 #include "ARM.h"
 #include "Platform.h"
 #include "ARMJIT_Memory.h"
 #include "ARMJIT.h"
+#include "dolphin/BitSet.h"
 
 namespace melonDS
 {
@@ -77,6 +81,12 @@ void ARMv5::CP15DoSavestate(Savestate* file)
 {
     file->Section("CP15");
 
+    // rolling back in memory (see Savestate::SetIncremental), the PU maps
+    // only have to be rebuilt if their settings changed
+    const u32 oldsettings[] = {CP15Control, PU_CodeCacheable, PU_DataCacheable, PU_DataCacheWrite, PU_CodeRW, PU_DataRW};
+    u32 oldregions[8];
+    memcpy(oldregions, PU_Region, sizeof(oldregions));
+
     file->Var32(&CP15Control);
 
     file->Var32(&DTCMSetting);
@@ -94,11 +104,33 @@ void ARMv5::CP15DoSavestate(Savestate* file)
 
     file->VarArray(PU_Region, 8*sizeof(u32));
 
+    // the instruction cache, so that fetches are timed the same way
+    // after loading a state as in a straight run (see NDS::SetICacheTiming)
+    bool icache = file->Saving || file->IsAtLeastVersion(12, 3);
+    if (icache)
+    {
+        file->VarArray(ICache, 0x2000);
+        file->VarArray(ICacheTags, 64*4*sizeof(u32));
+        file->VarArray(ICacheCount, 64);
+        file->Var32(&RNGSeed);
+    }
+
     if (!file->Saving)
     {
         UpdateDTCMSetting();
         UpdateITCMSetting();
-        UpdatePURegions(true);
+
+        // older states don't have it, those start over with an empty one
+        if (icache)
+            CurICacheAddr = 1;
+        else
+            ICacheInvalidateAll();
+
+        const u32 settings[] = {CP15Control, PU_CodeCacheable, PU_DataCacheable, PU_DataCacheWrite, PU_CodeRW, PU_DataRW};
+        if (!file->IsIncremental()
+            || memcmp(settings, oldsettings, sizeof(settings)) != 0
+            || memcmp(PU_Region, oldregions, sizeof(oldregions)) != 0)
+            UpdatePURegions(true);
     }
 }
 
@@ -128,6 +160,9 @@ void ARMv5::UpdateDTCMSetting()
         NDS.JIT.Memory.RemapDTCM(newDTCMBase, newDTCMSize);
         DTCMBase = newDTCMBase;
         DTCMMask = newDTCMMask;
+#ifdef JIT_ENABLED
+        ResetDecodedPage();
+#endif
     }
 }
 
@@ -144,6 +179,11 @@ void ARMv5::UpdateITCMSetting()
     {
         ITCMSize = 0;
     }
+
+#ifdef JIT_ENABLED
+    // the addresses the ITCM was or is now at are mapped elsewhere
+    ResetDecodedPage();
+#endif
 }
 
 
@@ -337,34 +377,47 @@ u32 ARMv5::RandomLineIndex()
     return (RNGSeed >> 17) & 0x3;
 }
 
-void ARMv5::ICacheLookup(u32 addr)
+// finds which of the 4 ways of a set holds the given tag
+// returns -1 if none of them does
+// only x86 has a vector version, other hosts go through the ways one by one
+static inline int ICacheFindWay(const u32* tags, u32 tag)
 {
-    u32 tag = addr & 0xFFFFF800;
-    u32 id = (addr >> 5) & 0x3F;
-
-    id <<= 2;
-    if (ICacheTags[id+0] == tag)
-    {
-        CodeCycles = 1;
-        CurICacheLine = &ICache[(id+0) << 5];
-        return;
-    }
-    if (ICacheTags[id+1] == tag)
+    // there can't be more than one match, invalid lines are set to 1
+    // which can't match any tag
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+    __m128i cmp = _mm_cmpeq_epi32(_mm_load_si128((const __m128i*)tags), _mm_set1_epi32(tag));
+    u32 mask = _mm_movemask_ps(_mm_castsi128_ps(cmp));
+    if (!mask) return -1;
+    return Common::LeastSignificantSetBit(mask);
+#else
+    for (int i = 0; i < 4; i++)
     {
-        CodeCycles = 1;
-        CurICacheLine = &ICache[(id+1) << 5];
-        return;
+        if (tags[i] == tag)
+            return i;
     }
-    if (ICacheTags[id+2] == tag)
+    return -1;
+#endif
+}
+
+void ARMv5::ICacheLookup(u32 addr)
+{
+    // sequential fetches mostly stay within the same line
+    if ((addr & ~0x1F) == CurICacheAddr)
     {
         CodeCycles = 1;
-        CurICacheLine = &ICache[(id+2) << 5];
         return;
     }
-    if (ICacheTags[id+3] == tag)
+
+    u32 tag = addr & 0xFFFFF800;
+    u32 id = (addr >> 5) & 0x3F;
+
+    id <<= 2;
+    int way = ICacheFindWay(&ICacheTags[id], tag);
+    if (way >= 0)
     {
         CodeCycles = 1;
-        CurICacheLine = &ICache[(id+3) << 5];
+        CurICacheLine = &ICache[(id+way) << 5];
+        CurICacheAddr = addr & ~0x1F;
         return;
     }
 
@@ -402,6 +455,7 @@ void ARMv5::ICacheLookup(u32 addr)
     //printf("cache miss %08X: %d/%d\n", addr, NDS::ARM9MemTimings[addr >> 14][2], NDS::ARM9MemTimings[addr >> 14][3]);
     CodeCycles = (NDS.ARM9MemTimings[addr >> 14][2] + (NDS.ARM9MemTimings[addr >> 14][3] * 7)) << NDS.ARM9ClockShift;
     CurICacheLine = ptr;
+    CurICacheAddr = addr;
 }
 
 void ARMv5::ICacheInvalidateByAddr(u32 addr)
@@ -410,32 +464,20 @@ void ARMv5::ICacheInvalidateByAddr(u32 addr)
     u32 id = (addr >> 5) & 0x3F;
 
     id <<= 2;
-    if (ICacheTags[id+0] == tag)
-    {
-        ICacheTags[id+0] = 1;
-        return;
-    }
-    if (ICacheTags[id+1] == tag)
-    {
-        ICacheTags[id+1] = 1;
-        return;
-    }
-    if (ICacheTags[id+2] == tag)
-    {
-        ICacheTags[id+2] = 1;
-        return;
-    }
-    if (ICacheTags[id+3] == tag)
-    {
-        ICacheTags[id+3] = 1;
-        return;
-    }
+    int way = ICacheFindWay(&ICacheTags[id], tag);
+    if (way >= 0)
+        ICacheTags[id+way] = 1;
+
+    if ((addr & ~0x1F) == CurICacheAddr)
+        CurICacheAddr = 1;
 }
 
 void ARMv5::ICacheInvalidateAll()
 {
     for (int i = 0; i < 64*4; i++)
         ICacheTags[i] = 1;
+
+    CurICacheAddr = 1;
 }
 
 
@@ -792,22 +834,36 @@ u32 ARMv5::CodeRead32(u32 addr, bool branch)
         }
     }*/
 
+    UpdateCodeCycles(addr, branch);
+    return CodeFetch32(addr);
+}
+
+void ARMv5::UpdateCodeCycles(u32 addr, bool branch)
+{
     if (addr < ITCMSize)
     {
         CodeCycles = 1;
-        return *(u32*)&ITCM[addr & (ITCMPhysicalSize - 1)];
+        return;
     }
 
     CodeCycles = RegionCodeCycles;
     if (CodeCycles == 0xFF) // cached memory. hax
     {
-        if (branch || !(addr & 0x1F))
-            CodeCycles = kCodeCacheTiming;//ICacheLookup(addr);
-        else
+        if (!branch && (addr & 0x1F))
             CodeCycles = 1;
+        else if (NDS.IsICacheTimingEnabled() && !NDS.IsJITEnabled())
+            ICacheLookup(addr);
+        else
+            CodeCycles = kCodeCacheTiming;
 
         //return *(u32*)&CurICacheLine[addr & 0x1C];
     }
+}
+
+u32 ARMv5::CodeFetch32(u32 addr)
+{
+    if (addr < ITCMSize)
+        return *(u32*)&ITCM[addr & (ITCMPhysicalSize - 1)];
 
     if (CodeMem.Mem) return *(u32*)&CodeMem.Mem[addr & CodeMem.Mask];
 
@@ -923,6 +979,8 @@ void ARMv5::DataRead32S(u32 addr, u32* val)
 
 void ARMv5::DataWrite8(u32 addr, u8 val)
 {
+    IdleLoopWrite(addr);
+
     if (!(PU_Map[addr>>12] & 0x02))
     {
         DataAbort();
@@ -951,6 +1009,8 @@ void ARMv5::DataWrite8(u32 addr, u8 val)
 
 void ARMv5::DataWrite16(u32 addr, u16 val)
 {
+    IdleLoopWrite(addr);
+
     if (!(PU_Map[addr>>12] & 0x02))
     {
         DataAbort();
@@ -981,6 +1041,8 @@ void ARMv5::DataWrite16(u32 addr, u16 val)
 
 void ARMv5::DataWrite32(u32 addr, u32 val)
 {
+    IdleLoopWrite(addr);
+
     if (!(PU_Map[addr>>12] & 0x02))
     {
         DataAbort();
@@ -1011,6 +1073,8 @@ void ARMv5::DataWrite32(u32 addr, u32 val)
 
 void ARMv5::DataWrite32S(u32 addr, u32 val)
 {
+    IdleLoopWrite(addr);
+
     addr &= ~3;
 
     if (addr < ITCMSize)
@@ -17,6 +17,7 @@
 */
 
 #include <stdio.h>
+#include <algorithm>
 #include <assert.h>
 #include <string.h>
 #include <inttypes.h>
@@ -163,6 +164,7 @@ void DSi::Reset()
     SCFG_Clock7 = 0x0187;
     SCFG_EXT[0] = 0x8307F100;
     SCFG_EXT[1] = 0x93FFFB06;
+    UpdateMemPages();
     SCFG_MC = 0x0010 | (~((u32)(NDSCartSlot.GetCart() != nullptr))&1);//0x0011;
     SCFG_RST = 0;
 
@@ -232,7 +234,7 @@ void DSi::DoSavestateExtra(Savestate* file)
         file->VarArray(&MBK[1][5], sizeof(u32)*3);
         file->Var32(&MBK[0][8]);
     }
-    else
+    else if (!file->IsSkippingSection())
     {
         Set_SCFG_Clock9(SCFG_Clock9);
         Set_SCFG_MC(SCFG_MC);
@@ -278,6 +280,8 @@ void DSi::DoSavestateExtra(Savestate* file)
         mbk[11] &= 0x00FFFF0F;
         MBK[0][8] = mbk[11];
         MBK[1][8] = mbk[11];
+
+        UpdateMemPages();
     }
 
     for (int i = 0; i < 8; i++)
@@ -720,6 +724,7 @@ void DSi::SoftReset()
     SCFG_Clock7 = 0x0187;
     SCFG_EXT[0] = 0x8307F100;
     SCFG_EXT[1] = 0x93FFFB06;
+    UpdateMemPages();
     SCFG_MC = 0x0010;//0x0011;
     // TODO: is this actually reset?
     SCFG_RST = 0;
@@ -757,6 +762,7 @@ bool DSi::LoadNAND()
     // run.
     SCFG_EXT[0] |= (1 << 25);
     SCFG_EXT[1] |= (1 << 25);
+    UpdateMemPages();
 
     memset(NWRAM_A, 0, NWRAMSize);
     memset(NWRAM_B, 0, NWRAMSize);
@@ -1259,6 +1265,46 @@ void DSi::MapNWRAMRange(u32 cpu, u32 num, u32 val)
         case 3: NWRAMMask[cpu][num] = 0x7; break;
         }
     }
+
+    UpdateMemPages();
+}
+
+void DSi::UpdateMemPages() noexcept
+{
+    NDS::UpdateMemPages();
+
+    bool write = !IsJITEnabled();
+
+    for (u32 addr = 0x0C000000; addr < 0x0D000000; addr += MemPageSize)
+    {
+        for (u32 cpu = 0; cpu < 2; cpu++)
+        {
+            MemPages[cpu][0][addr >> MemPageShift] = &MainRAM[addr & MainRAMMask];
+            if (write)
+                MemPages[cpu][1][addr >> MemPageShift] = &MainRAM[addr & MainRAMMask];
+        }
+    }
+
+    // NWRAM always goes through the usual path, as it has too many special cases
+    // (writes going to every bank mapped to the same place, etc.)
+    for (u32 cpu = 0; cpu < 2; cpu++)
+    {
+        if (!(SCFG_EXT[cpu] & (1 << 25)))
+            continue;
+
+        for (int num = 0; num < 3; num++)
+        {
+            u32 end = std::min(NWRAMEnd[cpu][num], 0x04000000u);
+            for (u32 addr = NWRAMStart[cpu][num] & ~(MemPageSize-1); addr < end; addr += MemPageSize)
+            {
+                MemPages[cpu][0][addr >> MemPageShift] = nullptr;
+                MemPages[cpu][1][addr >> MemPageShift] = nullptr;
+            }
+        }
+    }
+
+    // region lock hack, see ARM9Read32
+    MemPages[0][0][0x02FE71B0 >> MemPageShift] = nullptr;
 }
 
 void DSi::UpdateVRAMTimings()
@@ -2783,10 +2829,13 @@ u16 DSi::ARM7IORead16(u32 addr)
 
     if (addr >= 0x04004800 && addr < 0x04004A00)
     {
+        // the data port pops the FIFO
+        if (addr == 0x04004830) ARM7.IdleLoopDirty = true;
         return SDMMC.Read(addr);
     }
     if (addr >= 0x04004A00 && addr < 0x04004C00)
     {
+        if (addr == 0x04004A30) ARM7.IdleLoopDirty = true;
         return SDIO.Read(addr);
     }
 
@@ -2846,7 +2895,10 @@ u32 DSi::ARM7IORead32(u32 addr)
     case 0x04004170: return NDMAs[7].Cnt;
 
     case 0x04004400: return AES.ReadCnt();
-    case 0x0400440C: return AES.ReadOutputFIFO();
+    case 0x0400440C:
+        // reading pops the FIFO, loops doing it aren't idle
+        ARM7.IdleLoopDirty = true;
+        return AES.ReadOutputFIFO();
 
     case 0x04004D00: if (SCFG_BIOS & (1<<10)) return 0; return SDMMC.GetNAND()->GetConsoleID() & 0xFFFFFFFF;
     case 0x04004D04: if (SCFG_BIOS & (1<<10)) return 0; return SDMMC.GetNAND()->GetConsoleID() >> 32;
@@ -2859,11 +2911,14 @@ u32 DSi::ARM7IORead32(u32 addr)
 
     if (addr >= 0x04004800 && addr < 0x04004A00)
     {
+        // the data ports pop their FIFOs
+        if (addr == 0x0400490C || addr == 0x04004830) ARM7.IdleLoopDirty = true;
         if (addr == 0x0400490C) return SDMMC.ReadFIFO32();
         return SDMMC.Read(addr) | (SDMMC.Read(addr+2) << 16);
     }
     if (addr >= 0x04004A00 && addr < 0x04004C00)
     {
+        if (addr == 0x04004B0C || addr == 0x04004A30) ARM7.IdleLoopDirty = true;
         if (addr == 0x04004B0C) return SDIO.ReadFIFO32();
         return SDIO.Read(addr) | (SDIO.Read(addr+2) << 16);
     }
@@ -2880,11 +2935,13 @@ void DSi::ARM7IOWrite8(u32 addr, u8 val)
         if (!(SCFG_EXT[1] & (1 << 31))) /* no access to SCFG Registers if disabled*/
             return;
         SCFG_BIOS |= (val & 0x03);
+        JIT.ResetDecodedPages(); // the code at the BIOS addresses changed
         return;
     case 0x04004001:
         if (!(SCFG_EXT[1] & (1 << 31))) /* no access to SCFG Registers if disabled*/
             return;
         SCFG_BIOS |= ((val & 0x07) << 8);
+        JIT.ResetDecodedPages(); // the code at the BIOS addresses changed
         return;
     case 0x04004002:
         // SCFG_ROMWE. ignored, as it always reads as 0
@@ -2979,6 +3036,7 @@ void DSi::ARM7IOWrite16(u32 addr, u16 val)
             if (!(SCFG_EXT[1] & (1 << 31))) /* no access to SCFG Registers if disabled*/
                 return;
             SCFG_BIOS |= (val & 0x0703);
+            JIT.ResetDecodedPages(); // the code at the BIOS addresses changed
             return;
         case 0x04004002:
             // SCFG_ROMWE. ignored, as it always reads as 0
@@ -3086,6 +3144,7 @@ void DSi::ARM7IOWrite32(u32 addr, u32 val)
         if (!(SCFG_EXT[1] & (1 << 31))) /* no access to SCFG Registers if disabled*/
             return;
         SCFG_BIOS |= (val & 0x0703);
+        JIT.ResetDecodedPages(); // the code at the BIOS addresses changed
         return;
     case 0x04004008:
         if (!(SCFG_EXT[1] & (1 << 31))) /* no access to SCFG Registers if disabled*/
@@ -3094,6 +3153,7 @@ void DSi::ARM7IOWrite32(u32 addr, u32 val)
         SCFG_EXT[0] |= (val & 0x03000000);
         SCFG_EXT[1] &= ~0x93FF0F07;
         SCFG_EXT[1] |= (val & 0x93FF0F07);
+        UpdateMemPages();
         Log(LogLevel::Debug, "SCFG_EXT = %08X / %08X (val7 %08X)\n", SCFG_EXT[0], SCFG_EXT[1], val);
         return;
     case 0x04004010:
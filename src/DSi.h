@@ -117,6 +117,8 @@ public:
 
     bool ARM7GetMemRegion(u32 addr, bool write, MemRegion* region) override;
 
+    void UpdateMemPages() noexcept override;
+
     u8 ARM9IORead8(u32 addr) override;
     u16 ARM9IORead16(u32 addr) override;
     u32 ARM9IORead32(u32 addr) override;
@@ -0,0 +1,210 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_FLATHASHMAP_H
+#define MELONDS_FLATHASHMAP_H
+
+#include <assert.h>
+#include <string.h>
+#include "types.h"
+
+namespace melonDS
+{
+/*
+    FlatHashMap
+        - maps u32 keys (guest addresses, hashes) to pointers
+
+    - all entries live in one array, lookups probe linearly from the
+    hashed slot, so a lookup mostly touches a single cache line
+    - a null value marks an empty slot, so null can't be stored
+    - removing an entry moves the ones after it back instead of leaving
+    a tombstone, so lookups never get slower from removals
+    - doesn't allocate while no elements are inserted
+    - not stl conformant of course
+*/
+template<typename T>
+struct FlatHashMap
+{
+    struct Slot
+    {
+        u32 Key;
+        T* Value;
+    };
+
+    Slot* Slots = nullptr;
+    u32 Capacity = 0;
+    u32 Count = 0;
+
+    FlatHashMap() = default;
+    FlatHashMap(const FlatHashMap&) = delete;
+    FlatHashMap& operator=(const FlatHashMap&) = delete;
+
+    ~FlatHashMap()
+    {
+        delete[] Slots;
+    }
+
+    u32 Size() const
+    {
+        return Count;
+    }
+
+    T* Find(u32 key) const
+    {
+        if (!Count)
+            return nullptr;
+
+        for (u32 i = Home(key);; i = (i + 1) & (Capacity - 1))
+        {
+            if (!Slots[i].Value)
+                return nullptr;
+            if (Slots[i].Key == key)
+                return Slots[i].Value;
+        }
+    }
+
+    // returns the value which was replaced, if there was one
+    T* Insert(u32 key, T* value)
+    {
+        assert(value);
+        // kept at most 3/4 full
+        if ((Count + 1) * 4 > Capacity * 3)
+            Rehash(Capacity ? Capacity * 2 : 64);
+
+        u32 i = Home(key);
+        while (Slots[i].Value)
+        {
+            if (Slots[i].Key == key)
+            {
+                T* prev = Slots[i].Value;
+                Slots[i].Value = value;
+                return prev;
+            }
+            i = (i + 1) & (Capacity - 1);
+        }
+
+        Slots[i] = {key, value};
+        Count++;
+        return nullptr;
+    }
+
+    // returns the value which was removed, if there was one
+    T* Erase(u32 key)
+    {
+        if (!Count)
+            return nullptr;
+
+        for (u32 i = Home(key);; i = (i + 1) & (Capacity - 1))
+        {
+            if (!Slots[i].Value)
+                return nullptr;
+            if (Slots[i].Key == key)
+            {
+                T* value = Slots[i].Value;
+                RemoveSlot(i);
+                return value;
+            }
+        }
+    }
+
+    // calls func(key, value) for every entry
+    template <typename F>
+    void ForEach(F func) const
+    {
+        for (u32 i = 0; i < Capacity; i++)
+        {
+            if (Slots[i].Value)
+                func(Slots[i].Key, Slots[i].Value);
+        }
+    }
+
+    // removes every entry for which pred(key, value) returns true,
+    // pred is called exactly once for every entry
+    template <typename F>
+    void EraseIf(F pred)
+    {
+        if (!Count)
+            return;
+
+        // start right after an empty slot: entries are only ever moved back
+        // within a run of full slots, so none can be moved past the start
+        u32 start = 0;
+        while (Slots[start].Value)
+            start++;
+
+        for (u32 n = 1; n <= Capacity; n++)
+        {
+            u32 i = (start + n) & (Capacity - 1);
+            // whatever moves into this slot still needs to be looked at
+            while (Slots[i].Value && pred(Slots[i].Key, Slots[i].Value))
+                RemoveSlot(i);
+        }
+    }
+
+    void Clear()
+    {
+        if (Count)
+            memset(Slots, 0, sizeof(Slot) * Capacity);
+        Count = 0;
+    }
+
+private:
+    u32 Home(u32 key) const
+    {
+        // Fibonacci hashing, spreads out the aligned addresses
+        return (key * 0x9E3779B1) >> (32 - __builtin_ctz(Capacity));
+    }
+
+    void RemoveSlot(u32 hole)
+    {
+        // move entries back into the hole until one is already where it belongs
+        for (u32 i = (hole + 1) & (Capacity - 1); Slots[i].Value; i = (i + 1) & (Capacity - 1))
+        {
+            u32 home = Home(Slots[i].Key);
+            // only move it if the hole is between its home slot and where it is now
+            if (((i - home) & (Capacity - 1)) >= ((i - hole) & (Capacity - 1)))
+            {
+                Slots[hole] = Slots[i];
+                hole = i;
+            }
+        }
+
+        Slots[hole].Value = nullptr;
+        Count--;
+    }
+
+    void Rehash(u32 capacity)
+    {
+        Slot* oldSlots = Slots;
+        u32 oldCapacity = Capacity;
+
+        Slots = new Slot[capacity]();
+        Capacity = capacity;
+        Count = 0;
+
+        for (u32 i = 0; i < oldCapacity; i++)
+        {
+            if (oldSlots[i].Value)
+                Insert(oldSlots[i].Key, oldSlots[i].Value);
+        }
+        delete[] oldSlots;
+    }
+};
+}
+
+#endif //MELONDS_FLATHASHMAP_H
@@ -825,11 +825,11 @@ void GBACartSlot::DoSavestate(Savestate* file) noexcept
     }
     else
     {
-        u32 savetype;
+        u32 savetype = carttype; // kept if the section is skipped
         file->Var32(&savetype);
         if (savetype != carttype) return;
 
-        u32 savechk;
+        u32 savechk = cartchk;
         file->Var32(&savechk);
         if (savechk != cartchk) return;
     }
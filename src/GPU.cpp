@@ -119,6 +119,9 @@ void GPU::ResetVRAMCache() noexcept
 
 void GPU::Reset() noexcept
 {
+    GPU2D_Renderer->Sync();
+    GPU2D_Renderer->InvalidateLines();
+
     VCount = 0;
     NextVCount = -1;
     TotalScanlines = 0;
@@ -199,6 +202,9 @@ void GPU::Reset() noexcept
 
 void GPU::Stop() noexcept
 {
+    GPU2D_Renderer->Sync();
+    GPU2D_Renderer->InvalidateLines();
+
     int fbsize;
     if (GPU3D.IsRendererAccelerated())
         fbsize = (256*3 + 1) * 192;
@@ -215,6 +221,8 @@ void GPU::Stop() noexcept
 
 void GPU::DoSavestate(Savestate* file) noexcept
 {
+    GPU2D_Renderer->Sync();
+
     file->Section("GPUG");
 
     file->Var16(&VCount);
@@ -277,11 +285,16 @@ void GPU::DoSavestate(Savestate* file) noexcept
     GPU3D.DoSavestate(file);
 
     if (!file->Saving)
+    {
         ResetVRAMCache();
+        GPU2D_Renderer->InvalidateLines();
+    }
 }
 
 void GPU::AssignFramebuffers() noexcept
 {
+    GPU2D_Renderer->Sync();
+
     int backbuf = FrontBuffer ? 0 : 1;
     if (NDS.PowerControl9 & (1<<15))
     {
@@ -295,6 +308,9 @@ void GPU::AssignFramebuffers() noexcept
 
 void GPU::SetRenderer3D(std::unique_ptr<Renderer3D>&& renderer) noexcept
 {
+    // engine B checks whether the 3D renderer is accelerated
+    GPU2D_Renderer->Sync();
+
     if (renderer == nullptr)
         GPU3D.SetCurrentRenderer(std::make_unique<SoftRenderer>());
     else
@@ -305,6 +321,9 @@ void GPU::SetRenderer3D(std::unique_ptr<Renderer3D>&& renderer) noexcept
 
 void GPU::InitFramebuffers() noexcept
 {
+    GPU2D_Renderer->Sync();
+    GPU2D_Renderer->InvalidateLines();
+
     int fbsize;
     if (GPU3D.IsRendererAccelerated())
         fbsize = (256*3 + 1) * 192;
@@ -439,6 +458,9 @@ void GPU::MapVRAM_AB(u32 bank, u8 cnt) noexcept
 
 void GPU::MapVRAM_CD(u32 bank, u8 cnt) noexcept
 {
+    // these can be mapped to engine B
+    GPU2D_Renderer->Sync();
+
     cnt &= 0x9F;
 
     u8 oldcnt = VRAMCNT[bank];
@@ -690,6 +712,9 @@ void GPU::MapVRAM_FG(u32 bank, u8 cnt) noexcept
 
 void GPU::MapVRAM_H(u32 bank, u8 cnt) noexcept
 {
+    // these can be mapped to engine B
+    GPU2D_Renderer->Sync();
+
     cnt &= 0x83;
 
     u8 oldcnt = VRAMCNT[bank];
@@ -752,6 +777,9 @@ void GPU::MapVRAM_H(u32 bank, u8 cnt) noexcept
 
 void GPU::MapVRAM_I(u32 bank, u8 cnt) noexcept
 {
+    // these can be mapped to engine B
+    GPU2D_Renderer->Sync();
+
     cnt &= 0x83;
 
     u8 oldcnt = VRAMCNT[bank];
@@ -833,6 +861,7 @@ void GPU::SetPowerCnt(u32 val) noexcept
 
     if (!(val & (1<<0))) Log(LogLevel::Warn, "!!! CLEARING POWCNT BIT0. DANGER\n");
 
+    GPU2D_Renderer->Sync();
     GPU2D_A.SetEnabled(val & (1<<1));
     GPU2D_B.SetEnabled(val & (1<<9));
     GPU3D.SetEnabled(val & (1<<3), val & (1<<2));
@@ -934,6 +963,9 @@ void GPU::FinishFrame(u32 lines) noexcept
 
 void GPU::BlankFrame() noexcept
 {
+    GPU2D_Renderer->Sync();
+    GPU2D_Renderer->InvalidateLines();
+
     int backbuf = FrontBuffer ? 0 : 1;
     int fbsize;
     if (GPU3D.IsRendererAccelerated())
@@ -952,6 +984,9 @@ void GPU::BlankFrame() noexcept
 
 void GPU::StartScanline(u32 line) noexcept
 {
+    // engine B's rendering of the previous scanline depends on VCount and the windows
+    GPU2D_Renderer->Sync();
+
     if (line == 0)
         VCount = 0;
     else if (NextVCount != 0xFFFFFFFF)
@@ -349,6 +349,7 @@ public:
     template<typename T>
     void WriteVRAM_BBG(u32 addr, T val)
     {
+        GPU2D_Renderer->Sync();
         u32 mask = VRAMMap_BBG[(addr >> 14) & 0x7];
 
         if (mask & (1<<2))
@@ -387,6 +388,7 @@ public:
     template<typename T>
     void WriteVRAM_BOBJ(u32 addr, T val)
     {
+        GPU2D_Renderer->Sync();
         u32 mask = VRAMMap_BOBJ[(addr >> 14) & 0x7];
 
         if (mask & (1<<3))
@@ -479,6 +481,7 @@ public:
     void WritePalette(u32 addr, T val)
     {
         addr &= 0x7FF;
+        if (addr & 0x400) GPU2D_Renderer->Sync();
 
         *(T*)&Palette[addr] = val;
         PaletteDirty |= 1 << (addr / VRAMDirtyGranularity);
@@ -494,6 +497,7 @@ public:
     void WriteOAM(u32 addr, T val)
     {
         addr &= 0x7FF;
+        if (addr & 0x400) GPU2D_Renderer->Sync();
 
         *(T*)&OAM[addr] = val;
         OAMDirty |= 1 << (addr / 1024);
@@ -584,6 +588,11 @@ public:
     int FrontBuffer = 0;
     std::unique_ptr<u32[]> Framebuffer[2][2] {};
 
+    // set for frames that will never be displayed (speculative run-ahead frames)
+    // not part of the hardware state, don't serialize
+    bool SkipRender2D = false;
+    bool SkipRender3D = false;
+
     GPU2D::Unit GPU2D_A;
     GPU2D::Unit GPU2D_B;
     melonDS::GPU3D GPU3D;
@@ -602,6 +611,10 @@ public:
     VRAMTrackingSet<512*1024, 128*1024> VRAMDirty_Texture {};
     VRAMTrackingSet<128*1024, 16*1024> VRAMDirty_TexPal {};
 
+    // which parts of the palette and OAM were written to since the 2D renderer last looked
+    u32 OAMDirty = 0;
+    u32 PaletteDirty = 0;
+
     u8 VRAMFlat_ABG[512*1024] {};
     u8 VRAMFlat_BBG[128*1024] {};
     u8 VRAMFlat_AOBJ[256*1024] {};
@@ -701,9 +714,6 @@ private:
     u16 VMatch[2] {};
 
     std::unique_ptr<GPU2D::Renderer2D> GPU2D_Renderer = nullptr;
-
-    u32 OAMDirty = 0;
-    u32 PaletteDirty = 0;
 };
 }
 
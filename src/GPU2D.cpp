@@ -268,6 +268,9 @@ u32 Unit::Read32(u32 addr)
 
 void Unit::Write8(u32 addr, u8 val)
 {
+    // engine B might be getting rendered in the background
+    if (Num) GPU.GetRenderer2D().Sync();
+
     switch (addr & 0x00000FFF)
     {
     case 0x000:
@@ -372,6 +375,9 @@ void Unit::Write8(u32 addr, u8 val)
 
 void Unit::Write16(u32 addr, u16 val)
 {
+    // engine B might be getting rendered in the background
+    if (Num) GPU.GetRenderer2D().Sync();
+
     switch (addr & 0x00000FFF)
     {
     case 0x000:
@@ -524,6 +530,9 @@ void Unit::Write16(u32 addr, u16 val)
 
 void Unit::Write32(u32 addr, u32 val)
 {
+    // engine B might be getting rendered in the background
+    if (Num) GPU.GetRenderer2D().Sync();
+
     switch (addr & 0x00000FFF)
     {
     case 0x000:
@@ -136,6 +136,14 @@ public:
 
     virtual void VBlankEnd(Unit* unitA, Unit* unitB) = 0;
 
+    // waits for any rendering still going on in the background
+    // has to be called before anything it depends on is changed
+    virtual void Sync() {}
+
+    // forgets what previous frames looked like, has to be called when the
+    // framebuffers or the state of the engines are changed from outside
+    virtual void InvalidateLines() {}
+
     void SetFramebuffer(u32* unitA, u32* unitB)
     {
         Framebuffer[0] = unitA;
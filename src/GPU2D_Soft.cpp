@@ -16,20 +16,330 @@
     with melonDS. If not, see http://www.gnu.org/licenses/.
 */
 
+#include <string.h>
+#include <chrono>
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#endif
 #include "GPU2D_Soft.h"
 #include "GPU.h"
 #include "GPU3D.h"
 
+#define XXH_STATIC_LINKING_ONLY
+#include "xxhash/xxhash.h"
+
 namespace melonDS
 {
 namespace GPU2D
 {
+
+// vector helpers for compositing 4 pixels at once
+// every lane holds one pixel, as in BGOBJLine
+namespace
+{
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define GPU2D_SOFT_SIMD
+
+typedef __m128i Vec;
+
+inline Vec Load(const u32* src) { return _mm_loadu_si128((const __m128i*)src); }
+inline void Store(u32* dst, Vec v) { _mm_storeu_si128((__m128i*)dst, v); }
+inline Vec Set(u32 v) { return _mm_set1_epi32(v); }
+
+inline Vec LoadBytes(const u8* src)
+{
+    u32 bytes;
+    memcpy(&bytes, src, 4);
+    __m128i zero = _mm_setzero_si128();
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+}
+
+inline Vec And(Vec a, Vec b) { return _mm_and_si128(a, b); }
+inline Vec Or(Vec a, Vec b) { return _mm_or_si128(a, b); }
+inline Vec AndNot(Vec a, Vec b) { return _mm_andnot_si128(b, a); } // a & ~b
+inline Vec Add(Vec a, Vec b) { return _mm_add_epi32(a, b); }
+inline Vec Sub(Vec a, Vec b) { return _mm_sub_epi32(a, b); }
+inline Vec Equal(Vec a, Vec b) { return _mm_cmpeq_epi32(a, b); }
+inline Vec Select(Vec mask, Vec a, Vec b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+inline bool Any(Vec mask) { return _mm_movemask_epi8(mask) != 0; }
+template<int n> inline Vec ShiftLeft(Vec v) { return _mm_slli_epi32(v, n); }
+template<int n> inline Vec ShiftRight(Vec v) { return _mm_srli_epi32(v, n); }
+
+// all ones where any of the given bits is set
+inline Vec Test(Vec v, u32 bits)
+{
+    __m128i zero = _mm_setzero_si128();
+    return _mm_xor_si128(_mm_cmpeq_epi32(_mm_and_si128(v, _mm_set1_epi32(bits)), zero), _mm_cmpeq_epi32(zero, zero));
+}
+
+// each color channel becomes min(((c1 * eva) + (c2 * evb) + round) >> shift, 0x3F)
+// with the factors given per pixel, and the flags are set to 0xFF
+template<int round, int shift>
+inline Vec Blend(Vec val1, Vec val2, Vec eva, Vec evb)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i chanmask = _mm_set1_epi32(0x003F3F3F);
+    val1 = _mm_and_si128(val1, chanmask);
+    val2 = _mm_and_si128(val2, chanmask);
+
+    // the factors of each pixel, for each of its 16-bit channels
+    eva = _mm_or_si128(eva, _mm_slli_epi32(eva, 16));
+    evb = _mm_or_si128(evb, _mm_slli_epi32(evb, 16));
+
+    __m128i res[2];
+    for (int i = 0; i < 2; i++)
+    {
+        __m128i c1 = i ? _mm_unpackhi_epi8(val1, zero) : _mm_unpacklo_epi8(val1, zero);
+        __m128i c2 = i ? _mm_unpackhi_epi8(val2, zero) : _mm_unpacklo_epi8(val2, zero);
+        __m128i fa = i ? _mm_unpackhi_epi32(eva, eva) : _mm_unpacklo_epi32(eva, eva);
+        __m128i fb = i ? _mm_unpackhi_epi32(evb, evb) : _mm_unpacklo_epi32(evb, evb);
+
+        __m128i sum = _mm_add_epi16(_mm_mullo_epi16(c1, fa), _mm_mullo_epi16(c2, fb));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(round)), shift);
+        res[i] = _mm_min_epi16(sum, _mm_set1_epi16(0x3F));
+    }
+
+    __m128i ret = _mm_packus_epi16(res[0], res[1]);
+    return _mm_or_si128(_mm_and_si128(ret, chanmask), _mm_set1_epi32(0xFF000000));
+}
+
+#endif
+}
+
 SoftRenderer::SoftRenderer(melonDS::GPU& gpu)
     : Renderer2D(), GPU(gpu)
 {
     // mosaic table is initialized at compile-time
 }
 
+SoftRenderer::~SoftRenderer()
+{
+    StopRenderThread();
+}
+
+void SoftRenderer::SetThreaded(bool threaded) noexcept
+{
+    if (Threaded == threaded)
+        return;
+
+    Threaded = threaded;
+    if (threaded)
+    {
+        EngineB = std::make_unique<SoftRenderer>(GPU);
+        EngineB->Framebuffer[1] = Framebuffer[1];
+        EngineB->LineReuse = LineReuse;
+
+        // sprites are rendered a scanline in advance
+        memcpy(EngineB->OBJLine[1], OBJLine[1], sizeof(OBJLine[1]));
+        memcpy(EngineB->OBJWindow[1], OBJWindow[1], sizeof(OBJWindow[1]));
+        EngineB->NumSprites[1] = NumSprites[1];
+
+        Sema_RenderStart = Platform::Semaphore_Create();
+        Sema_RenderDone = Platform::Semaphore_Create();
+        RenderJobsQueued = 0;
+        RenderJobsDone = 0;
+
+        RenderThreadRunning = true;
+        RenderThread = Platform::Thread_Create([this]() { RenderThreadFunc(); });
+    }
+    else
+    {
+        StopRenderThread();
+    }
+}
+
+void SoftRenderer::StopRenderThread()
+{
+    if (!RenderThread)
+        return;
+
+    Sync();
+
+    RenderThreadRunning = false;
+    Platform::Semaphore_Post(Sema_RenderStart);
+
+    Platform::Thread_Wait(RenderThread);
+    Platform::Thread_Free(RenderThread);
+    RenderThread = nullptr;
+
+    Platform::Semaphore_Free(Sema_RenderStart);
+    Platform::Semaphore_Free(Sema_RenderDone);
+    Sema_RenderStart = nullptr;
+    Sema_RenderDone = nullptr;
+
+    memcpy(OBJLine[1], EngineB->OBJLine[1], sizeof(OBJLine[1]));
+    memcpy(OBJWindow[1], EngineB->OBJWindow[1], sizeof(OBJWindow[1]));
+    NumSprites[1] = EngineB->NumSprites[1];
+    Stats.LinesRendered += EngineB->Stats.LinesRendered;
+    Stats.LinesReused += EngineB->Stats.LinesReused;
+    EngineB = nullptr;
+
+    // engine B was drawn elsewhere in the meantime
+    InvalidateEngineLines(1);
+}
+
+void SoftRenderer::RenderThreadFunc()
+{
+    for (;;)
+    {
+        Platform::Semaphore_Wait(Sema_RenderStart);
+        if (!RenderThreadRunning) return;
+
+        u32 num = RenderJobsDone.load(std::memory_order_relaxed);
+        if (num == RenderJobsQueued.load(std::memory_order_acquire))
+            continue;
+
+        const RenderJob& job = RenderJobs[num & 3];
+        if (job.Sprites)
+            EngineB->RenderSprites(job.Line, job.Engine, job.PaletteOAMWritten);
+        else
+            EngineB->RenderScanline(job.Line, job.Engine, job.PaletteOAMWritten);
+
+        RenderJobsDone.store(num + 1, std::memory_order_release);
+        Platform::Semaphore_Post(Sema_RenderDone);
+    }
+}
+
+void SoftRenderer::QueueRenderJob(u32 line, bool sprites, Unit* unit, bool palOAMWritten)
+{
+    u32 num = RenderJobsQueued.load(std::memory_order_relaxed);
+    if ((num - RenderJobsDone.load(std::memory_order_acquire)) >= 4)
+        Sync();
+
+    // the framebuffers are only ever swapped after a Sync()
+    if (EngineB->Framebuffer[1] != Framebuffer[1])
+    {
+        Sync();
+        EngineB->Framebuffer[1] = Framebuffer[1];
+    }
+
+    RenderJobs[num & 3] = {unit, line, sprites, palOAMWritten};
+    RenderJobsQueued.store(num + 1, std::memory_order_release);
+    Platform::Semaphore_Post(Sema_RenderStart);
+}
+
+void SoftRenderer::Sync()
+{
+    if (!RenderThread)
+        return;
+    if (RenderJobsDone.load(std::memory_order_acquire) == RenderJobsQueued.load(std::memory_order_relaxed))
+        return;
+
+    // drop the signals of jobs nobody waited for
+    Platform::Semaphore_Reset(Sema_RenderDone);
+    while (RenderJobsDone.load(std::memory_order_acquire) != RenderJobsQueued.load(std::memory_order_relaxed))
+        Platform::Semaphore_Wait(Sema_RenderDone);
+}
+
+void SoftRenderer::SetLineReuse(bool reuse) noexcept
+{
+    Sync();
+
+    LineReuse = reuse;
+    InvalidateEngineLines(0);
+    InvalidateEngineLines(1);
+    if (EngineB)
+    {
+        EngineB->LineReuse = reuse;
+        EngineB->InvalidateEngineLines(1);
+    }
+}
+
+SoftRendererStats SoftRenderer::GetStats() noexcept
+{
+    Sync();
+
+    SoftRendererStats stats = Stats;
+    if (EngineB)
+    {
+        stats.LinesRendered += EngineB->Stats.LinesRendered;
+        stats.LinesReused += EngineB->Stats.LinesReused;
+    }
+    return stats;
+}
+
+void SoftRenderer::InvalidateLines()
+{
+    Sync();
+
+    InvalidateEngineLines(0);
+    InvalidateEngineLines(1);
+    if (EngineB)
+        EngineB->InvalidateEngineLines(1);
+}
+
+void SoftRenderer::InvalidateEngineLines(u32 num) noexcept
+{
+    InputVersion[num]++;
+    SpriteInputs[num] = 0;
+    memset(LineInputs[num], 0, sizeof(LineInputs[num]));
+    memset(LineOutput[num], 0, sizeof(LineOutput[num]));
+}
+
+bool SoftRenderer::TakePaletteOAMWrites(u32 num) noexcept
+{
+    // the second half of the palette and OAM belongs to engine B
+    u32 palmask = num ? 0xC : 0x3;
+    u32 oammask = num ? 0x2 : 0x1;
+
+    bool written = (GPU.PaletteDirty & palmask) || (GPU.OAMDirty & oammask);
+    GPU.PaletteDirty &= ~palmask;
+    GPU.OAMDirty &= ~oammask;
+    return written;
+}
+
+u64 SoftRenderer::ScanlineInputs(u32 line, u32 dispmode) const noexcept
+{
+    // VRAM and FIFO display, display capture and 3D aren't tracked
+    if (dispmode > 1)
+        return 0;
+    if (CurUnit->Num == 0 && (CurUnit->CaptureLatch || (CurUnit->DispCnt & (1<<3))))
+        return 0;
+    if (GPU.GPU3D.IsRendererAccelerated())
+        return 0;
+    if (!SpriteInputs[CurUnit->Num])
+        return 0;
+
+    // everything from DispCnt to MasterBrightness: the registers, and the
+    // affine, mosaic and window state they're turned into for each scanline
+    const u8* start = (const u8*)&CurUnit->DispCnt;
+    const u8* end = (const u8*)(&CurUnit->MasterBrightness + 1);
+
+    u64 seed = SpriteInputs[CurUnit->Num] ^ ((u64)InputVersion[CurUnit->Num] << 32) ^ line;
+    u64 hash = XXH3_64bits_withSeed(start, end - start, seed);
+    return hash ? hash : 1;
+}
+
+void SoftRenderer::SaveLineEndState(LineEndState& state) const noexcept
+{
+    for (int i = 0; i < 2; i++)
+    {
+        state.BGXRefInternal[i] = CurUnit->BGXRefInternal[i];
+        state.BGYRefInternal[i] = CurUnit->BGYRefInternal[i];
+    }
+    state.Win0Active = CurUnit->Win0Active;
+    state.Win1Active = CurUnit->Win1Active;
+    state.BGMosaicY = CurUnit->BGMosaicY;
+    state.BGMosaicYMax = CurUnit->BGMosaicYMax;
+    state.OBJMosaicYCount = CurUnit->OBJMosaicYCount;
+    state.OBJMosaicY = CurUnit->OBJMosaicY;
+}
+
+void SoftRenderer::LoadLineEndState(const LineEndState& state) noexcept
+{
+    for (int i = 0; i < 2; i++)
+    {
+        CurUnit->BGXRefInternal[i] = state.BGXRefInternal[i];
+        CurUnit->BGYRefInternal[i] = state.BGYRefInternal[i];
+    }
+    CurUnit->Win0Active = state.Win0Active;
+    CurUnit->Win1Active = state.Win1Active;
+    CurUnit->BGMosaicY = state.BGMosaicY;
+    CurUnit->BGMosaicYMax = state.BGMosaicYMax;
+    CurUnit->OBJMosaicYCount = state.OBJMosaicYCount;
+    CurUnit->OBJMosaicY = state.OBJMosaicY;
+}
+
 u32 SoftRenderer::ColorComposite(int i, u32 val1, u32 val2) const
 {
     u32 coloreffect = 0;
@@ -102,7 +412,160 @@ u32 SoftRenderer::ColorComposite(int i, u32 val1, u32 val2) const
     return val1;
 }
 
+void SoftRenderer::ColorCompositeLine()
+{
+#ifdef GPU2D_SOFT_SIMD
+    // same as ColorComposite, 4 pixels at a time
+    u32 blendCnt = CurUnit->BlendCnt;
+    u32 effect = (blendCnt >> 6) & 0x3;
+
+    Vec eva = Set(CurUnit->EVA);
+    Vec evb = Set(CurUnit->EVB);
+    // brightness up/down is blending with white/black
+    Vec evy = Set(CurUnit->EVY);
+    Vec evyInv = Set(16 - CurUnit->EVY);
+
+    for (int i = 0; i < 256; i+=4)
+    {
+        Vec val1 = Load(&BGOBJLine[i]);
+        Vec val2 = Load(&BGOBJLine[256+i]);
+
+        Vec flag1 = ShiftRight<24>(val1);
+        Vec flag2 = ShiftRight<24>(val2);
+        Vec obj1 = Test(flag1, 0x80);
+        Vec layer3D1 = Test(flag1, 0x40);
+
+        Vec target2 = Select(Test(flag2, 0x80), Set(0x1000),
+                      Select(Test(flag2, 0x40), Set(0x0100), ShiftLeft<8>(flag2)));
+        Vec target2Blend = Test(target2, blendCnt);
+
+        // sprite blending
+        Vec spriteBlend = And(obj1, target2Blend);
+        // 3D layer blending
+        Vec layer3DBlend = AndNot(And(layer3D1, target2Blend), obj1);
+
+        Vec target1 = Select(obj1, Set(0x10), Select(layer3D1, Set(0x01), flag1));
+        Vec regular = And(Test(target1, blendCnt), Test(LoadBytes(&WindowMask[i]), 0x20));
+        regular = AndNot(regular, Or(spriteBlend, layer3DBlend));
+
+        Vec blend = spriteBlend;
+        if (effect == 1)
+            blend = Or(blend, And(regular, target2Blend));
+
+        Vec ret = val1;
+
+        if (effect >= 2 && Any(regular))
+        {
+            Vec bright = (effect == 2)
+                ? Blend<8, 4>(val1, Set(0x3F3F3F), evyInv, evy)
+                : Blend<8, 4>(val1, Set(0), evyInv, Set(0));
+            ret = Select(regular, bright, ret);
+        }
+
+        if (Any(blend))
+        {
+            // semi-transparent bitmap sprites have their own alpha
+            Vec alpha = And(flag1, Set(0x1F));
+            Vec bitmapOBJ = And(obj1, layer3D1);
+            Vec blendA = Select(bitmapOBJ, alpha, eva);
+            Vec blendB = Select(bitmapOBJ, Sub(Set(16), alpha), evb);
+            ret = Select(blend, Blend<8, 4>(val1, val2, blendA, blendB), ret);
+        }
+
+        if (Any(layer3DBlend))
+        {
+            Vec blendA = Add(And(flag1, Set(0x1F)), Set(1));
+            Vec blendB = Sub(Set(32), blendA);
+            Vec blended = Select(Equal(blendA, Set(32)), val1, Blend<16, 5>(val1, val2, blendA, blendB));
+            ret = Select(layer3DBlend, blended, ret);
+        }
+
+        Store(&BGOBJLine[i], ret);
+    }
+#else
+    for (int i = 0; i < 256; i++)
+    {
+        u32 val1 = BGOBJLine[i];
+        u32 val2 = BGOBJLine[256+i];
+
+        BGOBJLine[i] = ColorComposite(i, val1, val2);
+    }
+#endif
+}
+
+CompositeCheckResult SoftRenderer::CheckComposite(Unit* unit, const u32* line, const u8* windowMask) noexcept
+{
+    using clock = std::chrono::steady_clock;
+    CompositeCheckResult res {};
+    Unit* oldunit = CurUnit;
+    CurUnit = unit;
+
+    u32 results[2][256];
+    for (int pass = 0; pass < 2; pass++)
+    {
+        auto start = clock::now();
+        memcpy(BGOBJLine, line, 512*4);
+        memcpy(WindowMask, windowMask, 256);
+        if (pass == 0)
+        {
+            ColorCompositeLine();
+        }
+        else
+        {
+            for (int i = 0; i < 256; i++)
+                BGOBJLine[i] = ColorComposite(i, BGOBJLine[i], BGOBJLine[256+i]);
+        }
+        memcpy(results[pass], BGOBJLine, 256*4);
+        u64 ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+        (pass == 0 ? res.LineNanoseconds : res.PixelNanoseconds) = ns;
+    }
+
+    for (int i = 0; i < 256; i++)
+        res.Mismatches += results[0][i] != results[1][i];
+
+    CurUnit = oldunit;
+    return res;
+}
+
+void SoftRenderer::ApplyMasterBrightness(u32* dst, u32 factor, bool up)
+{
+#ifdef GPU2D_SOFT_SIMD
+    // with these biases, it's blending with white/black without rounding
+    Vec f = Set(factor);
+    Vec fInv = Set(16 - factor);
+    for (int i = 0; i < 256; i+=4)
+    {
+        Vec val = Load(&dst[i]);
+        if (up) Store(&dst[i], Blend<0, 4>(val, Set(0x3F3F3F), fInv, f));
+        else    Store(&dst[i], Blend<0, 4>(val, Set(0), fInv, Set(0)));
+    }
+#else
+    if (up)
+    {
+        for (int i = 0; i < 256; i++)
+            dst[i] = ColorBrightnessUp(dst[i], factor, 0x0);
+    }
+    else
+    {
+        for (int i = 0; i < 256; i++)
+            dst[i] = ColorBrightnessDown(dst[i], factor, 0xF);
+    }
+#endif
+}
+
 void SoftRenderer::DrawScanline(u32 line, Unit* unit)
+{
+    // the palette and OAM aren't synced with the render thread,
+    // so writes to them are picked up here
+    bool palOAMWritten = LineReuse && TakePaletteOAMWrites(unit->Num);
+
+    if (Threaded && unit->Num)
+        QueueRenderJob(line, false, unit, palOAMWritten);
+    else
+        RenderScanline(line, unit, palOAMWritten);
+}
+
+void SoftRenderer::RenderScanline(u32 line, Unit* unit, bool palOAMWritten)
 {
     CurUnit = unit;
 
@@ -112,24 +575,31 @@ void SoftRenderer::DrawScanline(u32 line, Unit* unit)
     int n3dline = line;
     line = GPU.VCount;
 
+    bool changed = palOAMWritten;
     if (CurUnit->Num == 0)
     {
         auto bgDirty = GPU.VRAMDirty_ABG.DeriveState(GPU.VRAMMap_ABG, GPU);
-        GPU.MakeVRAMFlat_ABGCoherent(bgDirty);
+        changed |= GPU.MakeVRAMFlat_ABGCoherent(bgDirty);
         auto bgExtPalDirty = GPU.VRAMDirty_ABGExtPal.DeriveState(GPU.VRAMMap_ABGExtPal, GPU);
-        GPU.MakeVRAMFlat_ABGExtPalCoherent(bgExtPalDirty);
+        changed |= GPU.MakeVRAMFlat_ABGExtPalCoherent(bgExtPalDirty);
         auto objExtPalDirty = GPU.VRAMDirty_AOBJExtPal.DeriveState(&GPU.VRAMMap_AOBJExtPal, GPU);
-        GPU.MakeVRAMFlat_AOBJExtPalCoherent(objExtPalDirty);
+        changed |= GPU.MakeVRAMFlat_AOBJExtPalCoherent(objExtPalDirty);
     }
     else
     {
         auto bgDirty = GPU.VRAMDirty_BBG.DeriveState(GPU.VRAMMap_BBG, GPU);
-        GPU.MakeVRAMFlat_BBGCoherent(bgDirty);
+        changed |= GPU.MakeVRAMFlat_BBGCoherent(bgDirty);
         auto bgExtPalDirty = GPU.VRAMDirty_BBGExtPal.DeriveState(GPU.VRAMMap_BBGExtPal, GPU);
-        GPU.MakeVRAMFlat_BBGExtPalCoherent(bgExtPalDirty);
+        changed |= GPU.MakeVRAMFlat_BBGExtPalCoherent(bgExtPalDirty);
         auto objExtPalDirty = GPU.VRAMDirty_BOBJExtPal.DeriveState(&GPU.VRAMMap_BOBJExtPal, GPU);
-        GPU.MakeVRAMFlat_BOBJExtPalCoherent(objExtPalDirty);
+        changed |= GPU.MakeVRAMFlat_BOBJExtPalCoherent(objExtPalDirty);
     }
+    if (changed)
+        InputVersion[CurUnit->Num]++;
+
+    // only scanlines which go all the way through below are remembered
+    u64 previnputs = LineInputs[CurUnit->Num][n3dline];
+    LineInputs[CurUnit->Num][n3dline] = 0;
 
     bool forceblank = false;
 
@@ -167,12 +637,49 @@ void SoftRenderer::DrawScanline(u32 line, Unit* unit)
         return;
     }
 
+    // nothing of this frame will be shown, and the affine and mosaic
+    // counters are reset at the end of VBlank, so only display capture matters here
+    if (GPU.SkipRender2D && !((CurUnit->Num == 0) && CurUnit->CaptureLatch))
+        return;
+
     u32 dispmode = CurUnit->DispCnt >> 16;
     dispmode &= (CurUnit->Num ? 0x1 : 0x3);
 
-    // always render regular graphics
-    DrawScanline_BGOBJ(line);
-    CurUnit->UpdateMosaicCounters(line);
+    if (LineReuse)
+    {
+        u64 inputs = ScanlineInputs(line, dispmode);
+        u32* prev = LineOutput[CurUnit->Num][n3dline];
+        LineEndState& end = LineEnd[CurUnit->Num][n3dline];
+
+        // the previous output is in the front buffer, which isn't
+        // drawn to before the next frame starts
+        if (inputs && inputs == previnputs)
+        {
+            if (prev != dst)
+                memcpy(dst, prev, 256*4);
+            LoadLineEndState(end);
+
+            LineInputs[CurUnit->Num][n3dline] = inputs;
+            LineOutput[CurUnit->Num][n3dline] = dst;
+            Stats.LinesReused++;
+            return;
+        }
+
+        DrawScanline_BGOBJ(line);
+        CurUnit->UpdateMosaicCounters(line);
+
+        // the rest of this function only writes to dst
+        SaveLineEndState(end);
+        LineInputs[CurUnit->Num][n3dline] = inputs;
+        LineOutput[CurUnit->Num][n3dline] = dst;
+    }
+    else
+    {
+        // always render regular graphics
+        DrawScanline_BGOBJ(line);
+        CurUnit->UpdateMosaicCounters(line);
+    }
+    Stats.LinesRendered++;
 
     switch (dispmode)
     {
@@ -271,10 +778,7 @@ void SoftRenderer::DrawScanline(u32 line, Unit* unit)
             u32 factor = masterBrightness & 0x1F;
             if (factor > 16) factor = 16;
 
-            for (int i = 0; i < 256; i++)
-            {
-                dst[i] = ColorBrightnessUp(dst[i], factor, 0x0);
-            }
+            ApplyMasterBrightness(dst, factor, true);
         }
         else if ((masterBrightness >> 14) == 2)
         {
@@ -282,10 +786,7 @@ void SoftRenderer::DrawScanline(u32 line, Unit* unit)
             u32 factor = masterBrightness & 0x1F;
             if (factor > 16) factor = 16;
 
-            for (int i = 0; i < 256; i++)
-            {
-                dst[i] = ColorBrightnessDown(dst[i], factor, 0xF);
-            }
+            ApplyMasterBrightness(dst, factor, false);
         }
     }
 
@@ -737,17 +1238,10 @@ void SoftRenderer::DrawScanline_BGOBJ(u32 line)
     }
 
     // color special effects
-    // can likely be optimized
 
     if (!GPU.GPU3D.IsRendererAccelerated())
     {
-        for (int i = 0; i < 256; i++)
-        {
-            u32 val1 = BGOBJLine[i];
-            u32 val2 = BGOBJLine[256+i];
-
-            BGOBJLine[i] = ColorComposite(i, val1, val2);
-        }
+        ColorCompositeLine();
     }
     else
     {
@@ -1586,6 +2080,16 @@ void SoftRenderer::InterleaveSprites(u32 prio)
     }
 
 void SoftRenderer::DrawSprites(u32 line, Unit* unit)
+{
+    bool palOAMWritten = LineReuse && TakePaletteOAMWrites(unit->Num);
+
+    if (Threaded && unit->Num)
+        QueueRenderJob(line, true, unit, palOAMWritten);
+    else
+        RenderSprites(line, unit, palOAMWritten);
+}
+
+void SoftRenderer::RenderSprites(u32 line, Unit* unit, bool palOAMWritten)
 {
     CurUnit = unit;
 
@@ -1601,15 +2105,36 @@ void SoftRenderer::DrawSprites(u32 line, Unit* unit)
         CurUnit->OBJMosaicYCount = 0;
     }
 
+    bool changed = palOAMWritten;
     if (CurUnit->Num == 0)
     {
         auto objDirty = GPU.VRAMDirty_AOBJ.DeriveState(GPU.VRAMMap_AOBJ, GPU);
-        GPU.MakeVRAMFlat_AOBJCoherent(objDirty);
+        changed |= GPU.MakeVRAMFlat_AOBJCoherent(objDirty);
     }
     else
     {
         auto objDirty = GPU.VRAMDirty_BOBJ.DeriveState(GPU.VRAMMap_BOBJ, GPU);
-        GPU.MakeVRAMFlat_BOBJCoherent(objDirty);
+        changed |= GPU.MakeVRAMFlat_BOBJCoherent(objDirty);
+    }
+    if (changed)
+        InputVersion[CurUnit->Num]++;
+
+    // sprites for line 0 are drawn before we know whether the frame will be captured
+    if (GPU.SkipRender2D && line != 0 && !((CurUnit->Num == 0) && CurUnit->CaptureLatch))
+    {
+        SpriteInputs[CurUnit->Num] = 0;
+        return;
+    }
+
+    if (LineReuse)
+    {
+        // the sprites only depend on the registers, OAM and VRAM
+        // so the scanline's inputs are checked the same way
+        const u8* start = (const u8*)&CurUnit->DispCnt;
+        const u8* end = (const u8*)(&CurUnit->MasterBrightness + 1);
+        u64 seed = ((u64)InputVersion[CurUnit->Num] << 32) ^ line;
+        u64 hash = XXH3_64bits_withSeed(start, end - start, seed);
+        SpriteInputs[CurUnit->Num] = hash ? hash : 1;
     }
 
     NumSprites[CurUnit->Num] = 0;
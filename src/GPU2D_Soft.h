@@ -18,7 +18,10 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include "GPU2D.h"
+#include "Platform.h"
 
 namespace melonDS
 {
@@ -27,17 +30,114 @@ class GPU;
 namespace GPU2D
 {
 
+struct SoftRendererStats
+{
+    /// Scanlines that were drawn.
+    u64 LinesRendered;
+
+    /// Scanlines whose inputs were the same as the last time they were
+    /// drawn, and which were copied from the previous frame instead.
+    u64 LinesReused;
+};
+
+struct CompositeCheckResult
+{
+    /// Pixels for which ColorCompositeLine and ColorComposite disagreed.
+    u32 Mismatches;
+
+    /// Time taken by each of them, including copying the line in and out.
+    u64 LineNanoseconds;
+    u64 PixelNanoseconds;
+};
+
 class SoftRenderer : public Renderer2D
 {
 public:
     SoftRenderer(melonDS::GPU& gpu);
-    ~SoftRenderer() override {}
+    ~SoftRenderer() override;
 
     void DrawScanline(u32 line, Unit* unit) override;
     void DrawSprites(u32 line, Unit* unit) override;
     void VBlankEnd(Unit* unitA, Unit* unitB) override;
+    void Sync() override;
+    void InvalidateLines() override;
+
+    // renders engine B on a thread of its own, while engine A
+    // is rendered on the emulation thread
+    void SetThreaded(bool threaded) noexcept;
+    [[nodiscard]] bool IsThreaded() const noexcept { return Threaded; }
+
+    // copies scanlines from the previous frame when nothing
+    // they're drawn from has changed since
+    void SetLineReuse(bool reuse) noexcept;
+    [[nodiscard]] bool IsLineReuseEnabled() const noexcept { return LineReuse; }
+
+    [[nodiscard]] SoftRendererStats GetStats() noexcept;
+
+    // for melonDS-bench: composites a line in the format of BGOBJLine (the top
+    // pixels followed by the ones below them) with the blending settings of unit,
+    // once with ColorCompositeLine and once pixel by pixel with ColorComposite
+    CompositeCheckResult CheckComposite(Unit* unit, const u32* line, const u8* windowMask) noexcept;
 private:
     melonDS::GPU& GPU;
+
+    // engine B's scanlines and sprites, to be done by the render thread
+    struct RenderJob
+    {
+        Unit* Engine;
+        u32 Line;
+        bool Sprites;
+        bool PaletteOAMWritten;
+    };
+
+    void StopRenderThread();
+    void RenderThreadFunc();
+    void QueueRenderJob(u32 line, bool sprites, Unit* unit, bool palOAMWritten);
+
+    void RenderScanline(u32 line, Unit* unit, bool palOAMWritten);
+    void RenderSprites(u32 line, Unit* unit, bool palOAMWritten);
+
+    bool Threaded = false;
+    // does the rendering on the render thread, has buffers of its own
+    std::unique_ptr<SoftRenderer> EngineB;
+    Platform::Thread* RenderThread = nullptr;
+    Platform::Semaphore* Sema_RenderStart = nullptr;
+    Platform::Semaphore* Sema_RenderDone = nullptr;
+    std::atomic_bool RenderThreadRunning = false;
+    // at most one scanline and one set of sprites are queued, as each
+    // new scanline waits for the previous one (see GPU::StartScanline)
+    RenderJob RenderJobs[4];
+    std::atomic<u32> RenderJobsQueued = 0;
+    std::atomic<u32> RenderJobsDone = 0;
+
+    // what drawing a scanline changes in the engine's state,
+    // put back when the scanline is reused
+    struct LineEndState
+    {
+        s32 BGXRefInternal[2];
+        s32 BGYRefInternal[2];
+        u32 Win0Active, Win1Active;
+        u8 BGMosaicY, BGMosaicYMax;
+        u8 OBJMosaicYCount, OBJMosaicY;
+    };
+
+    bool TakePaletteOAMWrites(u32 num) noexcept;
+    u64 ScanlineInputs(u32 line, u32 dispmode) const noexcept;
+    void SaveLineEndState(LineEndState& state) const noexcept;
+    void LoadLineEndState(const LineEndState& state) noexcept;
+    void InvalidateEngineLines(u32 num) noexcept;
+
+    bool LineReuse = false;
+    // bumped whenever the VRAM, palette or OAM used by an engine change
+    u32 InputVersion[2] = {};
+    // inputs of the sprites drawn for the next scanline, 0 if they weren't drawn
+    u64 SpriteInputs[2] = {};
+    // inputs each scanline was last drawn with, 0 if it can't be reused
+    u64 LineInputs[2][192] = {};
+    u32* LineOutput[2][192] = {};
+    LineEndState LineEnd[2][192] = {};
+    SoftRendererStats Stats {};
+
     alignas(8) u32 BGOBJLine[256*3];
     u32* _3DLine;
 
@@ -118,6 +218,9 @@ private:
         return rb | g | 0xFF000000;
     }
     u32 ColorComposite(int i, u32 val1, u32 val2) const;
+    // applies ColorComposite to the whole line
+    void ColorCompositeLine();
+    void ApplyMasterBrightness(u32* dst, u32 factor, bool up);
 
     template<u32 bgmode> void DrawScanlineBGMode(u32 line);
     void DrawScanlineBGMode6(u32 line);
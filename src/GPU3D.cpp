@@ -312,6 +312,9 @@ void GPU3D::Reset() noexcept
 void GPU3D::DoSavestate(Savestate* file) noexcept
 {
     file->Section("GP3D");
+    // the polygons point into the vertex and polygon RAM, which would all be
+    // rebuilt from indices that were never read
+    if (file->IsSkippingSection()) return;
 
     SoftRenderer* softRenderer = dynamic_cast<SoftRenderer*>(CurrentRenderer.get());
     if (softRenderer && softRenderer->IsThreaded())
@@ -2535,6 +2538,38 @@ void GPU3D::VBlank() noexcept
 
 void GPU3D::VCount215(GPU& gpu) noexcept
 {
+    if (gpu.SkipRender3D)
+    {
+        // only the unthreaded software renderer can leave a frame out:
+        // the threaded one has the 2D renderer waiting on its scanlines,
+        // and the accelerated ones keep their own state across frames
+        SoftRenderer* softRenderer = dynamic_cast<SoftRenderer*>(CurrentRenderer.get());
+        if (softRenderer && !softRenderer->IsThreaded())
+        {
+            RenderFrameSkipped = true;
+            return;
+        }
+    }
+
+    if (RenderFrameSkipped)
+    {
+        // the renderer's buffers don't hold the last frame, so they can't be reused
+        RenderFrameIdentical = false;
+        RenderFrameSkipped = false;
+    }
+
+    CurrentRenderer->RenderFrame(gpu);
+}
+
+void GPU3D::RerenderFrame(GPU& gpu) noexcept
+{
+    // the render thread was already restarted on the current frame by DoSavestate()
+    SoftRenderer* softRenderer = dynamic_cast<SoftRenderer*>(CurrentRenderer.get());
+    if (softRenderer && softRenderer->IsThreaded())
+        return;
+
+    RenderFrameIdentical = false;
+    RenderFrameSkipped = false;
     CurrentRenderer->RenderFrame(gpu);
 }
 
@@ -2625,23 +2660,31 @@ void GPU3D::WriteToGXFIFO(u32 val) noexcept
 }
 
 
+void GPU3D::RunForRead() noexcept
+{
+    // GXSTAT depends on how far the geometry engine got by now,
+    // so the ARM9 can't skip ahead while polling it
+    NDS.ARM9.IdleLoopDirty = true;
+    Run();
+}
+
 u8 GPU3D::Read8(u32 addr) noexcept
 {
     switch (addr)
     {
     case 0x04000600:
-        Run();
+        RunForRead();
         return GXStat & 0xFF;
     case 0x04000601:
         {
-            Run();
+            RunForRead();
             return ((GXStat >> 8) & 0xFF) |
                    (PosMatrixStackPointer & 0x1F) |
                    ((ProjMatrixStackPointer & 0x1) << 5);
         }
     case 0x04000602:
         {
-            Run();
+            RunForRead();
 
             u32 fifolevel = CmdFIFO.Level();
 
@@ -2649,7 +2692,7 @@ u8 GPU3D::Read8(u32 addr) noexcept
         }
     case 0x04000603:
         {
-            Run();
+            RunForRead();
 
             u32 fifolevel = CmdFIFO.Level();
 
@@ -2676,7 +2719,7 @@ u16 GPU3D::Read16(u32 addr) noexcept
 
     case 0x04000600:
         {
-            Run();
+            RunForRead();
 
             return (GXStat & 0xFFFF) |
                    ((PosMatrixStackPointer & 0x1F) << 8) |
@@ -2684,7 +2727,7 @@ u16 GPU3D::Read16(u32 addr) noexcept
         }
     case 0x04000602:
         {
-            Run();
+            RunForRead();
 
             u32 fifolevel = CmdFIFO.Level();
 
@@ -2720,7 +2763,7 @@ u32 GPU3D::Read32(u32 addr) noexcept
 
     case 0x04000600:
         {
-            Run();
+            RunForRead();
 
             u32 fifolevel = CmdFIFO.Level();
 
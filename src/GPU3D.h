@@ -107,6 +107,10 @@ public:
     void VBlank() noexcept;
     void VCount215(GPU& gpu) noexcept;
 
+    /// Renders the current frame again, so that the renderer's output matches
+    /// the emulated state after rolling back to an earlier savestate.
+    void RerenderFrame(GPU& gpu) noexcept;
+
     void RestartFrame(GPU& gpu) noexcept;
     void Stop(const GPU& gpu) noexcept;
 
@@ -187,6 +191,8 @@ private:
         NormalPipeline = 0;
     }
 
+    void RunForRead() noexcept;
+
     std::unique_ptr<Renderer3D> CurrentRenderer = nullptr;
 
     u16 RenderXPos = 0;
@@ -272,6 +278,7 @@ public:
     u32 RenderClearAttr2 = 0;
 
     bool RenderFrameIdentical = false; // not part of the hardware state, don't serialize
+    bool RenderFrameSkipped = false; // ditto
 
     bool AbortFrame = false;
 
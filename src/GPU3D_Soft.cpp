@@ -19,8 +19,12 @@
 #include "GPU3D_Soft.h"
 
 #include <algorithm>
+#include <chrono>
 #include <stdio.h>
 #include <string.h>
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#endif
 #include "NDS.h"
 #include "GPU.h"
 
@@ -110,6 +114,7 @@ SoftRenderer::SoftRenderer() noexcept
 SoftRenderer::~SoftRenderer()
 {
     StopRenderThread();
+    StopRasterWorkers();
 
     Platform::Semaphore_Free(Sema_RenderStart);
     Platform::Semaphore_Free(Sema_RenderDone);
@@ -122,7 +127,7 @@ void SoftRenderer::Reset(GPU& gpu)
     memset(DepthBuffer, 0, BufferSize * 2 * 4);
     memset(AttrBuffer, 0, BufferSize * 2 * 4);
 
-    PrevIsShadowMask = false;
+    Raster.PrevIsShadowMask = false;
 
     SetupRenderThread(gpu);
     EnableRenderThread();
@@ -421,6 +426,146 @@ bool DepthTest_LessThan_FrontFacing(s32 dstz, s32 z, u32 dstattr)
     return false;
 }
 
+// vector helpers for drawing spans 4 pixels at a time
+// every lane holds one pixel
+namespace
+{
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define GPU3D_SOFT_SIMD
+
+typedef __m128i Vec;
+
+inline Vec Load(const u32* src) { return _mm_loadu_si128((const __m128i*)src); }
+inline void Store(u32* dst, Vec v) { _mm_storeu_si128((__m128i*)dst, v); }
+inline void Store(s32* dst, Vec v) { _mm_storeu_si128((__m128i*)dst, v); }
+inline Vec Set(s32 v) { return _mm_set1_epi32(v); }
+inline Vec Lanes(s32 v) { return _mm_setr_epi32(v, v+1, v+2, v+3); }
+
+inline Vec And(Vec a, Vec b) { return _mm_and_si128(a, b); }
+inline Vec Or(Vec a, Vec b) { return _mm_or_si128(a, b); }
+inline Vec AndNot(Vec a, Vec b) { return _mm_andnot_si128(b, a); } // a & ~b
+inline Vec Add(Vec a, Vec b) { return _mm_add_epi32(a, b); }
+inline Vec Sub(Vec a, Vec b) { return _mm_sub_epi32(a, b); }
+inline Vec Equal(Vec a, Vec b) { return _mm_cmpeq_epi32(a, b); }
+inline Vec LessThan(Vec a, Vec b) { return _mm_cmplt_epi32(a, b); } // signed
+inline Vec Select(Vec mask, Vec a, Vec b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+inline u32 Mask(Vec mask) { return _mm_movemask_ps(_mm_castsi128_ps(mask)); }
+template<int n> inline Vec ShiftLeft(Vec v) { return _mm_slli_epi32(v, n); }
+template<int n> inline Vec ShiftRight(Vec v) { return _mm_srli_epi32(v, n); }
+
+// all ones where any of the given bits is set
+inline Vec Test(Vec v, u32 bits)
+{
+    __m128i zero = _mm_setzero_si128();
+    return _mm_xor_si128(_mm_cmpeq_epi32(_mm_and_si128(v, _mm_set1_epi32(bits)), zero), _mm_cmpeq_epi32(zero, zero));
+}
+
+// unsigned a <= b
+inline Vec LessEqualU(Vec a, Vec b)
+{
+    __m128i bias = _mm_set1_epi32(0x80000000);
+    return _mm_xor_si128(_mm_cmpgt_epi32(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias)), _mm_cmpeq_epi32(a, a));
+}
+
+// the low 32 bits of a * b
+inline Vec Mul(Vec a, Vec b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+}
+
+// the low 32 bits of ((u64)a * b) >> n
+template<int n> inline Vec MulShiftRight(Vec a, Vec b)
+{
+    __m128i even = _mm_srli_epi64(_mm_mul_epu32(a, b), n);
+    __m128i odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32)), n);
+    return _mm_or_si128(_mm_and_si128(even, _mm_set1_epi64x(0xFFFFFFFF)), _mm_slli_epi64(odd, 32));
+}
+
+// (num * scale) / den, rounded towards zero
+// num and den are positive and small enough for the quotient to be exact,
+// lanes where den is 0 give 0
+inline Vec Divide(Vec num, double scale, Vec den)
+{
+    __m128d s = _mm_set1_pd(scale);
+    __m128i lo = _mm_cvttpd_epi32(_mm_div_pd(_mm_mul_pd(_mm_cvtepi32_pd(num), s), _mm_cvtepi32_pd(den)));
+    __m128i hi = _mm_cvttpd_epi32(_mm_div_pd(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(num, 8)), s),
+                                             _mm_cvtepi32_pd(_mm_srli_si128(den, 8))));
+    return _mm_andnot_si128(_mm_cmpeq_epi32(den, _mm_setzero_si128()), _mm_unpacklo_epi64(lo, hi));
+}
+
+#endif
+
+#ifdef GPU3D_SOFT_SIMD
+
+// one attribute interpolated along a span, like Interpolator<0>::Interpolate()
+// going from the lower to the higher value, by a factor that's reversed if
+// the lower value is on the right
+struct SpanAttr
+{
+    s32 Diff;
+    Vec Base, DiffV;
+    bool Reversed;
+
+    // linear interpolation steps through diff * x / xdiff as a quotient
+    // and remainder, which avoids dividing for every pixel
+    Vec Quot, Rem;
+    Vec StepQuot, StepRem;
+
+    SpanAttr(s32 y0, s32 y1)
+    {
+        Reversed = !(y0 < y1);
+        Diff = Reversed ? (y0 - y1) : (y1 - y0);
+        Base = Set(Reversed ? y1 : y0);
+        DiffV = Set(Diff);
+    }
+
+    // perspective-correct, with factor = yfactor and rfactor = (1<<8) - yfactor
+    Vec Perspective(Vec factor, Vec rfactor) const
+    {
+        return Add(Base, ShiftRight<8>(Mul(DiffV, Reversed ? rfactor : factor)));
+    }
+
+    // linear, starting with pos = x and rpos = xdiff - x
+    void StartLinear(Vec pos, Vec rpos, s32 xdiff)
+    {
+        Vec num = Mul(DiffV, Reversed ? rpos : pos);
+        Quot = Divide(num, 1.0, Set(xdiff));
+        Rem = Sub(num, Mul(Quot, Set(xdiff)));
+        StepQuot = Set((Diff * 4) / xdiff);
+        StepRem = Set((Diff * 4) % xdiff);
+    }
+
+    // returns the values for the current 4 pixels and moves on to the next ones
+    Vec Linear(Vec xdiff)
+    {
+        Vec ret = Add(Base, Quot);
+
+        if (!Reversed)
+        {
+            Quot = Add(Quot, StepQuot);
+            Rem = Add(Rem, StepRem);
+            Vec carry = LessThan(Sub(xdiff, Set(1)), Rem);
+            Quot = Sub(Quot, carry);
+            Rem = Sub(Rem, And(carry, xdiff));
+        }
+        else
+        {
+            Quot = Sub(Quot, StepQuot);
+            Rem = Sub(Rem, StepRem);
+            Vec borrow = LessThan(Rem, Set(0));
+            Quot = Add(Quot, borrow);
+            Rem = Add(Rem, And(borrow, xdiff));
+        }
+
+        return ret;
+    }
+};
+
+#endif
+}
+
 u32 SoftRenderer::AlphaBlend(const GPU3D& gpu3d, u32 srccolor, u32 dstcolor, u32 alpha) const noexcept
 {
     u32 dstalpha = dstcolor >> 24;
@@ -705,7 +850,7 @@ void SoftRenderer::SetupPolygon(SoftRenderer::RendererPolygon* rp, Polygon* poly
     }
 }
 
-void SoftRenderer::RenderShadowMaskScanline(const GPU3D& gpu3d, RendererPolygon* rp, s32 y)
+void SoftRenderer::RenderShadowMaskScanline(const GPU3D& gpu3d, RasterState& rs, RendererPolygon* rp, s32 y)
 {
     Polygon* polygon = rp->PolyData;
 
@@ -723,10 +868,10 @@ void SoftRenderer::RenderShadowMaskScanline(const GPU3D& gpu3d, RendererPolygon*
     else
         fnDepthTest = DepthTest_LessThan;
 
-    if (!PrevIsShadowMask)
-        memset(&StencilBuffer[256 * (y&0x1)], 0, 256);
+    if (!rs.PrevIsShadowMask)
+        memset(&rs.StencilBuffer[256 * (y&0x1)], 0, 256);
 
-    PrevIsShadowMask = true;
+    rs.PrevIsShadowMask = true;
 
     if (polygon->YTop != polygon->YBottom)
     {
@@ -867,13 +1012,13 @@ void SoftRenderer::RenderShadowMaskScanline(const GPU3D& gpu3d, RendererPolygon*
         u32 dstattr = AttrBuffer[pixeladdr];
 
         if (!fnDepthTest(DepthBuffer[pixeladdr], z, dstattr))
-            StencilBuffer[256*(y&0x1) + x] = 1;
+            rs.StencilBuffer[256*(y&0x1) + x] = 1;
 
         if (dstattr & 0xF)
         {
             pixeladdr += BufferSize;
             if (!fnDepthTest(DepthBuffer[pixeladdr], z, AttrBuffer[pixeladdr]))
-                StencilBuffer[256*(y&0x1) + x] |= 0x2;
+                rs.StencilBuffer[256*(y&0x1) + x] |= 0x2;
         }
     }
 
@@ -893,13 +1038,13 @@ void SoftRenderer::RenderShadowMaskScanline(const GPU3D& gpu3d, RendererPolygon*
         u32 dstattr = AttrBuffer[pixeladdr];
 
         if (!fnDepthTest(DepthBuffer[pixeladdr], z, dstattr))
-            StencilBuffer[256*(y&0x1) + x] = 1;
+            rs.StencilBuffer[256*(y&0x1) + x] = 1;
 
         if (dstattr & 0xF)
         {
             pixeladdr += BufferSize;
             if (!fnDepthTest(DepthBuffer[pixeladdr], z, AttrBuffer[pixeladdr]))
-                StencilBuffer[256*(y&0x1) + x] |= 0x2;
+                rs.StencilBuffer[256*(y&0x1) + x] |= 0x2;
         }
     }
 
@@ -919,13 +1064,13 @@ void SoftRenderer::RenderShadowMaskScanline(const GPU3D& gpu3d, RendererPolygon*
         u32 dstattr = AttrBuffer[pixeladdr];
 
         if (!fnDepthTest(DepthBuffer[pixeladdr], z, dstattr))
-            StencilBuffer[256*(y&0x1) + x] = 1;
+            rs.StencilBuffer[256*(y&0x1) + x] = 1;
 
         if (dstattr & 0xF)
         {
             pixeladdr += BufferSize;
             if (!fnDepthTest(DepthBuffer[pixeladdr], z, AttrBuffer[pixeladdr]))
-                StencilBuffer[256*(y&0x1) + x] |= 0x2;
+                rs.StencilBuffer[256*(y&0x1) + x] |= 0x2;
         }
     }
 
@@ -933,7 +1078,7 @@ void SoftRenderer::RenderShadowMaskScanline(const GPU3D& gpu3d, RendererPolygon*
     rp->XR = rp->SlopeR.Step();
 }
 
-void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s32 y)
+void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RasterState& rs, RendererPolygon* rp, s32 y)
 {
     Polygon* polygon = rp->PolyData;
 
@@ -951,7 +1096,7 @@ void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s3
     else
         fnDepthTest = DepthTest_LessThan;
 
-    PrevIsShadowMask = false;
+    rs.PrevIsShadowMask = false;
 
     if (polygon->YTop != polygon->YBottom)
     {
@@ -1119,7 +1264,7 @@ void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s3
         // check stencil buffer for shadows
         if (polygon->IsShadow)
         {
-            u8 stencil = StencilBuffer[256*(y&0x1) + x];
+            u8 stencil = rs.StencilBuffer[256*(y&0x1) + x];
             if (!stencil)
                 continue;
             if (!(stencil & 0x1))
@@ -1207,6 +1352,13 @@ void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s3
 
     if (wireframe && !edge) x = std::max(x, xlimit);
     else
+    {
+        // draw most of the span 4 pixels at a time, the rest goes through the loop below
+        s32 attrl[5] = {rl, gl, bl, sl, tl};
+        s32 attrr[5] = {rr, gr, br, sr, tr};
+        x = RenderSpan(gpu, polygon, interpX, y, x, xlimit, polyattr, edge, zl, zr, attrl, attrr);
+    }
+
     for (; x < xlimit; x++)
     {
         u32 pixeladdr = FirstPixelOffset + (y*ScanlineWidth) + x;
@@ -1215,7 +1367,7 @@ void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s3
         // check stencil buffer for shadows
         if (polygon->IsShadow)
         {
-            u8 stencil = StencilBuffer[256*(y&0x1) + x];
+            u8 stencil = rs.StencilBuffer[256*(y&0x1) + x];
             if (!stencil)
                 continue;
             if (!(stencil & 0x1))
@@ -1307,7 +1459,7 @@ void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s3
         // check stencil buffer for shadows
         if (polygon->IsShadow)
         {
-            u8 stencil = StencilBuffer[256*(y&0x1) + x];
+            u8 stencil = rs.StencilBuffer[256*(y&0x1) + x];
             if (!stencil)
                 continue;
             if (!(stencil & 0x1))
@@ -1391,19 +1543,213 @@ void SoftRenderer::RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s3
     rp->XR = rp->SlopeR.Step();
 }
 
-void SoftRenderer::RenderScanline(const GPU& gpu, s32 y, int npolys)
+s32 SoftRenderer::RenderSpan(const GPU& gpu, const Polygon* polygon, const Interpolator<0>& interpX, s32 y, s32 x, s32 xlimit,
+                             u32 polyattr, u32 edge, s32 zl, s32 zr, const s32* attrl, const s32* attrr)
+{
+#ifdef GPU3D_SOFT_SIMD
+    // shadows go through the stencil buffer one pixel at a time
+    if (!VectorSpans || polygon->IsShadow)
+        return x;
+
+    // keep the values small enough for the divisions to be exact
+    // W-buffering in linear mode uses a factor which isn't computed for the span
+    if (interpX.xdiff <= 0 || interpX.xdiff > 0x400)
+        return x;
+    if (interpX.w0d < 0 || interpX.w0d > 0xFFFF || interpX.w1d < 0 || interpX.w1d > 0xFFFF)
+        return x;
+    if (interpX.linear && polygon->WBuffer)
+        return x;
+
+    bool (*fnDepthTest)(s32 dstz, s32 z, u32 dstattr);
+    if (polygon->Attr & (1<<14))
+        fnDepthTest = polygon->WBuffer ? DepthTest_Equal_W : DepthTest_Equal_Z;
+    else if (polygon->FacingView)
+        fnDepthTest = DepthTest_LessThan_FrontFacing;
+    else
+        fnDepthTest = DepthTest_LessThan;
+
+    // untextured opaque pixels just take the vertex color, and are written
+    // for the 4 pixels at once as long as antialiasing doesn't apply to them
+    u32 blendmode = (polygon->Attr >> 4) & 0x3;
+    u32 polyalpha = (polygon->Attr >> 16) & 0x1F;
+    bool textured = (gpu.GPU3D.RenderDispCnt & (1<<0)) && (((polygon->TexParam >> 26) & 0x7) != 0);
+    bool flat = !textured && (blendmode != 2) && (polyalpha == 31) && (31 > gpu.GPU3D.RenderAlphaRef)
+        && !((gpu.GPU3D.RenderDispCnt & (1<<4)) && (edge & 0xF));
+
+    SpanAttr z(zl, zr);
+    SpanAttr attr[5] = {{attrl[0], attrr[0]}, {attrl[1], attrr[1]}, {attrl[2], attrr[2]},
+                        {attrl[3], attrr[3]}, {attrl[4], attrr[4]}};
+    Vec zdisp = Set(z.Diff >> 9);
+    Vec xdiff = Set(interpX.xdiff);
+    Vec w0 = Set(interpX.w0n), w1 = Set(interpX.w1d);
+    Vec flatattr = Set(polyattr | edge);
+
+    if (interpX.linear)
+    {
+        Vec pos = Lanes(x - interpX.x0);
+        for (int i = 0; i < 5; i++)
+            attr[i].StartLinear(pos, Sub(xdiff, pos), interpX.xdiff);
+    }
+
+    for (; x + 4 <= xlimit; x += 4)
+    {
+        u32 pixeladdr = FirstPixelOffset + (y*ScanlineWidth) + x;
+
+        Vec pos = Lanes(x - interpX.x0);
+        Vec rpos = Sub(xdiff, pos);
+
+        Vec va[5];
+        Vec factor = Set(0), rfactor = Set(0);
+        if (interpX.linear)
+        {
+            for (int i = 0; i < 5; i++)
+                va[i] = attr[i].Linear(xdiff);
+        }
+        else
+        {
+            // same as Interpolator<0>::SetX()
+            factor = Divide(Mul(pos, w0), 1 << 8, Add(Mul(pos, w0), Mul(rpos, w1)));
+            rfactor = Sub(Set(1 << 8), factor);
+        }
+
+        Vec vz;
+        if (polygon->WBuffer)
+            vz = Add(z.Base, MulShiftRight<8>(z.DiffV, z.Reversed ? rfactor : factor));
+        else
+            vz = Add(z.Base, MulShiftRight<13>(Mul(zdisp, z.Reversed ? rpos : pos), Set(interpX.xrecip_z)));
+
+        // depth test against the topmost pixels
+        Vec dstz = Load(&DepthBuffer[pixeladdr]);
+        Vec dstattr = Load(&AttrBuffer[pixeladdr]);
+        Vec pass;
+        if (fnDepthTest == DepthTest_Equal_Z)
+            pass = LessEqualU(Add(Sub(dstz, vz), Set(0x200)), Set(0x400));
+        else if (fnDepthTest == DepthTest_Equal_W)
+            pass = LessEqualU(Add(Sub(dstz, vz), Set(0xFF)), Set(0x1FE));
+        else if (fnDepthTest == DepthTest_LessThan_FrontFacing)
+            pass = Or(LessThan(vz, dstz), And(Equal(And(dstattr, Set(0x00400010)), Set(0x00000010)), Equal(vz, dstz)));
+        else
+            pass = LessThan(vz, dstz);
+
+        // the pixels underneath are only tested where there are any
+        u32 passmask = Mask(pass);
+        u32 undermask = Mask(AndNot(Test(dstattr, 0xF), pass));
+        if (!passmask && !undermask)
+            continue;
+
+        if (!interpX.linear)
+        {
+            for (int i = 0; i < 5; i++)
+                va[i] = attr[i].Perspective(factor, rfactor);
+        }
+
+        if (flat)
+        {
+            Vec color = Or(Or(And(ShiftRight<3>(va[0]), Set(0xFF)),
+                              ShiftLeft<8>(And(ShiftRight<3>(va[1]), Set(0xFF)))),
+                           Or(ShiftLeft<16>(And(ShiftRight<3>(va[2]), Set(0xFF))), Set(31 << 24)));
+
+            Store(&DepthBuffer[pixeladdr], Select(pass, vz, dstz));
+            Store(&ColorBuffer[pixeladdr], Select(pass, color, Load(&ColorBuffer[pixeladdr])));
+            Store(&AttrBuffer[pixeladdr], Select(pass, flatattr, dstattr));
+
+            if (!undermask)
+                continue;
+            passmask = 0;
+        }
+        else
+            undermask |= passmask;
+
+        alignas(16) s32 lz[4], lr[4], lg[4], lb[4], ls[4], lt[4];
+        Store(lz, vz);
+        Store(lr, va[0]); Store(lg, va[1]); Store(lb, va[2]);
+        Store(ls, va[3]); Store(lt, va[4]);
+
+        for (int i = 0; i < 4; i++)
+        {
+            if (!(undermask & (1<<i)))
+                continue;
+
+            PlotSpanPixel(gpu, polygon, fnDepthTest, pixeladdr+i, passmask & (1<<i), lz[i],
+                          lr[i], lg[i], lb[i], ls[i], lt[i], polyattr, edge);
+        }
+    }
+#endif
+
+    return x;
+}
+
+void SoftRenderer::PlotSpanPixel(const GPU& gpu, const Polygon* polygon, bool (*fnDepthTest)(s32 dstz, s32 z, u32 dstattr),
+                                 u32 pixeladdr, bool toppass, s32 z, u32 vr, u32 vg, u32 vb, s16 s, s16 t, u32 polyattr, u32 edge)
+{
+    u32 dstattr = AttrBuffer[pixeladdr];
+
+    // if depth test against the topmost pixel fails, test
+    // against the pixel underneath
+    if (!toppass)
+    {
+        if (!(dstattr & 0xF)) return;
+
+        pixeladdr += BufferSize;
+        dstattr = AttrBuffer[pixeladdr];
+        if (!fnDepthTest(DepthBuffer[pixeladdr], z, dstattr))
+            return;
+    }
+
+    u32 color = RenderPixel(gpu, polygon, vr>>3, vg>>3, vb>>3, s, t);
+    u8 alpha = color >> 24;
+
+    // alpha test
+    if (alpha <= gpu.GPU3D.RenderAlphaRef) return;
+
+    if (alpha == 31)
+    {
+        u32 attr = polyattr | edge;
+
+        if ((gpu.GPU3D.RenderDispCnt & (1<<4)) && (attr & 0xF))
+        {
+            // anti-aliasing: all edges are rendered
+
+            // set coverage to avoid black lines from anti-aliasing
+            attr |= (0x1F << 8);
+
+            // push old pixel down if needed
+            if (pixeladdr < BufferSize)
+            {
+                ColorBuffer[pixeladdr+BufferSize] = ColorBuffer[pixeladdr];
+                DepthBuffer[pixeladdr+BufferSize] = DepthBuffer[pixeladdr];
+                AttrBuffer[pixeladdr+BufferSize] = AttrBuffer[pixeladdr];
+            }
+        }
+
+        DepthBuffer[pixeladdr] = z;
+        ColorBuffer[pixeladdr] = color;
+        AttrBuffer[pixeladdr] = attr;
+    }
+    else
+    {
+        if (!(polygon->Attr & (1<<11))) z = -1;
+        PlotTranslucentPixel(gpu.GPU3D, pixeladdr, color, z, polyattr, polygon->IsShadow);
+
+        // blend with bottom pixel too, if needed
+        if ((dstattr & 0xF) && (pixeladdr < BufferSize))
+            PlotTranslucentPixel(gpu.GPU3D, pixeladdr+BufferSize, color, z, polyattr, polygon->IsShadow);
+    }
+}
+
+void SoftRenderer::RenderScanline(const GPU& gpu, RasterState& rs, s32 y, int npolys)
 {
     for (int i = 0; i < npolys; i++)
     {
-        RendererPolygon* rp = &PolygonList[i];
+        RendererPolygon* rp = &rs.PolygonList[i];
         Polygon* polygon = rp->PolyData;
 
         if (y >= polygon->YTop && (y < polygon->YBottom || (y == polygon->YTop && polygon->YBottom == polygon->YTop)))
         {
             if (polygon->IsShadowMask)
-                RenderShadowMaskScanline(gpu.GPU3D, rp, y);
+                RenderShadowMaskScanline(gpu.GPU3D, rs, rp, y);
             else
-                RenderPolygonScanline(gpu, rp, y);
+                RenderPolygonScanline(gpu, rs, rp, y);
         }
     }
 }
@@ -1709,17 +2055,27 @@ void SoftRenderer::ClearBuffers(const GPU& gpu)
 void SoftRenderer::RenderPolygons(const GPU& gpu, bool threaded, Polygon** polygons, int npolys)
 {
     int j = 0;
+    bool shadowmasks = false;
     for (int i = 0; i < npolys; i++)
     {
         if (polygons[i]->Degenerate) continue;
-        SetupPolygon(&PolygonList[j++], polygons[i]);
+        shadowmasks |= polygons[i]->IsShadowMask;
+        SetupPolygon(&Raster.PolygonList[j++], polygons[i]);
     }
 
-    RenderScanline(gpu, 0, j);
+    // shadow masks carry their stencil buffer over from one scanline
+    // to the next, so frames with them can't be split into bands
+    if (Bands.size() > 1 && !shadowmasks)
+    {
+        RenderBands(gpu, threaded, j);
+        return;
+    }
+
+    RenderScanline(gpu, Raster, 0, j);
 
     for (s32 y = 1; y < 192; y++)
     {
-        RenderScanline(gpu, y, j);
+        RenderScanline(gpu, Raster, y, j);
         ScanlineFinalPass(gpu.GPU3D, y-1);
 
         if (threaded)
@@ -1734,12 +2090,240 @@ void SoftRenderer::RenderPolygons(const GPU& gpu, bool threaded, Polygon** polyg
         Platform::Semaphore_Post(Sema_ScanlineCount);
 }
 
+void SoftRenderer::RenderBands(const GPU& gpu, bool threaded, int npolys)
+{
+    BandGPU = &gpu;
+    BandThreaded = threaded;
+    BandNumPolygons = npolys;
+
+    for (int y = 0; y < 192; y++)
+        LineDone[y].store(false, std::memory_order_relaxed);
+    LinesPosted.store(0, std::memory_order_relaxed);
+
+    for (auto& band : Bands)
+    {
+        band->LinesRasterized.store(0, std::memory_order_relaxed);
+
+        // without shadow masks, this is only read from
+        memcpy(band->State.StencilBuffer, Raster.StencilBuffer, sizeof(Raster.StencilBuffer));
+        band->State.PrevIsShadowMask = Raster.PrevIsShadowMask;
+    }
+
+    for (size_t i = 1; i < Bands.size(); i++)
+        Platform::Semaphore_Post(Bands[i]->Sema_Start);
+
+    RenderBand(*Bands[0]);
+
+    for (size_t i = 1; i < Bands.size(); i++)
+        Platform::Semaphore_Wait(Bands[i]->Sema_Done);
+
+    // keep it as if the whole frame had been rendered in one go
+    for (auto& band : Bands)
+        Raster.PrevIsShadowMask &= band->State.PrevIsShadowMask;
+}
+
+void SoftRenderer::RenderBand(RasterBand& band)
+{
+    const GPU& gpu = *BandGPU;
+    RasterState& rs = band.State;
+    s32 ystart = band.YStart, yend = band.YEnd;
+
+    // take the polygons which reach into the band, in the same order
+    int n = 0;
+    for (int i = 0; i < BandNumPolygons; i++)
+    {
+        const RendererPolygon& src = Raster.PolygonList[i];
+        Polygon* polygon = src.PolyData;
+
+        if (polygon->YTop >= yend)
+            continue;
+        if (polygon->YTop == polygon->YBottom ? (polygon->YTop < ystart) : (polygon->YBottom <= ystart))
+            continue;
+
+        RendererPolygon* rp = &rs.PolygonList[n++];
+        *rp = src;
+
+        // the edges are set up for the top of the polygon, move them to the top of the band
+        // this gives the same result as stepping through all the scanlines above
+        if (polygon->YTop < ystart)
+        {
+            SetupPolygonLeftEdge(rp, ystart);
+            SetupPolygonRightEdge(rp, ystart);
+        }
+    }
+
+    // the final pass of a scanline needs the ones above and below to be rasterized,
+    // the first and last scanlines of the band wait for the neighbouring bands
+    for (s32 y = ystart; y < yend; y++)
+    {
+        RenderScanline(gpu, rs, y, n);
+        band.LinesRasterized.store(y - ystart + 1, std::memory_order_release);
+
+        if (y > ystart && (y-1 > ystart || band.Index == 0))
+            FinishBandScanline(y-1);
+    }
+
+    if (band.Index + 1 < Bands.size())
+    {
+        const RasterBand& next = *Bands[band.Index + 1];
+        while (next.LinesRasterized.load(std::memory_order_acquire) < 1)
+            std::this_thread::yield();
+    }
+
+    if (yend-1 > ystart || band.Index == 0)
+        FinishBandScanline(yend-1);
+
+    if (band.Index > 0)
+    {
+        const RasterBand& prev = *Bands[band.Index - 1];
+        while (prev.LinesRasterized.load(std::memory_order_acquire) < (prev.YEnd - prev.YStart))
+            std::this_thread::yield();
+
+        FinishBandScanline(ystart);
+    }
+}
+
+void SoftRenderer::FinishBandScanline(s32 y)
+{
+    ScanlineFinalPass(BandGPU->GPU3D, y);
+    if (!BandThreaded)
+        return;
+
+    // the 2D renderer takes the scanlines from the top down,
+    // so they're handed over in that order, by whichever band finishes one
+    LineDone[y].store(true);
+
+    s32 posted = LinesPosted.load();
+    while (posted < 192 && LineDone[posted].load())
+    {
+        if (LinesPosted.compare_exchange_weak(posted, posted+1))
+        {
+            Platform::Semaphore_Post(Sema_ScanlineCount);
+            posted++;
+        }
+    }
+}
+
+void SoftRenderer::RasterWorkerFunc(RasterBand& band)
+{
+    for (;;)
+    {
+        Platform::Semaphore_Wait(band.Sema_Start);
+        if (!RasterWorkersRunning) return;
+
+        RenderBand(band);
+
+        Platform::Semaphore_Post(band.Sema_Done);
+    }
+}
+
+void SoftRenderer::StopRasterWorkers()
+{
+    RasterWorkersRunning = false;
+
+    for (auto& band : Bands)
+    {
+        if (!band->Thread)
+            continue;
+
+        Platform::Semaphore_Post(band->Sema_Start);
+        Platform::Thread_Wait(band->Thread);
+        Platform::Thread_Free(band->Thread);
+        Platform::Semaphore_Free(band->Sema_Start);
+        Platform::Semaphore_Free(band->Sema_Done);
+    }
+
+    Bands.clear();
+}
+
+void SoftRenderer::SetRasterThreads(u32 count, GPU& gpu) noexcept
+{
+    count = std::clamp<u32>(count, 1, MaxRasterThreads);
+    if (count == RasterThreads)
+        return;
+
+    // the render thread might be using the bands right now
+    StopRenderThread();
+    StopRasterWorkers();
+
+    RasterThreads = count;
+    if (count > 1)
+    {
+        RasterWorkersRunning = true;
+        for (u32 i = 0; i < count; i++)
+        {
+            auto band = std::make_unique<RasterBand>();
+            band->Index = i;
+            band->YStart = (192 * i) / count;
+            band->YEnd = (192 * (i+1)) / count;
+
+            // the first band is rendered by the thread rendering the frame
+            if (i > 0)
+            {
+                RasterBand* b = band.get();
+                band->Sema_Start = Platform::Semaphore_Create();
+                band->Sema_Done = Platform::Semaphore_Create();
+                band->Thread = Platform::Thread_Create([this, b]() { RasterWorkerFunc(*b); });
+            }
+
+            Bands.push_back(std::move(band));
+        }
+    }
+
+    SetupRenderThread(gpu);
+    EnableRenderThread();
+}
+
 void SoftRenderer::VCount144(GPU& gpu)
 {
     if (RenderThreadRunning.load(std::memory_order_relaxed) && !gpu.GPU3D.AbortFrame)
         Platform::Semaphore_Wait(Sema_RenderDone);
 }
 
+SpanCheckResult SoftRenderer::CheckVectorSpans(const GPU& gpu, Polygon** polygons, int npolys, bool clear)
+{
+    using clock = std::chrono::steady_clock;
+    constexpr int len = BufferSize * 2;
+    SpanCheckResult res {};
+    bool vectorspans = VectorSpans;
+
+    if (clear)
+        ClearBuffers(gpu);
+
+    std::vector<u32> start(len * 3), scalar(len * 3);
+    memcpy(&start[0], ColorBuffer, len*4);
+    memcpy(&start[len], DepthBuffer, len*4);
+    memcpy(&start[len*2], AttrBuffer, len*4);
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        memcpy(ColorBuffer, &start[0], len*4);
+        memcpy(DepthBuffer, &start[len], len*4);
+        memcpy(AttrBuffer, &start[len*2], len*4);
+
+        VectorSpans = pass == 1;
+        auto t0 = clock::now();
+        RenderPolygons(gpu, false, polygons, npolys);
+        u64 ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t0).count();
+        (pass == 0 ? res.ScalarNanoseconds : res.VectorNanoseconds) = ns;
+
+        if (pass == 0)
+        {
+            memcpy(&scalar[0], ColorBuffer, len*4);
+            memcpy(&scalar[len], DepthBuffer, len*4);
+            memcpy(&scalar[len*2], AttrBuffer, len*4);
+        }
+    }
+    VectorSpans = vectorspans;
+
+    res.Matches = !memcmp(&scalar[0], ColorBuffer, len*4)
+        && !memcmp(&scalar[len], DepthBuffer, len*4)
+        && !memcmp(&scalar[len*2], AttrBuffer, len*4);
+    for (int i = 0; i < len; i++)
+        res.PixelsChanged += scalar[i] != start[i] || scalar[len+i] != start[len+i] || scalar[len*2+i] != start[len*2+i];
+    return res;
+}
+
 void SoftRenderer::RenderFrame(GPU& gpu)
 {
     auto textureDirty = gpu.VRAMDirty_Texture.DeriveState(gpu.VRAMMap_Texture, gpu);
@@ -23,9 +23,24 @@
 #include "Platform.h"
 #include <thread>
 #include <atomic>
+#include <memory>
+#include <vector>
 
 namespace melonDS
 {
+struct SpanCheckResult
+{
+    /// Whether drawing with and without the vector path
+    /// left the same color, depth and attribute buffers.
+    bool Matches;
+
+    /// Pixels of the buffers which the polygons changed.
+    u32 PixelsChanged;
+
+    u64 ScalarNanoseconds;
+    u64 VectorNanoseconds;
+};
+
 class SoftRenderer : public Renderer3D
 {
 public:
@@ -36,6 +51,22 @@ public:
     void SetThreaded(bool threaded, GPU& gpu) noexcept;
     [[nodiscard]] bool IsThreaded() const noexcept { return Threaded; }
 
+    // splits the frame into horizontal bands, which are rasterized
+    // at the same time by this many threads (1 to rasterize it in one go)
+    void SetRasterThreads(u32 count, GPU& gpu) noexcept;
+    [[nodiscard]] u32 GetRasterThreads() const noexcept { return RasterThreads; }
+    static constexpr u32 MaxRasterThreads = 16;
+
+    // draws the inside of polygons 4 pixels at a time where possible
+    // the result is the same either way, this is only there to compare them
+    void SetVectorSpans(bool enable) noexcept { VectorSpans = enable; }
+    [[nodiscard]] bool GetVectorSpans() const noexcept { return VectorSpans; }
+
+    // for melonDS-bench: draws the polygons once pixel by pixel and once with the
+    // vector path, both times starting from cleared buffers or from the ones the
+    // previous call left behind, and compares the results
+    SpanCheckResult CheckVectorSpans(const GPU& gpu, Polygon** polygons, int npolys, bool clear);
+
     void VCount144(GPU& gpu) override;
     void RenderFrame(GPU& gpu) override;
     void RestartFrame(GPU& gpu) override;
@@ -215,6 +246,8 @@ private:
         }
 
     private:
+        friend class SoftRenderer;
+
         s32 x0, x1, xdiff, x;
 
         int shift;
@@ -444,20 +477,49 @@ private:
 
     };
 
-    RendererPolygon PolygonList[2048];
+    // what rasterizing goes through from one scanline to the next
+    // each band has its own, to be rasterized at the same time
+    struct RasterState
+    {
+        RendererPolygon PolygonList[2048];
+        u8 StencilBuffer[256*2];
+        bool PrevIsShadowMask;
+    };
+
+    struct RasterBand
+    {
+        RasterState State;
+        u32 Index;
+        s32 YStart, YEnd;
+        std::atomic<s32> LinesRasterized;
+
+        Platform::Thread* Thread = nullptr;
+        Platform::Semaphore* Sema_Start = nullptr;
+        Platform::Semaphore* Sema_Done = nullptr;
+    };
+
     void TextureLookup(const GPU& gpu, u32 texparam, u32 texpal, s16 s, s16 t, u16* color, u8* alpha) const;
     u32 RenderPixel(const GPU& gpu, const Polygon* polygon, u8 vr, u8 vg, u8 vb, s16 s, s16 t) const;
     void PlotTranslucentPixel(const GPU3D& gpu3d, u32 pixeladdr, u32 color, u32 z, u32 polyattr, u32 shadow);
     void SetupPolygonLeftEdge(RendererPolygon* rp, s32 y) const;
     void SetupPolygonRightEdge(RendererPolygon* rp, s32 y) const;
     void SetupPolygon(RendererPolygon* rp, Polygon* polygon) const;
-    void RenderShadowMaskScanline(const GPU3D& gpu3d, RendererPolygon* rp, s32 y);
-    void RenderPolygonScanline(const GPU& gpu, RendererPolygon* rp, s32 y);
-    void RenderScanline(const GPU& gpu, s32 y, int npolys);
+    void RenderShadowMaskScanline(const GPU3D& gpu3d, RasterState& rs, RendererPolygon* rp, s32 y);
+    void RenderPolygonScanline(const GPU& gpu, RasterState& rs, RendererPolygon* rp, s32 y);
+    s32 RenderSpan(const GPU& gpu, const Polygon* polygon, const Interpolator<0>& interpX, s32 y, s32 x, s32 xlimit,
+                   u32 polyattr, u32 edge, s32 zl, s32 zr, const s32* attrl, const s32* attrr);
+    void PlotSpanPixel(const GPU& gpu, const Polygon* polygon, bool (*fnDepthTest)(s32 dstz, s32 z, u32 dstattr),
+                       u32 pixeladdr, bool toppass, s32 z, u32 vr, u32 vg, u32 vb, s16 s, s16 t, u32 polyattr, u32 edge);
+    void RenderScanline(const GPU& gpu, RasterState& rs, s32 y, int npolys);
     u32 CalculateFogDensity(const GPU3D& gpu3d, u32 pixeladdr) const;
     void ScanlineFinalPass(const GPU3D& gpu3d, s32 y);
     void ClearBuffers(const GPU& gpu);
     void RenderPolygons(const GPU& gpu, bool threaded, Polygon** polygons, int npolys);
+    void RenderBands(const GPU& gpu, bool threaded, int npolys);
+    void RenderBand(RasterBand& band);
+    void FinishBandScanline(s32 y);
+    void RasterWorkerFunc(RasterBand& band);
+    void StopRasterWorkers();
 
     void RenderThreadFunc(GPU& gpu);
 
@@ -485,13 +547,15 @@ private:
     // bit22: translucent flag
     // bit24-29: polygon ID for opaque pixels
 
-    u8 StencilBuffer[256*2];
-    bool PrevIsShadowMask;
+    // polygons set up for the whole frame, and the state for rasterizing it in one go
+    RasterState Raster;
 
     bool Enabled;
 
     bool FrameIdentical;
 
+    bool VectorSpans = true;
+
     // threading
 
     bool Threaded = false;
@@ -508,5 +572,21 @@ private:
     // Used to allow the main thread to read some scanlines
     // before (the 3D portion of) the entire frame is rasterized.
     Platform::Semaphore* Sema_ScanlineCount;
+
+    // banded rasterization
+
+    u32 RasterThreads = 1;
+    std::vector<std::unique_ptr<RasterBand>> Bands;
+    std::atomic_bool RasterWorkersRunning = false;
+
+    // the frame being rendered in bands
+    const GPU* BandGPU = nullptr;
+    bool BandThreaded = false;
+    int BandNumPolygons = 0;
+
+    // scanlines which went through the final pass, and how many of them
+    // were handed to the 2D renderer through Sema_ScanlineCount
+    std::atomic_bool LineDone[192];
+    std::atomic<s32> LinesPosted = 0;
 };
 }
@@ -0,0 +1,127 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include "HostProfiler.h"
+#include "NDS.h"
+
+namespace melonDS
+{
+
+static_assert(Event_MAX <= MaxProfilerEvents, "not enough profiler slots for all scheduler events");
+
+void HostProfiler::SetEnabled(bool enabled) noexcept
+{
+    if (enabled == Enabled)
+        return;
+
+    Enabled = enabled;
+    CurFrame = {};
+    LastFrame = {};
+}
+
+void HostProfiler::BeginFrame() noexcept
+{
+    if (!Enabled)
+        return;
+
+    CurFrame = {};
+    FrameStart = Now();
+}
+
+void HostProfiler::EndFrame() noexcept
+{
+    if (!Enabled)
+        return;
+
+    CurFrame.FrameNanoseconds = Now() - FrameStart;
+    LastFrame = CurFrame;
+}
+
+u64 HostProfiler::Now() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* HostProfiler::GetCounterName(u32 counter) noexcept
+{
+    switch (counter)
+    {
+    case Prof_ARM9Execute: return "ARM9";
+    case Prof_ARM7Execute: return "ARM7";
+    case Prof_RunTimers: return "Timers";
+    case Prof_GPU3DRun: return "GPU3D";
+    case Prof_DMARun: return "DMA";
+    case Prof_JITCompile: return "JIT compile";
+
+    case Prof_Event + Event_LCD: return "LCD";
+    case Prof_Event + Event_SPU: return "SPU::Mix";
+    case Prof_Event + Event_Wifi: return "Wifi::USTimer";
+    case Prof_Event + Event_RTC: return "RTC";
+    case Prof_Event + Event_DisplayFIFO: return "DisplayFIFO";
+    case Prof_Event + Event_ROMTransfer: return "ROMTransfer";
+    case Prof_Event + Event_ROMSPITransfer: return "ROMSPITransfer";
+    case Prof_Event + Event_SPITransfer: return "SPITransfer";
+    case Prof_Event + Event_Div: return "Div";
+    case Prof_Event + Event_Sqrt: return "Sqrt";
+    case Prof_Event + Event_DSi_SDMMCTransfer: return "DSi SDMMC";
+    case Prof_Event + Event_DSi_SDIOTransfer: return "DSi SDIO";
+    case Prof_Event + Event_DSi_NWifi: return "DSi NWifi";
+    case Prof_Event + Event_DSi_CamIRQ: return "DSi CamIRQ";
+    case Prof_Event + Event_DSi_CamTransfer: return "DSi CamTransfer";
+    case Prof_Event + Event_DSi_DSP: return "DSi DSP";
+    }
+
+    return nullptr;
+}
+
+std::string HostProfiler::FormatFrame(const HostProfilerFrame& frame, int maxentries)
+{
+    u32 order[Prof_MAX];
+    for (u32 i = 0; i < Prof_MAX; i++)
+        order[i] = i;
+
+    std::sort(order, order + Prof_MAX, [&frame](u32 a, u32 b)
+    {
+        return frame.Nanoseconds[a] > frame.Nanoseconds[b];
+    });
+
+    char buf[64];
+    snprintf(buf, sizeof(buf), "frame %.2fms", frame.FrameNanoseconds / 1000000.0);
+    std::string ret = buf;
+
+    for (int i = 0; i < maxentries && i < Prof_MAX; i++)
+    {
+        u32 counter = order[i];
+        if (!frame.Calls[counter])
+            break;
+
+        const char* name = GetCounterName(counter);
+        if (!name) continue;
+
+        snprintf(buf, sizeof(buf), " | %s %.2fms", name, frame.Nanoseconds[counter] / 1000000.0);
+        ret += buf;
+    }
+
+    return ret;
+}
+
+}
@@ -0,0 +1,149 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef HOSTPROFILER_H
+#define HOSTPROFILER_H
+
+#include <string>
+#include "types.h"
+
+namespace melonDS
+{
+
+// scheduler events are tracked individually, one counter per SchedList slot
+// SchedListMask is 32 bits wide, so there can't be more events than that
+static constexpr u32 MaxProfilerEvents = 32;
+
+enum HostProfilerCounter : u32
+{
+    Prof_ARM9Execute = 0,
+    Prof_ARM7Execute,
+    Prof_RunTimers,
+    Prof_GPU3DRun,
+    Prof_DMARun,
+    Prof_JITCompile,
+
+    // Prof_Event + event ID
+    Prof_Event,
+
+    Prof_MAX = Prof_Event + MaxProfilerEvents
+};
+
+/// Host time spent in each subsystem over one emulated frame.
+/// Times are inclusive: JIT compilation happens from within the CPU
+/// Execute() calls, so it's counted in both.
+struct HostProfilerFrame
+{
+    u64 Nanoseconds[Prof_MAX] {};
+    u32 Calls[Prof_MAX] {};
+
+    /// Host time for the whole NDS::RunFrame() call.
+    u64 FrameNanoseconds = 0;
+};
+
+#ifdef HOSTPROFILER_ENABLED
+
+/// Opt-in per-subsystem host time profiler.
+/// Only compiled in with ENABLE_HOST_PROFILER, and even then it
+/// has to be switched on with SetEnabled() before it records anything.
+class HostProfiler
+{
+public:
+    void SetEnabled(bool enabled) noexcept;
+    [[nodiscard]] bool IsEnabled() const noexcept { return Enabled; }
+
+    void BeginFrame() noexcept;
+    void EndFrame() noexcept;
+
+    /// @return The counters of the last completed frame.
+    [[nodiscard]] const HostProfilerFrame& GetLastFrame() const noexcept { return LastFrame; }
+
+    /// @return A short display name for the given counter,
+    /// or \c nullptr for event slots that aren't used.
+    [[nodiscard]] static const char* GetCounterName(u32 counter) noexcept;
+
+    /// Formats the most expensive counters of a frame into one line,
+    /// short enough to fit in an OSD message.
+    [[nodiscard]] static std::string FormatFrame(const HostProfilerFrame& frame, int maxentries = 5);
+
+    static u64 Now() noexcept;
+
+    void Add(u32 counter, u64 ns) noexcept
+    {
+        CurFrame.Nanoseconds[counter] += ns;
+        CurFrame.Calls[counter]++;
+    }
+
+private:
+    bool Enabled = false;
+    u64 FrameStart = 0;
+    HostProfilerFrame CurFrame {};
+    HostProfilerFrame LastFrame {};
+};
+
+class HostProfilerScope
+{
+public:
+    HostProfilerScope(HostProfiler& profiler, u32 counter) noexcept :
+        Profiler(profiler), Counter(counter),
+        Start(profiler.IsEnabled() ? HostProfiler::Now() : 0)
+    {}
+
+    ~HostProfilerScope() noexcept
+    {
+        if (Profiler.IsEnabled())
+            Profiler.Add(Counter, HostProfiler::Now() - Start);
+    }
+
+    HostProfilerScope(const HostProfilerScope&) = delete;
+    HostProfilerScope& operator=(const HostProfilerScope&) = delete;
+
+private:
+    HostProfiler& Profiler;
+    u32 Counter;
+    u64 Start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(profiler, counter) \
+    melonDS::HostProfilerScope PROFILE_CONCAT(_profscope_, __LINE__)((profiler), (counter))
+
+#else
+
+// This version is a stub; it never records anything
+// and the instrumentation points compile to nothing.
+class HostProfiler
+{
+public:
+    void SetEnabled(bool) noexcept {}
+    [[nodiscard]] bool IsEnabled() const noexcept { return false; }
+    void BeginFrame() noexcept {}
+    void EndFrame() noexcept {}
+    [[nodiscard]] const HostProfilerFrame& GetLastFrame() const noexcept { static const HostProfilerFrame empty {}; return empty; }
+    [[nodiscard]] static const char* GetCounterName(u32) noexcept { return nullptr; }
+    [[nodiscard]] static std::string FormatFrame(const HostProfilerFrame&, int = 5) { return {}; }
+};
+
+#define PROFILE_SCOPE(profiler, counter)
+
+#endif // HOSTPROFILER_ENABLED
+
+}
+
+#endif // HOSTPROFILER_H
@@ -44,6 +44,15 @@ public:
     u16 NumAddresses;
     u16 NumLiterals;
 
+    // see ARMJIT::LookUpBlock
+    bool Superblock = false;
+    bool CanGrow = false;
+
+    // see ARMJIT::CompileOrLoad
+    bool Queued = false;
+    // invalidated while it was queued
+    bool Discarded = false;
+
     JitBlockEntry EntryPoint;
 
     const u32* AddressRanges() const { return &Data[0]; }
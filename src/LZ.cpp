@@ -0,0 +1,264 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include "LZ.h"
+
+namespace melonDS
+{
+
+/*
+    Block format (same as LZ4)
+
+    A list of sequences, each made of:
+    * token: literal count in the upper 4 bits, match length - 4 in the lower 4 bits
+    * if the literal count is 15: more bytes to add to it, until one isn't 255
+    * the literals
+    * match offset, 16-bit little-endian, counting back from the current position
+    * if the match length is 19: more bytes to add to it, same as the literal count
+
+    The last sequence only has literals, and ends the block.
+    Matches never start in the last 12 bytes or cover the last 5 bytes,
+    which is what LZ4 decoders expect.
+*/
+
+static constexpr u32 MinMatch = 4;
+static constexpr u32 LastLiterals = 5;
+static constexpr u32 MatchFindLimit = 12;
+static constexpr u32 MaxOffset = 65535;
+static constexpr int HashBits = 16;
+
+static inline u32 Read32(const u8* p)
+{
+    u32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline u64 Read64(const u8* p)
+{
+    u64 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline u32 Hash(u32 seq)
+{
+    return (seq * 2654435761u) >> (32 - HashBits);
+}
+
+// how many bytes a literal count or match length takes up past the token
+static inline u32 LengthSize(u32 len)
+{
+    return (len >= 15) ? ((len - 15) / 255 + 1) : 0;
+}
+
+static inline u8* WriteLength(u8* op, u32 len)
+{
+    len -= 15;
+    while (len >= 255)
+    {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (u8)len;
+    return op;
+}
+
+static inline bool ReadLength(const u8*& ip, const u8* iend, u32& len, u32 maxlen)
+{
+    for (;;)
+    {
+        if (ip >= iend) return false;
+        u8 b = *ip++;
+        len += b;
+        if (len > maxlen) return false;
+        if (b != 255) return true;
+    }
+}
+
+u32 LZCompress(const u8* src, u32 len, u8* dst, u32 maxlen) noexcept
+{
+    const u8* ip = src;
+    const u8* anchor = src;
+    const u8* iend = src + len;
+    u8* op = dst;
+    u8* oend = dst + maxlen;
+
+    if (len > MatchFindLimit)
+    {
+        // positions of the last 4-byte sequences seen, by hash
+        // stale or colliding entries are weeded out by comparing the data
+        auto table = std::make_unique<u32[]>(1 << HashBits);
+        const u8* mflimit = iend - MatchFindLimit;
+        const u8* matchlimit = iend - LastLiterals;
+        u32 misses = 0;
+
+        while (ip < mflimit)
+        {
+            u32 seq = Read32(ip);
+            u32 h = Hash(seq);
+            const u8* ref = src + table[h];
+            table[h] = (u32)(ip - src);
+
+            if (ref >= ip || (u32)(ip - ref) > MaxOffset || Read32(ref) != seq)
+            {
+                // step faster through data that doesn't compress
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            while (ip > anchor && ref > src && ip[-1] == ref[-1])
+            {
+                ip--;
+                ref--;
+            }
+
+            const u8* mp = ip + MinMatch;
+            const u8* rp = ref + MinMatch;
+            bool mismatch = false;
+            while (mp + 8 <= matchlimit)
+            {
+                u64 diff = Read64(mp) ^ Read64(rp);
+                if (diff)
+                {
+                    mp += __builtin_ctzll(diff) >> 3;
+                    mismatch = true;
+                    break;
+                }
+                mp += 8;
+                rp += 8;
+            }
+            if (!mismatch)
+            {
+                while (mp < matchlimit && *mp == *rp)
+                {
+                    mp++;
+                    rp++;
+                }
+            }
+
+            u32 litlen = (u32)(ip - anchor);
+            u32 matchlen = (u32)(mp - ip) - MinMatch;
+            if ((u32)(oend - op) < 1 + LengthSize(litlen) + litlen + 2 + LengthSize(matchlen))
+                return 0;
+
+            u8* token = op++;
+            *token = (u8)((std::min(litlen, 15u) << 4) | std::min(matchlen, 15u));
+            if (litlen >= 15)
+                op = WriteLength(op, litlen);
+            memcpy(op, anchor, litlen);
+            op += litlen;
+
+            u16 offset = (u16)(ip - ref);
+            memcpy(op, &offset, sizeof(offset));
+            op += 2;
+            if (matchlen >= 15)
+                op = WriteLength(op, matchlen);
+
+            ip = mp;
+            anchor = ip;
+            if (ip < mflimit)
+                table[Hash(Read32(ip - 2))] = (u32)(ip - 2 - src);
+        }
+    }
+
+    u32 litlen = (u32)(iend - anchor);
+    if ((u32)(oend - op) < 1 + LengthSize(litlen) + litlen)
+        return 0;
+
+    *op++ = (u8)(std::min(litlen, 15u) << 4);
+    if (litlen >= 15)
+        op = WriteLength(op, litlen);
+    memcpy(op, anchor, litlen);
+    op += litlen;
+
+    return (u32)(op - dst);
+}
+
+bool LZDecompress(const u8* src, u32 len, u8* dst, u32 dstlen) noexcept
+{
+    const u8* ip = src;
+    const u8* iend = src + len;
+    u8* op = dst;
+    u8* oend = dst + dstlen;
+
+    for (;;)
+    {
+        if (ip >= iend) return false;
+        u8 token = *ip++;
+
+        u32 litlen = token >> 4;
+        if (litlen == 15 && !ReadLength(ip, iend, litlen, dstlen))
+            return false;
+        if (litlen > (u32)(iend - ip) || litlen > (u32)(oend - op))
+            return false;
+
+        memcpy(op, ip, litlen);
+        ip += litlen;
+        op += litlen;
+
+        // the last sequence has no match
+        if (ip == iend)
+            break;
+
+        if ((u32)(iend - ip) < 2) return false;
+        u16 offset;
+        memcpy(&offset, ip, sizeof(offset));
+        ip += 2;
+        if (offset == 0 || offset > (u32)(op - dst))
+            return false;
+
+        u32 matchlen = token & 0xF;
+        if (matchlen == 15 && !ReadLength(ip, iend, matchlen, dstlen))
+            return false;
+        matchlen += MinMatch;
+        if (matchlen > (u32)(oend - op))
+            return false;
+
+        const u8* match = op - offset;
+        if (offset >= matchlen)
+        {
+            memcpy(op, match, matchlen);
+        }
+        else if (offset == 1)
+        {
+            memset(op, *match, matchlen);
+        }
+        else
+        {
+            // the match overlaps what it writes, so it repeats every <offset> bytes
+            // copy it in chunks that are multiples of that, doubling each time
+            u32 done = 0;
+            while (done < matchlen)
+            {
+                u32 chunk = std::min(matchlen - done, offset + done);
+                memcpy(op + done, match, chunk);
+                done += chunk;
+            }
+        }
+        op += matchlen;
+    }
+
+    return op == oend;
+}
+
+}
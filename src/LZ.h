@@ -0,0 +1,57 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef MELONDS_LZ_H
+#define MELONDS_LZ_H
+
+#include "types.h"
+
+namespace melonDS
+{
+/// Fast LZ compression, using the LZ4 block format.
+///
+/// This trades compression ratio for speed, which suits data like
+/// savestates where most of the memory is either zeroes or repeated.
+
+/// @return The largest size compressing \c len bytes can result in.
+constexpr u32 LZCompressBound(u32 len) noexcept
+{
+    return len + (len / 255) + 16;
+}
+
+/// Compresses a block of data.
+/// @param src The data to compress.
+/// @param len Length of \c src in bytes.
+/// @param dst Where the compressed data is written.
+/// @param maxlen Space available in \c dst.
+/// @return The size of the compressed data,
+/// or 0 if it wouldn't fit in \c maxlen bytes.
+u32 LZCompress(const u8* src, u32 len, u8* dst, u32 maxlen) noexcept;
+
+/// Decompresses a block of data.
+/// @param src The compressed data.
+/// @param len Length of \c src in bytes.
+/// @param dst Where the decompressed data is written.
+/// @param dstlen The exact size of the decompressed data.
+/// @return false if the compressed data is corrupted,
+/// or doesn't decompress to exactly \c dstlen bytes.
+bool LZDecompress(const u8* src, u32 len, u8* dst, u32 dstlen) noexcept;
+
+}
+
+#endif // MELONDS_LZ_H
@@ -74,8 +74,6 @@ const s32 kIterationCycleMargin = 8;
 //
 // timings for GBA slot and wifi are set up at runtime
 
-thread_local NDS* NDS::Current = nullptr;
-
 NDS::NDS() noexcept :
     NDS(
         NDSArgs {
@@ -111,6 +109,9 @@ NDS::NDS(NDSArgs&& args, int type, void* userdata) noexcept :
 #ifdef JIT_ENABLED
     EnableJIT(args.JIT.has_value()),
 #endif
+    EnableBIOSHLE(args.BIOSHLE),
+    EnableIdleLoopSkip(args.IdleLoopSkip),
+    EnableICacheTiming(args.ICacheTiming),
     DMAs {
         DMA(0, 0, *this),
         DMA(0, 1, *this),
@@ -224,6 +225,7 @@ void NDS::SetJITArgs(std::optional<JITArgs> args) noexcept
     }
 
     EnableJIT = args.has_value();
+    UpdateMemPages();
 }
 #endif
 
@@ -469,6 +471,8 @@ void NDS::Reset()
     memset(ARM7WRAM, 0, 0x10000);
 
     MapSharedWRAM(0);
+    // MainRAMMask might have changed
+    UpdateMemPages();
 
     ExMemCnt[0] = 0x4000;
     ExMemCnt[1] = 0x4000;
@@ -621,7 +625,7 @@ bool NDS::DoSavestate(Savestate* file)
     }
     else
     {
-        u32 console;
+        u32 console = ConsoleType; // kept if the section is skipped
         file->Var32(&console);
         if (console != ConsoleType)
         {
@@ -630,7 +634,15 @@ bool NDS::DoSavestate(Savestate* file)
         }
     }
 
-    file->VarArray(MainRAM, MainRAMMaxSize);
+    if (!file->Saving && file->IsIncremental() && ConsoleType == 0)
+    {
+        // only the first 4MB of main RAM are ever used on the DS,
+        // so rolling back doesn't have to look at the rest
+        file->VarArray(MainRAM, MainRAMMask + 1);
+        file->Skip(MainRAMMaxSize - (MainRAMMask + 1));
+    }
+    else
+        file->VarArray(MainRAM, MainRAMMaxSize);
     file->VarArray(SharedWRAM, SharedWRAMSize);
     file->VarArray(ARM7WRAM, ARM7WRAMSize);
 
@@ -716,7 +728,10 @@ bool NDS::DoSavestate(Savestate* file)
         // but we do need to update the mappings
         MapSharedWRAM(WRAMCnt);
 
-        InitTimings();
+        // the base timings never change, only rolling back in memory
+        // (see Savestate::SetIncremental) can count on them being set up
+        if (!file->IsIncremental())
+            InitTimings();
         SetGBASlotTimings();
 
         UpdateWifiTimings();
@@ -747,7 +762,11 @@ bool NDS::DoSavestate(Savestate* file)
         Wifi.SetPowerCnt(PowerControl7 & 0x0002);
 
 #ifdef JIT_ENABLED
-        JIT.Reset();
+        // when rolling back in memory, most of the code is still the same
+        if (file->IsIncremental())
+            InvalidateLoadedCode(file->LoadedPages());
+        else
+            JIT.Reset();
 #endif
     }
 
@@ -756,6 +775,46 @@ bool NDS::DoSavestate(Savestate* file)
     return true;
 }
 
+#ifdef JIT_ENABLED
+void NDS::InvalidateLoadedCode(const std::vector<u8*>& pages)
+{
+    bool vram = false;
+
+    for (u8* page : pages)
+    {
+        auto invalidate = [&](int region, u8* mem, u32 size)
+        {
+            if (page < mem || page >= mem + size)
+                return false;
+
+            u32 offset = page - mem;
+            JIT.CheckAndInvalidateRange(region, offset, std::min(Savestate::PAGE_SIZE, size - offset));
+            return true;
+        };
+
+        if (invalidate(ARMJIT_Memory::memregion_MainRAM, MainRAM, MainRAMMaxSize)
+            || invalidate(ARMJIT_Memory::memregion_SharedWRAM, SharedWRAM, SharedWRAMSize)
+            || invalidate(ARMJIT_Memory::memregion_WRAM7, ARM7WRAM, ARM7WRAMSize)
+            || invalidate(ARMJIT_Memory::memregion_ITCM, ARM9.ITCM, ITCMPhysicalSize))
+            continue;
+
+        for (int i = 0; i < 9; i++)
+        {
+            if (page >= GPU.VRAM[i] && page <= GPU.VRAM[i] + GPU.VRAMMask[i])
+                vram = true;
+        }
+    }
+
+    // code in VRAM isn't tracked by bank (see ARMJIT_Memory::LocaliseAddress),
+    // but it's rare enough that throwing all of it out doesn't matter
+    if (vram)
+    {
+        JIT.CheckAndInvalidateRange(ARMJIT_Memory::memregion_VRAM, 0, 0x100000);
+        JIT.CheckAndInvalidateRange(ARMJIT_Memory::memregion_VWRAM, 0, 0x40000);
+    }
+}
+#endif
+
 void NDS::SetNDSCart(std::unique_ptr<NDSCart::CartCommon>&& cart)
 {
     NDSCartSlot.SetCart(std::move(cart));
@@ -838,6 +897,7 @@ void NDS::RunSystem(u64 timestamp)
                 SchedListMask &= ~(1<<i);
 
                 EventFunc func = evt.Funcs[evt.FuncID];
+                PROFILE_SCOPE(Profiler, Prof_Event + i);
                 func(evt.That, evt.Param);
             }
         }
@@ -895,6 +955,7 @@ void NDS::RunSystemSleep(u64 timestamp)
                         param = evt.Param;
 
                     EventFunc func = evt.Funcs[evt.FuncID];
+                    PROFILE_SCOPE(Profiler, Prof_Event + i);
                     func(evt.That, param);
                 }
             }
@@ -914,7 +975,7 @@ void NDS::RunSystemSleep(u64 timestamp)
 template <CPUExecuteMode cpuMode>
 u32 NDS::RunFrame()
 {
-    Current = this;
+    Profiler.BeginFrame();
 
     FrameStartTimestamp = SysTimestamp;
 
@@ -981,6 +1042,7 @@ u32 NDS::RunFrame()
                 }
                 else if (CPUStop & CPUStop_DMA9)
                 {
+                    PROFILE_SCOPE(Profiler, Prof_DMARun);
                     DMAs[0].Run();
                     if (!(CPUStop & CPUStop_GXStall)) DMAs[1].Run();
                     if (!(CPUStop & CPUStop_GXStall)) DMAs[2].Run();
@@ -993,11 +1055,18 @@ u32 NDS::RunFrame()
                 }
                 else
                 {
+                    PROFILE_SCOPE(Profiler, Prof_ARM9Execute);
                     ARM9.Execute<cpuMode>();
                 }
 
-                RunTimers(0);
-                GPU.GPU3D.Run();
+                {
+                    PROFILE_SCOPE(Profiler, Prof_RunTimers);
+                    RunTimers(0);
+                }
+                {
+                    PROFILE_SCOPE(Profiler, Prof_GPU3DRun);
+                    GPU.GPU3D.Run();
+                }
 
                 target = ARM9Timestamp >> ARM9ClockShift;
                 CurCPU = 1;
@@ -1008,6 +1077,7 @@ u32 NDS::RunFrame()
 
                     if (CPUStop & CPUStop_DMA7)
                     {
+                        PROFILE_SCOPE(Profiler, Prof_DMARun);
                         DMAs[4].Run();
                         DMAs[5].Run();
                         DMAs[6].Run();
@@ -1020,9 +1090,11 @@ u32 NDS::RunFrame()
                     }
                     else
                     {
+                        PROFILE_SCOPE(Profiler, Prof_ARM7Execute);
                         ARM7.Execute<cpuMode>();
                     }
 
+                    PROFILE_SCOPE(Profiler, Prof_RunTimers);
                     RunTimers(1);
                 }
 
@@ -1054,6 +1126,8 @@ u32 NDS::RunFrame()
     if (LagFrameFlag)
         NumLagFrames++;
 
+    Profiler.EndFrame();
+
     if (Running)
         return GPU.TotalScanlines;
     else
@@ -1278,6 +1352,59 @@ void NDS::MapSharedWRAM(u8 val)
         SWRAM_ARM7.Mask = 0x7FFF;
         break;
     }
+
+    UpdateMemPages();
+}
+
+void NDS::UnmapMemPageWrites(u32 cpu, u32 addr) noexcept
+{
+    u8* page = GetMemPage(cpu, true, addr);
+    if (!page)
+        return;
+
+    for (u32 i = 0; i < 2; i++)
+    {
+        for (u32 j = 0; j < MemPageCount; j++)
+        {
+            if (MemPages[i][1][j] == page)
+                MemPages[i][1][j] = nullptr;
+        }
+    }
+}
+
+void NDS::UpdateMemPages() noexcept
+{
+    // with the JIT, writes have to go through the usual path
+    // so that the blocks they overwrite get invalidated
+    bool write = !IsJITEnabled();
+
+    memset(MemPages, 0, sizeof(MemPages));
+    // the interpreter's decoded instructions unmapped some of them again
+    JIT.ResetDecodedPages();
+
+    auto setPage = [&](u32 cpu, u32 addr, u8* ptr)
+    {
+        MemPages[cpu][0][addr >> MemPageShift] = ptr;
+        if (write)
+            MemPages[cpu][1][addr >> MemPageShift] = ptr;
+    };
+
+    for (u32 addr = 0x02000000; addr < 0x03000000; addr += MemPageSize)
+    {
+        setPage(0, addr, &MainRAM[addr & MainRAMMask]);
+        setPage(1, addr, &MainRAM[addr & MainRAMMask]);
+    }
+
+    for (u32 addr = 0x03000000; addr < 0x04000000; addr += MemPageSize)
+    {
+        if (SWRAM_ARM9.Mem)
+            setPage(0, addr, &SWRAM_ARM9.Mem[addr & SWRAM_ARM9.Mask]);
+
+        if (!(addr & 0x800000) && SWRAM_ARM7.Mem)
+            setPage(1, addr, &SWRAM_ARM7.Mem[addr & SWRAM_ARM7.Mask]);
+        else
+            setPage(1, addr, &ARM7WRAM[addr & (ARM7WRAMSize - 1)]);
+    }
 }
 
 
@@ -1664,6 +1791,10 @@ const s32 TimerPrescaler[4] = {0, 6, 8, 10};
 
 u16 NDS::TimerGetCounter(u32 timer)
 {
+    // the counter changes with every cycle, loops polling it can't be skipped
+    if (timer < 4) ARM9.IdleLoopDirty = true;
+    else           ARM7.IdleLoopDirty = true;
+
     RunTimers(timer>>2);
     u32 ret = Timers[timer].Counter;
 
@@ -3138,6 +3269,8 @@ u32 NDS::ARM9IORead32(u32 addr)
     case 0x04000304: return PowerControl9;
 
     case 0x04100000:
+        // reading pops the FIFO or sets the error flag, loops doing it aren't idle
+        ARM9.IdleLoopDirty = true;
         if (IPCFIFOCnt9 & 0x8000)
         {
             u32 ret;
@@ -3159,6 +3292,8 @@ u32 NDS::ARM9IORead32(u32 addr)
             return IPCFIFO7.Peek();
 
     case 0x04100010:
+        // moves the transfer along
+        ARM9.IdleLoopDirty = true;
         if (!(ExMemCnt[0] & (1<<11))) return NDSCartSlot.ReadROMData();
         return 0;
 
@@ -3967,6 +4102,8 @@ u32 NDS::ARM7IORead32(u32 addr)
     case 0x04000308: return ARM7BIOSProt;
 
     case 0x04100000:
+        // reading pops the FIFO or sets the error flag, loops doing it aren't idle
+        ARM7.IdleLoopDirty = true;
         if (IPCFIFOCnt7 & 0x8000)
         {
             u32 ret;
@@ -3988,6 +4125,8 @@ u32 NDS::ARM7IORead32(u32 addr)
             return IPCFIFO9.Peek();
 
     case 0x04100010:
+        // moves the transfer along
+        ARM7.IdleLoopDirty = true;
         if (ExMemCnt[0] & (1<<11)) return NDSCartSlot.ReadROMData();
         return 0;
     }
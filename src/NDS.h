@@ -42,6 +42,7 @@
 #include "CRC32.h"
 #include "DMA.h"
 #include "FreeBIOS.h"
+#include "HostProfiler.h"
 
 // when touching the main loop/timing code, pls test a lot of shit
 // with this enabled, to make sure it doesn't desync
@@ -244,6 +245,9 @@ private:
 #ifdef GDBSTUB_ENABLED
     bool EnableGDBStub = false;
 #endif
+    bool EnableBIOSHLE = false;
+    bool EnableIdleLoopSkip = false;
+    bool EnableICacheTiming = false;
 
 public: // TODO: Encapsulate the rest of these members
     void* UserData;
@@ -302,6 +306,16 @@ public: // TODO: Encapsulate the rest of these members
     MemRegion SWRAM_ARM9;
     MemRegion SWRAM_ARM7;
 
+    static constexpr u32 MemPageShift = 14;
+    static constexpr u32 MemPageSize = 1 << MemPageShift;
+    static constexpr u32 MemPageCount = 0x10000000 >> MemPageShift;
+
+    // direct pointers to the memory behind each 16 KB page of the first
+    // 256 MB of the ARM9 and ARM7 address space, for reads and writes
+    // NULL where the access has to go through ARM9Read8 etc.
+    // kept up to date by UpdateMemPages
+    u8* MemPages[2][2][MemPageCount] {};
+
     u32 KeyInput;
     u16 RCnt;
 
@@ -321,6 +335,10 @@ public: // TODO: Encapsulate the rest of these members
     melonDS::GPU GPU;
     melonDS::AREngine AREngine;
 
+    /// Per-subsystem host time counters.
+    /// A no-op unless the core was built with ENABLE_HOST_PROFILER.
+    HostProfiler Profiler;
+
     const u32 ARM7WRAMSize = 0x10000;
     u8* ARM7WRAM;
 
@@ -467,6 +485,20 @@ public: // TODO: Encapsulate the rest of these members
 
     virtual bool ARM7GetMemRegion(u32 addr, bool write, MemRegion* region);
 
+    /// The page of MemPages which covers addr, NULL if there's none.
+    u8* GetMemPage(u32 cpu, bool write, u32 addr) const noexcept
+    {
+        if (addr >= (MemPageCount << MemPageShift)) return nullptr;
+        return MemPages[cpu][write][addr >> MemPageShift];
+    }
+
+    /// Has to be called whenever any of the memory covered by MemPages is remapped.
+    virtual void UpdateMemPages() noexcept;
+
+    /// Removes the page which covers addr for writes, for every address and
+    /// CPU it's mapped at, so that writes to it go through ARM9Write/ARM7Write.
+    void UnmapMemPageWrites(u32 cpu, u32 addr) noexcept;
+
     virtual u8 ARM9IORead8(u32 addr);
     virtual u16 ARM9IORead16(u32 addr);
     virtual u32 ARM9IORead32(u32 addr);
@@ -489,6 +521,18 @@ public: // TODO: Encapsulate the rest of these members
     void SetJITArgs(std::optional<JITArgs> args) noexcept {}
 #endif
 
+    /// See NDSArgs::BIOSHLE.
+    [[nodiscard]] bool IsBIOSHLEEnabled() const noexcept { return EnableBIOSHLE; }
+    void SetBIOSHLE(bool enable) noexcept { EnableBIOSHLE = enable; }
+
+    /// See NDSArgs::IdleLoopSkip.
+    [[nodiscard]] bool IsIdleLoopSkipEnabled() const noexcept { return EnableIdleLoopSkip; }
+    void SetIdleLoopSkip(bool enable) noexcept { EnableIdleLoopSkip = enable; }
+
+    /// See NDSArgs::ICacheTiming.
+    [[nodiscard]] bool IsICacheTimingEnabled() const noexcept { return EnableICacheTiming; }
+    void SetICacheTiming(bool enable) noexcept { EnableICacheTiming = enable; }
+
 #ifdef GDBSTUB_ENABLED
     void SetGdbArgs(std::optional<GDBArgs> args) noexcept;
 #else
@@ -497,6 +541,9 @@ public: // TODO: Encapsulate the rest of these members
 
 private:
     void InitTimings();
+#ifdef JIT_ENABLED
+    void InvalidateLoadedCode(const std::vector<u8*>& pages);
+#endif
     u32 SchedListMask;
     u64 SysTimestamp;
     u8 WRAMCnt;
@@ -555,7 +602,6 @@ public:
     NDS(NDS&&) = delete;
     NDS& operator=(NDS&&) = delete;
 
-    static thread_local NDS* Current;
 protected:
     explicit NDS(NDSArgs&& args, int type, void* userdata) noexcept;
     virtual void DoSavestateExtra(Savestate* file) {}
@@ -0,0 +1,326 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <string.h>
+#include <chrono>
+#include <utility>
+#include "RewindBuffer.h"
+#include "NDS.h"
+#include "Platform.h"
+
+namespace melonDS
+{
+using Platform::Log;
+using Platform::LogLevel;
+
+/*
+    Delta entry format
+
+    A list of runs, each made of:
+    00 - number of unchanged 64-bit words before the run
+    04 - number of changed 64-bit words in the run (N)
+    08 - N words, XOR of the two states
+    until the end of the last whole word of the state.
+    After that, the XOR of the last (length % 8) bytes, if any.
+
+    A run only ends after two unchanged words, since a single
+    one takes up less space than a new run header.
+*/
+
+static u64 Now() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+RewindBuffer::RewindBuffer(melonDS::NDS& nds, u32 budget) noexcept :
+    NDS(nds),
+    Budget(budget)
+{
+}
+
+void RewindBuffer::SetBudget(u32 budget) noexcept
+{
+    Budget = budget;
+    Ring = nullptr;
+    EncodeBuffer = nullptr;
+    EncodeBufferLength = 0;
+    Clear();
+}
+
+void RewindBuffer::Clear() noexcept
+{
+    Entries.clear();
+    UsedBytes = 0;
+    HaveCurrent = false;
+    FrameCount = 0;
+}
+
+bool RewindBuffer::EncodeDelta(const u8* cur, const u8* prev, u32 len, u8* out, u32 maxlen, u32& outlen) noexcept
+{
+    u32 numwords = len >> 3;
+    u32 outpos = 0;
+    u32 i = 0;
+
+    while (i < numwords)
+    {
+        // most of the state doesn't change from one snapshot to the next,
+        // so skip over it in big blocks first
+        u32 start = i;
+        while (i + 64 <= numwords && memcmp(&cur[i << 3], &prev[i << 3], 64 << 3) == 0)
+            i += 64;
+        while (i < numwords && memcmp(&cur[i << 3], &prev[i << 3], 8) == 0)
+            i++;
+
+        if (i == numwords)
+            break;
+
+        u32 skip = i - start;
+        u32 runstart = i;
+        u32 runend = i;
+        while (i < numwords)
+        {
+            if (memcmp(&cur[i << 3], &prev[i << 3], 8) != 0)
+                runend = ++i;
+            else if (i - runend >= 1)
+                break;
+            else
+                i++;
+        }
+        i = runend;
+
+        u32 count = runend - runstart;
+        if (outpos + 8 + (count << 3) > maxlen)
+            return false;
+
+        memcpy(&out[outpos], &skip, 4);
+        memcpy(&out[outpos + 4], &count, 4);
+        outpos += 8;
+
+        for (u32 j = runstart; j < runend; j++)
+        {
+            u64 a, b;
+            memcpy(&a, &cur[j << 3], 8);
+            memcpy(&b, &prev[j << 3], 8);
+            a ^= b;
+            memcpy(&out[outpos], &a, 8);
+            outpos += 8;
+        }
+    }
+
+    u32 tail = len & 7;
+    if (outpos + tail > maxlen)
+        return false;
+
+    for (u32 j = 0; j < tail; j++)
+        out[outpos++] = cur[(numwords << 3) + j] ^ prev[(numwords << 3) + j];
+
+    outlen = outpos;
+    return true;
+}
+
+bool RewindBuffer::ApplyDelta(u8* state, u32 len, const u8* delta, u32 deltalen) noexcept
+{
+    u32 numwords = len >> 3;
+    u32 tail = len & 7;
+    u32 word = 0;
+    u32 pos = 0;
+
+    while (pos + tail < deltalen)
+    {
+        if (pos + 8 > deltalen)
+            return false;
+
+        u32 skip, count;
+        memcpy(&skip, &delta[pos], 4);
+        memcpy(&count, &delta[pos + 4], 4);
+        pos += 8;
+
+        word += skip;
+        if (word + count > numwords || pos + (count << 3) > deltalen)
+            return false;
+
+        for (u32 j = 0; j < count; j++)
+        {
+            u64 a, b;
+            memcpy(&a, &state[(word + j) << 3], 8);
+            memcpy(&b, &delta[pos], 8);
+            a ^= b;
+            memcpy(&state[(word + j) << 3], &a, 8);
+            pos += 8;
+        }
+        word += count;
+    }
+
+    if (pos + tail != deltalen)
+        return false;
+
+    for (u32 j = 0; j < tail; j++)
+        state[(numwords << 3) + j] ^= delta[pos++];
+
+    return true;
+}
+
+void RewindBuffer::PushEntry(u32 size) noexcept
+{
+    if (!Ring)
+        Ring = std::unique_ptr<u8[]>(new u8[Budget]);
+
+    u32 offset = 0;
+    if (!Entries.empty())
+    {
+        const Entry& newest = Entries.back();
+        offset = newest.Offset + newest.Size;
+        if (offset + size > Budget)
+        {
+            // whatever is left at the end of the ring is the oldest
+            while (!Entries.empty() && Entries.front().Offset >= offset)
+            {
+                UsedBytes -= Entries.front().Size;
+                Entries.pop_front();
+            }
+            offset = 0;
+        }
+    }
+
+    // drop the oldest entries until there's room for this one
+    while (!Entries.empty())
+    {
+        const Entry& oldest = Entries.front();
+        if (oldest.Offset >= offset + size || oldest.Offset + oldest.Size <= offset)
+            break;
+
+        UsedBytes -= oldest.Size;
+        Entries.pop_front();
+    }
+
+    memcpy(&Ring[offset], EncodeBuffer.get(), size);
+    Entries.push_back({offset, size});
+    UsedBytes += size;
+}
+
+bool RewindBuffer::Update()
+{
+    if (++FrameCount < Interval)
+        return false;
+
+    FrameCount = 0;
+    return Capture();
+}
+
+bool RewindBuffer::Capture()
+{
+    u64 start = Now();
+
+    if (!Next)
+        Next = std::make_unique<Savestate>();
+    else
+        Next->Rewind(true);
+
+    // the buffer still holds the snapshot before the newest one
+    Next->SetIncremental(true);
+
+    if (Next->Error || !NDS.DoSavestate(Next.get()) || Next->Error)
+    {
+        Log(LogLevel::Error, "rewind: failed to save state\n");
+        Next = nullptr;
+        return false;
+    }
+
+    u32 length = Next->Length();
+    if (HaveCurrent && length == CurrentLength)
+    {
+        // an entry that takes up more than a quarter of the budget
+        // isn't worth pushing most of the history out for
+        u32 maxsize = Budget / 4;
+        if (EncodeBufferLength < maxsize)
+        {
+            EncodeBuffer = std::unique_ptr<u8[]>(new u8[maxsize]);
+            EncodeBufferLength = maxsize;
+        }
+
+        u32 size = 0;
+        if (EncodeDelta((const u8*)Next->Buffer(), (const u8*)Current->Buffer(), length, EncodeBuffer.get(), maxsize, size))
+        {
+            PushEntry(size);
+            LastEntrySize = size;
+        }
+        else
+        {
+            Entries.clear();
+            UsedBytes = 0;
+            LastEntrySize = 0;
+        }
+    }
+    else
+    {
+        // the state layout changed (or there's no history yet),
+        // so the older snapshots can't be reached anymore
+        Entries.clear();
+        UsedBytes = 0;
+        LastEntrySize = 0;
+    }
+
+    std::swap(Current, Next);
+    CurrentLength = length;
+    HaveCurrent = true;
+
+    LastCaptureNanoseconds = Now() - start;
+    return true;
+}
+
+bool RewindBuffer::StepBack()
+{
+    if (!HaveCurrent)
+        return false;
+
+    // the snapshot is recent, so only what changed since has to be loaded
+    Savestate state(Current->Buffer(), CurrentLength, false);
+    state.SetIncremental(true);
+    if (state.Error || !NDS.DoSavestate(&state) || state.Error)
+    {
+        Log(LogLevel::Error, "rewind: failed to load state\n");
+        Clear();
+        return false;
+    }
+
+    // whatever the 3D renderer has belongs to the frame we left
+    NDS.GPU.GPU3D.RerenderFrame(NDS.GPU);
+
+    // make the previous snapshot the newest one
+    if (!Entries.empty())
+    {
+        const Entry& newest = Entries.back();
+        if (!ApplyDelta((u8*)Current->Buffer(), CurrentLength, &Ring[newest.Offset], newest.Size))
+        {
+            Log(LogLevel::Error, "rewind: corrupted delta entry\n");
+            Clear();
+            return true;
+        }
+
+        UsedBytes -= newest.Size;
+        Entries.pop_back();
+    }
+    else
+        HaveCurrent = false;
+
+    FrameCount = 0;
+    return true;
+}
+
+}
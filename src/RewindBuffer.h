@@ -0,0 +1,123 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef REWINDBUFFER_H
+#define REWINDBUFFER_H
+
+#include <deque>
+#include <memory>
+#include "types.h"
+#include "Savestate.h"
+
+namespace melonDS
+{
+class NDS;
+
+/// Rewind history kept in a fixed amount of memory.
+///
+/// Only the newest snapshot is kept as a full savestate. Every older one
+/// is stored as the XOR of itself and the snapshot that followed it,
+/// with the runs of unchanged bytes left out. Applying an entry to the
+/// newest snapshot turns it back into the previous one, so going back
+/// in time only ever touches the newest entry. The oldest entries are
+/// dropped once the memory budget is used up.
+class RewindBuffer
+{
+public:
+    static constexpr u32 DefaultBudget = 64 * 1024 * 1024;
+
+    explicit RewindBuffer(melonDS::NDS& nds, u32 budget = DefaultBudget) noexcept;
+    RewindBuffer(const RewindBuffer&) = delete;
+    RewindBuffer& operator=(const RewindBuffer&) = delete;
+
+    /// Sets how much memory the delta entries can take up, and clears the history.
+    /// The two full snapshots needed to build them aren't counted.
+    void SetBudget(u32 budget) noexcept;
+    [[nodiscard]] u32 GetBudget() const noexcept { return Budget; }
+
+    /// Sets how many frames there are between two snapshots.
+    void SetInterval(u32 frames) noexcept { Interval = frames ? frames : 1; }
+    [[nodiscard]] u32 GetInterval() const noexcept { return Interval; }
+
+    /// Drops the whole history.
+    void Clear() noexcept;
+
+    /// Call once after every emulated frame.
+    /// Takes a snapshot every <interval> frames.
+    /// @return true if a snapshot was taken.
+    bool Update();
+
+    /// Takes a snapshot right now.
+    bool Capture();
+
+    /// Loads the newest snapshot, and drops it from the history.
+    /// Calling this repeatedly goes further back in time.
+    /// @return false if there was no snapshot left to go back to.
+    bool StepBack();
+
+    /// @return How many snapshots can be gone back to.
+    [[nodiscard]] u32 GetNumSnapshots() const noexcept { return (HaveCurrent ? 1 : 0) + (u32)Entries.size(); }
+
+    /// @return How many bytes of the budget the delta entries take up.
+    [[nodiscard]] u32 GetUsedBytes() const noexcept { return UsedBytes; }
+
+    /// @return The size of the last delta entry, in bytes.
+    [[nodiscard]] u32 GetLastEntrySize() const noexcept { return LastEntrySize; }
+
+    /// @return Host time taken by the last snapshot, in nanoseconds.
+    [[nodiscard]] u64 GetLastCaptureNanoseconds() const noexcept { return LastCaptureNanoseconds; }
+
+private:
+    struct Entry
+    {
+        u32 Offset;
+        u32 Size;
+    };
+
+    static bool EncodeDelta(const u8* cur, const u8* prev, u32 len, u8* out, u32 maxlen, u32& outlen) noexcept;
+    static bool ApplyDelta(u8* state, u32 len, const u8* delta, u32 deltalen) noexcept;
+
+    void PushEntry(u32 size) noexcept;
+
+    melonDS::NDS& NDS;
+    u32 Budget;
+    u32 Interval = 1;
+    u32 FrameCount = 0;
+
+    // newest snapshot, and the one being taken
+    std::unique_ptr<Savestate> Current = nullptr;
+    std::unique_ptr<Savestate> Next = nullptr;
+    u32 CurrentLength = 0;
+    bool HaveCurrent = false;
+
+    // delta entries, oldest first
+    std::unique_ptr<u8[]> Ring = nullptr;
+    std::deque<Entry> Entries;
+    u32 UsedBytes = 0;
+
+    // deltas are encoded here first, since their size isn't known in advance
+    std::unique_ptr<u8[]> EncodeBuffer = nullptr;
+    u32 EncodeBufferLength = 0;
+
+    u32 LastEntrySize = 0;
+    u64 LastCaptureNanoseconds = 0;
+};
+
+}
+
+#endif // REWINDBUFFER_H
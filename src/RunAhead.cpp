@@ -0,0 +1,125 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <chrono>
+#include "RunAhead.h"
+#include "NDS.h"
+#include "Platform.h"
+
+namespace melonDS
+{
+using Platform::Log;
+using Platform::LogLevel;
+
+static u64 Now() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool RunAhead::SaveState()
+{
+    if (!State)
+        State = std::make_unique<Savestate>();
+    else
+        State->Rewind(true);
+
+    // the buffer still holds the state of the previous frame
+    State->SetIncremental(true);
+
+    if (State->Error || !NDS.DoSavestate(State.get()) || State->Error)
+    {
+        Log(LogLevel::Error, "run-ahead: failed to save state\n");
+        State = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+bool RunAhead::LoadState()
+{
+    // going back a few frames, so most of the memory and compiled code
+    // are still the same, and only what changed has to be loaded
+    State->Rewind(false);
+    State->SetIncremental(true);
+    if (!NDS.DoSavestate(State.get()) || State->Error)
+    {
+        Log(LogLevel::Error, "run-ahead: failed to load state\n");
+        State = nullptr;
+        return false;
+    }
+
+    // the 3D renderer's output belongs to the last speculative frame
+    NDS.GPU.GPU3D.RerenderFrame(NDS.GPU);
+    return true;
+}
+
+u32 RunAhead::RunFrame()
+{
+    if (!Frames)
+        return NDS.RunFrame();
+
+    // frame 0 is the one that is kept, frame <Frames> is displayed
+    // the 3D renderer works one frame ahead, and display capture can show it
+    // one frame later still, so only the two frames before the displayed one render 3D
+    auto render3D = [this](u32 frame) { return frame + 2 >= Frames && frame < Frames; };
+
+    u64 start = Now();
+
+    NDS.GPU.SkipRender2D = true;
+    NDS.GPU.SkipRender3D = !render3D(0);
+    u32 nlines = NDS.RunFrame();
+
+    u64 emulated = Now();
+    LastFrame.EmulateNanoseconds = emulated - start;
+
+    if (!NDS.IsRunning() || !SaveState())
+    {
+        NDS.GPU.SkipRender2D = false;
+        NDS.GPU.SkipRender3D = false;
+        LastFrame.SaveNanoseconds = 0;
+        LastFrame.SpeculateNanoseconds = 0;
+        LastFrame.LoadNanoseconds = 0;
+        return nlines;
+    }
+
+    u64 saved = Now();
+    LastFrame.SaveNanoseconds = saved - emulated;
+
+    NDS.SPU.SetOutputEnabled(false);
+    for (u32 i = 1; i <= Frames; i++)
+    {
+        NDS.GPU.SkipRender2D = i < Frames;
+        NDS.GPU.SkipRender3D = !render3D(i);
+        NDS.RunFrame();
+    }
+    NDS.SPU.SetOutputEnabled(true);
+    NDS.GPU.SkipRender2D = false;
+    NDS.GPU.SkipRender3D = false;
+
+    u64 speculated = Now();
+    LastFrame.SpeculateNanoseconds = speculated - saved;
+
+    LoadState();
+
+    LastFrame.LoadNanoseconds = Now() - speculated;
+    return nlines;
+}
+
+}
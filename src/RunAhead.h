@@ -0,0 +1,93 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef RUNAHEAD_H
+#define RUNAHEAD_H
+
+#include <memory>
+#include "types.h"
+#include "Savestate.h"
+
+namespace melonDS
+{
+class NDS;
+
+/// Host time spent on each step of the last run-ahead frame.
+struct RunAheadStats
+{
+    /// The frame that is kept, with audio but without 2D rendering.
+    u64 EmulateNanoseconds = 0;
+
+    /// Saving the state after that frame.
+    u64 SaveNanoseconds = 0;
+
+    /// The speculative frames, including the one that is displayed.
+    u64 SpeculateNanoseconds = 0;
+
+    /// Rolling back to the saved state.
+    u64 LoadNanoseconds = 0;
+
+    [[nodiscard]] u64 TotalNanoseconds() const noexcept
+    {
+        return EmulateNanoseconds + SaveNanoseconds + SpeculateNanoseconds + LoadNanoseconds;
+    }
+};
+
+/// Run-ahead input latency reduction.
+///
+/// Every call to RunFrame() emulates one frame, saves the state to memory,
+/// emulates the given number of frames further with the same input,
+/// then rolls back to the saved state. What's displayed is the last of
+/// those speculative frames, so the game reacts to input that many frames sooner.
+/// Audio is only output for the frame that is kept, and 2D/3D rendering is
+/// skipped on frames that are never displayed.
+class RunAhead
+{
+public:
+    explicit RunAhead(melonDS::NDS& nds) noexcept : NDS(nds) {}
+    RunAhead(const RunAhead&) = delete;
+    RunAhead& operator=(const RunAhead&) = delete;
+
+    /// Sets how many frames to run ahead; 0 disables run-ahead.
+    void SetFrames(u32 frames) noexcept { Frames = frames; }
+    [[nodiscard]] u32 GetFrames() const noexcept { return Frames; }
+
+    /// Runs one frame, the same way as NDS::RunFrame().
+    /// @return The number of scanlines of the frame that was kept.
+    u32 RunFrame();
+
+    /// @return How long each step of the last frame took.
+    /// Only valid while run-ahead is enabled.
+    [[nodiscard]] const RunAheadStats& GetLastFrameStats() const noexcept { return LastFrame; }
+
+private:
+    bool SaveState();
+    bool LoadState();
+
+    melonDS::NDS& NDS;
+    u32 Frames = 0;
+
+    // reused from frame to frame, so it only grows once
+    std::unique_ptr<Savestate> State = nullptr;
+
+    RunAheadStats LastFrame {};
+};
+
+}
+
+#endif // RUNAHEAD_H
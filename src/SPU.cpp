@@ -940,6 +940,12 @@ void SPU::Mix(u32 dummy)
         rightoutput &= 0xFFFFFFC0;
     }
 
+    if (!OutputEnabled)
+    {
+        NDS.ScheduleEvent(Event_SPU, true, 1024, 0, 0);
+        return;
+    }
+
     Platform::Mutex_Lock(AudioLock);
     OutputBuffer[OutputBufferWritePos++] = leftoutput >> 1;
     OutputBuffer[OutputBufferWritePos++] = rightoutput >> 1;
@@ -233,6 +233,11 @@ public:
     void SetDegrade10Bit(AudioBitDepth depth);
     void SetApplyBias(bool enable);
 
+    // when disabled, the SPU keeps running but its samples aren't
+    // sent to the output buffer (used for speculative run-ahead frames)
+    void SetOutputEnabled(bool enable) { OutputEnabled = enable; }
+    [[nodiscard]] bool IsOutputEnabled() const { return OutputEnabled; }
+
     void Mix(u32 dummy);
 
     void TrimOutput();
@@ -255,6 +260,7 @@ private:
     s16 OutputBuffer[2 * OutputBufferSize] {};
     u32 OutputBufferWritePos = 0;
     u32 OutputBufferReadPos = 0;
+    bool OutputEnabled = true; // not part of the hardware state, don't serialize
 
     Platform::Mutex* AudioLock;
 
@@ -19,7 +19,9 @@
 #include <stdio.h>
 #include <cassert>
 #include <cstring>
+#include <algorithm>
 #include "Savestate.h"
+#include "LZ.h"
 #include "Platform.h"
 
 namespace melonDS
@@ -28,6 +30,9 @@ using Platform::Log;
 using Platform::LogLevel;
 
 static const char* SAVESTATE_MAGIC = "MELN";
+static const char* SAVESTATE_COMPRESSED_MAGIC = "MELZ";
+static const char* SECTION_INDEX_MAGIC = "INDX";
+static constexpr u32 HEADER_SIZE = 0x10;
 
 /*
     Savestate format
@@ -45,11 +50,34 @@ static const char* SAVESTATE_MAGIC = "MELN";
     08 - reserved
     0C - reserved
 
+    since 12.2, the last section is an index of the others:
+    00 - section header, magic INDX
+    10 - for each section: magic, offset of its header, length
+    ...
+    after that, the number of entries, then the magic INDX again
+    so the index can be found from the end of the state
+
     Implementation details
 
     version difference:
     * different major means savestate file is incompatible
     * different minor means adjustments may have to be made
+
+    Compressed savestate format
+
+    header:
+    00 - magic MELZ
+    04 - version major
+    06 - version minor
+    08 - length of the uncompressed state
+    0C - reserved
+
+    followed by one block per section:
+    00 - uncompressed length
+    04 - compressed length (same as the uncompressed length if stored as-is)
+    08 - data, in LZ4 block format
+
+    Put back together, the blocks are the uncompressed state minus its header.
 */
 
 Savestate::Savestate(void *buffer, u32 size, bool save) :
@@ -60,7 +88,13 @@ Savestate::Savestate(void *buffer, u32 size, bool save) :
     buffer_offset(0),
     buffer_length(size),
     buffer_owned(false),
-    finished(false)
+    finished(false),
+    Incremental(false),
+    copied_pages(0),
+    skipped_pages(0),
+    Compressed(false),
+    raw_length(0),
+    skipping_section(false)
 {
     if (Saving)
     {
@@ -68,6 +102,15 @@ Savestate::Savestate(void *buffer, u32 size, bool save) :
     }
     else
     {
+        if (buffer_length >= HEADER_SIZE && memcmp(this->buffer, SAVESTATE_COMPRESSED_MAGIC, 4) == 0)
+        {
+            if (!Decompress(this->buffer, buffer_length))
+            {
+                Error = true;
+                return;
+            }
+        }
+
         // Ensure that the file starts with "MELN"
         u32 read_magic = 0;
         Var32(&read_magic);
@@ -112,6 +155,8 @@ Savestate::Savestate(void *buffer, u32 size, bool save) :
 
         // The next 4 bytes are reserved
         buffer_offset += 4;
+
+        ReadSectionIndex();
     }
 }
 
@@ -124,7 +169,13 @@ Savestate::Savestate(u32 initial_size) :
     buffer_offset(0),
     buffer_length(initial_size),
     buffer_owned(true),
-    finished(false)
+    finished(false),
+    Incremental(false),
+    copied_pages(0),
+    skipped_pages(0),
+    Compressed(false),
+    raw_length(0),
+    skipping_section(false)
 {
     buffer = static_cast<u8 *>(malloc(buffer_length));
 
@@ -138,6 +189,18 @@ Savestate::Savestate(u32 initial_size) :
     WriteSavestateHeader();
 }
 
+Savestate::Savestate(u32 initial_size, bool compressed) :
+    Savestate(initial_size)
+{
+    Compressed = compressed;
+    if (Compressed)
+    {
+        // the header is written once the uncompressed length is known
+        compressed_buffer.resize(HEADER_SIZE);
+        raw_length = HEADER_SIZE;
+    }
+}
+
 Savestate::~Savestate()
 {
     if (Saving && !finished && !buffer_owned && !Error)
@@ -177,6 +240,15 @@ void Savestate::Section(const char* magic)
     }
     else
     {
+        skipping_section = false;
+        if (!load_filter.empty())
+        {
+            u32 key;
+            memcpy(&key, magic, sizeof(key));
+            skipping_section = std::find(load_filter.begin(), load_filter.end(), key) == load_filter.end();
+            if (skipping_section) return;
+        }
+
         u32 section_offset = FindSection(magic);
 
         if (section_offset != NO_SECTION)
@@ -201,7 +273,8 @@ void Savestate::Bool32(bool* var)
     }
     else
     {
-        u32 val;
+        // left as it is if the section is skipped
+        u32 val = *var;
         Var32(&val);
         *var = val != 0;
     }
@@ -210,6 +283,7 @@ void Savestate::Bool32(bool* var)
 void Savestate::VarArray(void* data, u32 len)
 {
     if (Error || finished) return;
+    if (skipping_section && !Saving) return;
 
     assert(buffer_offset <= buffer_length);
 
@@ -229,7 +303,10 @@ void Savestate::VarArray(void* data, u32 len)
             // This way we can write the data and reduce the chance of needing to resize again.
         }
 
-        memcpy(buffer + buffer_offset, data, len);
+        if (Incremental && !Compressed && len >= PAGE_SIZE)
+            CopyChangedPages((const u8*)data, len);
+        else
+            memcpy(buffer + buffer_offset, data, len);
     }
     else
     {
@@ -244,17 +321,43 @@ void Savestate::VarArray(void* data, u32 len)
             // but we can't magically make the desired data appear.
         }
 
-        memcpy(data, buffer + buffer_offset, len);
+        if (Incremental && !Compressed && len >= PAGE_SIZE)
+            LoadChangedPages((u8*)data, len);
+        else
+            memcpy(data, buffer + buffer_offset, len);
+    }
+
+    buffer_offset += len;
+}
+
+void Savestate::Skip(u32 len)
+{
+    if (Error || finished) return;
+    if (skipping_section) return;
+
+    assert(!Saving && Incremental);
+
+    if (buffer_offset + len > buffer_length)
+    {
+        Log(LogLevel::Error, "savestate: %u-byte skip would exceed %u-byte savestate buffer\n", len, buffer_length);
+        Error = true;
+        return;
     }
 
+    skipped_pages += len / PAGE_SIZE;
     buffer_offset += len;
 }
 
 void Savestate::Finish()
 {
     if (Error || finished) return;
-    CloseCurrentSection();
-    WriteStateLength();
+    if (Saving)
+    {
+        // don't touch the buffer we're loading from
+        CloseCurrentSection();
+        WriteSectionIndex();
+        WriteStateLength();
+    }
     finished = true;
 }
 
@@ -266,6 +369,54 @@ void Savestate::Rewind(bool save)
 
     buffer_offset = 0;
     finished = false;
+    copied_pages = 0;
+    skipped_pages = 0;
+    loaded_pages.clear();
+    written_sections.clear();
+    section_index.clear();
+    skipping_section = false;
+
+    if (Compressed)
+    {
+        if (Saving)
+        {
+            compressed_buffer.resize(HEADER_SIZE);
+            raw_length = HEADER_SIZE;
+        }
+        else
+        {
+            // only the last section is left uncompressed,
+            // so the whole state has to be put back together
+            // from then on, this is a regular uncompressed state
+            if (!Decompress(compressed_buffer.data(), (u32)compressed_buffer.size()))
+            {
+                Error = true;
+                return;
+            }
+
+            Compressed = false;
+            compressed_buffer.clear();
+            compressed_buffer.shrink_to_fit();
+            raw_length = 0;
+        }
+    }
+
+    // so that an owned buffer can be reused for another state
+    if (Saving)
+        WriteSavestateHeader();
+    else
+        ReadSectionIndex();
+}
+
+void Savestate::SetLoadFilter(std::initializer_list<const char*> magics)
+{
+    load_filter.clear();
+    for (const char* magic : magics)
+    {
+        u32 key;
+        memcpy(&key, magic, sizeof(key));
+        load_filter.push_back(key);
+    }
 }
 
 void Savestate::CloseCurrentSection()
@@ -281,8 +432,185 @@ void Savestate::CloseCurrentSection()
         // (specifically the first 4 bytes after the magic number)
         memcpy(buffer + CurSection + 4, &section_length, sizeof(section_length));
 
+        // Remember where it is for the index
+        // (when compressing, the buffer only ever holds the current section)
+        IndexEntry entry;
+        memcpy(&entry.Magic, buffer + CurSection, sizeof(entry.Magic));
+        entry.Offset = Compressed ? (raw_length + CurSection - HEADER_SIZE) : CurSection;
+        entry.Length = section_length;
+        written_sections.push_back(entry);
+
         CurSection = NO_SECTION;
     }
+
+    if (Compressed && !finished)
+        CompressPending();
+}
+
+void Savestate::CompressPending()
+{
+    // everything after the header is the section that was just closed
+    u32 len = buffer_offset - HEADER_SIZE;
+    if (len == 0) return;
+
+    AppendCompressedBlock(compressed_buffer, buffer + HEADER_SIZE, len);
+    raw_length += len;
+    buffer_offset = HEADER_SIZE;
+}
+
+void Savestate::AppendCompressedBlock(std::vector<u8>& out, const u8* data, u32 len)
+{
+    size_t pos = out.size();
+    out.resize(pos + 8 + LZCompressBound(len));
+    u8* block = &out[pos];
+
+    // if it doesn't get any smaller, store it as-is
+    u32 complen = LZCompress(data, len, block + 8, len - 1);
+    if (complen == 0)
+    {
+        memcpy(block + 8, data, len);
+        complen = len;
+    }
+
+    memcpy(block, &len, sizeof(len));
+    memcpy(block + 4, &complen, sizeof(complen));
+    out.resize(pos + 8 + complen);
+}
+
+bool Savestate::Compress(std::vector<u8>& out) const
+{
+    if (Error || !Saving || !finished || Compressed)
+    {
+        Log(LogLevel::Error, "savestate: can only compress a complete uncompressed state\n");
+        return false;
+    }
+
+    u32 len = buffer_offset;
+    out.resize(HEADER_SIZE);
+    WriteCompressedHeader(out.data(), len);
+
+    // one block per section, same as when compressing while saving
+    for (u32 offset = HEADER_SIZE; offset < len;)
+    {
+        u32 section_length = 0;
+        if (len - offset >= 16)
+            memcpy(&section_length, buffer + offset + 4, sizeof(section_length));
+
+        if (section_length < 16 || section_length > len - offset)
+        {
+            Log(LogLevel::Error, "savestate: bad section length %u at %#x\n", section_length, offset);
+            return false;
+        }
+
+        AppendCompressedBlock(out, buffer + offset, section_length);
+        offset += section_length;
+    }
+
+    return true;
+}
+
+bool Savestate::Decompress(const u8* src, u32 len)
+{
+    u32 rawlen = 0;
+    memcpy(&rawlen, src + 0x08, sizeof(rawlen));
+    if (rawlen < HEADER_SIZE)
+    {
+        Log(LogLevel::Error, "savestate: bad uncompressed length %u\n", rawlen);
+        return false;
+    }
+
+    u8* raw = static_cast<u8 *>(malloc(rawlen));
+    if (raw == nullptr)
+    {
+        Log(LogLevel::Error, "savestate: failed to allocate %u bytes\n", rawlen);
+        return false;
+    }
+
+    // rebuild the regular header, so the rest of the loading goes as usual
+    memcpy(raw, SAVESTATE_MAGIC, 4);
+    memcpy(raw + 0x04, src + 0x04, 4);
+    memcpy(raw + 0x08, &rawlen, sizeof(rawlen));
+    memset(raw + 0x0C, 0, 4);
+
+    u32 in = HEADER_SIZE;
+    u32 out = HEADER_SIZE;
+    while (in < len)
+    {
+        u32 blockraw = 0, blockcomp = 0;
+        if (len - in < 8)
+            break;
+
+        memcpy(&blockraw, src + in, sizeof(blockraw));
+        memcpy(&blockcomp, src + in + 4, sizeof(blockcomp));
+        in += 8;
+
+        if (blockcomp > len - in || blockraw > rawlen - out || blockcomp > blockraw)
+            break;
+
+        if (blockcomp == blockraw)
+            memcpy(raw + out, src + in, blockraw);
+        else if (!LZDecompress(src + in, blockcomp, raw + out, blockraw))
+            break;
+
+        in += blockcomp;
+        out += blockraw;
+    }
+
+    if (in != len || out != rawlen)
+    {
+        Log(LogLevel::Error, "savestate: corrupted compressed state\n");
+        free(raw);
+        return false;
+    }
+
+    if (buffer_owned)
+        free(buffer);
+
+    buffer = raw;
+    buffer_length = rawlen;
+    buffer_offset = 0;
+    buffer_owned = true;
+    return true;
+}
+
+void Savestate::CopyChangedPages(const u8* data, u32 len)
+{
+    u8* dst = buffer + buffer_offset;
+    u32 i = 0;
+
+    // comparing only reads memory, so it's cheaper than copying
+    // whatever didn't change since the older state
+    for (; i + PAGE_SIZE <= len; i += PAGE_SIZE)
+    {
+        if (memcmp(dst + i, data + i, PAGE_SIZE) != 0)
+        {
+            memcpy(dst + i, data + i, PAGE_SIZE);
+            copied_pages++;
+        }
+        else
+            skipped_pages++;
+    }
+
+    if (i < len)
+        memcpy(dst + i, data + i, len - i);
+}
+
+void Savestate::LoadChangedPages(u8* data, u32 len)
+{
+    const u8* src = buffer + buffer_offset;
+
+    for (u32 i = 0; i < len; i += PAGE_SIZE)
+    {
+        u32 size = std::min(PAGE_SIZE, len - i);
+        if (memcmp(data + i, src + i, size) != 0)
+        {
+            memcpy(data + i, src + i, size);
+            loaded_pages.push_back(data + i);
+            copied_pages++;
+        }
+        else
+            skipped_pages++;
+    }
 }
 
 bool Savestate::Resize(u32 new_length)
@@ -333,6 +661,12 @@ void Savestate::WriteSavestateHeader()
 
 void Savestate::WriteStateLength()
 {
+    if (Compressed)
+    {
+        WriteCompressedHeader(compressed_buffer.data(), raw_length);
+        return;
+    }
+
     // Not to be confused with the buffer length.
     // The buffer might not be full,
     // so we don't want to write out the extra stuff.
@@ -342,10 +676,116 @@ void Savestate::WriteStateLength()
     memcpy(buffer + 0x08, &state_length, sizeof(state_length));
 }
 
+void Savestate::WriteCompressedHeader(u8* header, u32 rawlen)
+{
+    u16 major = SAVESTATE_MAJOR;
+    u16 minor = SAVESTATE_MINOR;
+    u32 zero = 0;
+
+    memcpy(header, SAVESTATE_COMPRESSED_MAGIC, 4);
+    memcpy(header + 0x04, &major, sizeof(major));
+    memcpy(header + 0x06, &minor, sizeof(minor));
+    memcpy(header + 0x08, &rawlen, sizeof(rawlen));
+    memcpy(header + 0x0C, &zero, sizeof(zero));
+}
+
+void Savestate::WriteSectionIndex()
+{
+    if (Error) return;
+
+    // the index doesn't list itself
+    std::vector<IndexEntry> entries = std::move(written_sections);
+    written_sections.clear();
+
+    CurSection = buffer_offset;
+    VarArray((void*)SECTION_INDEX_MAGIC, 4);
+
+    // length, filled in when closing, and reserved
+    u32 zero = 0;
+    Var32(&zero);
+    Var32(&zero);
+    Var32(&zero);
+
+    for (IndexEntry& entry : entries)
+    {
+        Var32(&entry.Magic);
+        Var32(&entry.Offset);
+        Var32(&entry.Length);
+    }
+
+    u32 count = (u32)entries.size();
+    Var32(&count);
+    VarArray((void*)SECTION_INDEX_MAGIC, 4);
+
+    CloseCurrentSection();
+}
+
+void Savestate::ReadSectionIndex()
+{
+    section_index.clear();
+
+    // older states don't have one, their sections are searched for instead
+    if (!IsAtLeastVersion(12, 2))
+        return;
+
+    // the buffer may be bigger than the state itself
+    u32 length = 0;
+    memcpy(&length, buffer + 0x08, sizeof(length));
+
+    auto fail = [this]()
+    {
+        Log(LogLevel::Warn, "savestate: bad section index, searching for sections instead\n");
+        section_index.clear();
+    };
+
+    constexpr u32 trailer = 8;
+    if (length > buffer_length || length < HEADER_SIZE + 16 + trailer
+        || memcmp(buffer + length - 4, SECTION_INDEX_MAGIC, 4) != 0)
+        return fail();
+
+    u32 count = 0;
+    memcpy(&count, buffer + length - trailer, sizeof(count));
+    if (count > (length - HEADER_SIZE - 16 - trailer) / 12)
+        return fail();
+
+    u32 start = length - trailer - (count * 12) - 16;
+    u32 index_length = 0;
+    memcpy(&index_length, buffer + start + 4, sizeof(index_length));
+    if (memcmp(buffer + start, SECTION_INDEX_MAGIC, 4) != 0 || index_length != 16 + (count * 12) + trailer)
+        return fail();
+
+    section_index.reserve(count);
+    for (u32 i = 0; i < count; i++)
+    {
+        IndexEntry entry;
+        memcpy(&entry, buffer + start + 16 + (i * 12), 12);
+
+        if (entry.Offset < HEADER_SIZE || entry.Offset > start
+            || entry.Length < 16 || entry.Length > start - entry.Offset
+            || memcmp(buffer + entry.Offset, &entry.Magic, 4) != 0)
+            return fail();
+
+        // same as searching, the first section with a given magic wins
+        section_index.emplace(entry.Magic, entry.Offset);
+    }
+}
+
 u32 Savestate::FindSection(const char* magic) const
 {
     if (!magic) return NO_SECTION;
 
+    if (!section_index.empty())
+    {
+        u32 key;
+        memcpy(&key, magic, sizeof(key));
+
+        auto it = section_index.find(key);
+        if (it == section_index.end())
+            return NO_SECTION;
+
+        return it->second + 16; // the first byte of the section after the header
+    }
+
     // Start looking at the savestate's beginning, right after its global header
     // (we can't start from the current offset because then we'd lose the ability to rearrange sections)
 
@@ -378,7 +818,6 @@ u32 Savestate::FindSection(const char* magic) const
     }
 
     // We've reached the end of the file without finding the requested section...
-    Log(LogLevel::Error, "savestate: section %s not found. blarg\n", magic);
     return NO_SECTION;
 }
 
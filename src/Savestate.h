@@ -22,10 +22,13 @@
 #include <cstring>
 #include <string>
 #include <stdio.h>
+#include <initializer_list>
+#include <unordered_map>
+#include <vector>
 #include "types.h"
 
 #define SAVESTATE_MAJOR 12
-#define SAVESTATE_MINOR 1
+#define SAVESTATE_MINOR 3
 
 namespace melonDS
 {
@@ -33,9 +36,22 @@ class Savestate
 {
 public:
     static constexpr u32 DEFAULT_SIZE = 32 * 1024 * 1024; // 32 MB
+    static constexpr u32 PAGE_SIZE = 4096;
     Savestate(void* buffer, u32 size, bool save);
     explicit Savestate(u32 initial_size = DEFAULT_SIZE);
 
+    // compressed state, for writing to a file
+    // each section is compressed as soon as it's complete, so the
+    // uncompressed data never takes up more than the biggest section
+    // Buffer() and Length() then refer to the compressed data
+    // states are decompressed transparently when loading
+    Savestate(u32 initial_size, bool compressed);
+
+    // compresses a complete uncompressed state after the fact,
+    // into the same format as the above
+    // this way the compression can be done away from the emulation thread
+    bool Compress(std::vector<u8>& out) const;
+
     ~Savestate();
 
     bool Error;
@@ -70,11 +86,55 @@ public:
 
     void VarArray(void* data, u32 len);
 
+    // when loading incrementally, skips over data the caller knows
+    // is the same in the state and in memory
+    void Skip(u32 len);
+
     void Finish();
 
-    // TODO rewinds the stream
+    // rewinds the stream, either to load the state again
+    // or to overwrite it with a new one
     void Rewind(bool save);
 
+    // incremental saving: when the buffer already holds an older state
+    // (of the same console), large arrays like RAM and VRAM are compared
+    // page by page, and only the pages that changed are copied
+    // the result is still a complete state, the older one is only used
+    // to avoid rewriting what didn't change
+    // incremental loading works the other way around: only the pages
+    // that differ from what's in memory are copied, which is meant for
+    // rolling back to a recent state of the same console
+    void SetIncremental(bool incremental) { Incremental = incremental; }
+    [[nodiscard]] bool IsIncremental() const { return Incremental; }
+
+    // how many pages were copied and skipped since the start of the state
+    [[nodiscard]] u32 CopiedPages() const { return copied_pages; }
+    [[nodiscard]] u32 SkippedPages() const { return skipped_pages; }
+
+    // when loading incrementally, where the pages that were copied went
+    // so that whatever was derived from that memory (like compiled code)
+    // can be updated
+    [[nodiscard]] const std::vector<u8*>& LoadedPages() const { return loaded_pages; }
+
+    [[nodiscard]] bool IsCompressed() const { return Compressed; }
+
+    // size of the state once decompressed
+    [[nodiscard]] u32 RawLength() const { return Compressed ? raw_length : buffer_offset; }
+
+    // partial loading: only the given sections are loaded, the others are
+    // skipped and that part of the emulator is left as it is
+    // only makes sense for sections that don't depend on the ones skipped,
+    // for instance the CPUs and RAM when rolling back
+    void SetLoadFilter(std::initializer_list<const char*> magics);
+    void ClearLoadFilter() { load_filter.clear(); }
+
+    // whether the section being loaded is left out by the filter
+    // nothing is read from it, so whatever the load would derive from its
+    // contents has to be left alone too
+    [[nodiscard]] bool IsSkippingSection() const { return skipping_section && !Saving; }
+
+    [[nodiscard]] bool HasSection(const char* magic) const { return FindSection(magic) != NO_SECTION; }
+
     bool IsAtLeastVersion(u32 major, u32 minor)
     {
         u16 major_version = MajorVersion();
@@ -83,12 +143,12 @@ public:
         return false;
     }
 
-    void* Buffer() { return buffer; }
-    [[nodiscard]] const void* Buffer() const { return buffer; }
+    void* Buffer() { return Compressed ? compressed_buffer.data() : buffer; }
+    [[nodiscard]] const void* Buffer() const { return Compressed ? compressed_buffer.data() : buffer; }
 
     [[nodiscard]] u32 BufferLength() const { return buffer_length; }
 
-    [[nodiscard]] u32 Length() const { return buffer_offset; }
+    [[nodiscard]] u32 Length() const { return Compressed ? (u32)compressed_buffer.size() : buffer_offset; }
 
     [[nodiscard]] u16 MajorVersion() const
     {
@@ -113,11 +173,39 @@ private:
     void WriteSavestateHeader();
     void WriteStateLength();
     u32 FindSection(const char* magic) const;
+    void WriteSectionIndex();
+    void ReadSectionIndex();
+    void CopyChangedPages(const u8* data, u32 len);
+    void LoadChangedPages(u8* data, u32 len);
+    void CompressPending();
+    static void AppendCompressedBlock(std::vector<u8>& out, const u8* data, u32 len);
+    static void WriteCompressedHeader(u8* header, u32 rawlen);
+    bool Decompress(const u8* src, u32 len);
     u8* buffer;
     u32 buffer_offset;
     u32 buffer_length;
     bool buffer_owned;
     bool finished;
+    bool Incremental;
+    u32 copied_pages;
+    u32 skipped_pages;
+    std::vector<u8*> loaded_pages;
+    bool Compressed;
+    u32 raw_length;
+    std::vector<u8> compressed_buffer;
+
+    struct IndexEntry
+    {
+        u32 Magic;
+        u32 Offset;
+        u32 Length;
+    };
+    std::vector<IndexEntry> written_sections;
+
+    // section magic -> offset, when loading a state that has an index
+    std::unordered_map<u32, u32> section_index;
+    std::vector<u32> load_filter;
+    bool skipping_section;
 };
 }
 
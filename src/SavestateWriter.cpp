@@ -0,0 +1,182 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <chrono>
+#include <utility>
+#include <vector>
+#include "SavestateWriter.h"
+
+namespace melonDS
+{
+using namespace Platform;
+
+static u64 Now() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SavestateWriter::SavestateWriter() noexcept
+{
+    Lock = Mutex_Create();
+    WorkSema = Semaphore_Create();
+    DoneSema = Semaphore_Create();
+}
+
+SavestateWriter::~SavestateWriter()
+{
+    if (Thread)
+    {
+        // whatever is still queued gets written first
+        Mutex_Lock(Lock);
+        Stopping = true;
+        Mutex_Unlock(Lock);
+        Semaphore_Post(WorkSema);
+
+        Thread_Wait(Thread);
+        Thread_Free(Thread);
+    }
+
+    Semaphore_Free(DoneSema);
+    Semaphore_Free(WorkSema);
+    Mutex_Free(Lock);
+}
+
+std::unique_ptr<Savestate> SavestateWriter::GetState()
+{
+    Mutex_Lock(Lock);
+    std::unique_ptr<Savestate> state = std::move(Spare);
+    Mutex_Unlock(Lock);
+
+    if (!state)
+        return std::make_unique<Savestate>();
+
+    state->Rewind(true);
+
+    // the buffer holds the last state that was written,
+    // which is likely to be mostly the same
+    state->SetIncremental(true);
+    return state;
+}
+
+void SavestateWriter::Queue(std::unique_ptr<Savestate> state, const std::string& filename, bool compress)
+{
+    if (!Thread)
+        Thread = Thread_Create([this]() { ThreadFunc(); });
+
+    Mutex_Lock(Lock);
+    Jobs.push_back({std::move(state), filename, compress});
+    Pending++;
+    Mutex_Unlock(Lock);
+
+    Semaphore_Post(WorkSema);
+}
+
+bool SavestateWriter::PollResult(Result& result)
+{
+    Mutex_Lock(Lock);
+    bool any = !Results.empty();
+    if (any)
+    {
+        result = std::move(Results.front());
+        Results.pop_front();
+    }
+    Mutex_Unlock(Lock);
+
+    return any;
+}
+
+void SavestateWriter::WaitIdle()
+{
+    for (;;)
+    {
+        Mutex_Lock(Lock);
+        bool idle = Pending == 0;
+        Mutex_Unlock(Lock);
+
+        if (idle) return;
+        Semaphore_Wait(DoneSema);
+    }
+}
+
+bool SavestateWriter::Write(const Job& job, u32& length)
+{
+    const void* data = job.State->Buffer();
+    length = job.State->Length();
+
+    std::vector<u8> compressed;
+    if (job.Compress)
+    {
+        if (!job.State->Compress(compressed))
+            return false;
+
+        data = compressed.data();
+        length = (u32)compressed.size();
+    }
+
+    FileHandle* file = OpenFile(job.Filename, FileMode::Write);
+    if (!file)
+    {
+        Log(LogLevel::Error, "savestate: failed to open %s for writing\n", job.Filename.c_str());
+        return false;
+    }
+
+    bool success = FileWrite(data, length, 1, file) == 1;
+    if (!success)
+        Log(LogLevel::Error, "savestate: failed to write %u bytes to %s\n", length, job.Filename.c_str());
+
+    CloseFile(file);
+    return success;
+}
+
+void SavestateWriter::ThreadFunc()
+{
+    for (;;)
+    {
+        Semaphore_Wait(WorkSema);
+
+        Mutex_Lock(Lock);
+        if (Jobs.empty())
+        {
+            bool stopping = Stopping;
+            Mutex_Unlock(Lock);
+            if (stopping) return;
+            continue;
+        }
+
+        Job job = std::move(Jobs.front());
+        Jobs.pop_front();
+        Mutex_Unlock(Lock);
+
+        u64 start = Now();
+        u32 length = 0;
+        bool success = !job.State->Error && Write(job, length);
+        u64 elapsed = Now() - start;
+
+        Mutex_Lock(Lock);
+        Results.push_back({job.Filename, success, length, elapsed});
+        if (!job.State->Error)
+            Spare = std::move(job.State);
+        Pending--;
+        Mutex_Unlock(Lock);
+
+        Semaphore_Post(DoneSema);
+    }
+}
+
+}
@@ -0,0 +1,100 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef SAVESTATEWRITER_H
+#define SAVESTATEWRITER_H
+
+#include <deque>
+#include <memory>
+#include <string>
+#include "types.h"
+#include "Savestate.h"
+#include "Platform.h"
+
+namespace melonDS
+{
+/// Writes savestates to files on a background thread.
+///
+/// The emulation thread only has to save the state to memory, which
+/// mostly comes down to copying RAM and VRAM. Compressing the state and
+/// writing it to the file are done by the writer thread, and the outcome
+/// can be polled for afterwards.
+class SavestateWriter
+{
+public:
+    struct Result
+    {
+        std::string Filename;
+        bool Success;
+
+        /// Size of the file that was written.
+        u32 Length;
+
+        /// Host time taken by compressing and writing the state.
+        u64 Nanoseconds;
+    };
+
+    SavestateWriter() noexcept;
+    ~SavestateWriter();
+    SavestateWriter(const SavestateWriter&) = delete;
+    SavestateWriter& operator=(const SavestateWriter&) = delete;
+
+    /// @return An empty state to save into. The buffer of a state
+    /// that was already written is reused when there is one,
+    /// which avoids allocating (and faulting in) a new one every time.
+    std::unique_ptr<Savestate> GetState();
+
+    /// Hands a complete state over to the writer thread.
+    /// @param compress Whether to write it in the compressed format.
+    void Queue(std::unique_ptr<Savestate> state, const std::string& filename, bool compress);
+
+    /// Takes the result of the oldest write that finished since the last call.
+    /// @return false if there was none.
+    bool PollResult(Result& result);
+
+    /// Blocks until every queued state has been written,
+    /// for instance before loading a state that may not be written yet.
+    void WaitIdle();
+
+private:
+    struct Job
+    {
+        std::unique_ptr<Savestate> State;
+        std::string Filename;
+        bool Compress;
+    };
+
+    void ThreadFunc();
+    static bool Write(const Job& job, u32& length);
+
+    Platform::Thread* Thread = nullptr;
+    Platform::Mutex* Lock;
+    Platform::Semaphore* WorkSema;
+    Platform::Semaphore* DoneSema;
+
+    // all of these are protected by Lock
+    std::deque<Job> Jobs;
+    std::deque<Result> Results;
+    std::unique_ptr<Savestate> Spare = nullptr;
+    u32 Pending = 0;
+    bool Stopping = false;
+};
+
+}
+
+#endif // SAVESTATEWRITER_H
@@ -371,10 +371,10 @@ void Wifi::UpdatePowerOn()
 
 void Wifi::SetPowerCnt(u32 val)
 {
-    printf("[DEBUG] Wifi::SetPowerCnt: val=0x%08X, enabled=%d\n", val, (val & (1<<1)) ? 1 : 0);
+    Log(LogLevel::Debug, "Wifi::SetPowerCnt: val=0x%08X, enabled=%d\n", val, (val & (1<<1)) ? 1 : 0);
     // Temporarily disable WiFi during DSi firmware boot to avoid JIT memory faults
     if (NDS.ConsoleType == 1) {
-        printf("[DEBUG] Wifi::SetPowerCnt: Disabling WiFi for DSi firmware boot\n");
+        Log(LogLevel::Debug, "Wifi::SetPowerCnt: Disabling WiFi for DSi firmware boot\n");
         Enabled = false;
     } else {
         Enabled = val & (1<<1);
@@ -2061,6 +2061,9 @@ u16 Wifi::Read(u32 addr)
     case W_RXBufDataRead:
         if (activeread)
         {
+            // moves the read address along, loops doing it aren't idle
+            NDS.ARM7.IdleLoopDirty = true;
+
             u32 rdaddr = IOPORT(W_RXBufReadAddr);
             u16 ret = *(u16*)&RAM[rdaddr];
 
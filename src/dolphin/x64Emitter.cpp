@@ -423,6 +423,7 @@ void XEmitter::JMP(const u8* addr, bool force5Bytes)
     // 8 bits will do
     Write8(0xEB);
     Write8((u8)(s8)distance);
+    RecordReloc(code - 1, CodeReloc::Type::Rel8, fn);
   }
   else
   {
@@ -432,6 +433,7 @@ void XEmitter::JMP(const u8* addr, bool force5Bytes)
                "Jump target too far away, needs indirect register");
     Write8(0xE9);
     Write32((u32)(s32)distance);
+    RecordReloc(code - 4, CodeReloc::Type::Rel32, fn);
   }
 }
 
@@ -471,6 +473,7 @@ void XEmitter::CALL(const void* fnptr)
              "CALL out of range (%p calls %p)", code, fnptr);
   Write8(0xE8);
   Write32(u32(distance));
+  RecordReloc(code - 4, CodeReloc::Type::Rel32, u64(fnptr));
 }
 
 FixupBranch XEmitter::CALL()
@@ -534,11 +537,13 @@ void XEmitter::J_CC(CCFlags conditionCode, const u8* addr)
     Write8(0x0F);
     Write8(0x80 + conditionCode);
     Write32((u32)(s32)distance);
+    RecordReloc(code - 4, CodeReloc::Type::Rel32, fn);
   }
   else
   {
     Write8(0x70 + conditionCode);
     Write8((u8)(s8)distance);
+    RecordReloc(code - 1, CodeReloc::Type::Rel8, fn);
   }
 }
 
@@ -554,6 +559,7 @@ void XEmitter::SetJumpTarget(const FixupBranch& branch)
     ASSERT_MSG(DYNA_REC, distance >= -0x80 && distance < 0x80,
                "Jump target too far away, needs force5Bytes = true");
     branch.ptr[-1] = (u8)(s8)distance;
+    RecordReloc(branch.ptr - 1, CodeReloc::Type::Rel8, (u64)code);
   }
   else if (branch.type == FixupBranch::Type::Branch32Bit)
   {
@@ -563,6 +569,7 @@ void XEmitter::SetJumpTarget(const FixupBranch& branch)
 
     s32 valid_distance = static_cast<s32>(distance);
     std::memcpy(&branch.ptr[-4], &valid_distance, sizeof(s32));
+    RecordReloc(branch.ptr - 4, CodeReloc::Type::Rel32, (u64)code);
   }
 }
 
@@ -1481,6 +1488,7 @@ void OpArg::WriteNormalOp(XEmitter* emit, bool toRM, NormalOp op, const OpArg& o
         {
           emit->Write8(0xB8 + (offsetOrBaseReg & 7));
           emit->Write64(operand.offset);
+          emit->RecordReloc(emit->code - 8, CodeReloc::Type::Imm64, operand.offset);
           return;
         }
         // mov reg64, simm32 (7 bytes)
@@ -1528,6 +1536,8 @@ void OpArg::WriteNormalOp(XEmitter* emit, bool toRM, NormalOp op, const OpArg& o
     break;
   case 32:
     emit->Write32((u32)operand.offset);
+    if (operand.scale == SCALE_IMM64)
+      emit->RecordReloc(emit->code - 4, CodeReloc::Type::Imm32, operand.offset);
     break;
   default:
     ASSERT_MSG(DYNA_REC, 0, "WriteNormalOp - Unhandled case");
@@ -11,6 +11,7 @@
 #include <functional>
 #include <tuple>
 #include <type_traits>
+#include <vector>
 
 #include "Compat.h"
 #include "BitSet.h"
@@ -333,14 +334,37 @@ struct FixupBranch
   Type type;
 };
 
+// melonDS: a place in emitted code which refers to an absolute address,
+// either through a relative branch or an immediate
+struct CodeReloc
+{
+  enum class Type
+  {
+    Rel8,
+    Rel32,
+    Imm32,  // sign extended to 64 bits
+    Imm64
+  };
+
+  u8* ptr;  // the displacement or the immediate
+  Type type;
+  u64 target;
+};
+
 class XEmitter
 {
   friend struct OpArg;  // for Write8 etc
 private:
   u8* code = nullptr;
   bool flags_locked = false;
+  std::vector<CodeReloc>* relocs = nullptr;
 
   void CheckFlags();
+  void RecordReloc(u8* ptr, CodeReloc::Type type, u64 target)
+  {
+    if (relocs)
+      relocs->push_back({ptr, type, target});
+  }
 
   void Rex(int w, int r, int x, int b);
   void WriteModRM(int mod, int reg, int rm);
@@ -397,6 +421,10 @@ public:
   const u8* GetCodePtr() const;
   u8* GetWritableCodePtr();
 
+  // melonDS: while set, every branch and 64-bit immediate emitted is added
+  // to the list, so the code can be moved somewhere else afterwards
+  void SetRelocRecorder(std::vector<CodeReloc>* list) { relocs = list; }
+
   void LockFlags() { flags_locked = true; }
   void UnlockFlags() { flags_locked = false; }
   // Looking for one of these? It's BANNED!! Some instructions are slow on modern CPU
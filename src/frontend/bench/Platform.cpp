@@ -0,0 +1,381 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+// Platform implementation for the headless benchmark runner.
+// Everything here is plain C++ standard library, so that the runner
+// only depends on the core and can run on machines without a display.
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "Platform.h"
+#include "BenchPlatform.h"
+
+namespace melonDS::Platform
+{
+
+static std::atomic<bool> EmuStopFlag {false};
+static LogLevel MinLogLevel = LogLevel::Warn;
+
+void SetBenchLogLevel(LogLevel level)
+{
+    MinLogLevel = level;
+}
+
+void SignalStop(StopReason reason, void* userdata)
+{
+    EmuStopFlag = true;
+}
+
+bool EmuShouldStop()
+{
+    return EmuStopFlag;
+}
+
+void ClearEmuShouldStop()
+{
+    EmuStopFlag = false;
+}
+
+
+static std::string GetModeString(FileMode mode, bool file_exists)
+{
+    std::string modeString;
+
+    if (mode & FileMode::Append)
+        modeString += 'a';
+    else if (!(mode & FileMode::Write))
+        modeString += 'r';
+    else if (mode & (FileMode::Preserve | FileMode::NoCreate))
+        modeString += file_exists ? 'r' : 'w';
+    else
+        modeString += 'w';
+
+    if ((mode & FileMode::ReadWrite) == FileMode::ReadWrite)
+        modeString += '+';
+    else if ((mode & FileMode::Write) && modeString[0] == 'r')
+        modeString += '+';
+
+    if (!(mode & FileMode::Text))
+        modeString += 'b';
+
+    return modeString;
+}
+
+std::string GetLocalFilePath(const std::string& filename)
+{
+    return filename;
+}
+
+FileHandle* OpenFile(const std::string& path, FileMode mode)
+{
+    if ((mode & (FileMode::ReadWrite | FileMode::Append)) == FileMode::None)
+    {
+        Log(LogLevel::Error, "Attempted to open \"%s\" in neither read nor write mode (FileMode 0x%x)\n", path.c_str(), mode);
+        return nullptr;
+    }
+
+    bool exists = FileExists(path);
+    if ((mode & FileMode::NoCreate) && !exists)
+        return nullptr;
+
+    FILE* file = fopen(path.c_str(), GetModeString(mode, exists).c_str());
+    return reinterpret_cast<FileHandle*>(file);
+}
+
+FileHandle* OpenLocalFile(const std::string& path, FileMode mode)
+{
+    return OpenFile(GetLocalFilePath(path), mode);
+}
+
+bool FileExists(const std::string& name)
+{
+    FILE* f = fopen(name.c_str(), "rb");
+    if (!f) return false;
+    fclose(f);
+    return true;
+}
+
+bool LocalFileExists(const std::string& name)
+{
+    return FileExists(GetLocalFilePath(name));
+}
+
+bool CheckFileWritable(const std::string& filepath)
+{
+    FILE* f = fopen(filepath.c_str(), "ab");
+    if (!f) return false;
+    fclose(f);
+    return true;
+}
+
+bool CheckLocalFileWritable(const std::string& filepath)
+{
+    return CheckFileWritable(GetLocalFilePath(filepath));
+}
+
+bool CloseFile(FileHandle* file)
+{
+    return fclose(reinterpret_cast<FILE*>(file)) == 0;
+}
+
+bool IsEndOfFile(FileHandle* file)
+{
+    return feof(reinterpret_cast<FILE*>(file)) != 0;
+}
+
+bool FileReadLine(char* str, int count, FileHandle* file)
+{
+    return fgets(str, count, reinterpret_cast<FILE*>(file)) != nullptr;
+}
+
+bool FileSeek(FileHandle* file, s64 offset, FileSeekOrigin origin)
+{
+    int stdorigin;
+    switch (origin)
+    {
+        case FileSeekOrigin::Start: stdorigin = SEEK_SET; break;
+        case FileSeekOrigin::Current: stdorigin = SEEK_CUR; break;
+        case FileSeekOrigin::End: stdorigin = SEEK_END; break;
+        default: return false;
+    }
+
+    return fseek(reinterpret_cast<FILE*>(file), offset, stdorigin) == 0;
+}
+
+void FileRewind(FileHandle* file)
+{
+    rewind(reinterpret_cast<FILE*>(file));
+}
+
+u64 FileRead(void* data, u64 size, u64 count, FileHandle* file)
+{
+    return fread(data, size, count, reinterpret_cast<FILE*>(file));
+}
+
+bool FileFlush(FileHandle* file)
+{
+    return fflush(reinterpret_cast<FILE*>(file)) == 0;
+}
+
+u64 FileWrite(const void* data, u64 size, u64 count, FileHandle* file)
+{
+    return fwrite(data, size, count, reinterpret_cast<FILE*>(file));
+}
+
+u64 FileWriteFormatted(FileHandle* file, const char* fmt, ...)
+{
+    if (fmt == nullptr)
+        return 0;
+
+    va_list args;
+    va_start(args, fmt);
+    u64 ret = vfprintf(reinterpret_cast<FILE*>(file), fmt, args);
+    va_end(args);
+    return ret;
+}
+
+u64 FileLength(FileHandle* file)
+{
+    FILE* stdfile = reinterpret_cast<FILE*>(file);
+    long pos = ftell(stdfile);
+    fseek(stdfile, 0, SEEK_END);
+    long len = ftell(stdfile);
+    fseek(stdfile, pos, SEEK_SET);
+    return len;
+}
+
+void Log(LogLevel level, const char* fmt, ...)
+{
+    if (fmt == nullptr || level < MinLogLevel)
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+
+struct BenchSemaphore
+{
+    std::mutex Lock;
+    std::condition_variable Cond;
+    int Count = 0;
+};
+
+Thread* Thread_Create(std::function<void()> func)
+{
+    return reinterpret_cast<Thread*>(new std::thread(std::move(func)));
+}
+
+void Thread_Free(Thread* thread)
+{
+    auto* t = reinterpret_cast<std::thread*>(thread);
+    if (t->joinable())
+        t->join();
+    delete t;
+}
+
+void Thread_Wait(Thread* thread)
+{
+    auto* t = reinterpret_cast<std::thread*>(thread);
+    if (t->joinable())
+        t->join();
+}
+
+Semaphore* Semaphore_Create()
+{
+    return reinterpret_cast<Semaphore*>(new BenchSemaphore);
+}
+
+void Semaphore_Free(Semaphore* sema)
+{
+    delete reinterpret_cast<BenchSemaphore*>(sema);
+}
+
+void Semaphore_Reset(Semaphore* sema)
+{
+    auto* s = reinterpret_cast<BenchSemaphore*>(sema);
+    std::lock_guard lock(s->Lock);
+    s->Count = 0;
+}
+
+void Semaphore_Wait(Semaphore* sema)
+{
+    auto* s = reinterpret_cast<BenchSemaphore*>(sema);
+    std::unique_lock lock(s->Lock);
+    s->Cond.wait(lock, [s]() { return s->Count > 0; });
+    s->Count--;
+}
+
+bool Semaphore_TryWait(Semaphore* sema, int timeout_ms)
+{
+    auto* s = reinterpret_cast<BenchSemaphore*>(sema);
+    std::unique_lock lock(s->Lock);
+    if (!s->Cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), [s]() { return s->Count > 0; }))
+        return false;
+    s->Count--;
+    return true;
+}
+
+void Semaphore_Post(Semaphore* sema, int count)
+{
+    auto* s = reinterpret_cast<BenchSemaphore*>(sema);
+    {
+        std::lock_guard lock(s->Lock);
+        s->Count += count;
+    }
+    s->Cond.notify_all();
+}
+
+Mutex* Mutex_Create()
+{
+    return reinterpret_cast<Mutex*>(new std::mutex);
+}
+
+void Mutex_Free(Mutex* mutex)
+{
+    delete reinterpret_cast<std::mutex*>(mutex);
+}
+
+void Mutex_Lock(Mutex* mutex)
+{
+    reinterpret_cast<std::mutex*>(mutex)->lock();
+}
+
+void Mutex_Unlock(Mutex* mutex)
+{
+    reinterpret_cast<std::mutex*>(mutex)->unlock();
+}
+
+bool Mutex_TryLock(Mutex* mutex)
+{
+    return reinterpret_cast<std::mutex*>(mutex)->try_lock();
+}
+
+void Sleep(u64 usecs)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(usecs));
+}
+
+u64 GetMSCount()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+u64 GetUSCount()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// saves and firmware writes are deliberately dropped,
+// a benchmark run should never touch the user's files
+
+void WriteNDSSave(const u8* savedata, u32 savelen, u32 writeoffset, u32 writelen, void* userdata)
+{
+}
+
+void WriteGBASave(const u8* savedata, u32 savelen, u32 writeoffset, u32 writelen, void* userdata)
+{
+}
+
+void WriteFirmware(const Firmware& firmware, u32 writeoffset, u32 writelen, void* userdata)
+{
+}
+
+void WriteDateTime(int year, int month, int day, int hour, int minute, int second, void* userdata)
+{
+}
+
+
+void MP_Begin(void* userdata) {}
+void MP_End(void* userdata) {}
+int MP_SendPacket(u8* data, int len, u64 timestamp, void* userdata) { return 0; }
+int MP_RecvPacket(u8* data, u64* timestamp, void* userdata) { return 0; }
+int MP_SendCmd(u8* data, int len, u64 timestamp, void* userdata) { return 0; }
+int MP_SendReply(u8* data, int len, u64 timestamp, u16 aid, void* userdata) { return 0; }
+int MP_SendAck(u8* data, int len, u64 timestamp, void* userdata) { return 0; }
+int MP_RecvHostPacket(u8* data, u64* timestamp, void* userdata) { return 0; }
+u16 MP_RecvReplies(u8* data, u64 timestamp, u16 aidmask, void* userdata) { return 0; }
+
+int Net_SendPacket(u8* data, int len, void* userdata) { return 0; }
+int Net_RecvPacket(u8* data, void* userdata) { return 0; }
+
+void Camera_Start(int num, void* userdata) {}
+void Camera_Stop(int num, void* userdata) {}
+void Camera_CaptureFrame(int num, u32* frame, int width, int height, bool yuv, void* userdata) {}
+
+bool Addon_KeyDown(KeyType type, void* userdata) { return false; }
+void Addon_RumbleStart(u32 len, void* userdata) {}
+void Addon_RumbleStop(void* userdata) {}
+float Addon_MotionQuery(MotionQueryType type, void* userdata) { return 0.0f; }
+
+DynamicLibrary* DynamicLibrary_Load(const char* lib) { return nullptr; }
+void DynamicLibrary_Unload(DynamicLibrary* lib) {}
+void* DynamicLibrary_LoadFunction(DynamicLibrary* lib, const char* name) { return nullptr; }
+
+}
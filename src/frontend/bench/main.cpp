@@ -0,0 +1,1651 @@
+/*
+    Copyright 2016-2025 melonDS team
+
+    This file is part of melonDS.
+
+    melonDS is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    melonDS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with melonDS. If not, see http://www.gnu.org/licenses/.
+*/
+
+// Headless benchmark runner.
+// Boots a ROM (or just the BIOS/firmware), runs a fixed amount of frames
+// as fast as possible and reports host frame times, for every requested
+// combination of CPU execution mode and 3D renderer.
+// There is no window, no audio device and no frame pacing, so the numbers
+// are the raw throughput of the core.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "NDS.h"
+#include "DSi.h"
+#include "Args.h"
+#include "FlatHashMap.h"
+#include "GPU2D_Soft.h"
+#include "GPU3D_Soft.h"
+#include "HostProfiler.h"
+#include "RunAhead.h"
+#include "RewindBuffer.h"
+#include "Savestate.h"
+#include "SavestateWriter.h"
+#include "Platform.h"
+#include "BenchPlatform.h"
+
+#define XXH_STATIC_LINKING_ONLY
+#include "xxhash/xxhash.h"
+
+using namespace melonDS;
+using namespace melonDS::Platform;
+
+enum class BenchCPUMode
+{
+    Interpreter,
+    JIT,
+};
+
+enum class BenchRenderer
+{
+    Software,
+    SoftwareThreaded,
+};
+
+struct BenchOptions
+{
+    std::string ROMPath;
+    std::string ARM9BIOSPath;
+    std::string ARM7BIOSPath;
+    std::string FirmwarePath;
+    std::string DSiARM9BIOSPath;
+    std::string DSiARM7BIOSPath;
+    std::string NANDPath;
+    std::string JITCachePath;
+    std::string GoldenPath;
+    JITPerfMap PerfMap = JITPerfMap::None;
+
+    bool DSi = false;
+    bool DirectBoot = true;
+    bool Verbose = false;
+    bool Profile = false;
+    bool MapTrace = false;
+    bool Superblocks = false;
+    bool AsyncJIT = false;
+    bool BIOSHLE = false;
+    bool IdleLoopSkip = false;
+    bool ICacheTiming = false;
+    bool Threaded2D = false;
+    bool ReuseLines2D = false;
+    u32 RasterThreads = 1;
+    bool ScalarSpans = false;
+
+    u32 Frames = 1800;
+    u32 Warmup = 120;
+    u32 RunAheadFrames = 0;
+    u32 RewindInterval = 0;
+    bool Savestates = false;
+    u32 Instances = 1;
+    u32 Threads = 0;
+    u32 CompositeLines = 0;
+    u32 SpanFrames = 0;
+    bool CheckHLECode = false;
+
+    std::vector<BenchCPUMode> CPUModes;
+    std::vector<BenchRenderer> Renderers;
+};
+
+struct BenchResult
+{
+    BenchCPUMode CPUMode;
+    BenchRenderer Renderer;
+
+    u32 Frames;
+    double TotalSeconds;
+    double FPS;
+    double MeanMS, StdDevMS;
+    double MinMS, P50MS, P90MS, P99MS, MaxMS;
+    u64 FrameHash;
+
+    // summed over all measured frames, only filled in with --profile
+    HostProfilerFrame Profile;
+
+    // summed over all measured frames, only filled in with --runahead
+    RunAheadStats RunAhead;
+
+    // for the whole run including warmup, only filled in for the JIT
+    ARMJITStats JIT;
+    // JIT blocks run during the measured frames
+    u64 BlocksDispatched;
+
+    // for the whole run including warmup
+    GPU2D::SoftRendererStats Lines2D;
+
+    // only filled in with --golden
+    struct
+    {
+        bool Recorded;
+        u32 Frames;
+        u32 Mismatches;
+        u32 FirstMismatch;
+    } Golden;
+
+    // only filled in for the JIT with --map-trace, best of a few replays
+    struct
+    {
+        u64 Ops;
+        u64 Finds, Inserts, Erases, Clears;
+        u64 StdNanoseconds;
+        u64 FlatNanoseconds;
+        bool Matches;
+    } MapTrace;
+
+    // only filled in with --rewind
+    struct
+    {
+        u32 Captures;
+        u64 CaptureNanoseconds;
+        u64 EntryBytes;
+        u32 Snapshots;
+        u32 UsedBytes;
+        u32 StepBacks;
+        u64 StepBackNanoseconds;
+        bool ReplayMatches;
+    } Rewind;
+
+    // only filled in with --savestate, averaged over a few runs
+    struct
+    {
+        u32 RawBytes;
+        u32 CompressedBytes;
+        u64 RawSaveNanoseconds;
+        u64 CompressedSaveNanoseconds;
+        u64 RawLoadNanoseconds;
+        u64 CompressedLoadNanoseconds;
+        u64 PartialLoadNanoseconds;
+        bool IndexedLoads;
+        bool UnindexedLoads;
+        bool SkippedSectionsKept;
+        u64 AsyncStallNanoseconds;
+        u64 AsyncWriteNanoseconds;
+        bool AsyncWritten;
+        bool Matches;
+    } States;
+};
+
+static const char* CPUModeName(BenchCPUMode mode)
+{
+    switch (mode)
+    {
+    case BenchCPUMode::Interpreter: return "interpreter";
+    case BenchCPUMode::JIT: return "jit";
+    }
+    return "?";
+}
+
+static const char* RendererName(BenchRenderer renderer)
+{
+    switch (renderer)
+    {
+    case BenchRenderer::Software: return "soft";
+    case BenchRenderer::SoftwareThreaded: return "soft-threaded";
+    }
+    return "?";
+}
+
+static void PrintUsage(const char* argv0)
+{
+    printf("usage: %s [options] [rom.nds]\n", argv0);
+    printf("\n");
+    printf("Runs the emulator core headless and reports host frame times.\n");
+    printf("Without a ROM, the console boots the BIOS/firmware.\n");
+    printf("\n");
+    printf("  --frames N          frames to measure (default 1800)\n");
+    printf("  --warmup N          frames to run before measuring (default 120)\n");
+    printf("  --cpu MODE          interpreter, jit or all (default all)\n");
+    printf("  --renderer R        soft, soft-threaded or all (default soft)\n");
+    printf("  --threaded-2d       render the 2D engine B on a thread of its own\n");
+    printf("  --reuse-2d-lines    copy 2D scanlines whose inputs didn't change from the previous frame\n");
+    printf("  --raster-threads N  rasterize 3D frames in N bands at once (default 1)\n");
+    printf("  --scalar-spans      draw 3D polygons one pixel at a time, without the vector path\n");
+    printf("  --check-composite N instead of running the console, blend N random 2D scanlines\n");
+    printf("                      a line and a pixel at a time and compare them\n");
+    printf("  --check-spans N     instead of running the console, draw N frames of random 3D polygons\n");
+    printf("                      with and without the vector path and compare them\n");
+    printf("  --golden FILE       compare the framebuffers of every measured frame with FILE,\n");
+    printf("                      or record them there if it doesn't exist yet\n");
+    printf("  --runahead N        run N frames ahead and roll back every frame\n");
+    printf("  --rewind K          keep rewind snapshots every K frames, then check\n");
+    printf("                      that replaying from the oldest one gives the same result\n");
+    printf("  --savestate         compare saving/loading compressed and uncompressed states,\n");
+    printf("                      and saving to a file in the background\n");
+    printf("  --instances N       run N consoles at once, stepped a frame at a time\n");
+    printf("                      by a pool of worker threads, and report each one's throughput\n");
+    printf("  --threads N         worker threads for --instances (default: one per core)\n");
+    printf("  --jit-cache FILE    load compiled JIT blocks from FILE before the run\n");
+    printf("                      and save them back afterwards\n");
+    printf("  --no-direct-boot    boot the ROM through the firmware\n");
+    printf("  --bios9 FILE        ARM9 BIOS (default FreeBIOS)\n");
+    printf("  --bios7 FILE        ARM7 BIOS (default FreeBIOS)\n");
+    printf("  --firmware FILE     firmware image (default generated)\n");
+    printf("  --hle-bios          run the BIOS decompression, copy and math functions natively\n");
+    printf("  --check-hle-code    instead of running a ROM, check that code the native BIOS functions\n");
+    printf("                      decompress over code that already ran is the one that runs next\n");
+    printf("  --skip-idle-loops   let the interpreter skip ahead when a CPU waits in a loop\n");
+    printf("  --icache-timing     time the interpreter's ARM9 code fetches with its instruction cache\n");
+    printf("  --dsi               emulate a DSi, requires the three options below\n");
+    printf("  --dsi-bios9 FILE    DSi ARM9 BIOS\n");
+    printf("  --dsi-bios7 FILE    DSi ARM7 BIOS\n");
+    printf("  --nand FILE         DSi NAND image\n");
+    printf("  --perf-map FORMAT   name the JIT's code for Linux perf, FORMAT is map\n");
+    printf("                      (/tmp/perf-<pid>.map) or jitdump (/tmp/jit-<pid>.dump)\n");
+    printf("  --superblocks       compile hot JIT blocks again as longer superblocks\n");
+    printf("  --async-jit         compile JIT blocks on a separate thread (x86-64 only)\n");
+    printf("  --map-trace         record what the JIT does to its block maps and replay it\n");
+    printf("                      on std::unordered_map and on FlatHashMap\n");
+    printf("  --profile           break frame times down per subsystem\n");
+    printf("                      (needs a build with ENABLE_HOST_PROFILER)\n");
+    printf("  --verbose           show core log messages\n");
+}
+
+static bool ParseOptions(int argc, char** argv, BenchOptions& opts)
+{
+    std::string cpumode = "all";
+    std::string renderer = "soft";
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto next = [&]() -> const char*
+        {
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, "missing value for %s\n", arg.c_str());
+                return nullptr;
+            }
+            return argv[++i];
+        };
+
+        const char* val = nullptr;
+        if (arg == "--help" || arg == "-h")
+        {
+            PrintUsage(argv[0]);
+            exit(0);
+        }
+        else if (arg == "--frames")
+        {
+            if (!(val = next())) return false;
+            opts.Frames = strtoul(val, nullptr, 0);
+        }
+        else if (arg == "--warmup")
+        {
+            if (!(val = next())) return false;
+            opts.Warmup = strtoul(val, nullptr, 0);
+        }
+        else if (arg == "--cpu")
+        {
+            if (!(val = next())) return false;
+            cpumode = val;
+        }
+        else if (arg == "--renderer")
+        {
+            if (!(val = next())) return false;
+            renderer = val;
+        }
+        else if (arg == "--runahead")
+        {
+            if (!(val = next())) return false;
+            opts.RunAheadFrames = strtoul(val, nullptr, 0);
+        }
+        else if (arg == "--rewind")
+        {
+            if (!(val = next())) return false;
+            opts.RewindInterval = strtoul(val, nullptr, 0);
+        }
+        else if (arg == "--instances")
+        {
+            if (!(val = next())) return false;
+            opts.Instances = strtoul(val, nullptr, 0);
+        }
+        else if (arg == "--raster-threads")
+        {
+            if (!(val = next())) return false;
+            opts.RasterThreads = strtoul(val, nullptr, 0);
+        }
+        else if (arg == "--threads")
+        {
+            if (!(val = next())) return false;
+            opts.Threads = strtoul(val, nullptr, 0);
+        }
+        else if (arg == "--check-composite")
+        {
+            if (!(val = next())) return false;
+            opts.CompositeLines = strtoul(val, nullptr, 0);
+        }
+        else if (arg == "--check-spans")
+        {
+            if (!(val = next())) return false;
+            opts.SpanFrames = strtoul(val, nullptr, 0);
+        }
+        else if (arg == "--perf-map")
+        {
+            if (!(val = next())) return false;
+            if (!strcmp(val, "map"))
+                opts.PerfMap = JITPerfMap::PerfMap;
+            else if (!strcmp(val, "jitdump"))
+                opts.PerfMap = JITPerfMap::JitDump;
+            else
+            {
+                fprintf(stderr, "unknown perf map format %s\n", val);
+                return false;
+            }
+        }
+        else if (arg == "--jit-cache")
+        {
+            if (!(val = next())) return false;
+            opts.JITCachePath = val;
+        }
+        else if (arg == "--golden")
+        {
+            if (!(val = next())) return false;
+            opts.GoldenPath = val;
+        }
+        else if (arg == "--savestate") opts.Savestates = true;
+        else if (arg == "--no-direct-boot") opts.DirectBoot = false;
+        else if (arg == "--dsi") opts.DSi = true;
+        else if (arg == "--verbose") opts.Verbose = true;
+        else if (arg == "--profile") opts.Profile = true;
+        else if (arg == "--map-trace") opts.MapTrace = true;
+        else if (arg == "--superblocks") opts.Superblocks = true;
+        else if (arg == "--async-jit") opts.AsyncJIT = true;
+        else if (arg == "--hle-bios") opts.BIOSHLE = true;
+        else if (arg == "--check-hle-code") opts.CheckHLECode = true;
+        else if (arg == "--skip-idle-loops") opts.IdleLoopSkip = true;
+        else if (arg == "--icache-timing") opts.ICacheTiming = true;
+        else if (arg == "--threaded-2d") opts.Threaded2D = true;
+        else if (arg == "--reuse-2d-lines") opts.ReuseLines2D = true;
+        else if (arg == "--scalar-spans") opts.ScalarSpans = true;
+        else if (arg == "--bios9")
+        {
+            if (!(val = next())) return false;
+            opts.ARM9BIOSPath = val;
+        }
+        else if (arg == "--bios7")
+        {
+            if (!(val = next())) return false;
+            opts.ARM7BIOSPath = val;
+        }
+        else if (arg == "--firmware")
+        {
+            if (!(val = next())) return false;
+            opts.FirmwarePath = val;
+        }
+        else if (arg == "--dsi-bios9")
+        {
+            if (!(val = next())) return false;
+            opts.DSiARM9BIOSPath = val;
+        }
+        else if (arg == "--dsi-bios7")
+        {
+            if (!(val = next())) return false;
+            opts.DSiARM7BIOSPath = val;
+        }
+        else if (arg == "--nand")
+        {
+            if (!(val = next())) return false;
+            opts.NANDPath = val;
+        }
+        else if (arg[0] == '-')
+        {
+            fprintf(stderr, "unknown option %s\n", arg.c_str());
+            return false;
+        }
+        else
+            opts.ROMPath = arg;
+    }
+
+    if (cpumode == "interpreter" || cpumode == "all")
+        opts.CPUModes.push_back(BenchCPUMode::Interpreter);
+#ifdef JIT_ENABLED
+    if (cpumode == "jit" || cpumode == "all")
+        opts.CPUModes.push_back(BenchCPUMode::JIT);
+#else
+    if (cpumode == "jit")
+        fprintf(stderr, "this build has no JIT\n");
+#endif
+    if (opts.CPUModes.empty())
+    {
+        fprintf(stderr, "no usable CPU mode in '%s'\n", cpumode.c_str());
+        return false;
+    }
+
+    // the OpenGL and compute renderers need a GL context, which we
+    // deliberately don't have, so only the software renderer is benchmarked
+    if (renderer == "soft" || renderer == "all")
+        opts.Renderers.push_back(BenchRenderer::Software);
+    if (renderer == "soft-threaded" || renderer == "all")
+        opts.Renderers.push_back(BenchRenderer::SoftwareThreaded);
+    if (opts.Renderers.empty())
+    {
+        fprintf(stderr, "no usable renderer in '%s'\n", renderer.c_str());
+        return false;
+    }
+
+#ifndef HOSTPROFILER_ENABLED
+    if (opts.Profile)
+    {
+        fprintf(stderr, "this build has no host profiler, --profile is ignored\n");
+        opts.Profile = false;
+    }
+#endif
+
+    if (opts.Frames == 0)
+    {
+        fprintf(stderr, "need at least one frame to measure\n");
+        return false;
+    }
+
+    if (opts.Instances == 0)
+    {
+        fprintf(stderr, "need at least one instance\n");
+        return false;
+    }
+    if (opts.Instances > 1 && (opts.Profile || opts.RunAheadFrames || opts.RewindInterval || opts.Savestates || opts.MapTrace))
+    {
+        fprintf(stderr, "--profile, --runahead, --rewind, --savestate and --map-trace only work with a single instance\n");
+        return false;
+    }
+    if (opts.Threads == 0)
+        opts.Threads = std::max(1u, std::thread::hardware_concurrency());
+
+    if (opts.DSi && (opts.DSiARM9BIOSPath.empty() || opts.DSiARM7BIOSPath.empty() || opts.NANDPath.empty()))
+    {
+        fprintf(stderr, "DSi mode requires --dsi-bios9, --dsi-bios7 and --nand\n");
+        return false;
+    }
+
+    return true;
+}
+
+static bool LoadFile(const std::string& path, std::unique_ptr<u8[]>& data, u32& len)
+{
+    FileHandle* f = OpenFile(path, FileMode::Read);
+    if (!f)
+    {
+        fprintf(stderr, "couldn't open %s\n", path.c_str());
+        return false;
+    }
+
+    len = (u32)FileLength(f);
+    data = std::make_unique<u8[]>(len);
+    FileRewind(f);
+    bool ok = FileRead(data.get(), len, 1, f) == 1;
+    CloseFile(f);
+
+    if (!ok)
+        fprintf(stderr, "couldn't read %s\n", path.c_str());
+    return ok;
+}
+
+template <size_t N>
+static bool LoadBIOS(const std::string& path, std::unique_ptr<std::array<u8, N>>& bios)
+{
+    if (path.empty())
+        return true;
+
+    std::unique_ptr<u8[]> data;
+    u32 len;
+    if (!LoadFile(path, data, len))
+        return false;
+
+    if (len != N)
+    {
+        fprintf(stderr, "%s has the wrong size (%u, expected %zu)\n", path.c_str(), len, N);
+        return false;
+    }
+
+    bios = std::make_unique<std::array<u8, N>>();
+    memcpy(bios->data(), data.get(), N);
+    return true;
+}
+
+static std::unique_ptr<NDS> CreateConsole(const BenchOptions& opts, BenchCPUMode cpumode)
+{
+    NDSArgs ndsargs {};
+
+    if (!LoadBIOS(opts.ARM9BIOSPath, ndsargs.ARM9BIOS)) return nullptr;
+    if (!LoadBIOS(opts.ARM7BIOSPath, ndsargs.ARM7BIOS)) return nullptr;
+
+    if (!opts.FirmwarePath.empty())
+    {
+        FileHandle* f = OpenFile(opts.FirmwarePath, FileMode::Read);
+        if (!f)
+        {
+            fprintf(stderr, "couldn't open %s\n", opts.FirmwarePath.c_str());
+            return nullptr;
+        }
+        ndsargs.Firmware = Firmware(f);
+        CloseFile(f);
+        if (!ndsargs.Firmware.Buffer())
+        {
+            fprintf(stderr, "couldn't load firmware %s\n", opts.FirmwarePath.c_str());
+            return nullptr;
+        }
+    }
+
+    ndsargs.BIOSHLE = opts.BIOSHLE;
+    ndsargs.IdleLoopSkip = opts.IdleLoopSkip;
+    ndsargs.ICacheTiming = opts.ICacheTiming;
+
+    if (cpumode == BenchCPUMode::Interpreter)
+        ndsargs.JIT = std::nullopt;
+    else
+    {
+        ndsargs.JIT->CodeCache = !opts.JITCachePath.empty();
+        ndsargs.JIT->PerfMap = opts.PerfMap;
+        ndsargs.JIT->Superblocks = opts.Superblocks;
+        ndsargs.JIT->AsyncCompile = opts.AsyncJIT;
+    }
+
+    if (!opts.DSi)
+        return std::make_unique<NDS>(std::move(ndsargs));
+
+    std::unique_ptr<DSiBIOSImage> arm9ibios, arm7ibios;
+    if (!LoadBIOS(opts.DSiARM9BIOSPath, arm9ibios)) return nullptr;
+    if (!LoadBIOS(opts.DSiARM7BIOSPath, arm7ibios)) return nullptr;
+
+    FileHandle* nandfile = OpenFile(opts.NANDPath, FileMode::ReadWriteExisting);
+    if (!nandfile)
+    {
+        fprintf(stderr, "couldn't open %s\n", opts.NANDPath.c_str());
+        return nullptr;
+    }
+
+    // the NAND image takes ownership of the file handle
+    DSi_NAND::NANDImage nand(nandfile, &(*arm7ibios)[0x8308]);
+    if (!nand)
+    {
+        fprintf(stderr, "couldn't parse DSi NAND %s\n", opts.NANDPath.c_str());
+        return nullptr;
+    }
+
+    DSiArgs dsiargs {
+            std::move(ndsargs),
+            std::move(arm9ibios),
+            std::move(arm7ibios),
+            std::move(nand),
+            std::nullopt,
+            false,
+    };
+
+    return std::make_unique<DSi>(std::move(dsiargs));
+}
+
+static u64 HashFramebuffers(const NDS& nds)
+{
+    const GPU& gpu = nds.GPU;
+    int fb = gpu.FrontBuffer;
+
+    u64 hash = XXH3_64bits(gpu.Framebuffer[fb][0].get(), 256 * 192 * 4);
+    return XXH3_64bits_withSeed(gpu.Framebuffer[fb][1].get(), 256 * 192 * 4, hash);
+}
+
+// the golden file holds one hash per frame, as written by the first run
+// later runs (and the other CPU modes and renderers of this one) must match it
+static bool CheckGolden(const std::string& path, const std::vector<u64>& hashes, BenchResult& res)
+{
+    res.Golden.Frames = (u32)hashes.size();
+
+    if (!FileExists(path))
+    {
+        FileHandle* f = OpenFile(path, FileMode::Write);
+        if (!f)
+        {
+            fprintf(stderr, "couldn't create %s\n", path.c_str());
+            return false;
+        }
+        bool ok = FileWrite(hashes.data(), sizeof(u64), hashes.size(), f) == hashes.size();
+        CloseFile(f);
+        if (!ok)
+            fprintf(stderr, "couldn't write %s\n", path.c_str());
+
+        res.Golden.Recorded = true;
+        return ok;
+    }
+
+    std::unique_ptr<u8[]> data;
+    u32 len = 0;
+    if (!LoadFile(path, data, len))
+        return false;
+
+    u32 count = len / sizeof(u64);
+    if (count < hashes.size())
+    {
+        fprintf(stderr, "%s only has %u frames\n", path.c_str(), count);
+        return false;
+    }
+
+    for (u32 i = 0; i < hashes.size(); i++)
+    {
+        u64 golden;
+        memcpy(&golden, &data[i * sizeof(u64)], sizeof(u64));
+        if (golden == hashes[i])
+            continue;
+
+        if (!res.Golden.Mismatches)
+            res.Golden.FirstMismatch = i;
+        res.Golden.Mismatches++;
+    }
+
+    return true;
+}
+
+static void BenchSavestates(NDS& nds, BenchResult& res)
+{
+    using clock = std::chrono::steady_clock;
+    auto elapsed = [](clock::time_point t)
+    {
+        return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t).count();
+    };
+
+    constexpr u32 runs = 5;
+    auto& ss = res.States;
+    ss = {};
+    ss.Matches = true;
+    ss.IndexedLoads = true;
+    ss.UnindexedLoads = true;
+
+    for (u32 i = 0; i < runs; i++)
+    {
+        auto t = clock::now();
+        Savestate raw;
+        nds.DoSavestate(&raw);
+        ss.RawSaveNanoseconds += elapsed(t);
+
+        t = clock::now();
+        Savestate compressed(Savestate::DEFAULT_SIZE, true);
+        nds.DoSavestate(&compressed);
+        ss.CompressedSaveNanoseconds += elapsed(t);
+
+        if (raw.Error || compressed.Error)
+        {
+            ss.Matches = false;
+            return;
+        }
+        ss.RawBytes = raw.Length();
+        ss.CompressedBytes = compressed.Length();
+
+        // loading the same state back doesn't change anything
+        // file I/O isn't timed, but copying the file into memory is
+        t = clock::now();
+        std::vector<u8> rawfile((const u8*)raw.Buffer(), (const u8*)raw.Buffer() + raw.Length());
+        Savestate rawload(rawfile.data(), (u32)rawfile.size(), false);
+        nds.DoSavestate(&rawload);
+        ss.RawLoadNanoseconds += elapsed(t);
+
+        t = clock::now();
+        std::vector<u8> compfile((const u8*)compressed.Buffer(), (const u8*)compressed.Buffer() + compressed.Length());
+        Savestate compload(compfile.data(), (u32)compfile.size(), false);
+        nds.DoSavestate(&compload);
+        ss.CompressedLoadNanoseconds += elapsed(t);
+
+        // a decompressed state is loaded from the same bytes as the raw one
+        if (rawload.Error || compload.Error
+            || compload.BufferLength() != raw.Length()
+            || memcmp(compload.Buffer(), raw.Buffer(), raw.Length()) != 0)
+            ss.Matches = false;
+
+        // rolling back only the CPUs and RAM
+        t = clock::now();
+        Savestate partial(rawfile.data(), (u32)rawfile.size(), false);
+        partial.SetLoadFilter({"NDSG", "ARM9", "ARM7", "CP15"});
+        nds.DoSavestate(&partial);
+        ss.PartialLoadNanoseconds += elapsed(t);
+
+        if (partial.Error || !partial.HasSection("GP3D"))
+            ss.IndexedLoads = false;
+
+        // states from before the section index are searched through instead
+        u16 minor = 1;
+        memcpy(&rawfile[0x06], &minor, sizeof(minor));
+        Savestate unindexed(rawfile.data(), (u32)rawfile.size(), false);
+        if (!nds.DoSavestate(&unindexed) || unindexed.Error)
+            ss.UnindexedLoads = false;
+    }
+
+    // the sections a partial load skips stay as they are, including the
+    // polygons the geometry engine has in flight, which point into its vertex RAM
+    {
+        GPU3D& gpu3d = nds.GPU.GPU3D;
+        Savestate restore;
+        nds.DoSavestate(&restore);
+
+        // the BIOS boot and 2D games don't leave any behind, so make one up
+        if (!gpu3d.NumPolygons)
+        {
+            Polygon& poly = gpu3d.CurPolygonRAM[0];
+            for (u32 i = 0; i < 3; i++)
+                poly.Vertices[i] = &gpu3d.CurVertexRAM[i];
+            poly.NumVertices = 3;
+            gpu3d.NumVertices = 3;
+            gpu3d.NumPolygons = 1;
+        }
+
+        Savestate before;
+        nds.DoSavestate(&before);
+        std::vector<u8> beforefile((const u8*)before.Buffer(), (const u8*)before.Buffer() + before.Length());
+        Savestate partial(beforefile.data(), (u32)beforefile.size(), false);
+        partial.SetLoadFilter({"NDSG", "ARM9", "ARM7", "CP15"});
+        nds.DoSavestate(&partial);
+
+        Savestate after;
+        nds.DoSavestate(&after);
+        ss.SkippedSectionsKept = !partial.Error && !before.Error && !after.Error
+            && after.Length() == before.Length()
+            && memcmp(after.Buffer(), before.Buffer(), before.Length()) == 0;
+
+        // back to where the run left the console
+        std::vector<u8> restorefile((const u8*)restore.Buffer(), (const u8*)restore.Buffer() + restore.Length());
+        Savestate restoreload(restorefile.data(), (u32)restorefile.size(), false);
+        nds.DoSavestate(&restoreload);
+    }
+
+    // saving to a file in the background, the way the frontends do it:
+    // only the in-memory copy stalls the emulation
+    std::string path = (std::filesystem::temp_directory_path() / "melonDS-bench.mln").string();
+    SavestateWriter writer;
+    ss.AsyncWritten = true;
+    for (u32 i = 0; i < runs; i++)
+    {
+        auto t = clock::now();
+        std::unique_ptr<Savestate> state = writer.GetState();
+        nds.DoSavestate(state.get());
+        writer.Queue(std::move(state), path, true);
+        ss.AsyncStallNanoseconds += elapsed(t);
+
+        writer.WaitIdle();
+        SavestateWriter::Result written {};
+        if (!writer.PollResult(written) || !written.Success)
+            ss.AsyncWritten = false;
+        ss.AsyncWriteNanoseconds += written.Nanoseconds;
+    }
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+
+    ss.AsyncStallNanoseconds /= runs;
+    ss.AsyncWriteNanoseconds /= runs;
+    ss.RawSaveNanoseconds /= runs;
+    ss.CompressedSaveNanoseconds /= runs;
+    ss.RawLoadNanoseconds /= runs;
+    ss.CompressedLoadNanoseconds /= runs;
+    ss.PartialLoadNanoseconds /= runs;
+}
+
+// applies the operations to a fresh set of maps
+// returns how many lookups found something, so both kinds of map can be compared
+template <typename Map>
+static u64 ReplayMapTrace(const std::vector<JitMapOp>& trace, Map (&maps)[3])
+{
+    u64 hits = 0;
+    for (const JitMapOp& op : trace)
+    {
+        Map& map = maps[op.Map];
+        // any non-null value will do
+        void* value = (void*)(uintptr_t)(op.Key | 1);
+        switch (op.Op)
+        {
+        case JitMapOp::Find:
+            if constexpr (std::is_same_v<Map, FlatHashMap<void>>)
+                hits += map.Find(op.Key) != nullptr;
+            else
+                hits += map.find(op.Key) != map.end();
+            break;
+        case JitMapOp::Insert:
+            if constexpr (std::is_same_v<Map, FlatHashMap<void>>)
+                map.Insert(op.Key, value);
+            else
+                map[op.Key] = value;
+            break;
+        case JitMapOp::Erase:
+            if constexpr (std::is_same_v<Map, FlatHashMap<void>>)
+                hits += map.Erase(op.Key) != nullptr;
+            else
+                hits += map.erase(op.Key);
+            break;
+        case JitMapOp::Clear:
+            if constexpr (std::is_same_v<Map, FlatHashMap<void>>)
+                map.Clear();
+            else
+                map.clear();
+            break;
+        }
+    }
+    return hits;
+}
+
+template <typename Map>
+static u64 TimeMapTrace(const std::vector<JitMapOp>& trace, u64& hits)
+{
+    u64 best = UINT64_MAX;
+    for (int run = 0; run < 5; run++)
+    {
+        Map maps[3];
+        auto start = std::chrono::steady_clock::now();
+        hits = ReplayMapTrace(trace, maps);
+        u64 ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, ns);
+    }
+    return best;
+}
+
+static void BenchMapTrace(const std::vector<JitMapOp>& trace, BenchResult& res)
+{
+    auto& mt = res.MapTrace;
+    mt.Ops = trace.size();
+    for (const JitMapOp& op : trace)
+    {
+        switch (op.Op)
+        {
+        case JitMapOp::Find: mt.Finds++; break;
+        case JitMapOp::Insert: mt.Inserts++; break;
+        case JitMapOp::Erase: mt.Erases++; break;
+        case JitMapOp::Clear: mt.Clears++; break;
+        }
+    }
+
+    u64 stdHits, flatHits;
+    mt.StdNanoseconds = TimeMapTrace<std::unordered_map<u32, void*>>(trace, stdHits);
+    mt.FlatNanoseconds = TimeMapTrace<FlatHashMap<void>>(trace, flatHits);
+    mt.Matches = stdHits == flatHits;
+}
+
+// the flag byte of a pixel in BGOBJLine, as the 2D renderer writes them:
+// BGs, sprites, the backdrop, semi-transparent and bitmap sprites
+// and the 3D layer, the last two with their alpha
+static u32 RandomLayerFlag(std::mt19937& rng)
+{
+    switch (rng() % 9)
+    {
+    case 0: case 1: case 2: case 3: case 4: case 5: return 1 << (rng() % 6);
+    case 6: return 0x80;
+    case 7: return 0xC0 | (2 + rng() % 15);
+    default: return 0x40 | (rng() & 0x1F);
+    }
+}
+
+// blends random lines with random settings, to cover the combinations
+// of layer flags and blending modes that ColorCompositeLine has to handle
+static bool CheckComposite(NDS& nds, u32 lines)
+{
+    auto& renderer2d = static_cast<GPU2D::SoftRenderer&>(nds.GPU.GetRenderer2D());
+    GPU2D::Unit& unit = nds.GPU.GPU2D_A;
+    std::mt19937 rng(1);
+
+    u32 line[512];
+    u8 windowMask[256];
+    u64 mismatches = 0, linens = 0, pixelns = 0;
+    for (u32 l = 0; l < lines; l++)
+    {
+        unit.BlendCnt = rng() & 0x3FFF;
+        unit.EVA = rng() % 17;
+        unit.EVB = rng() % 17;
+        unit.EVY = rng() % 17;
+        for (u32& pixel : line)
+            pixel = (RandomLayerFlag(rng) << 24) | (rng() & 0x3F3F3F);
+        for (u8& mask : windowMask)
+            mask = rng();
+
+        GPU2D::CompositeCheckResult res = renderer2d.CheckComposite(&unit, line, windowMask);
+        mismatches += res.Mismatches;
+        linens += res.LineNanoseconds;
+        pixelns += res.PixelNanoseconds;
+    }
+
+    printf("2d compositing: %u lines, a line at a time %.1fns/line, a pixel at a time %.1fns/line, ",
+           lines, (double)linens / lines, (double)pixelns / lines);
+    if (mismatches)
+        printf("%llu pixels DO NOT MATCH\n", (unsigned long long)mismatches);
+    else
+        printf("results match\n");
+    return !mismatches;
+}
+
+// draws frames of random convex polygons, on top of cleared buffers or the
+// previous frame, so the depth tests see a mix of empty and covered pixels
+static bool CheckSpans(NDS& nds, u32 frames)
+{
+    GPU& gpu = nds.GPU;
+    auto& renderer3d = static_cast<SoftRenderer&>(gpu.GetRenderer3D());
+    std::mt19937 rng(1);
+    auto random = [&](u32 n) { return rng() % n; };
+
+    for (u8& b : gpu.VRAMFlat_Texture)
+        b = rng();
+    for (u8& b : gpu.VRAMFlat_TexPal)
+        b = rng();
+
+    constexpr int maxpolys = 64;
+    std::vector<Vertex> vertices(maxpolys * 4);
+    std::vector<Polygon> polygons(maxpolys);
+    std::vector<Polygon*> polylist(maxpolys);
+
+    u32 mismatches = 0;
+    u64 changed = 0, scalarns = 0, vectorns = 0;
+    for (u32 f = 0; f < frames; f++)
+    {
+        gpu.GPU3D.RenderDispCnt = random(64);
+        gpu.GPU3D.RenderAlphaRef = random(4) ? 0 : random(32);
+        for (u16& toon : gpu.GPU3D.RenderToonTable)
+            toon = rng();
+        gpu.GPU3D.RenderClearAttr1 = rng() & 0x3F1F7FFF;
+        gpu.GPU3D.RenderClearAttr2 = rng() & 0x7FFF;
+        bool wbuffer = random(2);
+
+        int npolys = 1 + random(maxpolys);
+        for (int p = 0; p < npolys; p++)
+        {
+            Polygon& poly = polygons[p];
+            poly = {};
+            poly.NumVertices = 3 + random(2);
+            poly.WBuffer = wbuffer;
+
+            // points on an ellipse, sorted by angle so the polygon is convex
+            s32 cx = random(300) - 20, cy = random(220) - 14;
+            s32 rx = 1 + random(random(2) ? 40 : 200), ry = 1 + random(random(2) ? 30 : 150);
+            double angles[4];
+            for (u32 v = 0; v < poly.NumVertices; v++)
+                angles[v] = rng() * (6.2831853 / 4294967296.0);
+            std::sort(angles, angles + poly.NumVertices);
+            if (random(2))
+                std::reverse(angles, angles + poly.NumVertices);
+
+            u32 wbase = 0x100 + random(0xFF00);
+            for (u32 v = 0; v < poly.NumVertices; v++)
+            {
+                Vertex& vtx = vertices[p*4 + v];
+                vtx.FinalPosition[0] = std::clamp<s32>(cx + (s32)(rx * cos(angles[v])), 0, 256);
+                vtx.FinalPosition[1] = std::clamp<s32>(cy + (s32)(ry * sin(angles[v])), 0, 192);
+                for (s32& c : vtx.FinalColor)
+                    c = random(0x200);
+                vtx.TexCoords[0] = rng();
+                vtx.TexCoords[1] = rng();
+                poly.Vertices[v] = &vtx;
+                poly.FinalW[v] = std::max<u32>(1, (wbase + random(0x2000)) & 0xFFFF);
+                poly.FinalZ[v] = wbuffer ? poly.FinalW[v] : random(0x1000000);
+            }
+
+            // no shadow polygons, those can't be drawn without their masks
+            u32 alpha = random(3) ? 31 : random(32);
+            u32 mode = random(3);
+            poly.Attr = (mode << 4) | (random(2) << 11) | (random(2) << 14) | (random(2) << 15) | (alpha << 16) | (random(64) << 24);
+            poly.TexParam = random(3) ? rng() & 0x3FFFFFFF : 0;
+            poly.TexPalette = rng() & 0x1FFF;
+            poly.FacingView = random(2);
+            u32 texfmt = (poly.TexParam >> 26) & 7;
+            poly.Translucent = alpha < 31 || texfmt == 1 || texfmt == 6;
+
+            poly.YTop = 192; poly.XTop = 256;
+            poly.YBottom = 0; poly.XBottom = 0;
+            for (u32 v = 0; v < poly.NumVertices; v++)
+            {
+                s32 x = poly.Vertices[v]->FinalPosition[0], y = poly.Vertices[v]->FinalPosition[1];
+                if (y < poly.YTop || (y == poly.YTop && x < poly.XTop))
+                {
+                    poly.VTop = v; poly.YTop = y; poly.XTop = x;
+                }
+                if (y > poly.YBottom || (y == poly.YBottom && x > poly.XBottom))
+                {
+                    poly.VBottom = v; poly.YBottom = y; poly.XBottom = x;
+                }
+            }
+            polylist[p] = &poly;
+        }
+
+        SpanCheckResult res = renderer3d.CheckVectorSpans(gpu, polylist.data(), npolys, random(2));
+        mismatches += !res.Matches;
+        changed += res.PixelsChanged;
+        scalarns += res.ScalarNanoseconds;
+        vectorns += res.VectorNanoseconds;
+    }
+
+    printf("3d spans: %u frames, %.1f pixels changed per frame, pixel by pixel %.3fms/frame, vector %.3fms/frame, ",
+           frames, (double)changed / frames, scalarns / 1000000.0 / frames, vectorns / 1000000.0 / frames);
+    if (mismatches)
+        printf("%u frames DO NOT MATCH\n", mismatches);
+    else
+        printf("results match\n");
+    return !mismatches;
+}
+
+// ARM9 code which calls a function, decompresses a new version of it over
+// the old one with LZ77UnCompWram and calls it again
+// what the two calls return ends up in r4 and r5
+static const u32 HLECodeProgram[] =
+{
+    0xEB000006, // bl func
+    0xE1A04000, // mov r4, r0
+    0xE28F0018, // add r0, pc, #0x18 (compressed)
+    0xE28F100C, // add r1, pc, #0x0C (func)
+    0xEF110000, // swi 0x11
+    0xEB000001, // bl func
+    0xE1A05000, // mov r5, r0
+    0xEAFFFFFE, // b .
+    // func:
+    0xE3A00001, // mov r0, #1
+    0xE12FFF1E, // bx lr
+    // compressed: 8 bytes, all of them literals
+    0x00000810,
+    // flags 0x00, then mov r0, #2; bx lr
+    0xA0000200, 0x2FFF1EE3, 0x000000E1,
+};
+
+static bool CheckHLECode(const BenchOptions& opts, BenchCPUMode cpumode)
+{
+    BenchOptions hleopts = opts;
+    hleopts.BIOSHLE = true;
+    auto nds = CreateConsole(hleopts, cpumode);
+    if (!nds)
+        return false;
+
+    // out of the way of the BIOS on the ARM7
+    constexpr u32 addr = 0x02100000;
+    nds->Reset();
+    memcpy(&nds->MainRAM[addr & nds->MainRAMMask], HLECodeProgram, sizeof(HLECodeProgram));
+    nds->ARM9.JumpTo(addr);
+
+    nds->Start();
+    for (int i = 0; i < 2; i++)
+        nds->RunFrame();
+    nds->Stop();
+
+    bool ok = nds->ARM9.R[4] == 1 && nds->ARM9.R[5] == 2;
+    printf("%-12s hle bios: code decompressed over code that already ran %s\n",
+           CPUModeName(cpumode), ok ? "runs" : "DOES NOT RUN");
+    return ok;
+}
+
+// creates a console with the ROM inserted and starts it
+static std::unique_ptr<NDS> BootConsole(const BenchOptions& opts, BenchCPUMode cpumode, BenchRenderer renderer)
+{
+    auto nds = CreateConsole(opts, cpumode);
+    if (!nds)
+        return nullptr;
+
+    std::unique_ptr<u8[]> romdata;
+    u32 romlen = 0;
+    if (!opts.ROMPath.empty())
+    {
+        if (!LoadFile(opts.ROMPath, romdata, romlen))
+            return nullptr;
+
+        auto cart = NDSCart::ParseROM(std::move(romdata), romlen);
+        if (!cart)
+        {
+            fprintf(stderr, "couldn't parse ROM %s\n", opts.ROMPath.c_str());
+            return nullptr;
+        }
+        nds->SetNDSCart(std::move(cart));
+    }
+
+    nds->GPU.SetRenderer3D(std::make_unique<SoftRenderer>());
+    auto& renderer3d = static_cast<SoftRenderer&>(nds->GPU.GetRenderer3D());
+    renderer3d.SetThreaded(renderer == BenchRenderer::SoftwareThreaded, nds->GPU);
+    renderer3d.SetRasterThreads(opts.RasterThreads, nds->GPU);
+    renderer3d.SetVectorSpans(!opts.ScalarSpans);
+    auto& renderer2d = static_cast<GPU2D::SoftRenderer&>(nds->GPU.GetRenderer2D());
+    renderer2d.SetThreaded(opts.Threaded2D);
+    renderer2d.SetLineReuse(opts.ReuseLines2D);
+
+    // a missing cache file just means starting from scratch
+    if (cpumode == BenchCPUMode::JIT && !opts.JITCachePath.empty())
+        nds->JIT.LoadCodeCache(opts.JITCachePath);
+
+    nds->Reset();
+    if (nds->CartInserted() && (opts.DirectBoot || nds->NeedsDirectBoot()))
+        nds->SetupDirectBoot(opts.ROMPath);
+    nds->Start();
+    return nds;
+}
+
+static std::optional<BenchResult> RunBenchmark(const BenchOptions& opts, BenchCPUMode cpumode, BenchRenderer renderer)
+{
+    auto nds = BootConsole(opts, cpumode, renderer);
+    if (!nds)
+        return std::nullopt;
+
+    RunAhead runahead(*nds);
+    runahead.SetFrames(opts.RunAheadFrames);
+
+    RewindBuffer rewind(*nds);
+    rewind.SetInterval(opts.RewindInterval);
+
+    std::vector<JitMapOp> maptrace;
+#ifdef JIT_ENABLED
+    if (opts.MapTrace && cpumode == BenchCPUMode::JIT)
+        nds->JIT.MapTrace = &maptrace;
+#endif
+
+    for (u32 i = 0; i < opts.Warmup && nds->IsRunning(); i++)
+        runahead.RunFrame();
+
+    std::vector<double> frametimes;
+    frametimes.reserve(opts.Frames);
+
+    std::vector<u64> framehashes;
+    if (!opts.GoldenPath.empty())
+        framehashes.reserve(opts.Frames);
+
+    BenchResult res {};
+    nds->Profiler.SetEnabled(opts.Profile);
+
+    u64 dispatched = nds->JIT.Stats.BlocksDispatched;
+
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    auto last = start;
+    for (u32 i = 0; i < opts.Frames && nds->IsRunning(); i++)
+    {
+        runahead.RunFrame();
+
+        if (opts.RewindInterval && rewind.Update())
+        {
+            res.Rewind.Captures++;
+            res.Rewind.CaptureNanoseconds += rewind.GetLastCaptureNanoseconds();
+            res.Rewind.EntryBytes += rewind.GetLastEntrySize();
+        }
+
+        // hashing the framebuffers counts towards the frame time
+        if (!opts.GoldenPath.empty())
+            framehashes.push_back(HashFramebuffers(*nds));
+
+        auto now = clock::now();
+        frametimes.push_back(std::chrono::duration<double, std::milli>(now - last).count());
+        last = now;
+
+        if (opts.Profile)
+        {
+            const HostProfilerFrame& prof = nds->Profiler.GetLastFrame();
+            for (u32 c = 0; c < Prof_MAX; c++)
+            {
+                res.Profile.Nanoseconds[c] += prof.Nanoseconds[c];
+                res.Profile.Calls[c] += prof.Calls[c];
+            }
+            res.Profile.FrameNanoseconds += prof.FrameNanoseconds;
+        }
+
+        if (opts.RunAheadFrames)
+        {
+            const RunAheadStats& stats = runahead.GetLastFrameStats();
+            res.RunAhead.EmulateNanoseconds += stats.EmulateNanoseconds;
+            res.RunAhead.SaveNanoseconds += stats.SaveNanoseconds;
+            res.RunAhead.SpeculateNanoseconds += stats.SpeculateNanoseconds;
+            res.RunAhead.LoadNanoseconds += stats.LoadNanoseconds;
+        }
+    }
+    double total = std::chrono::duration<double>(last - start).count();
+    res.BlocksDispatched = nds->JIT.Stats.BlocksDispatched - dispatched;
+
+    if (frametimes.empty())
+    {
+        fprintf(stderr, "the console stopped before any frame could be measured\n");
+        return std::nullopt;
+    }
+
+    res.CPUMode = cpumode;
+    res.Renderer = renderer;
+    res.Frames = (u32)frametimes.size();
+    res.TotalSeconds = total;
+    res.FPS = frametimes.size() / total;
+
+    double sum = 0, sumsq = 0;
+    for (double t : frametimes)
+    {
+        sum += t;
+        sumsq += t * t;
+    }
+    res.MeanMS = sum / frametimes.size();
+    res.StdDevMS = std::sqrt(std::max(0.0, sumsq / frametimes.size() - res.MeanMS * res.MeanMS));
+
+    std::sort(frametimes.begin(), frametimes.end());
+    auto percentile = [&](double p)
+    {
+        size_t idx = (size_t)(p * (frametimes.size() - 1) + 0.5);
+        return frametimes[idx];
+    };
+    res.MinMS = frametimes.front();
+    res.P50MS = percentile(0.50);
+    res.P90MS = percentile(0.90);
+    res.P99MS = percentile(0.99);
+    res.MaxMS = frametimes.back();
+
+    res.FrameHash = HashFramebuffers(*nds);
+
+    if (!opts.GoldenPath.empty() && !CheckGolden(opts.GoldenPath, framehashes, res))
+        return std::nullopt;
+
+    if (opts.RewindInterval)
+    {
+        res.Rewind.Snapshots = rewind.GetNumSnapshots();
+        res.Rewind.UsedBytes = rewind.GetUsedBytes();
+
+        // go all the way back, then emulate up to the same frame again
+        u32 endframe = nds->NumFrames;
+        while (true)
+        {
+            auto t = clock::now();
+            if (!rewind.StepBack())
+                break;
+            res.Rewind.StepBackNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t).count();
+            res.Rewind.StepBacks++;
+        }
+
+        while (nds->NumFrames < endframe && nds->IsRunning())
+            runahead.RunFrame();
+
+        res.Rewind.ReplayMatches = HashFramebuffers(*nds) == res.FrameHash;
+    }
+
+    if (opts.Savestates)
+        BenchSavestates(*nds, res);
+
+    res.JIT = nds->JIT.Stats;
+    res.Lines2D = static_cast<GPU2D::SoftRenderer&>(nds->GPU.GetRenderer2D()).GetStats();
+#ifdef JIT_ENABLED
+    nds->JIT.MapTrace = nullptr;
+#endif
+    if (!maptrace.empty())
+        BenchMapTrace(maptrace, res);
+    if (cpumode == BenchCPUMode::JIT && !opts.JITCachePath.empty())
+        nds->JIT.SaveCodeCache(opts.JITCachePath);
+
+    nds->Stop();
+    return res;
+}
+
+struct PoolInstance
+{
+    std::unique_ptr<NDS> Console;
+    u32 FramesLeft;
+    u32 Frames;
+    u64 BusyNanoseconds;
+    double Seconds;
+    u32 Migrations;
+    int LastWorker;
+};
+
+// runs every instance for <frames> frames
+// each frame is a job of its own, so an instance hops between workers
+// whenever another one gets to it first
+static void RunPool(std::vector<PoolInstance>& instances, u32 frames, u32 numthreads)
+{
+    using clock = std::chrono::steady_clock;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<size_t> ready;
+    size_t active = 0;
+
+    for (size_t i = 0; i < instances.size(); i++)
+    {
+        PoolInstance& inst = instances[i];
+        inst.FramesLeft = frames;
+        inst.Frames = 0;
+        inst.BusyNanoseconds = 0;
+        inst.Seconds = 0;
+        inst.Migrations = 0;
+        inst.LastWorker = -1;
+        if (frames && inst.Console->IsRunning())
+        {
+            ready.push_back(i);
+            active++;
+        }
+    }
+
+    auto start = clock::now();
+    auto worker = [&](int id)
+    {
+        std::unique_lock guard(lock);
+        for (;;)
+        {
+            wake.wait(guard, [&]() { return !ready.empty() || active == 0; });
+            if (ready.empty())
+                return;
+
+            size_t idx = ready.front();
+            ready.pop_front();
+            guard.unlock();
+
+            PoolInstance& inst = instances[idx];
+            if (inst.LastWorker != -1 && inst.LastWorker != id)
+                inst.Migrations++;
+            inst.LastWorker = id;
+
+            auto t = clock::now();
+            inst.Console->RunFrame();
+            auto now = clock::now();
+            inst.BusyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(now - t).count();
+            inst.Frames++;
+
+            bool done = --inst.FramesLeft == 0 || !inst.Console->IsRunning();
+            if (done)
+                inst.Seconds = std::chrono::duration<double>(now - start).count();
+
+            guard.lock();
+            if (done)
+                active--;
+            else
+                ready.push_back(idx);
+            wake.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (u32 i = 0; i < numthreads; i++)
+        threads.emplace_back(worker, (int)i);
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+static bool RunInstances(const BenchOptions& opts, BenchCPUMode cpumode, BenchRenderer renderer)
+{
+    std::vector<PoolInstance> instances(opts.Instances);
+    for (PoolInstance& inst : instances)
+    {
+        inst.Console = BootConsole(opts, cpumode, renderer);
+        if (!inst.Console)
+            return false;
+    }
+
+    RunPool(instances, opts.Warmup, opts.Threads);
+
+    auto start = std::chrono::steady_clock::now();
+    RunPool(instances, opts.Frames, opts.Threads);
+    double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%-12s %-14s %u instances on %u threads\n",
+           CPUModeName(cpumode), RendererName(renderer), opts.Instances, opts.Threads);
+    printf("  %-8s %8s %9s %9s %10s  %-16s\n", "instance", "frames", "fps", "busy fps", "migrations", "fbhash");
+
+    u32 frames = 0;
+    double minfps = 0, maxfps = 0;
+    bool match = true;
+    u64 firsthash = HashFramebuffers(*instances[0].Console);
+    for (size_t i = 0; i < instances.size(); i++)
+    {
+        const PoolInstance& inst = instances[i];
+        u64 hash = HashFramebuffers(*inst.Console);
+        match = match && hash == firsthash;
+
+        // fps is what the instance got out of the pool, busy fps is how fast
+        // it runs while it's actually on a worker
+        double fps = inst.Seconds > 0 ? inst.Frames / inst.Seconds : 0;
+        double busyfps = inst.BusyNanoseconds ? inst.Frames * 1000000000.0 / inst.BusyNanoseconds : 0;
+        printf("  %-8zu %8u %9.2f %9.2f %10u  %016llx\n",
+               i, inst.Frames, fps, busyfps, inst.Migrations, (unsigned long long)hash);
+
+        frames += inst.Frames;
+        minfps = i ? std::min(minfps, fps) : fps;
+        maxfps = i ? std::max(maxfps, fps) : fps;
+
+        inst.Console->Stop();
+    }
+
+    printf("  total %.2f fps (%.1f%% speed), per instance min %.2f max %.2f, framebuffers %s\n",
+           frames / total, frames / total * 100.0 / 59.8261,
+           minfps, maxfps, match ? "all match" : "DIFFER");
+    return match;
+}
+
+static void PrintProfile(const BenchResult& res)
+{
+    u32 frames = res.Frames;
+    printf("  %-18s %10s %8s %12s\n", "subsystem", "ms/frame", "share%", "calls/frame");
+    for (u32 c = 0; c < Prof_MAX; c++)
+    {
+        const char* name = HostProfiler::GetCounterName(c);
+        if (!name || !res.Profile.Calls[c])
+            continue;
+
+        double ms = res.Profile.Nanoseconds[c] / 1000000.0 / frames;
+        double share = res.Profile.Nanoseconds[c] * 100.0 / res.Profile.FrameNanoseconds;
+        printf("  %-18s %10.4f %8.2f %12.1f\n", name, ms, share, (double)res.Profile.Calls[c] / frames);
+    }
+}
+
+static void PrintRunAhead(const BenchResult& res, u32 runahead)
+{
+    const RunAheadStats& stats = res.RunAhead;
+    double scale = 1.0 / 1000000.0 / res.Frames;
+    double kept = stats.EmulateNanoseconds * scale;
+    double overhead = (stats.TotalNanoseconds() - stats.EmulateNanoseconds) * scale;
+
+    printf("  run-ahead %u: kept frame %.3fms, save %.3fms, speculative %.3fms, load %.3fms\n",
+           runahead, kept,
+           stats.SaveNanoseconds * scale, stats.SpeculateNanoseconds * scale, stats.LoadNanoseconds * scale);
+    printf("  overhead %.3fms per frame (%.0f%% of the kept frame)\n",
+           overhead, kept > 0 ? overhead * 100.0 / kept : 0.0);
+}
+
+static void PrintRewind(const BenchResult& res, u32 interval)
+{
+    const auto& rw = res.Rewind;
+    u32 deltas = rw.Captures > 1 ? rw.Captures - 1 : 0;
+
+    printf("  rewind every %u: capture %.3fms, entry %.1fKB, %u snapshots in %.2fMB\n",
+           interval,
+           rw.Captures ? rw.CaptureNanoseconds / 1000000.0 / rw.Captures : 0.0,
+           deltas ? rw.EntryBytes / 1024.0 / deltas : 0.0,
+           rw.Snapshots, rw.UsedBytes / (1024.0 * 1024.0));
+    printf("  step back %.3fms, replay from oldest snapshot %s\n",
+           rw.StepBacks ? rw.StepBackNanoseconds / 1000000.0 / rw.StepBacks : 0.0,
+           rw.ReplayMatches ? "matches" : "DOES NOT MATCH");
+}
+
+static void PrintGolden(const BenchResult& res, const std::string& path)
+{
+    const auto& golden = res.Golden;
+    if (golden.Recorded)
+        printf("  golden: recorded %u frames to %s\n", golden.Frames, path.c_str());
+    else if (!golden.Mismatches)
+        printf("  golden: %u frames match %s\n", golden.Frames, path.c_str());
+    else
+        printf("  golden: %u of %u frames DO NOT MATCH %s, first one is frame %u\n",
+               golden.Mismatches, golden.Frames, path.c_str(), golden.FirstMismatch);
+}
+
+static void PrintJITCache(const BenchResult& res)
+{
+    const ARMJITStats& jit = res.JIT;
+    printf("  jit cache: %llu blocks compiled, %llu loaded, %llu restored, %llu segments evicted (%llu blocks), %llu recompiled, %llu resets\n",
+           (unsigned long long)jit.BlocksCompiled, (unsigned long long)jit.BlocksLoaded, (unsigned long long)jit.BlocksRestored,
+           (unsigned long long)jit.SegmentsEvicted, (unsigned long long)jit.BlocksEvicted,
+           (unsigned long long)jit.BlocksRecompiled, (unsigned long long)jit.CacheResets);
+    printf("  dispatches: %.0f blocks per frame\n", (double)res.BlocksDispatched / res.Frames);
+    if (jit.SuperblocksCompiled)
+        printf("  superblocks: %llu\n", (unsigned long long)jit.SuperblocksCompiled);
+    if (jit.BlocksCompiledAsync)
+        printf("  compiled in the background: %llu\n", (unsigned long long)jit.BlocksCompiledAsync);
+}
+
+static void PrintLines2D(const BenchResult& res)
+{
+    const GPU2D::SoftRendererStats& stats = res.Lines2D;
+    u64 total = stats.LinesRendered + stats.LinesReused;
+    printf("  2d scanlines: %llu rendered, %llu reused (%.1f%%)\n",
+           (unsigned long long)stats.LinesRendered, (unsigned long long)stats.LinesReused,
+           total ? stats.LinesReused * 100.0 / total : 0.0);
+}
+
+static void PrintMapTrace(const BenchResult& res)
+{
+    const auto& mt = res.MapTrace;
+    printf("  block maps: %llu operations (%llu lookups, %llu inserts, %llu removals, %llu clears)\n",
+           (unsigned long long)mt.Ops, (unsigned long long)mt.Finds, (unsigned long long)mt.Inserts,
+           (unsigned long long)mt.Erases, (unsigned long long)mt.Clears);
+    printf("  replay: std::unordered_map %.2fms (%.1fns/op), FlatHashMap %.2fms (%.1fns/op), results %s\n",
+           mt.StdNanoseconds / 1000000.0, mt.Ops ? (double)mt.StdNanoseconds / mt.Ops : 0.0,
+           mt.FlatNanoseconds / 1000000.0, mt.Ops ? (double)mt.FlatNanoseconds / mt.Ops : 0.0,
+           mt.Matches ? "match" : "DO NOT MATCH");
+}
+
+static void PrintSavestate(const BenchResult& res)
+{
+    const auto& ss = res.States;
+    printf("  savestate: raw %.2fMB, save %.3fms, load %.3fms\n",
+           ss.RawBytes / (1024.0 * 1024.0),
+           ss.RawSaveNanoseconds / 1000000.0, ss.RawLoadNanoseconds / 1000000.0);
+    printf("  compressed %.2fMB (%.1f%%), save %.3fms, load %.3fms, contents %s\n",
+           ss.CompressedBytes / (1024.0 * 1024.0),
+           ss.RawBytes ? ss.CompressedBytes * 100.0 / ss.RawBytes : 0.0,
+           ss.CompressedSaveNanoseconds / 1000000.0, ss.CompressedLoadNanoseconds / 1000000.0,
+           ss.Matches ? "match" : "DO NOT MATCH");
+    printf("  partial load (CPUs and RAM) %.3fms, section index %s, skipped sections %s, states without one %s\n",
+           ss.PartialLoadNanoseconds / 1000000.0,
+           ss.IndexedLoads ? "ok" : "BROKEN",
+           ss.SkippedSectionsKept ? "kept" : "CHANGED",
+           ss.UnindexedLoads ? "load" : "DO NOT LOAD");
+    printf("  background save: emulation stalled %.3fms, compressing and writing %.3fms%s\n",
+           ss.AsyncStallNanoseconds / 1000000.0, ss.AsyncWriteNanoseconds / 1000000.0,
+           ss.AsyncWritten ? "" : ", WRITE FAILED");
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions opts;
+    if (!ParseOptions(argc, argv, opts))
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    SetBenchLogLevel(opts.Verbose ? LogLevel::Debug : LogLevel::Error);
+
+    if (opts.CompositeLines || opts.SpanFrames || opts.CheckHLECode)
+    {
+        int failures = 0;
+
+        // these only need the renderers, the console itself never runs
+        if (opts.CompositeLines || opts.SpanFrames)
+        {
+            auto nds = CreateConsole(opts, BenchCPUMode::Interpreter);
+            if (!nds)
+                return 1;
+            nds->GPU.SetRenderer3D(std::make_unique<SoftRenderer>());
+            static_cast<SoftRenderer&>(nds->GPU.GetRenderer3D()).SetRasterThreads(opts.RasterThreads, nds->GPU);
+
+            if (opts.CompositeLines && !CheckComposite(*nds, opts.CompositeLines))
+                failures++;
+            if (opts.SpanFrames && !CheckSpans(*nds, opts.SpanFrames))
+                failures++;
+        }
+
+        if (opts.CheckHLECode)
+        {
+            for (BenchCPUMode cpumode : opts.CPUModes)
+            {
+                if (!CheckHLECode(opts, cpumode))
+                    failures++;
+            }
+        }
+        return failures ? 1 : 0;
+    }
+
+    printf("melonDS-bench: %s, %s, %u frames (+%u warmup)",
+           opts.ROMPath.empty() ? "no ROM" : opts.ROMPath.c_str(),
+           opts.DSi ? "DSi" : "DS",
+           opts.Frames, opts.Warmup);
+    if (opts.RunAheadFrames)
+        printf(", run-ahead %u", opts.RunAheadFrames);
+    if (opts.RewindInterval)
+        printf(", rewind every %u", opts.RewindInterval);
+    printf("\n");
+
+    if (opts.Instances > 1)
+    {
+        int failures = 0;
+        for (BenchCPUMode cpumode : opts.CPUModes)
+        {
+            for (BenchRenderer renderer : opts.Renderers)
+            {
+                if (!RunInstances(opts, cpumode, renderer))
+                {
+                    printf("%-12s %-14s failed\n", CPUModeName(cpumode), RendererName(renderer));
+                    failures++;
+                }
+                fflush(stdout);
+            }
+        }
+        return failures ? 1 : 0;
+    }
+
+    printf("%-12s %-14s %9s %8s %8s %8s %8s %8s %8s %8s %8s  %-16s\n",
+           "cpu", "renderer", "fps", "speed%", "mean", "stddev", "min", "p50", "p90", "p99", "max", "fbhash");
+
+    int failures = 0;
+    for (BenchCPUMode cpumode : opts.CPUModes)
+    {
+        for (BenchRenderer renderer : opts.Renderers)
+        {
+            auto res = RunBenchmark(opts, cpumode, renderer);
+            if (!res)
+            {
+                printf("%-12s %-14s failed\n", CPUModeName(cpumode), RendererName(renderer));
+                failures++;
+                continue;
+            }
+
+            // the DS refreshes at ~59.8261 Hz
+            printf("%-12s %-14s %9.2f %8.1f %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f  %016llx\n",
+                   CPUModeName(res->CPUMode), RendererName(res->Renderer),
+                   res->FPS, res->FPS * 100.0 / 59.8261,
+                   res->MeanMS, res->StdDevMS,
+                   res->MinMS, res->P50MS, res->P90MS, res->P99MS, res->MaxMS,
+                   (unsigned long long)res->FrameHash);
+            if (opts.Profile)
+                PrintProfile(*res);
+            if (res->CPUMode == BenchCPUMode::JIT)
+                PrintJITCache(*res);
+            if (opts.ReuseLines2D)
+                PrintLines2D(*res);
+            if (res->MapTrace.Ops)
+                PrintMapTrace(*res);
+            if (opts.RunAheadFrames)
+                PrintRunAhead(*res, opts.RunAheadFrames);
+            if (opts.RewindInterval)
+                PrintRewind(*res, opts.RewindInterval);
+            if (opts.Savestates)
+                PrintSavestate(*res);
+            if (!opts.GoldenPath.empty())
+            {
+                PrintGolden(*res, opts.GoldenPath);
+                if (res->Golden.Mismatches)
+                    failures++;
+            }
+            fflush(stdout);
+        }
+    }
+
+    return failures ? 1 : 0;
+}
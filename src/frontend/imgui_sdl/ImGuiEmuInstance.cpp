@@ -117,6 +117,7 @@ ImGuiEmuInstance::~ImGuiEmuInstance()
         emuThread->stop();
         delete emuThread;
     }
+    saveJITCache();
     if (saveManager) {
         delete saveManager;
     }
@@ -152,6 +153,9 @@ bool ImGuiEmuInstance::loadROM(const std::vector<std::string>& filepath, bool re
 
     bool directBoot = globalConfig.GetBool("Emu.DirectBoot");
 
+    // the console is replaced below, keep what was compiled for the last game
+    saveJITCache();
+
     if (!isDSi) {
         auto arm9bios = loadARM9BIOS();
         auto arm7bios = loadARM7BIOS();
@@ -170,6 +174,10 @@ bool ImGuiEmuInstance::loadROM(const std::vector<std::string>& filepath, bool re
                 jitopt.GetBool("LiteralOptimisations"),
                 jitopt.GetBool("BranchOptimisations"),
                 jitopt.GetBool("FastMemory"),
+                jitopt.GetBool("CodeCache"),
+                static_cast<melonDS::JITPerfMap>(jitopt.GetInt("PerfMap")),
+                jitopt.GetBool("Superblocks"),
+                jitopt.GetBool("AsyncCompile"),
         };
         auto jitargs = jitopt.GetBool("Enable") ? std::make_optional(_jitargs) : std::nullopt;
 #else
@@ -183,8 +191,12 @@ bool ImGuiEmuInstance::loadROM(const std::vector<std::string>& filepath, bool re
             jitargs,
             static_cast<melonDS::AudioBitDepth>(globalConfig.GetInt("Audio.BitDepth")),
             static_cast<melonDS::AudioInterpolation>(globalConfig.GetInt("Audio.Interpolation")),
-            std::nullopt
+            std::nullopt,
+            globalConfig.GetBool("Emu.BIOSHLE"),
+            globalConfig.GetBool("Emu.IdleLoopSkip"),
+            globalConfig.GetBool("Emu.ICacheTiming")
         };
+        runAhead.reset();
         nds = std::make_unique<melonDS::NDS>(std::move(args), this);
         auto cart = melonDS::NDSCart::ParseROM(filedata.get(), filelen, this);
         if (cart) {
@@ -245,6 +257,10 @@ bool ImGuiEmuInstance::loadROM(const std::vector<std::string>& filepath, bool re
                 jitopt.GetBool("LiteralOptimisations"),
                 jitopt.GetBool("BranchOptimisations"),
                 jitopt.GetBool("FastMemory"),
+                jitopt.GetBool("CodeCache"),
+                static_cast<melonDS::JITPerfMap>(jitopt.GetInt("PerfMap")),
+                jitopt.GetBool("Superblocks"),
+                jitopt.GetBool("AsyncCompile"),
         };
         auto jitargs = jitopt.GetBool("Enable") ? std::make_optional(_jitargs) : std::nullopt;
 #else
@@ -259,7 +275,10 @@ bool ImGuiEmuInstance::loadROM(const std::vector<std::string>& filepath, bool re
                 jitargs,
                 static_cast<melonDS::AudioBitDepth>(globalConfig.GetInt("Audio.BitDepth")),
                 static_cast<melonDS::AudioInterpolation>(globalConfig.GetInt("Audio.Interpolation")),
-                std::nullopt
+                std::nullopt,
+                globalConfig.GetBool("Emu.BIOSHLE"),
+                globalConfig.GetBool("Emu.IdleLoopSkip"),
+                globalConfig.GetBool("Emu.ICacheTiming")
             },
             std::move(arm9ibios),
             std::move(arm7ibios),
@@ -267,6 +286,7 @@ bool ImGuiEmuInstance::loadROM(const std::vector<std::string>& filepath, bool re
             std::move(sdcard),
             fullBIOSBoot
         };
+        runAhead.reset();
         dsi = std::make_unique<melonDS::DSi>(std::move(args), this);
         auto cart = melonDS::NDSCart::ParseROM(filedata.get(), filelen, this);
         if (cart) {
@@ -278,6 +298,8 @@ bool ImGuiEmuInstance::loadROM(const std::vector<std::string>& filepath, bool re
         }
     }
 
+    loadJITCache(basepath + romname.substr(0, romname.rfind('.')) + ".mjc");
+
     if (reset) {
         this->reset();
     }
@@ -329,29 +351,29 @@ bool ImGuiEmuInstance::loadGBAROM(const std::vector<std::string>& filepath, std:
 
 bool ImGuiEmuInstance::saveState(const std::string& filename)
 {
-    melonDS::Savestate savestate(melonDS::Savestate::DEFAULT_SIZE);
-    if (savestate.Error) return false;
+    // compressing and writing the file are done by the writer thread,
+    // ImGuiEmuThread reports the outcome
+    std::unique_ptr<melonDS::Savestate> savestate = savestateWriter.GetState();
+    if (savestate->Error) return false;
     
     bool success = false;
     if (nds) {
-        success = nds->DoSavestate(&savestate);
+        success = nds->DoSavestate(savestate.get());
     } else if (dsi) {
-        success = static_cast<melonDS::NDS*>(dsi.get())->DoSavestate(&savestate);
+        success = static_cast<melonDS::NDS*>(dsi.get())->DoSavestate(savestate.get());
     }
     
-    if (!success || savestate.Error) return false;
-    
-    auto file = melonDS::Platform::OpenFile(filename, melonDS::Platform::FileMode::Write);
-    if (!file) return false;
+    if (!success || savestate->Error) return false;
     
-    bool writeSuccess = (melonDS::Platform::FileWrite(savestate.Buffer(), savestate.Length(), 1, file) == 1);
-    melonDS::Platform::CloseFile(file);
-    
-    return writeSuccess;
+    savestateWriter.Queue(std::move(savestate), filename, globalConfig.GetBool("Savestate.Compress"));
+    return true;
 }
 
 bool ImGuiEmuInstance::loadState(const std::string& filename)
 {
+    // the state might still be on its way to the file
+    savestateWriter.WaitIdle();
+
     if ((nds || dsi) && running)
     {
         backupState = std::make_unique<melonDS::Savestate>(melonDS::Savestate::DEFAULT_SIZE);
@@ -409,6 +431,7 @@ bool ImGuiEmuInstance::loadState(const std::string& filename)
 
 void ImGuiEmuInstance::ejectCart()
 {
+    saveJITCache();
     if (nds) {
         nds->EjectCart();
     } else if (dsi) {
@@ -595,6 +618,14 @@ std::string ImGuiEmuInstance::getSavestateName(int slot)
     return filename;
 }
 
+int ImGuiEmuInstance::getSavestateSlot(const std::string& filename)
+{
+    for (int slot = 1; slot <= 8; ++slot) {
+        if (getSavestateName(slot) == filename) return slot;
+    }
+    return 0;
+}
+
 bool ImGuiEmuInstance::savestateExists(int slot)
 {
     if (slot <= 0) return false;
@@ -639,6 +670,23 @@ melonDS::DSi* ImGuiEmuInstance::getDSi() {
     return dsi.get();
 }
 
+void ImGuiEmuInstance::loadJITCache(const std::string& path) {
+    melonDS::NDS* console = getNDS();
+    jitCachePath = "";
+    if (!console || !console->JIT.CodeCacheEnabled()) return;
+
+    jitCachePath = path;
+    console->JIT.LoadCodeCache(jitCachePath);
+}
+
+void ImGuiEmuInstance::saveJITCache() {
+    melonDS::NDS* console = getNDS();
+    if (!console || jitCachePath.empty()) return;
+
+    console->JIT.SaveCodeCache(jitCachePath);
+    jitCachePath = "";
+}
+
 melonDS::ARCodeFile* ImGuiEmuInstance::getCheatFile() {
     return cheatFile.get();
 }
@@ -1206,6 +1254,20 @@ void ImGuiEmuInstance::reset() {
         dsi->Reset();
     }
 }
+melonDS::u32 ImGuiEmuInstance::runFrame(melonDS::NDS& console) {
+    // hidden setting: frames to run ahead, to cut input latency
+    int runAheadFrames = globalConfig.GetInt("Emu.RunAheadFrames");
+    if (runAheadFrames <= 0)
+        return console.RunFrame();
+
+    // reset whenever nds or dsi is replaced
+    if (!runAhead)
+        runAhead = std::make_unique<melonDS::RunAhead>(console);
+
+    runAhead->SetFrames(runAheadFrames);
+    return runAhead->RunFrame();
+}
+
 void ImGuiEmuInstance::frameStep() {
     static int emuFrameCount = 0;
     
@@ -1219,7 +1281,7 @@ void ImGuiEmuInstance::frameStep() {
         } else {
             nds->ReleaseScreen();
         }
-        nds->RunFrame();
+        runFrame(*nds);
         emuFrameCount++;
     } else if (dsi) {
         dsi->SetKeyMask(inputMask);
@@ -1230,12 +1292,24 @@ void ImGuiEmuInstance::frameStep() {
             dsi->ReleaseScreen();
         }
         if (dsi->IsRunning()) {
-            dsi->RunFrame();
+            runFrame(*dsi);
             emuFrameCount++;
         }
     }
     
     audioSync();
+
+#ifdef HOSTPROFILER_ENABLED
+    melonDS::NDS* console = nds ? nds.get() : dsi.get();
+    if (console && (emuFrameCount % 150) == 0) {
+        // one line every ~2.5 seconds, so the OSD doesn't get flooded
+        console->Profiler.SetEnabled(globalConfig.GetBool("Emu.HostProfiler"));
+        if (console->Profiler.IsEnabled()) {
+            std::string prof = melonDS::HostProfiler::FormatFrame(console->Profiler.GetLastFrame());
+            osdAddMessage(0, prof.c_str());
+        }
+    }
+#endif
     
     if (melonDS::Platform::EmuShouldStop()) {
         stop();
@@ -1314,6 +1388,7 @@ bool ImGuiEmuInstance::importSavefile(const std::string& filename) {
 
 bool ImGuiEmuInstance::bootFirmware(std::string& errorstr) {
     std::cout << "[bootFirmware] Called. ConsoleType: " << globalConfig.GetInt("Emu.ConsoleType") << std::endl;
+    saveJITCache();
     consoleType = globalConfig.GetInt("Emu.ConsoleType");
 
     if (nds) nds->EjectCart();
@@ -1394,6 +1469,10 @@ bool ImGuiEmuInstance::bootFirmware(std::string& errorstr) {
                 jitopt.GetBool("LiteralOptimisations"),
                 jitopt.GetBool("BranchOptimisations"),
                 jitopt.GetBool("FastMemory"),
+                jitopt.GetBool("CodeCache"),
+                static_cast<melonDS::JITPerfMap>(jitopt.GetInt("PerfMap")),
+                jitopt.GetBool("Superblocks"),
+                jitopt.GetBool("AsyncCompile"),
         };
         auto jitargs = jitopt.GetBool("Enable") ? std::make_optional(_jitargs) : std::nullopt;
 #else
@@ -1408,7 +1487,10 @@ bool ImGuiEmuInstance::bootFirmware(std::string& errorstr) {
                 jitargs,
                 static_cast<melonDS::AudioBitDepth>(globalConfig.GetInt("Audio.BitDepth")),
                 static_cast<melonDS::AudioInterpolation>(globalConfig.GetInt("Audio.Interpolation")),
-                std::nullopt // GDB args
+                std::nullopt, // GDB args
+                globalConfig.GetBool("Emu.BIOSHLE"),
+                globalConfig.GetBool("Emu.IdleLoopSkip"),
+                globalConfig.GetBool("Emu.ICacheTiming")
             },
             std::move(arm9ibios),
             std::move(arm7ibios),
@@ -1416,6 +1498,7 @@ bool ImGuiEmuInstance::bootFirmware(std::string& errorstr) {
             std::move(sdcard),
             fullBIOSBoot
         };
+        runAhead.reset();
         dsi = std::make_unique<melonDS::DSi>(std::move(args), this);
         std::cout << "[bootFirmware] DSi instance created." << std::endl;
         std::string firmwarePath = globalConfig.GetString("DSi.FirmwarePath");
@@ -1466,6 +1549,10 @@ bool ImGuiEmuInstance::bootFirmware(std::string& errorstr) {
             jitopt.GetBool("LiteralOptimisations"),
             jitopt.GetBool("BranchOptimisations"),
             jitopt.GetBool("FastMemory"),
+            jitopt.GetBool("CodeCache"),
+            static_cast<melonDS::JITPerfMap>(jitopt.GetInt("PerfMap")),
+            jitopt.GetBool("Superblocks"),
+            jitopt.GetBool("AsyncCompile"),
     };
     auto jitargs = jitopt.GetBool("Enable") ? std::make_optional(_jitargs) : std::nullopt;
 #else
@@ -1479,8 +1566,12 @@ bool ImGuiEmuInstance::bootFirmware(std::string& errorstr) {
         jitargs,
         static_cast<melonDS::AudioBitDepth>(globalConfig.GetInt("Audio.BitDepth")),
         static_cast<melonDS::AudioInterpolation>(globalConfig.GetInt("Audio.Interpolation")),
-        std::nullopt // GDB args
+        std::nullopt, // GDB args
+        globalConfig.GetBool("Emu.BIOSHLE"),
+        globalConfig.GetBool("Emu.IdleLoopSkip"),
+        globalConfig.GetBool("Emu.ICacheTiming")
     };
+    runAhead.reset();
     nds = std::make_unique<melonDS::NDS>(std::move(args));
     nds->EjectCart();
     cartInserted = false;
@@ -1846,10 +1937,12 @@ bool ImGuiEmuInstance::bootToMenu(std::string& errorstr) {
         return false;
     }
 
+    saveJITCache();
     int newConsoleType = globalConfig.GetInt("Emu.ConsoleType");
     std::cout << "[bootToMenu] ConsoleType: " << newConsoleType << std::endl;
     if (consoleType != newConsoleType) {
         consoleType = newConsoleType;
+        runAhead.reset();
         nds.reset();
         dsi.reset();
         std::cout << "[bootToMenu] Reset core objects" << std::endl;
@@ -1885,6 +1978,10 @@ bool ImGuiEmuInstance::bootToMenu(std::string& errorstr) {
                 jitopt.GetBool("LiteralOptimisations"),
                 jitopt.GetBool("BranchOptimisations"),
                 jitopt.GetBool("FastMemory"),
+                jitopt.GetBool("CodeCache"),
+                static_cast<melonDS::JITPerfMap>(jitopt.GetInt("PerfMap")),
+                jitopt.GetBool("Superblocks"),
+                jitopt.GetBool("AsyncCompile"),
         };
         auto jitargs = jitopt.GetBool("Enable") ? std::make_optional(_jitargs) : std::nullopt;
 #else
@@ -1898,6 +1995,9 @@ bool ImGuiEmuInstance::bootToMenu(std::string& errorstr) {
             static_cast<melonDS::AudioBitDepth>(globalConfig.GetInt("Audio.BitDepth")),
             static_cast<melonDS::AudioInterpolation>(globalConfig.GetInt("Audio.Interpolation")),
             std::nullopt, // GDB
+            globalConfig.GetBool("Emu.BIOSHLE"),
+            globalConfig.GetBool("Emu.IdleLoopSkip"),
+            globalConfig.GetBool("Emu.ICacheTiming"),
         };
         melonDS::DSiArgs dsiargs{
             std::move(ndsargs),
@@ -1907,6 +2007,7 @@ bool ImGuiEmuInstance::bootToMenu(std::string& errorstr) {
             std::move(sdcard),
             globalConfig.GetBool("DSi.FullBIOSBoot")
         };
+        runAhead.reset();
         dsi = std::make_unique<melonDS::DSi>(std::move(dsiargs));
         // Set firmware on DSi instance (like Qt/bootFirmware)
         dsi->SetFirmware(std::move(*firmware));
@@ -1918,6 +2019,10 @@ bool ImGuiEmuInstance::bootToMenu(std::string& errorstr) {
                 jitopt.GetBool("LiteralOptimisations"),
                 jitopt.GetBool("BranchOptimisations"),
                 jitopt.GetBool("FastMemory"),
+                jitopt.GetBool("CodeCache"),
+                static_cast<melonDS::JITPerfMap>(jitopt.GetInt("PerfMap")),
+                jitopt.GetBool("Superblocks"),
+                jitopt.GetBool("AsyncCompile"),
         };
         auto jitargs = jitopt.GetBool("Enable") ? std::make_optional(_jitargs) : std::nullopt;
 #else
@@ -1931,7 +2036,11 @@ bool ImGuiEmuInstance::bootToMenu(std::string& errorstr) {
             static_cast<melonDS::AudioBitDepth>(globalConfig.GetInt("Audio.BitDepth")),
             static_cast<melonDS::AudioInterpolation>(globalConfig.GetInt("Audio.Interpolation")),
             std::nullopt, // GDB
+            globalConfig.GetBool("Emu.BIOSHLE"),
+            globalConfig.GetBool("Emu.IdleLoopSkip"),
+            globalConfig.GetBool("Emu.ICacheTiming"),
         };
+        runAhead.reset();
         nds = std::make_unique<melonDS::NDS>(std::move(ndsargs));
     }
 
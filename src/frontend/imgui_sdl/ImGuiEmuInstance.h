@@ -37,6 +37,8 @@
 #include "../../NDSCart.h"
 #include "../../GBACart.h"
 #include "../../Savestate.h"
+#include "../../RunAhead.h"
+#include "../../SavestateWriter.h"
 #include "../../Platform.h"
 #include "ImGuiEmuThread.h"
 #include "ImGuiSaveManager.h"
@@ -84,7 +86,9 @@ public:
     bool loadState(const std::string& filename);
     void undoStateLoad();
     std::string getSavestateName(int slot);
+    int getSavestateSlot(const std::string& filename);
     bool savestateExists(int slot);
+    bool pollSavestateWrite(melonDS::SavestateWriter::Result& result) { return savestateWriter.PollResult(result); }
 
     melonDS::ARCodeFile* getCheatFile();
     void enableCheats(bool enable);
@@ -153,6 +157,8 @@ public:
     std::string verifyDSiFirmware();
     std::string verifyDSiNAND();
     bool bootToMenu(std::string& errorstr);
+    void loadJITCache(const std::string& path);
+    void saveJITCache();
     void customizeFirmware(melonDS::Firmware& firmware, bool overridesettings) noexcept;
     bool parseMacAddress(void* data);
 
@@ -267,6 +273,11 @@ private:
     std::unique_ptr<melonDS::NDS> nds;
     std::unique_ptr<melonDS::DSi> dsi;
 
+    // Run-ahead, refers to whichever console is running,
+    // so it has to be reset before that console is replaced
+    std::unique_ptr<melonDS::RunAhead> runAhead;
+    melonDS::u32 runFrame(melonDS::NDS& console);
+
     ImGuiEmuThread* emuThread;
     ImGuiSaveManager* saveManager;
 
@@ -284,6 +295,7 @@ private:
     // State management
     std::unique_ptr<melonDS::Savestate> backupState;
     bool savestateLoaded;
+    melonDS::SavestateWriter savestateWriter;
     std::string previousSaveFile;
 
     // GBA cart state
@@ -300,6 +312,9 @@ private:
     std::unique_ptr<melonDS::ARCodeFile> cheatFile;
     bool cheatsOn;
 
+    // Where the JIT code cache of the current game is saved to
+    std::string jitCachePath;
+
     // OSD messages
     std::vector<std::pair<std::string, unsigned int>> osdMessages;
 
@@ -233,10 +233,27 @@ void ImGuiEmuThread::run()
             melonDS::Platform::Sleep(75000);
         }
         
+        checkSavestateWrites();
         handleMessages();
     }
 }
 
+void ImGuiEmuThread::checkSavestateWrites()
+{
+    melonDS::SavestateWriter::Result res;
+    while (emuInstance->pollSavestateWrite(res))
+    {
+        if (!res.Success) {
+            emuInstance->osdAddMessage(0xFFA0A0, "State save failed");
+            continue;
+        }
+        
+        int slot = emuInstance->getSavestateSlot(res.Filename);
+        if (slot > 0) emuInstance->osdAddMessage(0, ("State saved to slot " + std::to_string(slot)).c_str());
+        else emuInstance->osdAddMessage(0, "State saved to file");
+    }
+}
+
 void ImGuiEmuThread::handleMessages()
 {
     std::lock_guard<std::mutex> lock(msgMutex);
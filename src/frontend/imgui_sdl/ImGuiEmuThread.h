@@ -100,6 +100,7 @@ private:
     void run();
     void handleMessages();
     void handleEmulation();
+    void checkSavestateWrites();
 
     ImGuiEmuInstance* emuInstance;
     std::thread thread;
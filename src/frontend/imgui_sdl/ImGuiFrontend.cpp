@@ -4333,10 +4333,8 @@ void ImGuiFrontend::onSaveState(int slot) {
         );
         if (filename.empty()) return;
     }
-    if (emuInstance->saveState(filename)) {
-        if (slot > 0) emuInstance->osdAddMessage(0, ("State saved to slot " + std::to_string(slot)).c_str());
-        else emuInstance->osdAddMessage(0, "State saved to file");
-    } else {
+    // on success, the file is written in the background and ImGuiEmuThread reports when it's done
+    if (!emuInstance->saveState(filename)) {
         emuInstance->osdAddMessage(0xFFA0A0, "State save failed");
     }
 }
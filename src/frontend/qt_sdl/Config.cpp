@@ -93,6 +93,7 @@ DefaultList<int> DefaultInts =
     {"Screen.VSyncInterval", 1},
     {"3D.Renderer", renderer3D_Software},
     {"3D.GL.ScaleFactor", 1},
+    {"3D.Soft.RasterThreads", 1},
 #ifdef JIT_ENABLED
     {"JIT.MaxBlockSize", 32},
 #endif
@@ -118,6 +119,7 @@ RangeList IntRanges =
     {"3D.Renderer", {0, renderer3D_Max-1}},
     {"Screen.VSyncInterval", {1, 20}},
     {"3D.GL.ScaleFactor", {1, 16}},
+    {"3D.Soft.RasterThreads", {1, 16}},
     {"Audio.Interpolation", {0, 4}},
     {"Instance*.Audio.Volume", {0, 256}},
     {"Mic.InputType", {0, micInputType_MAX-1}},
@@ -135,6 +137,8 @@ DefaultList<bool> DefaultBools =
 {
     {"Screen.Filter", true},
     {"3D.Soft.Threaded", true},
+    {"2D.Soft.Threaded", false},
+    {"2D.Soft.ReuseLines", false},
     {"3D.GL.HiresCoordinates", true},
     {"LimitFPS", true},
     {"Instance*.Window*.ShowOSD", true},
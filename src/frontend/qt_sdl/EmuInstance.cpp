@@ -166,7 +166,9 @@ EmuInstance::~EmuInstance()
 
     if (nds)
     {
+        saveJITCache();
         saveRTCData();
+        runAhead = nullptr;
         delete nds;
     }
 }
@@ -699,6 +701,17 @@ std::string EmuInstance::getSavestateName(int slot)
     return getAssetPath(false, localCfg.GetString("SavestatePath"), ext);
 }
 
+int EmuInstance::getSavestateSlot(const std::string& filename)
+{
+    for (int slot = 1; slot <= 8; slot++)
+    {
+        if (getSavestateName(slot) == filename)
+            return slot;
+    }
+
+    return 0;
+}
+
 bool EmuInstance::savestateExists(int slot)
 {
     std::string ssfile = getSavestateName(slot);
@@ -707,6 +720,9 @@ bool EmuInstance::savestateExists(int slot)
 
 bool EmuInstance::loadState(const std::string& filename)
 {
+    // the state might still be on its way to the file
+    savestateWriter.WaitIdle();
+
     Platform::FileHandle* file = Platform::OpenFile(filename, Platform::FileMode::Read);
     if (file == nullptr)
     { // If we couldn't open the state file...
@@ -774,41 +790,24 @@ bool EmuInstance::loadState(const std::string& filename)
 
 bool EmuInstance::saveState(const std::string& filename)
 {
-    Platform::FileHandle* file = Platform::OpenFile(filename, Platform::FileMode::Write);
-
-    if (file == nullptr)
-    { // If the file couldn't be opened...
-        return false;
-    }
-
-    Savestate state;
-    if (state.Error)
+    // Only the in-memory copy is made here. Compressing it and writing it
+    // to the file are left to the writer thread, which EmuThread polls
+    // to tell whether the file was actually written.
+    std::unique_ptr<Savestate> state = savestateWriter.GetState();
+    if (state->Error)
     { // If there was an error creating the state (and allocating its memory)...
-        Platform::CloseFile(file);
         return false;
     }
 
     // Write the savestate to the in-memory buffer
-    nds->DoSavestate(&state);
+    nds->DoSavestate(state.get());
 
-    if (state.Error)
+    if (state->Error)
     {
-        Platform::CloseFile(file);
-        return false;
-    }
-
-    if (Platform::FileWrite(state.Buffer(), state.Length(), 1, file) == 0)
-    { // Write the Savestate buffer to the file. If that fails...
-        Platform::Log(Platform::Error,
-                      "Failed to write %d-byte savestate to %s\n",
-                      state.Length(),
-                      filename.c_str()
-        );
-        Platform::CloseFile(file);
         return false;
     }
 
-    Platform::CloseFile(file);
+    savestateWriter.Queue(std::move(state), filename, globalCfg.GetBool("Savestate.Compress"));
 
     if (globalCfg.GetBool("Savestate.RelocSRAM") && ndsSave)
     {
@@ -864,6 +863,26 @@ void EmuInstance::loadCheats()
     }
 }
 
+void EmuInstance::loadJITCache()
+{
+    jitCachePath = "";
+    if (!nds->JIT.CodeCacheEnabled())
+        return;
+
+    // the cache is per game, so the firmware and each ROM get their own file
+    jitCachePath = getAssetPath(false, localCfg.GetString("SaveFilePath"), ".mjc");
+    nds->JIT.LoadCodeCache(jitCachePath);
+}
+
+void EmuInstance::saveJITCache()
+{
+    if (jitCachePath.empty())
+        return;
+
+    nds->JIT.SaveCodeCache(jitCachePath);
+    jitCachePath = "";
+}
+
 std::unique_ptr<ARM9BIOSImage> EmuInstance::loadARM9BIOS() noexcept
 {
     if (!globalCfg.GetBool("Emu.ExternalBIOSEnable"))
@@ -1292,6 +1311,10 @@ bool EmuInstance::updateConsole() noexcept
             jitopt.GetBool("LiteralOptimisations"),
             jitopt.GetBool("BranchOptimisations"),
             jitopt.GetBool("FastMemory"),
+            jitopt.GetBool("CodeCache"),
+            static_cast<JITPerfMap>(jitopt.GetInt("PerfMap")),
+            jitopt.GetBool("Superblocks"),
+            jitopt.GetBool("AsyncCompile"),
     };
     auto jitargs = jitopt.GetBool("Enable") ? std::make_optional(_jitargs) : std::nullopt;
 #else
@@ -1319,6 +1342,9 @@ bool EmuInstance::updateConsole() noexcept
             static_cast<AudioBitDepth>(globalCfg.GetInt("Audio.BitDepth")),
             static_cast<AudioInterpolation>(globalCfg.GetInt("Audio.Interpolation")),
             gdbargs,
+            globalCfg.GetBool("Emu.BIOSHLE"),
+            globalCfg.GetBool("Emu.IdleLoopSkip"),
+            globalCfg.GetBool("Emu.ICacheTiming"),
     };
     NDSArgs* args = &ndsargs;
 
@@ -1352,12 +1378,17 @@ bool EmuInstance::updateConsole() noexcept
         args = &(*dsiargs);
     }
 
+    // the game may change, so the blocks compiled for the old one are saved first
+    if (nds)
+        saveJITCache();
+
     renderLock.lock();
     if ((!nds) || (consoleType != nds->ConsoleType))
     {
         if (nds)
         {
             saveRTCData();
+            runAhead = nullptr;
             delete nds;
         }
 
@@ -1377,6 +1408,9 @@ bool EmuInstance::updateConsole() noexcept
         nds->SetFirmware(std::move(args->Firmware));
         nds->SetJITArgs(args->JIT);
         nds->SetGdbArgs(args->GDB);
+        nds->SetBIOSHLE(args->BIOSHLE);
+        nds->SetIdleLoopSkip(args->IdleLoopSkip);
+        nds->SetICacheTiming(args->ICacheTiming);
         nds->SPU.SetInterpolation(args->Interpolation);
         nds->SPU.SetDegrade10Bit(args->BitDepth);
 
@@ -1405,6 +1439,7 @@ bool EmuInstance::updateConsole() noexcept
     renderLock.unlock();
 
     loadCheats();
+    loadJITCache();
 
     return true;
 }
@@ -1956,8 +1991,10 @@ bool EmuInstance::loadROM(QStringList filepath, bool reset, QString& errorstr)
     {
         if (emuIsActive())
         {
+            saveJITCache();
             nds->SetNDSCart(std::move(cart));
             loadCheats();
+            loadJITCache();
         }
         else
         {
@@ -1978,6 +2015,7 @@ void EmuInstance::ejectCart()
 
     if (emuIsActive())
     {
+        saveJITCache();
         nds->EjectCart();
         unloadCheats();
     }
@@ -24,10 +24,12 @@
 #include "Platform.h"
 #include "main.h"
 #include "NDS.h"
+#include "RunAhead.h"
 #include "EmuThread.h"
 #include "Window.h"
 #include "Config.h"
 #include "SaveManager.h"
+#include "SavestateWriter.h"
 
 const int kMaxWindows = 4;
 
@@ -174,12 +176,15 @@ private:
     std::string getEffectiveFirmwareSavePath();
     void initFirmwareSaveManager() noexcept;
     std::string getSavestateName(int slot);
+    int getSavestateSlot(const std::string& filename);
     bool savestateExists(int slot);
     bool loadState(const std::string& filename);
     bool saveState(const std::string& filename);
     void undoStateLoad();
     void unloadCheats();
     void loadCheats();
+    void loadJITCache();
+    void saveJITCache();
     std::unique_ptr<melonDS::ARM9BIOSImage> loadARM9BIOS() noexcept;
     std::unique_ptr<melonDS::ARM7BIOSImage> loadARM7BIOS() noexcept;
     std::unique_ptr<melonDS::DSiBIOSImage> loadDSiARM9BIOS() noexcept;
@@ -265,6 +270,8 @@ private:
 
     int consoleType;
     melonDS::NDS* nds;
+    // refers to nds, so it has to go whenever nds is replaced
+    std::unique_ptr<melonDS::RunAhead> runAhead;
 
     int cartType;
     std::string baseROMDir;
@@ -298,11 +305,15 @@ private:
 
     std::unique_ptr<melonDS::Savestate> backupState;
     bool savestateLoaded;
+    melonDS::SavestateWriter savestateWriter;
     std::string previousSaveFile;
 
     std::unique_ptr<melonDS::ARCodeFile> cheatFile;
     bool cheatsOn;
 
+    // where the JIT code cache of the current game is saved to
+    std::string jitCachePath;
+
     SDL_AudioDeviceID audioDevice;
     int audioFreq;
     int audioBufSize;
@@ -48,11 +48,13 @@
 #include "RTC.h"
 #include "DSi.h"
 #include "DSi_I2C.h"
+#include "GPU2D_Soft.h"
 #include "GPU3D_Soft.h"
 #include "GPU3D_OpenGL.h"
 #include "GPU3D_Compute.h"
 
 #include "Savestate.h"
+#include "RunAhead.h"
 
 #include "EmuInstance.h"
 
@@ -148,6 +150,7 @@ void EmuThread::run()
 
     bool fastforward = false;
     bool slowmo = false;
+
     emuInstance->fastForwardToggled = false;
     emuInstance->slowmoToggled = false;
 
@@ -307,7 +310,19 @@ void EmuThread::run()
             }
             else
             {
-                nlines = emuInstance->nds->RunFrame();
+                // hidden setting: frames to run ahead, to cut input latency
+                int runAheadFrames = globalCfg.GetInt("Emu.RunAheadFrames");
+                if (runAheadFrames > 0)
+                {
+                    // dropped by the emu instance whenever it replaces the console
+                    if (!emuInstance->runAhead)
+                        emuInstance->runAhead = std::make_unique<RunAhead>(*emuInstance->nds);
+
+                    emuInstance->runAhead->SetFrames(runAheadFrames);
+                    nlines = emuInstance->runAhead->RunFrame();
+                }
+                else
+                    nlines = emuInstance->nds->RunFrame();
             }
 
             if (emuInstance->ndsSave)
@@ -429,7 +444,20 @@ void EmuThread::run()
                 double actualfps = (59.8261 * 263.0) / nlines;
                 snprintf(melontitle, sizeof(melontitle), "[%d/%.0f] melonDS " MELONDS_VERSION, fps, actualfps);
                 changeWindowTitle(melontitle);
+
+#ifdef HOSTPROFILER_ENABLED
+                emuInstance->nds->Profiler.SetEnabled(globalCfg.GetBool("Emu.HostProfiler"));
+#endif
             }
+
+#ifdef HOSTPROFILER_ENABLED
+            // one line every ~2.5 seconds, which is how long OSD messages stay up
+            if (emuInstance->nds->Profiler.IsEnabled() && (emuInstance->nds->NumFrames % 150) == 0)
+            {
+                std::string prof = HostProfiler::FormatFrame(emuInstance->nds->Profiler.GetLastFrame());
+                emuInstance->osdAddMessage(0, "%s", prof.c_str());
+            }
+#endif
         }
         else
         {
@@ -451,10 +479,28 @@ void EmuThread::run()
             }
         }
 
+        checkSavestateWrites();
         handleMessages();
     }
 }
 
+void EmuThread::checkSavestateWrites()
+{
+    SavestateWriter::Result res;
+    while (emuInstance->savestateWriter.PollResult(res))
+    {
+        if (!res.Success)
+        {
+            emuInstance->osdAddMessage(0xFFA0A0, "State save failed");
+            continue;
+        }
+
+        int slot = emuInstance->getSavestateSlot(res.Filename);
+        if (slot > 0) emuInstance->osdAddMessage(0, "State saved to slot %d", slot);
+        else          emuInstance->osdAddMessage(0, "State saved to file");
+    }
+}
+
 void EmuThread::sendMessage(Message msg)
 {
     msgMutex.lock();
@@ -885,13 +931,18 @@ void EmuThread::updateRenderer()
     lastVideoRenderer = videoRenderer;
 
     auto& cfg = emuInstance->getGlobalConfig();
+    auto& renderer2d = static_cast<GPU2D::SoftRenderer&>(emuInstance->nds->GPU.GetRenderer2D());
+    renderer2d.SetThreaded(cfg.GetBool("2D.Soft.Threaded"));
+    renderer2d.SetLineReuse(cfg.GetBool("2D.Soft.ReuseLines"));
     switch (videoRenderer)
     {
         case renderer3D_Software:
-            static_cast<SoftRenderer&>(emuInstance->nds->GPU.GetRenderer3D()).SetThreaded(
-                    cfg.GetBool("3D.Soft.Threaded"),
-                    emuInstance->nds->GPU);
+        {
+            auto& renderer3d = static_cast<SoftRenderer&>(emuInstance->nds->GPU.GetRenderer3D());
+            renderer3d.SetThreaded(cfg.GetBool("3D.Soft.Threaded"), emuInstance->nds->GPU);
+            renderer3d.SetRasterThreads(cfg.GetInt("3D.Soft.RasterThreads"), emuInstance->nds->GPU);
             break;
+        }
         case renderer3D_OpenGL:
             static_cast<GLRenderer&>(emuInstance->nds->GPU.GetRenderer3D()).SetRenderSettings(
                     cfg.GetBool("3D.GL.BetterPolygons"),
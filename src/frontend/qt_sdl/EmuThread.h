@@ -165,6 +165,7 @@ signals:
 
 private:
     void handleMessages();
+    void checkSavestateWrites();
 
     void updateRenderer();
     void compileShaders();
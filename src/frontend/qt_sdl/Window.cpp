@@ -1591,9 +1591,8 @@ void MainWindow::onSaveState()
 
     if (emuThread->saveState(filename))
     {
-        if (slot > 0) emuInstance->osdAddMessage(0, "State saved to slot %d", slot);
-        else          emuInstance->osdAddMessage(0, "State saved to file");
-
+        // the file is written in the background,
+        // EmuThread reports when that's done
         actLoadState[slot]->setEnabled(true);
     }
     else